@@ -0,0 +1,191 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file netascii-bench.cpp
+ * @brief Microbenchmark of the NETASCII conversion (vectorized kernels against the former byte loops)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "tftp-netascii.hpp"
+
+using namespace std;
+
+#define BENCH_TEXT_SIZE (8 * 1024 * 1024)
+#define BENCH_REPEATS 5
+
+
+/**
+ * @brief Former encoding loop (byte by byte from the stream with the mode check on every Byte)
+ */
+static unsigned int former_load_data_block(istream &file_read, char *data_block, unsigned int blocksize, string mode, bool *lf_on_new, bool *null_on_new){
+    unsigned int loaded_actual = 0;
+
+    if (*lf_on_new){
+        data_block[loaded_actual++] = '\n';
+        *lf_on_new = false;
+    }
+    else if (*null_on_new){
+        data_block[loaded_actual++] = '\x00';
+        *null_on_new = false;
+    }
+    while (loaded_actual < blocksize){
+        char c;
+        file_read.get(c);
+        if (file_read.eof()){
+            break;
+        }
+        else if (c == '\n' && mode == "netascii"){
+            data_block[loaded_actual++] = NETASCII_CR;
+            if (loaded_actual == blocksize){
+                *lf_on_new = true;
+            }
+            else{
+                data_block[loaded_actual++] = c;
+            }
+        }
+        else if (c == NETASCII_CR && mode == "netascii"){
+            data_block[loaded_actual++] = NETASCII_CR;
+            if (loaded_actual == blocksize){
+                *null_on_new = true;
+            }
+            else{
+                data_block[loaded_actual++] = '\x00';
+            }
+        }
+        else{
+            data_block[loaded_actual++] = c;
+        }
+    }
+
+    return loaded_actual;
+}
+
+
+/**
+ * @brief Former decoding loop (memmove of the rest of the block for every CR)
+ */
+static int former_format_netascii_data(char *data, int data_size){
+    for (int i = 0; i + 1 < data_size; i++){
+        if (data[i] == NETASCII_CR){
+            if (data[i + 1] == '\n'){
+                memmove(&data[i], &data[i + 1], data_size - i - 1);
+                data_size--;
+            }
+            else if(data[i + 1] == '\x00'){
+                memmove(&data[i + 1], &data[i + 2], data_size - i - 2);
+                data_size--;
+            }
+        }
+    }
+    return data_size;
+}
+
+
+/**
+ * @brief Generates text with lines of the given average length
+ */
+static string generate_text(size_t size, unsigned int line_length){
+    string text(size, 'a');
+    unsigned int seed = 1;
+    for (size_t i = 0; i < size; i++){
+        seed = seed * 1103515245 + 12345;
+        unsigned int value = (seed >> 16) % (line_length * 8);
+        text[i] = value < 8 ? '\n' : (value == 8 ? NETASCII_CR : 'a' + value % 26);
+    }
+    return text;
+}
+
+
+/**
+ * @brief Measures the given function, returns throughput in MB/s of the input text
+ */
+template <typename function_t>
+static double measure(size_t text_size, function_t function){
+    double best_seconds = 1e9;
+    for (int i = 0; i < BENCH_REPEATS; i++){
+        auto start = chrono::steady_clock::now();
+        function();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best_seconds = min(best_seconds, seconds);
+    }
+    return text_size / best_seconds / 1e6;
+}
+
+
+int main(){
+    for (unsigned int blocksize : {512, 16384})
+    for (unsigned int line_length : {8, 40, 1000}){
+        string text = generate_text(BENCH_TEXT_SIZE, line_length);
+        vector<char> block(blocksize + 1);
+
+        //encoding by the former loop
+        vector<string> former_blocks;
+        double former_encode = measure(text.size(), [&](){
+            former_blocks.clear();
+            istringstream stream(text);
+            bool lf_on_new = false, null_on_new = false;
+            unsigned int loaded;
+            do{
+                loaded = former_load_data_block(stream, block.data(), blocksize, "netascii", &lf_on_new, &null_on_new);
+                former_blocks.emplace_back(block.data(), loaded);
+            }
+            while (loaded == blocksize);
+        });
+
+        //encoding by the kernel
+        vector<string> blocks;
+        double encode = measure(text.size(), [&](){
+            blocks.clear();
+            netascii_state_t state;
+            size_t position = 0;
+            size_t loaded;
+            do{
+                size_t consumed;
+                loaded = netascii_encode(text.data() + position, text.size() - position, &consumed, block.data(), blocksize, &state);
+                position += consumed;
+                blocks.emplace_back(block.data(), loaded);
+            }
+            while (loaded == blocksize);
+        });
+
+        //decoding by the former loop (blocks are copied in both variants)
+        double former_decode = measure(text.size(), [&](){
+            for (string &data : blocks){
+                memcpy(block.data(), data.data(), data.size());
+                former_format_netascii_data(block.data(), data.size());
+            }
+        });
+
+        //decoding by the kernel
+        double decode = measure(text.size(), [&](){
+            netascii_state_t state;
+            for (string &data : blocks){
+                netascii_decode(data.data(), data.size(), block.data(), &state);
+            }
+        });
+
+        //decoded text has to be the same as the original one
+        string decoded;
+        netascii_state_t state;
+        for (string &data : blocks){
+            size_t size = netascii_decode(data.data(), data.size(), block.data(), &state);
+            decoded.append(block.data(), size);
+        }
+        size_t size = netascii_decode_end(block.data(), &state);
+        decoded.append(block.data(), size);
+
+        bool is_correct = blocks == former_blocks && decoded == text;
+
+        cout << "blocksize=" << blocksize << " line_length=" << line_length
+            << " encode_former=" << (int)former_encode << "MB/s encode=" << (int)encode << "MB/s"
+            << " decode_former=" << (int)former_decode << "MB/s decode=" << (int)decode << "MB/s"
+            << " correct=" << (is_correct ? "yes" : "no") << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,211 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file packet-parser-bench.cpp
+ * @brief Microbenchmark of the request parsing (bounded string_view parser against the former copying one)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <climits>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "tftp-packet-structures.hpp"
+
+using namespace std;
+
+#define BENCH_PACKETS 4096
+#define BENCH_ROUNDS 200
+#define BENCH_REPEATS 5
+
+
+/**
+ * @brief Former option parsing (option and value built by appending single Bytes, numbers parsed by stoull)
+ */
+static void former_deserialize_option_info(option_info_t *option_information, const char *sequence, int options_start_index){
+    string option;
+    string value;
+    int order_number = 0;
+
+    for (int i = options_start_index; sequence[i] != '\x00';){
+        option = "";
+        value = "";
+
+        while (sequence[i] != '\x00'){
+            option += tolower(sequence[i++]);
+        }
+        i++;
+
+        while (sequence[i] != '\x00'){
+            value += sequence[i++];
+        }
+        i++;
+
+        if (value.empty() || value.find_first_not_of("0123456789") != string::npos){
+            continue;
+        }
+        unsigned long long value_number;
+        try{
+            value_number = stoull(value);
+        }
+        catch(exception &err){
+            continue;
+        }
+        unsigned int value_int = min(value_number, (unsigned long long)UINT_MAX);
+
+        if (option == "blksize"){
+            option_information->option_blocksize = true;
+            option_information->blocksize = value_int;
+            option_information->option_order[order_number++] = BLOCKSIZE;
+        }
+        else if (option == "timeout"){
+            option_information->option_timeout_interval = true;
+            option_information->timeout_interval = value_int;
+            option_information->option_order[order_number++] = TIMEOUT;
+        }
+        else if (option == "tsize"){
+            option_information->option_transfer_size = true;
+            option_information->transfer_size = value_number;
+            option_information->option_order[order_number++] = TRANSFER_SIZE;
+        }
+        else if (option == "windowsize"){
+            option_information->option_window_size = true;
+            option_information->window_size = value_int;
+            option_information->option_order[order_number++] = WINDOW_SIZE;
+        }
+        else if (option == "utimeout"){
+            option_information->option_utimeout_interval = true;
+            option_information->utimeout_interval = value_int;
+            option_information->option_order[order_number++] = UTIMEOUT;
+        }
+        else if (option == "rollover"){
+            option_information->option_rollover = true;
+            option_information->rollover = value_int;
+            option_information->option_order[order_number++] = ROLLOVER;
+        }
+    }
+}
+
+
+/**
+ * @brief Former request parsing (file name and mode copied Byte by Byte, relies on the zero Bytes behind the packet)
+ */
+static void former_deserialize_request(tftp_rrq_wrq_packet_t *packet_struct, const char *sequence){
+    int i = 2;
+    string filename = "";
+    string mode = "";
+
+    while (sequence[i] != '\0'){
+        filename += sequence[i++];
+    }
+    i++;
+
+    while (sequence[i] != '\0'){
+        mode += tolower(sequence[i++]);
+    }
+
+    packet_struct->opcode = ((unsigned char)sequence[0] << 8) | (unsigned char)sequence[1];
+    packet_struct->filename = filename;
+    packet_struct->mode = mode;
+    former_deserialize_option_info(&packet_struct->options, sequence, ++i);
+}
+
+
+/**
+ * @brief Generates requests with file names of various lengths and options in various letter case
+ */
+static vector<string> generate_requests(){
+    const char *option_names[][2] = {{"blksize", "BLKSIZE"}, {"tsize", "TSize"}, {"timeout", "Timeout"}, {"windowsize", "WindowSize"}};
+    vector<string> requests;
+    unsigned int seed = 1;
+
+    for (int i = 0; i < BENCH_PACKETS; i++){
+        seed = seed * 1103515245 + 12345;
+        tftp_rrq_wrq_packet_t request;
+        request.opcode = (seed >> 8) % 2 ? RRQ_OPCODE : WRQ_OPCODE;
+        request.filename = "pxelinux.cfg/" + string(8 + (seed >> 16) % 48, 'a' + i % 26);
+        request.mode = (seed >> 4) % 2 ? "octet" : "OCTET";
+
+        string packet = serialize_packet_struct(&request);
+        for (int option = 0; option < (int)((seed >> 12) % 5); option++){
+            packet += string(option_names[option][(seed >> option) % 2]) + '\x00' + to_string(512 + (seed >> 20) % 60000) + '\x00';
+        }
+        requests.push_back(packet);
+    }
+
+    return requests;
+}
+
+
+/**
+ * @brief Measures the given function, returns nanoseconds per packet
+ */
+template <typename function_t>
+static double measure(size_t packets, function_t function){
+    double best_seconds = 1e9;
+    for (int i = 0; i < BENCH_REPEATS; i++){
+        auto start = chrono::steady_clock::now();
+        function();
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        best_seconds = min(best_seconds, seconds);
+    }
+    return best_seconds * 1e9 / packets;
+}
+
+
+int main(){
+    vector<string> requests = generate_requests();
+    size_t packets = requests.size() * BENCH_ROUNDS;
+    volatile unsigned long long checksum = 0;
+
+    //former parser copying the strings
+    double former = measure(packets, [&](){
+        for (int round = 0; round < BENCH_ROUNDS; round++){
+            for (string &packet : requests){
+                tftp_rrq_wrq_packet_t request;
+                former_deserialize_request(&request, packet.c_str());
+                checksum += request.filename.size() + request.options.blocksize;
+            }
+        }
+    });
+
+    //views into the packet
+    double view = measure(packets, [&](){
+        for (int round = 0; round < BENCH_ROUNDS; round++){
+            for (string &packet : requests){
+                tftp_request_view_t request;
+                parse_request(packet.data(), packet.size(), &request);
+                checksum += request.filename.size() + request.options.blocksize;
+            }
+        }
+    });
+
+    //structure used by the server (file name is copied)
+    double structure = measure(packets, [&](){
+        for (int round = 0; round < BENCH_ROUNDS; round++){
+            for (string &packet : requests){
+                tftp_rrq_wrq_packet_t request;
+                deserialize_packet_struct(&request, packet.data(), packet.size());
+                checksum += request.filename.size() + request.options.blocksize;
+            }
+        }
+    });
+
+    //both parsers have to give the same result
+    bool is_correct = true;
+    for (string &packet : requests){
+        tftp_rrq_wrq_packet_t former_request;
+        tftp_rrq_wrq_packet_t request;
+        former_deserialize_request(&former_request, packet.c_str());
+        is_correct &= deserialize_packet_struct(&request, packet.data(), packet.size()) == PACKET_OK_CODE &&
+                      request.opcode == former_request.opcode && request.filename == former_request.filename &&
+                      request.mode == former_request.mode &&
+                      serialize_option_info(&request.options) == serialize_option_info(&former_request.options);
+    }
+
+    cout << "packets=" << requests.size() << " former=" << former << "ns view=" << view << "ns structure=" << structure << "ns"
+        << " speedup_view=" << former / view << "x speedup_structure=" << former / structure << "x"
+        << " correct=" << (is_correct ? "yes" : "no") << "\n";
+    return 0;
+}
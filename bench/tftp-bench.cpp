@@ -0,0 +1,1186 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-bench.cpp
+ * @brief Loopback benchmark of the server (goodput, time to first byte, CPU time and memory of RRQ/WRQ transfers,
+ * content of every transfer is checked)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "tftp-packet-structures.hpp"
+#include "tftp-netascii.hpp"
+
+using namespace std;
+
+#define BENCH_DEFAULT_PORT 16969
+#define BENCH_RETRANSMIT_TIMEOUT_MS 500     //lost request, Data or Ack of the benchmark client
+#define BENCH_STALL_TIMEOUT_S 30            //case is aborted, when no session makes progress for this long
+#define BENCH_PROBE_ATTEMPTS 250            //server readiness probes (sent every 20 ms)
+#define BENCH_STOP_TIMEOUT_MS 5000          //server is killed, when it does not exit after the interrupt signal
+#define BENCH_QUICK_CASE_LIMIT (256ULL << 20)
+#define BENCH_FULL_CASE_LIMIT (4ULL << 30)
+#define BENCH_MAX_DATAGRAM (65464 + DATA_PACKET_OFFSET)
+#define BENCH_CHECK_FILE_SIZE (16ULL << 20)
+#define BENCH_CHECKSUM_INITIAL 0xcbf29ce484222325ULL     //FNV-1a offset basis
+#define BENCH_CHECK_TRUNCATE_BLOCK 64       //file is truncated, when the block is received
+#define BENCH_CHECK_TIMEOUT_S 10            //check fails, when the server doesn't answer for this long
+#define BENCH_CHECK_SEGMENTS_FILE_SIZE (5ULL << 20)     //big enough to be downloaded by ranges
+#define BENCH_CHECK_SEGMENTS "4"
+#define BENCH_CHECK_RESUME_FILE_SIZE (256ULL << 20)     //prefix of the resumed download checksummed by the server
+#define BENCH_CHECK_RESUME_BLOCK 64         //resumed download is requested, when the active session receives the block
+#define BENCH_CHECK_STALL_MS 100            //active session may wait this long for a Data block
+
+typedef chrono::steady_clock::time_point bench_time_t;
+
+
+//Structure containing the benchmark matrix and the tested server
+typedef struct bench_settings {
+    string server_path = "./tftp-server";
+    string client_path = "./tftp-client";       //client of the checks
+    vector<string> server_args;                 //additional arguments of the server (e.g. -e)
+    int port = BENCH_DEFAULT_PORT;
+    vector<string> operations = {"RRQ", "WRQ"};
+    vector<string> modes = {MODE_OCTET, MODE_NETASCII};
+    vector<unsigned long long> file_sizes = {1ULL << 10, 1ULL << 20, 16ULL << 20};
+    vector<unsigned int> blocksizes = {512, 8192, 65464};
+    vector<unsigned int> sessions = {1, 10, 100};
+    unsigned long long case_limit = BENCH_QUICK_CASE_LIMIT;     //cases transferring more Bytes in total are skipped
+    bool check = false;                         //checks of the server are run instead of the matrix
+} bench_settings_t;
+
+
+//Structure containing one combination of the matrix
+typedef struct bench_case {
+    string operation;
+    string mode;
+    unsigned long long file_size;
+    unsigned int blocksize;
+    unsigned int sessions;
+} bench_case_t;
+
+
+//Structure containing one transfer of the case
+typedef struct bench_session {
+    int socket = -1;
+    struct sockaddr_in server_address;          //listening port until the first response, then the server TID
+    bool tid_known = false;
+    string packet;                              //last sent packet, retransmitted on timeout
+    bench_time_t request_time;
+    bench_time_t sent_time;
+    long ttfb_us = -1;                          //RRQ: first Data, WRQ: first Ack/Oack (server ready to receive)
+
+    unsigned int blocksize;
+    block_index_t block_index = 0;              //RRQ: last received block, WRQ: last sent block
+    size_t source_offset = 0;                   //WRQ: position in the file content
+    netascii_state_t netascii_state;
+    bool last_block_sent = false;
+
+    unsigned long long bytes = 0;               //transferred payload
+    unsigned long long checksum = BENCH_CHECKSUM_INITIAL;       //RRQ: checksum of the received payload
+    unsigned int retransmissions = 0;
+    bool done = false;
+    bool failed = false;
+} bench_session_t;
+
+
+//Structure containing measured values of the case
+typedef struct bench_result {
+    unsigned int completed = 0;
+    unsigned int failed = 0;                    //including the transfers with wrong content
+    unsigned int mismatched = 0;                //received (RRQ) or stored (WRQ) content differs from the source
+    unsigned long retransmissions = 0;
+    unsigned long long bytes = 0;
+    double seconds = 0;
+    double ttfb_p50_us = 0;
+    double ttfb_p99_us = 0;
+    double server_cpu_s = 0;
+    double client_cpu_s = 0;
+    long server_peak_rss_kb = 0;
+} bench_result_t;
+
+
+/**
+ * @brief Prints help and exits
+ */
+static void print_help(){
+    cout << "Usage: tftp-bench [-s server] [-c client] [-p port] [--full] [--ops LIST] [--modes LIST] [--sizes LIST]\n"
+         << "                  [--blksizes LIST] [--sessions LIST] [--limit SIZE] [--check] [-- server arguments]\n\n"
+         << "  -s <PATH>\t\tserver binary (default ./tftp-server)\n"
+         << "  -c <PATH>\t\tclient binary of the checks (default ./tftp-client)\n"
+         << "  -p <PORT>\t\tport of the server on the loopback (default " << BENCH_DEFAULT_PORT << ")\n"
+         << "  --full\t\tfull matrix (1K-1G files, blksize 512-65464, 1-1000 sessions)\n"
+         << "  --ops\t\t\tRRQ,WRQ\n"
+         << "  --modes\t\toctet,netascii\n"
+         << "  --sizes\t\tfile sizes in Bytes (suffix K, M or G allowed)\n"
+         << "  --blksizes\t\tblock sizes\n"
+         << "  --sessions\t\tnumbers of concurrent sessions\n"
+         << "  --limit <SIZE>\tcases transferring more Bytes in total are skipped\n"
+         << "  --check\t\trun the checks of the server (file truncated during RRQ, download by --segments, resumed download next to an active session) instead of the matrix\n\n"
+         << "Results are written in JSON on standard output, progress on standard error.\n";
+    exit(0);
+}
+
+
+/**
+ * @brief Parses the size with an optional K, M or G suffix
+ *
+ * @param text size to be parsed
+ * @param size address, where the size will be stored
+ * @return true if the size is valid, else false
+ */
+static bool parse_size(string text, unsigned long long *size){
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(text.c_str(), &end, 10);
+    if (errno != 0 || end == text.c_str()){
+        return false;
+    }
+
+    string suffix = end;
+    if (suffix == "K") value <<= 10;
+    else if (suffix == "M") value <<= 20;
+    else if (suffix == "G") value <<= 30;
+    else if (suffix != "") return false;
+
+    *size = value;
+    return true;
+}
+
+
+/**
+ * @brief Splits the comma separated list
+ */
+static vector<string> split_list(string text){
+    vector<string> items;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')){
+        items.push_back(item);
+    }
+    return items;
+}
+
+
+/**
+ * @brief Validates and parses given program arguments
+ *
+ * @param argc number of given arguments
+ * @param argv array of given arguments
+ * @param settings address, where the settings will be stored
+ */
+static void check_program_args(int argc, char *argv[], bench_settings_t *settings){
+    bool full = false;
+    bool limit_given = false;
+
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        string value = i + 1 < argc ? argv[i + 1] : "";
+        bool is_valid = true;
+
+        if (arg == "--help"){
+            print_help();
+        }
+        else if (arg == "--"){
+            settings->server_args.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        else if (arg == "--full"){
+            full = true;
+            continue;
+        }
+        else if (arg == "--check"){
+            settings->check = true;
+            continue;
+        }
+        else if (i + 1 >= argc){
+            is_valid = false;
+        }
+        else if (arg == "-s"){
+            settings->server_path = value;
+        }
+        else if (arg == "-c"){
+            settings->client_path = value;
+        }
+        else if (arg == "-p"){
+            settings->port = atoi(value.c_str());
+            is_valid = settings->port > 0 && settings->port < 65536;
+        }
+        else if (arg == "--ops"){
+            settings->operations = split_list(value);
+            for (string &operation : settings->operations){
+                transform(operation.begin(), operation.end(), operation.begin(), ::toupper);
+                is_valid &= operation == "RRQ" || operation == "WRQ";
+            }
+        }
+        else if (arg == "--modes"){
+            settings->modes = split_list(value);
+            for (string &mode : settings->modes){
+                is_valid &= mode == MODE_OCTET || mode == MODE_NETASCII;
+            }
+        }
+        else if (arg == "--sizes" || arg == "--blksizes" || arg == "--sessions"){
+            vector<unsigned long long> values;
+            for (string &item : split_list(value)){
+                unsigned long long number;
+                is_valid &= parse_size(item, &number);
+                values.push_back(number);
+            }
+            if (arg == "--sizes"){
+                settings->file_sizes = values;
+            }
+            else if (arg == "--blksizes"){
+                settings->blocksizes.assign(values.begin(), values.end());
+                for (unsigned long long blocksize : values){
+                    is_valid &= blocksize >= 8 && blocksize <= 65464;
+                }
+            }
+            else{
+                settings->sessions.assign(values.begin(), values.end());
+                for (unsigned long long sessions : values){
+                    is_valid &= sessions >= 1 && sessions <= 100000;
+                }
+            }
+        }
+        else if (arg == "--limit"){
+            is_valid = parse_size(value, &settings->case_limit);
+            limit_given = true;
+        }
+        else{
+            is_valid = false;
+        }
+
+        if (!is_valid){
+            cerr << "ERROR: invalid argument " << arg << " (see --help)\n";
+            exit(PROG_RET_CODE_ERR);
+        }
+        i++;
+    }
+
+    if (full){
+        //explicitly given lists take precedence over the full matrix
+        vector<string> given(argv + 1, argv + argc);
+        auto is_given = [&given](string arg){return find(given.begin(), given.end(), arg) != given.end();};
+        if (!is_given("--sizes")) settings->file_sizes = {1ULL << 10, 64ULL << 10, 1ULL << 20, 16ULL << 20, 256ULL << 20, 1ULL << 30};
+        if (!is_given("--blksizes")) settings->blocksizes = {512, 1428, 8192, 32768, 65464};
+        if (!is_given("--sessions")) settings->sessions = {1, 10, 100, 1000};
+        if (!limit_given) settings->case_limit = BENCH_FULL_CASE_LIMIT;
+    }
+}
+
+
+/**
+ * @brief Generates the file with pseudorandom content (octet) or text with LF line endings (netascii)
+ *
+ * @param path path to the file
+ * @param size size of the file in Bytes
+ * @param is_text generate text
+ * @return true if the file was generated, else false
+ */
+static bool generate_file(string path, unsigned long long size, bool is_text){
+    ofstream file(path, ios::binary);
+    vector<char> buffer(1 << 20);
+    unsigned long long state = 0x9E3779B97F4A7C15ULL ^ size;
+
+    while (size > 0 && file){
+        size_t chunk = min((unsigned long long)buffer.size(), size);
+        for (size_t i = 0; i < chunk; i++){
+            //xorshift generator
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            if (is_text){
+                buffer[i] = (state % 48 == 0) ? '\n' : 'a' + (state >> 8) % 26;
+            }
+            else{
+                buffer[i] = state >> 24;
+            }
+        }
+        file.write(buffer.data(), chunk);
+        size -= chunk;
+    }
+    return (bool)file;
+}
+
+
+/**
+ * @brief Adds the data to the checksum (FNV-1a), corrupted, missing or reordered Bytes change it
+ *
+ * @param checksum checksum of the preceding data
+ * @param data added data
+ * @param size size of the data in Bytes
+ * @return checksum including the data
+ */
+static unsigned long long checksum_update(unsigned long long checksum, const char *data, size_t size){
+    for (size_t i = 0; i < size; i++){
+        checksum = (checksum ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+    }
+    return checksum;
+}
+
+
+/**
+ * @brief Computes the checksum of the data sent by the server for RRQ (text converted to NETASCII)
+ *
+ * @param content content of the file
+ * @param size size of the file in Bytes
+ * @param is_text NETASCII mode
+ * @return checksum of the sent data
+ */
+static unsigned long long checksum_sent_content(const char *content, unsigned long long size, bool is_text){
+    if (!is_text){
+        return checksum_update(BENCH_CHECKSUM_INITIAL, content, size);
+    }
+
+    unsigned long long checksum = BENCH_CHECKSUM_INITIAL;
+    vector<char> output(1 << 20);
+    netascii_state_t netascii_state;
+    size_t offset = 0;
+    while (offset < size || netascii_state.has_pending){
+        size_t consumed;
+        size_t output_size = netascii_encode(content + offset, size - offset, &consumed, output.data(), output.size(), &netascii_state);
+        checksum = checksum_update(checksum, output.data(), output_size);
+        offset += consumed;
+    }
+    return checksum;
+}
+
+
+/**
+ * @brief Computes the checksum of the file stored by the server for WRQ
+ *
+ * @param path path to the file
+ * @param checksum address, where the checksum will be stored
+ * @return true if the file was read, else false
+ */
+static bool checksum_file(string path, unsigned long long *checksum){
+    ifstream file(path, ios::binary);
+    vector<char> buffer(1 << 20);
+    *checksum = BENCH_CHECKSUM_INITIAL;
+    while (file){
+        file.read(buffer.data(), buffer.size());
+        *checksum = checksum_update(*checksum, buffer.data(), file.gcount());
+    }
+    return file.eof();
+}
+
+
+/**
+ * @brief Starts the server in a new process group, its output is discarded
+ *
+ * @param settings benchmark settings
+ * @param root_dirpath root directory of the server
+ * @return PID of the server
+ */
+static pid_t server_start(bench_settings_t *settings, string root_dirpath){
+    vector<string> args = {settings->server_path, "-p", to_string(settings->port), root_dirpath};
+    args.insert(args.end(), settings->server_args.begin(), settings->server_args.end());
+
+    pid_t pid = fork();
+    if (pid == 0){
+        setpgid(0, 0);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, STDOUT_FILENO);
+        dup2(null_fd, STDERR_FILENO);
+
+        vector<char *> argv;
+        for (string &arg : args){
+            argv.push_back((char *)arg.c_str());
+        }
+        argv.push_back(NULL);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    else if (pid < 0){
+        cerr << "ERROR: fork - starting the server\n";
+        exit(PROG_RET_CODE_ERR);
+    }
+
+    setpgid(pid, pid);
+    return pid;
+}
+
+
+/**
+ * @brief Waits until the server responds to a request (Error packet for a missing file)
+ *
+ * @param port port of the server
+ * @return true if the server responded, else false
+ */
+static bool server_wait_ready(int port){
+    int probe_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    tftp_rrq_wrq_packet_t request;
+    request.opcode = RRQ_OPCODE;
+    request.filename = "tftp-bench-probe-missing";
+    request.mode = MODE_OCTET;
+    string packet = serialize_packet_struct(&request);
+
+    bool is_ready = false;
+    for (int i = 0; i < BENCH_PROBE_ATTEMPTS && !is_ready; i++){
+        sendto(probe_socket, packet.data(), packet.size(), 0, (struct sockaddr *)&address, sizeof(address));
+
+        struct timeval timeout = {0, 20000};
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(probe_socket, &read_set);
+        is_ready = select(probe_socket + 1, &read_set, NULL, NULL, &timeout) > 0;
+    }
+
+    close(probe_socket);
+    return is_ready;
+}
+
+
+/**
+ * @brief Interrupts the server and all its processes, collects their CPU time and peak memory
+ *
+ * @param pid PID of the server
+ * @param result address, where the measured values will be stored
+ */
+static void server_stop(pid_t pid, bench_result_t *result){
+    kill(-pid, SIGINT);
+
+    bool server_exited = false;
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(BENCH_STOP_TIMEOUT_MS);
+    while (true){
+        //child processes of the server are reparented to the benchmark (subreaper), so all of them are accounted
+        struct rusage usage;
+        int status;
+        pid_t exited = wait4(-1, &status, server_exited ? 0 : WNOHANG, &usage);
+        if (exited < 0){
+            break;      //no processes left
+        }
+        else if (exited == 0){
+            if (chrono::steady_clock::now() > deadline){
+                kill(-pid, SIGKILL);
+            }
+            usleep(1000);
+            continue;
+        }
+
+        server_exited |= exited == pid;
+        result->server_cpu_s += usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+        result->server_peak_rss_kb = max(result->server_peak_rss_kb, usage.ru_maxrss);
+    }
+}
+
+
+/**
+ * @brief Sends the packet of the session to the server and remembers it for retransmission
+ */
+static void session_send(bench_session_t *session, string packet){
+    session->packet = packet;
+    session->sent_time = chrono::steady_clock::now();
+    sendto(session->socket, packet.data(), packet.size(), 0, (struct sockaddr *)&session->server_address, sizeof(session->server_address));
+}
+
+
+/**
+ * @brief Sends the Ack of the last received block (RRQ)
+ */
+static void session_send_ack(bench_session_t *session){
+    tftp_ack_packet_t ack_packet;
+    ack_packet.block_number = block_number_from_index(session->block_index, DEFAULT_ROLLOVER);
+    session_send(session, serialize_packet_struct(&ack_packet));
+}
+
+
+/**
+ * @brief Sends the next Data block of the file (WRQ), text is converted to NETASCII
+ */
+static void session_send_data(bench_session_t *session, bench_case_t *bench_case, const char *content){
+    char datagram[BENCH_MAX_DATAGRAM];
+    tftp_data_packet_t data_packet;
+    data_packet.block_number = block_number_from_index(++session->block_index, DEFAULT_ROLLOVER);
+    serialize_data_header(&data_packet, datagram);
+
+    size_t payload_size;
+    if (bench_case->mode == MODE_NETASCII){
+        size_t consumed;
+        payload_size = netascii_encode(content + session->source_offset, bench_case->file_size - session->source_offset, &consumed,
+                                       datagram + DATA_PACKET_OFFSET, session->blocksize, &session->netascii_state);
+        session->source_offset += consumed;
+    }
+    else{
+        payload_size = min((unsigned long long)session->blocksize, bench_case->file_size - session->source_offset);
+        memcpy(datagram + DATA_PACKET_OFFSET, content + session->source_offset, payload_size);
+        session->source_offset += payload_size;
+    }
+
+    session->bytes += payload_size;
+    session->last_block_sent = payload_size < session->blocksize;
+    session_send(session, string(datagram, DATA_PACKET_OFFSET + payload_size));
+}
+
+
+/**
+ * @brief Sends the request of the session (blksize option is used, when the block size is not the default one)
+ */
+static void session_start(bench_session_t *session, bench_case_t *bench_case, string filename, int port){
+    session->socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (session->socket < 0){
+        cerr << "ERROR: socket - creating the socket of the session (raise the limit of open files)\n";
+        exit(PROG_RET_CODE_ERR);
+    }
+
+    memset(&session->server_address, 0, sizeof(session->server_address));
+    session->server_address.sin_family = AF_INET;
+    session->server_address.sin_port = htons(port);
+    session->server_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    session->blocksize = DEFAULT_BLOCK_SIZE;
+
+    tftp_rrq_wrq_packet_t request;
+    request.opcode = bench_case->operation == "RRQ" ? RRQ_OPCODE : WRQ_OPCODE;
+    request.filename = filename;
+    request.mode = bench_case->mode;
+    if (bench_case->blocksize != DEFAULT_BLOCK_SIZE){
+        request.options.option_blocksize = true;
+        request.options.blocksize = bench_case->blocksize;
+    }
+
+    session->request_time = chrono::steady_clock::now();
+    session_send(session, serialize_packet_struct(&request));
+}
+
+
+/**
+ * @brief Processes the datagram received by the session
+ *
+ * @param session session structure
+ * @param bench_case benchmark case
+ * @param content content of the uploaded file (WRQ)
+ * @param buffer received datagram (terminated by NUL)
+ * @param size size of the datagram
+ */
+static void session_receive(bench_session_t *session, bench_case_t *bench_case, const char *content, char *buffer, int size){
+    if (size < 4 || session->done){
+        return;
+    }
+
+    char opcode_char[2] = {buffer[0], buffer[1]};
+    char block_number_char[2] = {buffer[2], buffer[3]};
+    ushort opcode = chars_to_short(opcode_char);
+    ushort block_number = chars_to_short(block_number_char);
+    bool is_rrq = bench_case->operation == "RRQ";
+
+    if (opcode == ERROR_OPCODE){
+        session->failed = session->done = true;
+        return;
+    }
+    else if (opcode == OACK_OPCODE && session->block_index == 0){
+        tftp_oack_packet_t oack_packet;
+        deserialize_packet_struct(&oack_packet, buffer, size);
+        if (oack_packet.options.option_blocksize){
+            session->blocksize = oack_packet.options.blocksize;
+        }
+    }
+
+    auto now = chrono::steady_clock::now();
+    if (is_rrq){
+        if (opcode == OACK_OPCODE && session->block_index == 0){
+            session_send_ack(session);
+        }
+        else if (opcode == DATA_OPCODE && block_number == block_number_from_index(session->block_index + 1, DEFAULT_ROLLOVER)){
+            if (session->ttfb_us < 0){
+                session->ttfb_us = chrono::duration_cast<chrono::microseconds>(now - session->request_time).count();
+            }
+            session->block_index++;
+            session->bytes += size - DATA_PACKET_OFFSET;
+            session->checksum = checksum_update(session->checksum, buffer + DATA_PACKET_OFFSET, size - DATA_PACKET_OFFSET);
+            session_send_ack(session);
+            session->done = size - DATA_PACKET_OFFSET < (int)session->blocksize;
+        }
+        else if (opcode == DATA_OPCODE && block_number == block_number_from_index(session->block_index, DEFAULT_ROLLOVER)){
+            session_send(session, session->packet);     //Ack was lost
+        }
+    }
+    else if ((opcode == OACK_OPCODE && session->block_index == 0) ||
+             (opcode == ACK_OPCODE && block_number == block_number_from_index(session->block_index, DEFAULT_ROLLOVER))){
+        if (session->ttfb_us < 0){
+            session->ttfb_us = chrono::duration_cast<chrono::microseconds>(now - session->request_time).count();
+        }
+        if (session->last_block_sent){
+            session->done = true;
+        }
+        else{
+            session_send_data(session, bench_case, content);
+        }
+    }
+}
+
+
+/**
+ * @brief Computes the percentile of the sorted values
+ */
+static double percentile(vector<long> &sorted_values, double fraction){
+    if (sorted_values.empty()){
+        return 0;
+    }
+    size_t index = (size_t)(fraction * (sorted_values.size() - 1) + 0.5);
+    return sorted_values[index];
+}
+
+
+/**
+ * @brief Runs all sessions of the case against a freshly started server
+ *
+ * @param settings benchmark settings
+ * @param bench_case benchmark case
+ * @param root_dirpath root directory of the server
+ * @param case_number number of the case (unique names of uploaded files)
+ * @return measured values
+ */
+static bench_result_t run_case(bench_settings_t *settings, bench_case_t *bench_case, string root_dirpath, int case_number){
+    bench_result_t result;
+    string filename = "bench-" + to_string(bench_case->file_size) + (bench_case->mode == MODE_NETASCII ? ".txt" : ".bin");
+    bool is_rrq = bench_case->operation == "RRQ";
+
+    //content of the uploaded file, received and stored content is compared with it
+    const char *content = NULL;
+    int content_fd = open((root_dirpath + "/" + filename).c_str(), O_RDONLY);
+    if (bench_case->file_size > 0){
+        content = (const char *)mmap(NULL, bench_case->file_size, PROT_READ, MAP_PRIVATE, content_fd, 0);
+        if (content == MAP_FAILED){
+            cerr << "ERROR: mmap - reading the file " << filename << "\n";
+            exit(PROG_RET_CODE_ERR);
+        }
+    }
+    close(content_fd);
+    unsigned long long content_checksum = is_rrq ? checksum_sent_content(content, bench_case->file_size, bench_case->mode == MODE_NETASCII) :
+                                                   checksum_update(BENCH_CHECKSUM_INITIAL, content, bench_case->file_size);
+
+    pid_t server_pid = server_start(settings, root_dirpath);
+    if (!server_wait_ready(settings->port)){
+        cerr << "ERROR: server does not respond on the port " << settings->port << "\n";
+        server_stop(server_pid, &result);
+        exit(PROG_RET_CODE_ERR);
+    }
+
+    struct rusage usage_start, usage_end;
+    getrusage(RUSAGE_SELF, &usage_start);
+
+    int epoll_fd = epoll_create1(0);
+    vector<bench_session_t> sessions(bench_case->sessions);
+    auto start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < sessions.size(); i++){
+        string session_filename = is_rrq ? filename : "upload-" + to_string(case_number) + "-" + to_string(i);
+        session_start(&sessions[i], bench_case, session_filename, settings->port);
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sessions[i].socket, &event);
+    }
+
+    char buffer[BENCH_MAX_DATAGRAM + 1];
+    vector<struct epoll_event> events(256);
+    unsigned int sessions_done = 0;
+    auto last_progress = start;
+    auto last_timeout_check = start;
+
+    while (sessions_done < sessions.size()){
+        int ready = epoll_wait(epoll_fd, events.data(), events.size(), 10);
+        auto now = chrono::steady_clock::now();
+
+        for (int i = 0; i < ready; i++){
+            bench_session_t *session = &sessions[events[i].data.u32];
+            while (!session->done){
+                struct sockaddr_in from_address;
+                socklen_t from_size = sizeof(from_address);
+                bzero(buffer, 512);     //options of the Oack are read up to NUL
+                int bytes_rx = recvfrom(session->socket, buffer, BENCH_MAX_DATAGRAM, 0, (struct sockaddr *)&from_address, &from_size);
+                if (bytes_rx < 0){
+                    break;
+                }
+                buffer[bytes_rx] = '\0';
+
+                if (!session->tid_known){
+                    session->server_address.sin_port = from_address.sin_port;
+                }
+                else if (from_address.sin_port != session->server_address.sin_port){
+                    continue;   //unknown TID
+                }
+
+                session_receive(session, bench_case, content, buffer, bytes_rx);
+                session->tid_known = true;
+                last_progress = now;
+
+                if (session->done){
+                    sessions_done++;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, session->socket, NULL);
+                }
+            }
+        }
+
+        //retransmission of lost packets
+        if (now - last_timeout_check >= chrono::milliseconds(10)){
+            last_timeout_check = now;
+            for (auto &session : sessions){
+                if (!session.done && now - session.sent_time >= chrono::milliseconds(BENCH_RETRANSMIT_TIMEOUT_MS)){
+                    session.retransmissions++;
+                    session_send(&session, session.packet);
+                }
+            }
+        }
+
+        if (now - last_progress >= chrono::seconds(BENCH_STALL_TIMEOUT_S)){
+            cerr << "ERROR: no progress for " << BENCH_STALL_TIMEOUT_S << " s, the case is aborted\n";
+            break;
+        }
+    }
+
+    result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    getrusage(RUSAGE_SELF, &usage_end);
+    result.client_cpu_s = (usage_end.ru_utime.tv_sec - usage_start.ru_utime.tv_sec) + (usage_end.ru_utime.tv_usec - usage_start.ru_utime.tv_usec) / 1e6 +
+                          (usage_end.ru_stime.tv_sec - usage_start.ru_stime.tv_sec) + (usage_end.ru_stime.tv_usec - usage_start.ru_stime.tv_usec) / 1e6;
+
+    server_stop(server_pid, &result);
+
+    vector<long> ttfb_values;
+    for (unsigned int i = 0; i < sessions.size(); i++){
+        bench_session_t *session = &sessions[i];
+        close(session->socket);
+
+        //transfer with wrong content is a failure, however fast it was
+        string upload_path = root_dirpath + "/upload-" + to_string(case_number) + "-" + to_string(i);
+        unsigned long long checksum = session->checksum;
+        bool is_matching = !session->done || session->failed || (is_rrq ? checksum == content_checksum :
+                           checksum_file(upload_path, &checksum) && checksum == content_checksum);
+        if (!is_matching){
+            result.mismatched++;
+        }
+
+        if (session->done && !session->failed && is_matching){
+            result.completed++;
+        }
+        else{
+            result.failed++;
+        }
+        result.bytes += session->bytes;
+        result.retransmissions += session->retransmissions;
+        if (session->ttfb_us >= 0){
+            ttfb_values.push_back(session->ttfb_us);
+        }
+        if (!is_rrq){
+            remove(upload_path.c_str());
+        }
+    }
+    close(epoll_fd);
+    if (content != NULL){
+        munmap((void *)content, bench_case->file_size);
+    }
+
+    sort(ttfb_values.begin(), ttfb_values.end());
+    result.ttfb_p50_us = percentile(ttfb_values, 0.50);
+    result.ttfb_p99_us = percentile(ttfb_values, 0.99);
+    return result;
+}
+
+
+/**
+ * @brief Checks the server survives the file truncated during RRQ. The session has to end by an Error packet
+ * (pages of the truncated mapped file can't be sent) or send the whole former content (cached copy of the file)
+ * and the server has to answer the next request.
+ *
+ * @param settings benchmark settings
+ * @param root_dirpath root directory of the server
+ * @return true if the check passed, else false
+ */
+static bool check_truncated_file(bench_settings_t *settings, string root_dirpath){
+    string filename = "check-truncate.bin";
+    string path = root_dirpath + "/" + filename;
+    if (!generate_file(path, BENCH_CHECK_FILE_SIZE, false)){
+        cerr << "ERROR: generating the file " << path << "\n";
+        return false;
+    }
+
+    bench_result_t result;
+    pid_t server_pid = server_start(settings, root_dirpath);
+    bool passed = server_wait_ready(settings->port);
+
+    bench_case_t bench_case = {"RRQ", MODE_OCTET, BENCH_CHECK_FILE_SIZE, DEFAULT_BLOCK_SIZE, 1};
+    bench_session_t session;
+    session_start(&session, &bench_case, filename, settings->port);
+
+    char buffer[BENCH_MAX_DATAGRAM + 1];
+    bool is_truncated = false;
+    auto last_progress = chrono::steady_clock::now();
+    while (passed && !session.done && chrono::steady_clock::now() - last_progress < chrono::seconds(BENCH_CHECK_TIMEOUT_S)){
+        struct timeval timeout = {0, 10000};
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(session.socket, &read_set);
+        if (select(session.socket + 1, &read_set, NULL, NULL, &timeout) <= 0){
+            if (chrono::steady_clock::now() - session.sent_time >= chrono::milliseconds(BENCH_RETRANSMIT_TIMEOUT_MS)){
+                session_send(&session, session.packet);
+            }
+            continue;
+        }
+
+        struct sockaddr_in from_address;
+        socklen_t from_size = sizeof(from_address);
+        bzero(buffer, 512);     //options of the Oack are read up to NUL
+        int bytes_rx = recvfrom(session.socket, buffer, BENCH_MAX_DATAGRAM, 0, (struct sockaddr *)&from_address, &from_size);
+        if (bytes_rx < 0 || (session.tid_known && from_address.sin_port != session.server_address.sin_port)){
+            continue;
+        }
+        buffer[bytes_rx] = '\0';
+        session.server_address.sin_port = from_address.sin_port;
+        session.tid_known = true;
+
+        session_receive(&session, &bench_case, NULL, buffer, bytes_rx);
+        last_progress = chrono::steady_clock::now();
+
+        if (!is_truncated && session.block_index >= BENCH_CHECK_TRUNCATE_BLOCK){
+            is_truncated = truncate(path.c_str(), 0) == 0;
+            passed = is_truncated;
+        }
+    }
+
+    //short Data block (the transfer looks complete) or no answer fail the check
+    passed &= session.done && (session.failed || session.bytes == BENCH_CHECK_FILE_SIZE);
+    passed &= server_wait_ready(settings->port);
+
+    close(session.socket);
+    server_stop(server_pid, &result);
+    remove(path.c_str());
+    return passed;
+}
+
+
+/**
+ * @brief Compares the contents of two files
+ *
+ * @param path first file
+ * @param other_path second file
+ * @return true if both files exist and have the same content, else false
+ */
+static bool files_equal(string path, string other_path){
+    ifstream file(path, ios::binary);
+    ifstream other_file(other_path, ios::binary);
+    if (!file || !other_file){
+        return false;
+    }
+
+    vector<char> buffer(1 << 20), other_buffer(1 << 20);
+    while (file && other_file){
+        file.read(buffer.data(), buffer.size());
+        other_file.read(other_buffer.data(), other_buffer.size());
+        if (file.gcount() != other_file.gcount() || memcmp(buffer.data(), other_buffer.data(), file.gcount()) != 0){
+            return false;
+        }
+    }
+    return file.eof() && other_file.eof();
+}
+
+
+/**
+ * @brief Checks the download of a multi-block file by the client started with --segments (ranges downloaded by own
+ * sessions at once), the client has to exit with 0 and the downloaded file has to be the same as the file of the server
+ *
+ * @param settings benchmark settings
+ * @param root_dirpath root directory of the server
+ * @return true if the check passed, else false
+ */
+static bool check_segmented_download(bench_settings_t *settings, string root_dirpath){
+    string filename = "check-segments.bin";
+    string path = root_dirpath + "/" + filename;
+    string download_path = root_dirpath + "/check-segments-download.bin";
+    if (!generate_file(path, BENCH_CHECK_SEGMENTS_FILE_SIZE, false)){
+        cerr << "ERROR: generating the file " << path << "\n";
+        return false;
+    }
+
+    bench_result_t result;
+    pid_t server_pid = server_start(settings, root_dirpath);
+    bool passed = server_wait_ready(settings->port);
+
+    if (passed){
+        vector<string> args = {settings->client_path, "-h", "127.0.0.1", "-p", to_string(settings->port), "-f", filename,
+                               "--segments", BENCH_CHECK_SEGMENTS, "-t", download_path};
+        pid_t client_pid = fork();
+        if (client_pid == 0){
+            int null_fd = open("/dev/null", O_WRONLY);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+
+            vector<char *> argv;
+            for (string &arg : args){
+                argv.push_back((char *)arg.c_str());
+            }
+            argv.push_back(NULL);
+            execv(argv[0], argv.data());
+            _exit(127);
+        }
+
+        //client is killed, when it doesn't finish in time
+        int status = -1;
+        auto start = chrono::steady_clock::now();
+        while (client_pid > 0 && waitpid(client_pid, &status, WNOHANG) == 0){
+            if (chrono::steady_clock::now() - start >= chrono::seconds(BENCH_STALL_TIMEOUT_S)){
+                kill(client_pid, SIGKILL);
+                waitpid(client_pid, &status, 0);
+                status = -1;
+                break;
+            }
+            usleep(10000);
+        }
+        passed = client_pid > 0 && status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0 && files_equal(path, download_path);
+    }
+
+    server_stop(server_pid, &result);
+    remove(path.c_str());
+    remove(download_path.c_str());
+    return passed;
+}
+
+
+/**
+ * @brief Checks the server keeps sending the Data of an active session, while it verifies a long prefix of a resumed
+ * download (--resume is added to the arguments of the server). The prefix has a wrong checksum, so the request has to be
+ * answered by the Oack with the resume option 0 and no Data block of the active session may be delayed meanwhile.
+ *
+ * @param settings benchmark settings
+ * @param root_dirpath root directory of the server
+ * @return true if the check passed, else false
+ */
+static bool check_resume_stall(bench_settings_t *settings, string root_dirpath){
+    string filename = "check-resume.bin";
+    string path = root_dirpath + "/" + filename;
+    if (!generate_file(path, BENCH_CHECK_RESUME_FILE_SIZE, false)){
+        cerr << "ERROR: generating the file " << path << "\n";
+        return false;
+    }
+
+    bench_settings_t resume_settings = *settings;
+    resume_settings.server_args.push_back("--resume");
+    bench_result_t result;
+    pid_t server_pid = server_start(&resume_settings, root_dirpath);
+    bool passed = server_wait_ready(settings->port);
+
+    bench_case_t bench_case = {"RRQ", MODE_OCTET, BENCH_CHECK_RESUME_FILE_SIZE, DEFAULT_BLOCK_SIZE, 1};
+    bench_session_t session;
+    session_start(&session, &bench_case, filename, settings->port);
+
+    //resumed download of the whole file (the server reads the whole prefix)
+    bench_session_t resumed;
+    tftp_rrq_wrq_packet_t request;
+    request.opcode = RRQ_OPCODE;
+    request.filename = filename;
+    request.mode = MODE_OCTET;
+    request.options.option_resume = true;
+    request.options.resume_bytes = BENCH_CHECK_RESUME_FILE_SIZE;
+    request.options.resume_checksum = 0;        //never a valid Adler-32 checksum
+
+    char buffer[BENCH_MAX_DATAGRAM + 1];
+    bool is_requested = false;
+    bool is_answered = false;
+    bool is_finished = false;               //active session received a Data block after the answer
+    long longest_wait_ms = 0;
+    auto last_data = chrono::steady_clock::now();
+    auto requested = last_data;
+    auto answered = last_data;
+    while (passed && !session.done && !is_finished && chrono::steady_clock::now() - last_data < chrono::seconds(BENCH_CHECK_TIMEOUT_S)){
+        struct timeval timeout = {0, 10000};
+        fd_set read_set;
+        FD_ZERO(&read_set);
+        FD_SET(session.socket, &read_set);
+        if (is_requested && !is_answered){
+            FD_SET(resumed.socket, &read_set);
+        }
+        if (select(max(session.socket, resumed.socket) + 1, &read_set, NULL, NULL, &timeout) <= 0){
+            if (chrono::steady_clock::now() - session.sent_time >= chrono::milliseconds(BENCH_RETRANSMIT_TIMEOUT_MS)){
+                session_send(&session, session.packet);
+            }
+            continue;
+        }
+
+        struct sockaddr_in from_address;
+        socklen_t from_size = sizeof(from_address);
+        if (is_requested && !is_answered && FD_ISSET(resumed.socket, &read_set)){
+            bzero(buffer, 512);     //options of the Oack are read up to NUL
+            int bytes_rx = recvfrom(resumed.socket, buffer, BENCH_MAX_DATAGRAM, 0, (struct sockaddr *)&from_address, &from_size);
+            tftp_oack_packet_t oack_packet;
+            char opcode_char[2] = {buffer[0], buffer[1]};
+            answered = chrono::steady_clock::now();
+            is_answered = bytes_rx >= 2 && chars_to_short(opcode_char) == OACK_OPCODE &&
+                          deserialize_packet_struct(&oack_packet, buffer, bytes_rx) == PACKET_OK_CODE;
+            passed = is_answered && oack_packet.options.option_resume && oack_packet.options.resume_bytes == 0;
+            continue;
+        }
+
+        int bytes_rx = recvfrom(session.socket, buffer, BENCH_MAX_DATAGRAM, 0, (struct sockaddr *)&from_address, &from_size);
+        if (bytes_rx < 0 || (session.tid_known && from_address.sin_port != session.server_address.sin_port)){
+            continue;
+        }
+        buffer[bytes_rx] = '\0';
+        session.server_address.sin_port = from_address.sin_port;
+        session.tid_known = true;
+
+        block_index_t block_index = session.block_index;
+        session_receive(&session, &bench_case, NULL, buffer, bytes_rx);
+        if (session.block_index != block_index){
+            auto now = chrono::steady_clock::now();
+            if (is_requested){
+                longest_wait_ms = max(longest_wait_ms, (long)chrono::duration_cast<chrono::milliseconds>(now - last_data).count());
+            }
+            last_data = now;
+            is_finished = is_answered;
+        }
+
+        if (!is_requested && session.block_index >= BENCH_CHECK_RESUME_BLOCK){
+            resumed.socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            resumed.server_address = session.server_address;
+            resumed.server_address.sin_port = htons(settings->port);
+            session_send(&resumed, serialize_packet_struct(&request));
+            is_requested = true;
+            requested = chrono::steady_clock::now();
+        }
+    }
+
+    if (is_answered){
+        cerr << "CHECK resume_stall: prefix verified in " << chrono::duration_cast<chrono::milliseconds>(answered - requested).count()
+             << " ms, the longest wait for Data " << longest_wait_ms << " ms\n";
+    }
+    passed &= is_finished && !session.failed && longest_wait_ms < BENCH_CHECK_STALL_MS;
+
+    close(session.socket);
+    if (resumed.socket >= 0){
+        close(resumed.socket);
+    }
+    server_stop(server_pid, &result);
+    remove(path.c_str());
+    return passed;
+}
+
+
+/**
+ * @brief Writes the result of the case as a JSON object
+ */
+static void print_result(bench_case_t *bench_case, bench_result_t *result, bool is_first){
+    double goodput = result->seconds > 0 ? result->bytes / result->seconds / 1e6 : 0;
+    cout << (is_first ? "" : ",\n") << fixed << setprecision(6)
+         << "    {\"op\": \"" << bench_case->operation << "\", \"mode\": \"" << bench_case->mode << "\""
+         << ", \"file_size\": " << bench_case->file_size << ", \"blksize\": " << bench_case->blocksize << ", \"sessions\": " << bench_case->sessions
+         << ", \"completed\": " << result->completed << ", \"failed\": " << result->failed << ", \"mismatched\": " << result->mismatched
+         << ", \"retransmissions\": " << result->retransmissions
+         << ", \"bytes\": " << result->bytes << ", \"seconds\": " << result->seconds << ", \"goodput_mb_s\": " << setprecision(3) << goodput
+         << ", \"ttfb_p50_us\": " << setprecision(0) << result->ttfb_p50_us << ", \"ttfb_p99_us\": " << result->ttfb_p99_us
+         << ", \"server_cpu_s\": " << setprecision(6) << result->server_cpu_s << ", \"client_cpu_s\": " << result->client_cpu_s
+         << ", \"server_peak_rss_kb\": " << result->server_peak_rss_kb << "}" << flush;
+
+    cerr << fixed << bench_case->operation << " " << bench_case->mode << " size=" << bench_case->file_size << " blksize=" << bench_case->blocksize
+         << " sessions=" << bench_case->sessions << " goodput=" << setprecision(1) << goodput << "MB/s ttfb_p50=" << setprecision(0) << result->ttfb_p50_us
+         << "us failed=" << result->failed << " mismatched=" << result->mismatched << "\n";
+}
+
+
+int main(int argc, char *argv[]){
+    bench_settings_t settings;
+    check_program_args(argc, argv, &settings);
+
+    //every session and every session of the server has its own socket
+    struct rlimit files_limit;
+    getrlimit(RLIMIT_NOFILE, &files_limit);
+    files_limit.rlim_cur = files_limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &files_limit);
+
+    //exited child processes of the forking server are reaped (and accounted) by the benchmark
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+    char root_template[] = "/tmp/tftp-bench-XXXXXX";
+    if (mkdtemp(root_template) == NULL){
+        cerr << "ERROR: mkdtemp - creating the root directory\n";
+        return PROG_RET_CODE_ERR;
+    }
+    string root_dirpath = root_template;
+
+    cout << "{\n  \"server\": \"" << settings.server_path << "\",\n  \"server_args\": [";
+    for (size_t i = 0; i < settings.server_args.size(); i++){
+        cout << (i ? ", " : "") << "\"" << settings.server_args[i] << "\"";
+    }
+    cout << "],\n";
+
+    if (settings.check){
+        vector<pair<string, bool>> checks;
+        checks.push_back({"truncated_file", check_truncated_file(&settings, root_dirpath)});
+        checks.push_back({"segmented_download", check_segmented_download(&settings, root_dirpath)});
+        checks.push_back({"resume_stall", check_resume_stall(&settings, root_dirpath)});
+
+        bool passed = true;
+        cout << "  \"checks\": [\n";
+        for (size_t i = 0; i < checks.size(); i++){
+            cout << "    {\"name\": \"" << checks[i].first << "\", \"passed\": " << (checks[i].second ? "true" : "false") << "}"
+                 << (i + 1 < checks.size() ? ",\n" : "\n");
+            cerr << "CHECK " << checks[i].first << " " << (checks[i].second ? "passed" : "FAILED") << "\n";
+            passed &= checks[i].second;
+        }
+        cout << "  ]\n}\n";
+        rmdir(root_dirpath.c_str());
+        return passed ? PROG_RET_CODE_OK : PROG_RET_CODE_ERR;
+    }
+
+    cout << "  \"results\": [\n";
+
+    bool is_first = true;
+    int case_number = 0;
+    for (unsigned long long file_size : settings.file_sizes){
+        //files of the size exist only while they are tested
+        for (string &mode : settings.modes){
+            string path = root_dirpath + "/bench-" + to_string(file_size) + (mode == MODE_NETASCII ? ".txt" : ".bin");
+            if (!generate_file(path, file_size, mode == MODE_NETASCII)){
+                cerr << "ERROR: generating the file " << path << "\n";
+                return PROG_RET_CODE_ERR;
+            }
+        }
+
+        for (string &operation : settings.operations)
+        for (string &mode : settings.modes)
+        for (unsigned int blocksize : settings.blocksizes)
+        for (unsigned int sessions : settings.sessions){
+            if (file_size * sessions > settings.case_limit){
+                continue;
+            }
+
+            bench_case_t bench_case = {operation, mode, file_size, blocksize, sessions};
+            bench_result_t result = run_case(&settings, &bench_case, root_dirpath, case_number++);
+            print_result(&bench_case, &result, is_first);
+            is_first = false;
+        }
+
+        for (string &mode : settings.modes){
+            remove((root_dirpath + "/bench-" + to_string(file_size) + (mode == MODE_NETASCII ? ".txt" : ".bin")).c_str());
+        }
+    }
+
+    cout << "\n  ]\n}\n";
+    rmdir(root_dirpath.c_str());
+    return PROG_RET_CODE_OK;
+}
@@ -0,0 +1,585 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-impair.cpp
+ * @brief UDP impairment proxy placed between the client and the server (loss, delay, jitter, duplication and reordering)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <string>
+#include <vector>
+#include "tftp-packet-structures.hpp"
+
+using namespace std;
+
+#define IMPAIR_DEFAULT_PORT 6969
+#define IMPAIR_MAX_DATAGRAM 65535
+#define IMPAIR_FLOW_IDLE_S 10               //flow is reported and closed, when no packet passes for this long
+#define IMPAIR_REORDER_DELAY_MS 10          //reordered packet is held back by this time (passed by the following ones)
+
+typedef chrono::steady_clock::time_point impair_time_t;
+
+
+//Direction of the forwarded packet
+enum impair_direction{
+    TO_SERVER,
+    TO_CLIENT
+};
+
+
+//Structure containing the impairment settings
+typedef struct impair_settings {
+    int listen_port = IMPAIR_DEFAULT_PORT;
+    struct sockaddr_in server_address;          //listening address of the server
+    double loss = 0;                            //probabilities in percents
+    double duplication = 0;
+    double reorder = 0;
+    unsigned int delay_ms = 0;
+    unsigned int jitter_ms = 0;
+    unsigned long seed = 1;
+    bool impair_to_server = true;
+    bool impair_to_client = true;
+} impair_settings_t;
+
+
+//Statistics of one direction of the flow
+typedef struct impair_direction_stats {
+    unsigned long packets = 0;                  //received by the proxy
+    unsigned long dropped = 0;
+    unsigned long duplicated = 0;
+    unsigned long reordered = 0;
+    unsigned long data_blocks = 0;              //new Data blocks
+    unsigned long data_retransmitted = 0;       //Data blocks sent again
+    unsigned long long data_bytes = 0;          //payload of the new Data blocks
+    unsigned long acks = 0;
+    unsigned long acks_duplicated = 0;          //Ack of the same block as the previous one
+    unsigned long requests = 0;                 //RRQ/WRQ (more than one is a retransmitted request)
+    block_index_t highest_block = 0;            //position of the highest Data block
+    int last_ack = -1;
+} impair_direction_stats_t;
+
+
+//Structure containing one transfer passing the proxy (client address and the server TID)
+typedef struct impair_flow {
+    struct sockaddr_in client_address;
+    struct sockaddr_in server_address;          //listening port of the server until its first response, then its TID
+    bool tid_known = false;
+    int downstream_socket;                      //talks with the client (proxy TID), created by the server response
+    int upstream_socket;                        //talks with the server
+    impair_time_t start;
+    impair_time_t last_packet;
+    impair_direction_stats_t stats[2];
+} impair_flow_t;
+
+
+//Packet waiting for the delivery
+typedef struct impair_packet {
+    impair_time_t delivery;
+    unsigned long sequence;                     //keeps order of packets with the same delivery time
+    int socket;
+    struct sockaddr_in destination;
+    string data;
+
+    bool operator>(const impair_packet &other) const{
+        return delivery != other.delivery ? delivery > other.delivery : sequence > other.sequence;
+    }
+} impair_packet_t;
+
+
+//Structure containing the proxy state
+typedef struct impair_proxy {
+    impair_settings_t settings;
+    mt19937_64 random;
+    int epoll_fd;
+    int listen_socket;
+    map<int, shared_ptr<impair_flow_t>> flows_by_socket;
+    map<pair<uint32_t, uint16_t>, shared_ptr<impair_flow_t>> flows_by_client;
+    priority_queue<impair_packet_t, vector<impair_packet_t>, greater<impair_packet_t>> pending;
+    unsigned long sequence = 0;
+    impair_direction_stats_t total[2];
+    unsigned long flows_finished = 0;
+} impair_proxy_t;
+
+
+static volatile sig_atomic_t interrupted = 0;
+
+
+/**
+ * @brief Handles interrupt signal (ctrl+c), statistics are reported by the main loop
+ */
+static void interrupt_signal_handler(int signum){
+    (void)signum;
+    interrupted = 1;
+}
+
+
+/**
+ * @brief Prints help and exits
+ */
+static void print_help(){
+    cout << "Usage: tftp-impair -s server[:port] [-l port] [--loss P] [--delay MS] [--jitter MS] [--dup P] [--reorder P]\n"
+         << "                   [--seed N] [--dir both|to-server|to-client]\n\n"
+         << "  -s <HOST[:PORT]>\tserver, that the requests are forwarded to (default port 69)\n"
+         << "  -l <PORT>\t\tport, where the proxy receives requests of the clients (default " << IMPAIR_DEFAULT_PORT << ")\n"
+         << "  --loss <P>\t\tprobability of dropping the packet in percents\n"
+         << "  --delay <MS>\t\tdelay of every packet in milliseconds\n"
+         << "  --jitter <MS>\t\tdelay is randomly changed up to this value in both directions\n"
+         << "  --dup <P>\t\tprobability of duplicating the packet in percents\n"
+         << "  --reorder <P>\t\tprobability of holding the packet back by " << IMPAIR_REORDER_DELAY_MS << " ms (following packets pass it)\n"
+         << "  --seed <N>\t\tseed of the random decisions (same seed and traffic give the same impairments)\n"
+         << "  --dir <DIR>\t\timpaired direction (default both)\n\n"
+         << "Statistics of every transfer are written when it ends (idle for " << IMPAIR_FLOW_IDLE_S << " s) and the totals on ctrl+c.\n";
+    exit(0);
+}
+
+
+/**
+ * @brief Parses the probability in percents
+ */
+static bool parse_percent(const char *text, double *value){
+    char *end;
+    *value = strtod(text, &end);
+    return end != text && *end == '\0' && *value >= 0 && *value <= 100;
+}
+
+
+/**
+ * @brief Parses the non-negative number
+ */
+static bool parse_number(const char *text, unsigned long *value){
+    char *end;
+    *value = strtoul(text, &end, 10);
+    return end != text && *end == '\0' && text[0] != '-';
+}
+
+
+/**
+ * @brief Validates and parses given program arguments
+ *
+ * @param argc number of given arguments
+ * @param argv array of given arguments
+ * @param settings address, where the settings will be stored
+ */
+static void check_program_args(int argc, char *argv[], impair_settings_t *settings){
+    bool server_given = false;
+
+    for (int i = 1; i < argc; i++){
+        string arg = argv[i];
+        if (arg == "--help"){
+            print_help();
+        }
+        if (i + 1 >= argc){
+            cerr << "ERROR: missing value of the argument " << arg << " (see --help)\n";
+            exit(PROG_RET_CODE_ERR);
+        }
+
+        char *value = argv[++i];
+        unsigned long number = 0;
+        bool is_valid = true;
+        if (arg == "-s"){
+            string host = value;
+            string port = "69";
+            size_t colon = host.rfind(':');
+            if (colon != string::npos){
+                port = host.substr(colon + 1);
+                host = host.substr(0, colon);
+            }
+
+            struct addrinfo hints, *result;
+            memset(&hints, 0, sizeof(hints));
+            hints.ai_family = AF_INET;
+            hints.ai_socktype = SOCK_DGRAM;
+            is_valid = getaddrinfo(host.c_str(), port.c_str(), &hints, &result) == 0;
+            if (is_valid){
+                memcpy(&settings->server_address, result->ai_addr, sizeof(settings->server_address));
+                freeaddrinfo(result);
+            }
+            server_given = true;
+        }
+        else if (arg == "-l"){
+            is_valid = parse_number(value, &number) && number > 0 && number < 65536;
+            settings->listen_port = number;
+        }
+        else if (arg == "--loss"){
+            is_valid = parse_percent(value, &settings->loss);
+        }
+        else if (arg == "--dup"){
+            is_valid = parse_percent(value, &settings->duplication);
+        }
+        else if (arg == "--reorder"){
+            is_valid = parse_percent(value, &settings->reorder);
+        }
+        else if (arg == "--delay"){
+            is_valid = parse_number(value, &number);
+            settings->delay_ms = number;
+        }
+        else if (arg == "--jitter"){
+            is_valid = parse_number(value, &number);
+            settings->jitter_ms = number;
+        }
+        else if (arg == "--seed"){
+            is_valid = parse_number(value, &settings->seed);
+        }
+        else if (arg == "--dir"){
+            string direction = value;
+            is_valid = direction == "both" || direction == "to-server" || direction == "to-client";
+            settings->impair_to_server = direction != "to-client";
+            settings->impair_to_client = direction != "to-server";
+        }
+        else{
+            is_valid = false;
+        }
+
+        if (!is_valid){
+            cerr << "ERROR: invalid argument " << arg << " " << value << " (see --help)\n";
+            exit(PROG_RET_CODE_ERR);
+        }
+    }
+
+    if (!server_given){
+        cerr << "ERROR: server address (-s) is required (see --help)\n";
+        exit(PROG_RET_CODE_ERR);
+    }
+}
+
+
+/**
+ * @brief Creates the UDP socket bound to the given port (0 for an ephemeral one) and watches it by epoll
+ */
+static int create_bound_socket(impair_proxy_t *proxy, int port){
+    int new_socket = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+    if (new_socket < 0){
+        cerr << "ERROR: socket - creating the socket\n";
+        exit(PROG_RET_CODE_ERR);
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(new_socket, (struct sockaddr *)&address, sizeof(address)) < 0){
+        cerr << "ERROR: bind - binding the socket to the port " << port << "\n";
+        exit(PROG_RET_CODE_ERR);
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = new_socket;
+    epoll_ctl(proxy->epoll_fd, EPOLL_CTL_ADD, new_socket, &event);
+    return new_socket;
+}
+
+
+/**
+ * @brief Formats the address as IP:port
+ */
+static string address_to_string(struct sockaddr_in *address){
+    char ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &address->sin_addr, ip, sizeof(ip));
+    return string(ip) + ":" + to_string(ntohs(address->sin_port));
+}
+
+
+/**
+ * @brief Updates the TFTP statistics of the direction by the forwarded packet
+ */
+static void stats_count_packet(impair_direction_stats_t *stats, const string &data){
+    stats->packets++;
+    if (data.size() < 4){
+        return;
+    }
+
+    char opcode_char[2] = {data[0], data[1]};
+    char block_number_char[2] = {data[2], data[3]};
+    ushort opcode = chars_to_short(opcode_char);
+    ushort block_number = chars_to_short(block_number_char);
+
+    if (opcode == RRQ_OPCODE || opcode == WRQ_OPCODE){
+        stats->requests++;
+    }
+    else if (opcode == DATA_OPCODE){
+        block_index_t block_index = block_index_from_number(block_number, stats->highest_block, DEFAULT_ROLLOVER);
+        if (block_index > stats->highest_block){
+            stats->highest_block = block_index;
+            stats->data_blocks++;
+            stats->data_bytes += data.size() - DATA_PACKET_OFFSET;
+        }
+        else{
+            stats->data_retransmitted++;
+        }
+    }
+    else if (opcode == ACK_OPCODE){
+        stats->acks++;
+        if (stats->last_ack == block_number){
+            stats->acks_duplicated++;
+        }
+        stats->last_ack = block_number;
+    }
+}
+
+
+/**
+ * @brief Adds statistics of the flow to the totals
+ */
+static void stats_add(impair_direction_stats_t *total, impair_direction_stats_t *stats){
+    total->packets += stats->packets;
+    total->dropped += stats->dropped;
+    total->duplicated += stats->duplicated;
+    total->reordered += stats->reordered;
+    total->data_blocks += stats->data_blocks;
+    total->data_retransmitted += stats->data_retransmitted;
+    total->data_bytes += stats->data_bytes;
+    total->acks += stats->acks;
+    total->acks_duplicated += stats->acks_duplicated;
+    total->requests += stats->requests;
+}
+
+
+/**
+ * @brief Prints statistics of both directions
+ *
+ * @param label beginning of the line
+ * @param stats statistics of the directions
+ * @param seconds duration of the transfer (0 if goodput should not be printed)
+ */
+static void print_stats(string label, impair_direction_stats_t *stats, double seconds){
+    impair_direction_stats_t *up = &stats[TO_SERVER];
+    impair_direction_stats_t *down = &stats[TO_CLIENT];
+    unsigned long long data_bytes = up->data_bytes + down->data_bytes;
+
+    cout << label << fixed << setprecision(3);
+    if (seconds > 0){
+        cout << " duration=" << seconds << "s goodput=" << data_bytes / seconds / 1e6 << "MB/s";
+    }
+    cout << " data=" << up->data_blocks + down->data_blocks << " data_retransmitted=" << up->data_retransmitted + down->data_retransmitted
+         << " acks=" << up->acks + down->acks << " acks_duplicated=" << up->acks_duplicated + down->acks_duplicated
+         << " requests=" << up->requests
+         << " to_server=" << up->packets << "/" << up->dropped << "/" << up->duplicated << "/" << up->reordered
+         << " to_client=" << down->packets << "/" << down->dropped << "/" << down->duplicated << "/" << down->reordered
+         << "\n" << flush;
+}
+
+
+/**
+ * @brief Reports the flow, adds its statistics to the totals and closes its sockets
+ */
+static void flow_finish(impair_proxy_t *proxy, shared_ptr<impair_flow_t> flow){
+    double seconds = chrono::duration<double>(flow->last_packet - flow->start).count();
+    print_stats("FLOW " + address_to_string(&flow->client_address) + " server=" + address_to_string(&flow->server_address), flow->stats, seconds);
+    stats_add(&proxy->total[TO_SERVER], &flow->stats[TO_SERVER]);
+    stats_add(&proxy->total[TO_CLIENT], &flow->stats[TO_CLIENT]);
+    proxy->flows_finished++;
+
+    proxy->flows_by_client.erase({flow->client_address.sin_addr.s_addr, flow->client_address.sin_port});
+    for (int flow_socket : {flow->upstream_socket, flow->downstream_socket}){
+        if (flow_socket >= 0){
+            proxy->flows_by_socket.erase(flow_socket);
+            close(flow_socket);
+        }
+    }
+}
+
+
+/**
+ * @brief Applies the impairments to the packet and schedules its delivery (or drops it)
+ *
+ * @param proxy proxy structure
+ * @param stats statistics of the direction
+ * @param is_impaired impairments are applied in this direction
+ * @param socket socket, that the packet is sent from
+ * @param destination destination of the packet
+ * @param data packet data
+ */
+static void forward_packet(impair_proxy_t *proxy, impair_direction_stats_t *stats, bool is_impaired, int socket, struct sockaddr_in *destination, string &data){
+    impair_settings_t *settings = &proxy->settings;
+    uniform_real_distribution<double> percent(0, 100);
+    auto now = chrono::steady_clock::now();
+
+    //all random values are drawn for every packet, so the decisions depend only on the seed and the order of packets
+    bool is_dropped = percent(proxy->random) < settings->loss;
+    bool is_duplicated = percent(proxy->random) < settings->duplication;
+    bool is_reordered = percent(proxy->random) < settings->reorder;
+    long jitter_us = settings->jitter_ms == 0 ? 0 : uniform_int_distribution<long>(-(long)settings->jitter_ms * 1000, settings->jitter_ms * 1000)(proxy->random);
+
+    if (!is_impaired){
+        is_dropped = is_duplicated = is_reordered = false;
+        jitter_us = 0;
+    }
+
+    if (is_dropped){
+        stats->dropped++;
+        return;
+    }
+
+    long delay_us = is_impaired ? max(0L, (long)settings->delay_ms * 1000 + jitter_us) : 0;
+    if (is_reordered){
+        delay_us += IMPAIR_REORDER_DELAY_MS * 1000;
+        stats->reordered++;
+    }
+
+    impair_packet_t packet = {now + chrono::microseconds(delay_us), proxy->sequence++, socket, *destination, data};
+    proxy->pending.push(packet);
+    if (is_duplicated){
+        packet.sequence = proxy->sequence++;
+        proxy->pending.push(packet);
+        stats->duplicated++;
+    }
+}
+
+
+/**
+ * @brief Handles a datagram received by the proxy
+ *
+ * @param proxy proxy structure
+ * @param socket socket, that received the datagram
+ * @param buffer buffer for the datagram
+ */
+static void handle_datagram(impair_proxy_t *proxy, int socket, char *buffer){
+    struct sockaddr_in from_address;
+    socklen_t from_size = sizeof(from_address);
+    int bytes_rx = recvfrom(socket, buffer, IMPAIR_MAX_DATAGRAM, 0, (struct sockaddr *)&from_address, &from_size);
+    if (bytes_rx < 0){
+        return;
+    }
+    string data(buffer, bytes_rx);
+    auto now = chrono::steady_clock::now();
+
+    if (socket == proxy->listen_socket){
+        //request (or its retransmission) of the client
+        auto key = make_pair(from_address.sin_addr.s_addr, from_address.sin_port);
+        auto found = proxy->flows_by_client.find(key);
+        shared_ptr<impair_flow_t> flow;
+        if (found == proxy->flows_by_client.end()){
+            flow = make_shared<impair_flow_t>();
+            flow->client_address = from_address;
+            flow->server_address = proxy->settings.server_address;
+            flow->upstream_socket = create_bound_socket(proxy, 0);
+            flow->downstream_socket = -1;
+            flow->start = now;
+            proxy->flows_by_client[key] = flow;
+            proxy->flows_by_socket[flow->upstream_socket] = flow;
+        }
+        else{
+            flow = found->second;
+        }
+
+        flow->last_packet = now;
+        stats_count_packet(&flow->stats[TO_SERVER], data);
+        forward_packet(proxy, &flow->stats[TO_SERVER], proxy->settings.impair_to_server, flow->upstream_socket, &proxy->settings.server_address, data);
+        return;
+    }
+
+    auto found = proxy->flows_by_socket.find(socket);
+    if (found == proxy->flows_by_socket.end()){
+        return;
+    }
+    shared_ptr<impair_flow_t> flow = found->second;
+
+    if (socket == flow->upstream_socket){
+        //server responds from its TID, the client gets responses from the TID of the proxy
+        if (!flow->tid_known){
+            flow->server_address = from_address;
+            flow->tid_known = true;
+            flow->downstream_socket = create_bound_socket(proxy, 0);
+            proxy->flows_by_socket[flow->downstream_socket] = flow;
+        }
+        else if (from_address.sin_port != flow->server_address.sin_port){
+            return;     //other server process (duplicated request), the client would reject it
+        }
+
+        flow->last_packet = now;
+        stats_count_packet(&flow->stats[TO_CLIENT], data);
+        forward_packet(proxy, &flow->stats[TO_CLIENT], proxy->settings.impair_to_client, flow->downstream_socket, &flow->client_address, data);
+    }
+    else{
+        if (from_address.sin_port != flow->client_address.sin_port || from_address.sin_addr.s_addr != flow->client_address.sin_addr.s_addr){
+            return;
+        }
+
+        flow->last_packet = now;
+        stats_count_packet(&flow->stats[TO_SERVER], data);
+        forward_packet(proxy, &flow->stats[TO_SERVER], proxy->settings.impair_to_server, flow->upstream_socket, &flow->server_address, data);
+    }
+}
+
+
+int main(int argc, char *argv[]){
+    impair_proxy_t proxy;
+    memset(&proxy.settings.server_address, 0, sizeof(proxy.settings.server_address));
+    check_program_args(argc, argv, &proxy.settings);
+    proxy.random.seed(proxy.settings.seed);
+
+    signal(SIGINT, interrupt_signal_handler);
+    signal(SIGTERM, interrupt_signal_handler);
+
+    proxy.epoll_fd = epoll_create1(0);
+    proxy.listen_socket = create_bound_socket(&proxy, proxy.settings.listen_port);
+
+    cout << "Proxy on the port " << proxy.settings.listen_port << " -> " << address_to_string(&proxy.settings.server_address)
+         << " loss=" << proxy.settings.loss << "% delay=" << proxy.settings.delay_ms << "ms jitter=" << proxy.settings.jitter_ms
+         << "ms dup=" << proxy.settings.duplication << "% reorder=" << proxy.settings.reorder << "% seed=" << proxy.settings.seed << "\n" << flush;
+
+    char buffer[IMPAIR_MAX_DATAGRAM];
+    struct epoll_event events[64];
+
+    while (!interrupted){
+        //waiting until the next delivery at most
+        int timeout_ms = 1000;
+        if (!proxy.pending.empty()){
+            auto wait = chrono::duration_cast<chrono::microseconds>(proxy.pending.top().delivery - chrono::steady_clock::now()).count();
+            timeout_ms = max(0L, (wait + 999) / 1000);
+        }
+
+        int ready = epoll_wait(proxy.epoll_fd, events, 64, timeout_ms);
+        for (int i = 0; i < ready; i++){
+            handle_datagram(&proxy, events[i].data.fd, buffer);
+        }
+
+        auto now = chrono::steady_clock::now();
+        while (!proxy.pending.empty() && proxy.pending.top().delivery <= now){
+            const impair_packet_t &packet = proxy.pending.top();
+            sendto(packet.socket, packet.data.data(), packet.data.size(), 0, (struct sockaddr *)&packet.destination, sizeof(packet.destination));
+            proxy.pending.pop();
+        }
+
+        //ended transfers (idle time is longer than the longest delay, so no pending packet uses their sockets)
+        auto idle_time = chrono::seconds(IMPAIR_FLOW_IDLE_S) + chrono::milliseconds(proxy.settings.delay_ms + proxy.settings.jitter_ms + IMPAIR_REORDER_DELAY_MS);
+        vector<shared_ptr<impair_flow_t>> idle_flows;
+        for (auto &entry : proxy.flows_by_client){
+            if (now - entry.second->last_packet >= idle_time){
+                idle_flows.push_back(entry.second);
+            }
+        }
+        for (auto &flow : idle_flows){
+            flow_finish(&proxy, flow);
+        }
+    }
+
+    vector<shared_ptr<impair_flow_t>> flows;
+    for (auto &entry : proxy.flows_by_client){
+        flows.push_back(entry.second);
+    }
+    for (auto &flow : flows){
+        flow_finish(&proxy, flow);
+    }
+
+    print_stats("TOTAL flows=" + to_string(proxy.flows_finished), proxy.total, 0);
+    return PROG_RET_CODE_OK;
+}
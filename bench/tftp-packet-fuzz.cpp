@@ -0,0 +1,115 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-packet-fuzz.cpp
+ * @brief libFuzzer target of the packet parser (requests, Oack and Error packets), built with a random input driver
+ * when PACKET_FUZZ_STANDALONE is defined (compilers without libFuzzer)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include "tftp-packet-structures.hpp"
+
+using namespace std;
+
+
+/**
+ * @brief Checks the invariants of the parsed request, violation aborts the fuzzer
+ *
+ * @param request parsed request view
+ * @param data start of the packet
+ * @param size size of the packet in Bytes
+ */
+static void check_request(tftp_request_view_t *request, const char *data, size_t size){
+    //views have to lie inside the packet and cannot contain the terminating zero Byte
+    for (string_view field : {request->filename, request->mode}){
+        if (field.data() < data || field.data() + field.size() > data + size || field.find('\x00') != string_view::npos){
+            abort();
+        }
+    }
+
+    int options_number = 0;
+    for (int i = 0; i < SUPPORTED_OPTIONS_NUMBER; i++){
+        options_number += request->options.option_order[i] != NONE;
+    }
+    if (options_number != request->options.option_blocksize + request->options.option_transfer_size +
+                          request->options.option_timeout_interval + request->options.option_utimeout_interval +
+                          request->options.option_window_size + request->options.option_rollover + request->options.option_multicast +
+                          request->options.option_offset + request->options.option_length + request->options.option_resume){
+        abort();
+    }
+}
+
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size){
+    //copy without any Bytes behind the packet, so reading behind it is detected by AddressSanitizer
+    unique_ptr<char[]> packet(new char[size]);
+    memcpy(packet.get(), data, size);
+
+    tftp_request_view_t request;
+    if (parse_request(packet.get(), size, &request) == PACKET_OK_CODE){
+        check_request(&request, packet.get(), size);
+    }
+
+    tftp_rrq_wrq_packet_t request_struct;
+    deserialize_packet_struct(&request_struct, packet.get(), size);
+
+    tftp_oack_packet_t oack_struct;
+    deserialize_packet_struct(&oack_struct, packet.get(), size);
+
+    tftp_error_packet_t error_struct;
+    deserialize_packet_struct(&error_struct, packet.get(), size);
+
+    string error_message;
+    if (deserialize_packet_struct(&request_struct, packet.get(), size) == PACKET_OK_CODE){
+        check_packet_content(&request_struct, &error_message);
+    }
+
+    return 0;
+}
+
+
+#ifdef PACKET_FUZZ_STANDALONE
+#define FUZZ_SEED(literal) string(literal, sizeof(literal) - 1)
+
+/**
+ * @brief Feeds random mutations of valid packets to the target
+ */
+int main(int argc, char *argv[]){
+    unsigned long iterations = argc > 1 ? stoul(argv[1]) : 1000000;
+    mt19937_64 generator(1);
+
+    const string seeds[] = {
+        FUZZ_SEED("\x00\x01" "file\x00" "octet\x00" "blksize\x00" "1428\x00" "tsize\x00" "0\x00" "offset\x00" "1048576\x00" "length\x00" "0\x00"),
+        FUZZ_SEED("\x00\x02" "dir/file.bin\x00" "NetAscii\x00" "windowsize\x00" "16\x00" "rollover\x00" "1\x00" "resume\x00" "1048576,2793167444\x00"),
+        FUZZ_SEED("\x00\x06" "blksize\x00" "512\x00" "timeout\x00" "5\x00" "multicast\x00" "239.255.0.1,1758,1\x00"),
+        FUZZ_SEED("\x00\x05\x00\x01" "File not found\x00"),
+    };
+
+    for (unsigned long i = 0; i < iterations; i++){
+        string packet = seeds[generator() % 4];
+
+        int mutations = 1 + generator() % 8;
+        for (int j = 0; j < mutations; j++){
+            size_t position = packet.empty() ? 0 : generator() % packet.size();
+            switch (generator() % 5){
+                case 0: if (!packet.empty()) packet[position] = generator(); break;
+                case 1: if (!packet.empty()) packet[position] = '\x00'; break;
+                case 2: packet.insert(position, 1, (char)generator()); break;
+                case 3: if (!packet.empty()) packet.erase(position, 1 + generator() % 8); break;
+                case 4: packet.resize(generator() % (packet.size() + 1)); break;
+            }
+        }
+
+        LLVMFuzzerTestOneInput((const uint8_t *)packet.data(), packet.size());
+    }
+
+    cout << "iterations=" << iterations << " OK\n";
+    return 0;
+}
+#endif
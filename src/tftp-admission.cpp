@@ -0,0 +1,142 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-admission.cpp
+ * @brief Admission control of the requests (table of the sessions by the client address and port, limit of the sessions
+ * and token bucket of the requests of every client address), shared by the worker threads
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <pthread.h>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <unordered_set>
+#include "tftp-admission.hpp"
+#include "tftp-metrics.hpp"
+
+
+typedef chrono::steady_clock::time_point admission_time_t;
+
+
+//Token bucket of the requests of one client address
+typedef struct admission_bucket {
+    double tokens;
+    admission_time_t updated;                   //time the tokens were last added
+} admission_bucket_t;
+
+
+static pthread_mutex_t admission_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int max_sessions = 0;           //sessions in progress at once (0 if not limited)
+static double bucket_rate = 0;                  //tokens added per second (0 if the requests are not limited)
+static double bucket_size = 0;
+static unordered_set<unsigned long long> sessions;                 //sessions in progress by the client address and port
+static unordered_map<unsigned int, admission_bucket_t> buckets;     //buckets by the client address
+
+
+/**
+ * @brief Creates the key of the session table
+ *
+ * @param client_address address and port of the client
+ * @return address and port in one number
+ */
+static inline unsigned long long admission_key(const struct sockaddr_in *client_address){
+    return ((unsigned long long)client_address->sin_addr.s_addr << 16) | client_address->sin_port;
+}
+
+
+/**
+ * @brief Adds the tokens for the time since the last update of the bucket
+ *
+ * @param bucket token bucket
+ * @param now current time
+ */
+static void admission_refill(admission_bucket_t *bucket, admission_time_t now){
+    double elapsed_s = chrono::duration<double>(now - bucket->updated).count();
+    bucket->tokens = min(bucket_size, bucket->tokens + elapsed_s * bucket_rate);
+    bucket->updated = now;
+}
+
+
+/**
+ * @brief Takes a token from the bucket of the client address, new address gets a full bucket
+ *
+ * @param address client address
+ * @return true if the request is admitted, false if the bucket is empty or there is no room for a new bucket
+ */
+static bool admission_take_token(unsigned int address){
+    admission_time_t now = chrono::steady_clock::now();
+
+    auto found = buckets.find(address);
+    if (found == buckets.end()){
+        //buckets filled up again are the same as new ones, so they are dropped to make room
+        if (buckets.size() >= ADMISSION_MAX_BUCKETS){
+            for (auto it = buckets.begin(); it != buckets.end();){
+                admission_refill(&it->second, now);
+                it = it->second.tokens >= bucket_size ? buckets.erase(it) : next(it);
+            }
+            if (buckets.size() >= ADMISSION_MAX_BUCKETS){
+                return false;
+            }
+        }
+        found = buckets.emplace(address, admission_bucket_t{bucket_size, now}).first;
+    }
+
+    admission_bucket_t *bucket = &found->second;
+    admission_refill(bucket, now);
+    if (bucket->tokens < 1){
+        return false;
+    }
+    bucket->tokens -= 1;
+    return true;
+}
+
+
+void admission_init(unsigned int sessions_limit, double rate, double burst){
+    pthread_mutex_lock(&admission_lock);
+    max_sessions = sessions_limit;
+    bucket_rate = rate;
+    bucket_size = max(burst, 1.0);
+    pthread_mutex_unlock(&admission_lock);
+}
+
+
+admission_result_t admission_request(const struct sockaddr_in *client_address){
+    admission_result_t result = ADMISSION_ACCEPTED;
+    unsigned long long key = admission_key(client_address);
+
+    pthread_mutex_lock(&admission_lock);
+    if (sessions.count(key) != 0){
+        result = ADMISSION_DUPLICATE;
+    }
+    else if (max_sessions != 0 && sessions.size() >= max_sessions){
+        result = ADMISSION_SESSIONS_LIMIT;
+    }
+    else if (bucket_rate > 0 && !admission_take_token(client_address->sin_addr.s_addr)){
+        result = ADMISSION_RATE_LIMIT;
+    }
+    else{
+        sessions.insert(key);
+    }
+    pthread_mutex_unlock(&admission_lock);
+
+    if (result != ADMISSION_ACCEPTED){
+        metrics_count_request_dropped(result);
+    }
+    return result;
+}
+
+
+void admission_session_end(const struct sockaddr_in *client_address){
+    pthread_mutex_lock(&admission_lock);
+    sessions.erase(admission_key(client_address));
+    pthread_mutex_unlock(&admission_lock);
+}
+
+
+string admission_error_message(admission_result_t result){
+    if (result == ADMISSION_RATE_LIMIT){
+        return "Server busy - too many requests from the address";
+    }
+    return "Server busy - too many sessions";
+}
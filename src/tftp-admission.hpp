@@ -0,0 +1,67 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-admission.hpp
+ * @brief Admission control of the requests (table of the sessions by the client address and port, limit of the sessions
+ * and token bucket of the requests of every client address), shared by the worker threads
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_ADMISSION_HPP
+#define TFTP_ADMISSION_HPP
+
+#include <arpa/inet.h>
+#include <string>
+
+using namespace std;
+
+#define ADMISSION_MAX_BUCKETS 65536         //addresses with own token bucket, buckets filled up again are dropped first
+
+
+//Result of the request, drop reasons are counted by the metrics in this order
+typedef enum admission_result {
+    ADMISSION_DUPLICATE,                    //request of the session in progress (retransmitted by the client), it is dropped
+    ADMISSION_SESSIONS_LIMIT,               //all sessions are in use, "server busy" is answered
+    ADMISSION_RATE_LIMIT,                   //bucket of the client address is empty, "server busy" is answered
+    ADMISSION_ACCEPTED
+} admission_result_t;
+
+
+/**
+ * @brief Sets the limits, has to be called before creating worker threads. Without it the number of sessions
+ * is not limited and the requests are not limited by their address.
+ *
+ * @param max_sessions maximal number of sessions in progress at once (0 if not limited)
+ * @param rate requests per second admitted from one client address (0 if not limited)
+ * @param burst requests admitted from one client address at once (size of the bucket)
+ */
+void admission_init(unsigned int max_sessions, double rate, double burst);
+
+
+/**
+ * @brief Decides about the received request, the accepted request is recorded as a session in progress
+ * until admission_session_end is called with its address
+ *
+ * @param client_address address and port of the client
+ * @return ADMISSION_ACCEPTED if the session should be created, else the reason of the drop
+ */
+admission_result_t admission_request(const struct sockaddr_in *client_address);
+
+
+/**
+ * @brief Ends the session of the client address and port, its next request is admitted again
+ *
+ * @param client_address address and port of the client
+ */
+void admission_session_end(const struct sockaddr_in *client_address);
+
+
+/**
+ * @brief Gets the message of the Error packet answering the request over the limit
+ *
+ * @param result result of the request (ADMISSION_SESSIONS_LIMIT or ADMISSION_RATE_LIMIT)
+ * @return error message
+ */
+string admission_error_message(admission_result_t result);
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-batch-io.cpp
+ * @brief Batched datagram I/O (recvmmsg, sendmmsg) and statistics of the I/O system calls
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <errno.h>
+#include <iomanip>
+#include "tftp-batch-io.hpp"
+#include "tftp-metrics.hpp"
+#include "tftp-log.hpp"
+#include "tftp-shaper.hpp"
+
+
+thread_local io_stats_t io_statistics;
+
+
+io_stats_t *get_io_stats(){
+    return &io_statistics;
+}
+
+int send_packet(connection_info_t *connection_information, const string &packet){
+    io_statistics.send_syscalls++;
+
+    int bytes_tx = sendto(connection_information->socket, packet.c_str(), packet.size(), 0,
+                          connection_information->address, connection_information->address_size);
+    if (bytes_tx >= 0){
+        io_statistics.packets_sent++;
+        metrics_count_sent(1, bytes_tx);
+    }
+    return bytes_tx;
+}
+
+/**
+ * @brief Sends prepared messages, sendmmsg may send only a part of them, rest is sent by the next call
+ *
+ * @param socket socket to send from
+ * @param messages prepared messages
+ * @param messages_number number of the messages
+ * @return number of sent messages
+ */
+static int send_messages(int socket, struct mmsghdr *messages, unsigned int messages_number){
+    unsigned int sent_batch = 0;
+    while (sent_batch < messages_number){
+        io_statistics.send_syscalls++;
+        int sent = sendmmsg(socket, &messages[sent_batch], messages_number - sent_batch, 0);
+        if (sent <= 0){
+            int error_number = errno;       //reason of the failure is kept for the caller
+            cout << "ERROR: sendmmsg - sending data\n";
+            errno = error_number;
+            break;
+        }
+        unsigned long long bytes = 0;
+        for (int i = 0; i < sent; i++){
+            bytes += messages[sent_batch + i].msg_len;
+        }
+        metrics_count_sent(sent, bytes);
+
+        sent_batch += sent;
+        io_statistics.packets_sent += sent;
+    }
+    return sent_batch;
+}
+
+int send_packets(connection_info_t *connection_information, const deque<string> &packets, size_t first_index){
+    struct mmsghdr messages[IO_BATCH_SIZE];
+    struct iovec iovecs[IO_BATCH_SIZE];
+    int sent_total = 0;
+
+    while (first_index < packets.size()){
+        unsigned int messages_number = 0;
+
+        for (; first_index < packets.size() && messages_number < IO_BATCH_SIZE; first_index++, messages_number++){
+            iovecs[messages_number].iov_base = (void *)packets[first_index].c_str();
+            iovecs[messages_number].iov_len = packets[first_index].size();
+
+            memset(&messages[messages_number], 0, sizeof(struct mmsghdr));
+            messages[messages_number].msg_hdr.msg_name = connection_information->address;
+            messages[messages_number].msg_hdr.msg_namelen = connection_information->address_size;
+            messages[messages_number].msg_hdr.msg_iov = &iovecs[messages_number];
+            messages[messages_number].msg_hdr.msg_iovlen = 1;
+        }
+
+        int sent = send_messages(connection_information->socket, messages, messages_number);
+        sent_total += sent;
+        if (sent < (int)messages_number){
+            return sent_total;
+        }
+    }
+
+    return sent_total;
+}
+
+int send_data_blocks(connection_info_t *connection_information, data_window_t *window, unsigned int first_index){
+    struct mmsghdr messages[IO_BATCH_SIZE];
+    struct iovec iovecs[IO_BATCH_SIZE][2];
+    int sent_total = 0;
+
+    while (first_index < window->count){
+        unsigned int messages_number = 0;
+
+        for (; first_index < window->count && messages_number < IO_BATCH_SIZE; first_index++, messages_number++){
+            data_block_t *block = data_window_at(window, first_index);
+            iovecs[messages_number][0].iov_base = block->header;
+            iovecs[messages_number][0].iov_len = DATA_PACKET_OFFSET;
+            iovecs[messages_number][1].iov_base = block->payload;
+            iovecs[messages_number][1].iov_len = block->payload_size;
+
+            memset(&messages[messages_number], 0, sizeof(struct mmsghdr));
+            messages[messages_number].msg_hdr.msg_name = connection_information->address;
+            messages[messages_number].msg_hdr.msg_namelen = connection_information->address_size;
+            messages[messages_number].msg_hdr.msg_iov = iovecs[messages_number];
+            messages[messages_number].msg_hdr.msg_iovlen = 2;
+        }
+
+        int sent = send_messages(connection_information->socket, messages, messages_number);
+        sent_total += sent;
+
+        //sent Data (also retransmitted) take the tokens of the bandwidth limits
+        if (connection_information->shaper != NULL){
+            unsigned long long sent_bytes = 0;
+            for (int i = 0; i < sent; i++){
+                sent_bytes += iovecs[i][0].iov_len + iovecs[i][1].iov_len;
+            }
+            shaper_charge(connection_information->shaper, sent_bytes);
+        }
+
+        if (sent < (int)messages_number){
+            window->is_failed = errno == EFAULT;        //payload of the mapped file is not readable
+            return sent_total;
+        }
+    }
+
+    return sent_total;
+}
+
+void receive_batch_prepare(receive_batch_t *batch, unsigned int datagram_size){
+    unsigned int slot_size = datagram_size + IO_BATCH_PADDING;
+
+    batch->received = 0;
+    batch->next = 0;
+    if (batch->slot_size == slot_size){
+        return;
+    }
+
+    //whole batch has to fit into the memory limit (at least one datagram)
+    batch->slot_size = slot_size;
+    batch->slots_number = max(1u, min((unsigned int)IO_BATCH_SIZE, IO_BATCH_MEMORY / slot_size));
+    batch->storage.assign((size_t)batch->slot_size * batch->slots_number, 0);
+
+    for (unsigned int i = 0; i < batch->slots_number; i++){
+        batch->iovecs[i].iov_base = &batch->storage[(size_t)i * batch->slot_size];
+        batch->iovecs[i].iov_len = datagram_size;
+    }
+}
+
+int receive_batch_fill(receive_batch_t *batch, int socket, int flags){
+    for (unsigned int i = 0; i < batch->slots_number; i++){
+        memset(&batch->messages[i], 0, sizeof(struct mmsghdr));
+        batch->messages[i].msg_hdr.msg_name = &batch->addresses[i];
+        batch->messages[i].msg_hdr.msg_namelen = sizeof(batch->addresses[i]);
+        batch->messages[i].msg_hdr.msg_iov = &batch->iovecs[i];
+        batch->messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    io_statistics.receive_syscalls++;
+    int received = recvmmsg(socket, batch->messages, batch->slots_number, flags, NULL);
+
+    batch->next = 0;
+    batch->received = received > 0 ? received : 0;
+    io_statistics.packets_received += batch->received;
+
+    //terminating every datagram by zero Bytes, packet parsing relies on them
+    unsigned long long bytes = 0;
+    for (int i = 0; i < batch->received; i++){
+        memset((char *)batch->iovecs[i].iov_base + batch->messages[i].msg_len, 0, IO_BATCH_PADDING);
+        bytes += batch->messages[i].msg_len;
+    }
+    metrics_count_received(batch->received, bytes);
+
+    return received;
+}
+
+char *receive_batch_next(receive_batch_t *batch, int *bytes_rx, struct sockaddr_in *address){
+    if (batch->next >= batch->received){
+        return NULL;
+    }
+
+    int index = batch->next++;
+    *(bytes_rx) = batch->messages[index].msg_len;
+    *(address) = batch->addresses[index];
+    return (char *)batch->iovecs[index].iov_base;
+}
+
+void log_io_stats(io_stats_t *stats){
+    log_flush();        //summary follows the logged packets
+
+    unsigned long packets = stats->packets_sent + stats->packets_received;
+    unsigned long syscalls = stats->send_syscalls + stats->receive_syscalls + stats->wait_syscalls;
+
+    cerr << "IO sent=" << stats->packets_sent << "/" << stats->send_syscalls
+        << " received=" << stats->packets_received << "/" << stats->receive_syscalls
+        << " waits=" << stats->wait_syscalls
+        << " syscalls_per_packet=" << fixed << setprecision(3) << (packets ? (double)syscalls / packets : 0.0)
+        << defaultfloat << "\n";
+}
@@ -0,0 +1,124 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-batch-io.hpp
+ * @brief Batched datagram I/O (recvmmsg, sendmmsg) and statistics of the I/O system calls
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_BATCH_IO_HPP
+#define TFTP_BATCH_IO_HPP
+
+#include <sys/socket.h>
+#include <vector>
+#include "tftp-communication.hpp"
+
+#define IO_BATCH_SIZE 64
+#define IO_BATCH_MEMORY (1024 * 1024)
+#define IO_BATCH_PADDING 4        //zero Bytes placed behind every received datagram (string terminators)
+
+
+//Structure containing statistics of the datagram I/O (per thread)
+typedef struct io_stats {
+    unsigned long packets_sent = 0;
+    unsigned long send_syscalls = 0;
+    unsigned long packets_received = 0;
+    unsigned long receive_syscalls = 0;
+    unsigned long wait_syscalls = 0;            //select and epoll_wait calls
+} io_stats_t;
+
+
+//Structure containing datagrams received by one recvmmsg call, that were not processed yet
+typedef struct receive_batch {
+    vector<char> storage;
+    unsigned int slot_size = 0;                 //space for one datagram (with padding)
+    unsigned int slots_number = 0;
+    struct mmsghdr messages[IO_BATCH_SIZE];
+    struct iovec iovecs[IO_BATCH_SIZE];
+    struct sockaddr_in addresses[IO_BATCH_SIZE];
+    int received = 0;                           //number of datagrams in the batch
+    int next = 0;                               //index of the next datagram to be processed
+} receive_batch_t;
+
+
+/**
+ * @brief Gets I/O statistics of the current thread
+ *
+ * @return address of the statistics structure
+ */
+io_stats_t *get_io_stats();
+
+
+/**
+ * @brief Sends a single packet and counts it into the statistics
+ *
+ * @param connection_information connection information
+ * @param packet stream of bytes to be sent
+ * @return number of sent Bytes or -1 when an error occurs
+ */
+int send_packet(connection_info_t *connection_information, const string &packet);
+
+
+/**
+ * @brief Sends packets from the given index to the end of the queue with as few sendmmsg calls as possible
+ *
+ * @param connection_information connection information
+ * @param packets queue of packets
+ * @param first_index index of the first packet to be sent
+ * @return number of sent packets
+ */
+int send_packets(connection_info_t *connection_information, const deque<string> &packets, size_t first_index = 0);
+
+
+/**
+ * @brief Sends Data blocks of the window from the given index with as few sendmmsg calls as possible
+ * (header and payload of every block are passed as two iovecs, payload is not copied), sent Bytes are charged
+ * to the bandwidth shaping of the connection. Window is failed, when a payload can't be read (mapped file was truncated).
+ *
+ * @param connection_information connection information
+ * @param window window of the blocks in flight
+ * @param first_index position of the first block to be sent
+ * @return number of sent packets
+ */
+int send_data_blocks(connection_info_t *connection_information, data_window_t *window, unsigned int first_index = 0);
+
+
+/**
+ * @brief Prepares the batch for datagrams of given maximal size (drops not processed datagrams)
+ *
+ * @param batch batch structure
+ * @param datagram_size maximal size of a datagram
+ */
+void receive_batch_prepare(receive_batch_t *batch, unsigned int datagram_size);
+
+
+/**
+ * @brief Receives all waiting datagrams (up to the batch capacity) by one recvmmsg call
+ *
+ * @param batch prepared batch structure
+ * @param socket socket to receive from
+ * @param flags recvmmsg flags
+ * @return number of received datagrams or -1 when an error occurs
+ */
+int receive_batch_fill(receive_batch_t *batch, int socket, int flags);
+
+
+/**
+ * @brief Takes the next not processed datagram from the batch (datagram is followed by zero padding)
+ *
+ * @param batch batch structure
+ * @param bytes_rx address, where size of the datagram will be stored
+ * @param address address, where source address of the datagram will be stored
+ * @return address of the datagram or NULL if the batch is empty
+ */
+char *receive_batch_next(receive_batch_t *batch, int *bytes_rx, struct sockaddr_in *address);
+
+
+/**
+ * @brief Writes I/O statistics (number of packets and system calls) on standard error stream
+ *
+ * @param stats statistics structure
+ */
+void log_io_stats(io_stats_t *stats);
+
+#endif
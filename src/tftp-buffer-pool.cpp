@@ -0,0 +1,208 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-buffer-pool.cpp
+ * @brief Pool of the session buffers (receive and send arena per session, reused by all blocks of the transfer
+ * and by the next sessions) and accounting of their memory shared by all processes of the server
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <iostream>
+#include <new>
+#include <vector>
+#include "tftp-buffer-pool.hpp"
+#include "tftp-batch-io.hpp"
+#include "tftp-log.hpp"
+
+
+static buffer_pool_usage_t local_usage;
+static buffer_pool_usage_t *usage = &local_usage;      //shared memory after buffer_pool_init
+
+static vector<char *> free_arenas[BUFFER_POOL_CLASSES];     //arenas returned by the ended sessions by their size class
+static size_t cached_bytes = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+int buffer_pool_init(unsigned long long limit){
+    void *memory = mmap(NULL, sizeof(buffer_pool_usage_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED){
+        cout << "ERROR: mmap - buffer pool\n";
+        return PROG_RET_CODE_ERR;
+    }
+
+    usage = new (memory) buffer_pool_usage_t();
+    usage->limit = limit;
+
+    return PROG_RET_CODE_OK;
+}
+
+
+/**
+ * @brief Gets the size class of the arena
+ *
+ * @param size needed size in Bytes
+ * @return index of the class (size of the arena is BUFFER_POOL_MIN_ARENA << class)
+ */
+static int arena_class(size_t size){
+    int size_class = 0;
+    while (((size_t)BUFFER_POOL_MIN_ARENA << size_class) < size){
+        size_class++;
+    }
+    return size_class;
+}
+
+
+/**
+ * @brief Takes a free arena of the class from the pool or allocates a new one
+ *
+ * @param size_class size class of the arena
+ * @return arena or NULL if the memory can't be allocated
+ */
+static char *arena_take(int size_class){
+    pthread_mutex_lock(&pool_lock);
+    if (!free_arenas[size_class].empty()){
+        char *arena = free_arenas[size_class].back();
+        free_arenas[size_class].pop_back();
+        cached_bytes -= (size_t)BUFFER_POOL_MIN_ARENA << size_class;
+        pthread_mutex_unlock(&pool_lock);
+        return arena;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    return new (nothrow) char[(size_t)BUFFER_POOL_MIN_ARENA << size_class];
+}
+
+
+/**
+ * @brief Returns the arena into the pool, it's freed when the pool already keeps enough memory
+ *
+ * @param arena arena to be returned (NULL is ignored)
+ * @param capacity size of the arena in Bytes
+ */
+static void arena_return(char *arena, size_t capacity){
+    if (arena == NULL){
+        return;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    if (cached_bytes + capacity <= BUFFER_POOL_CACHE_SIZE){
+        free_arenas[arena_class(capacity)].push_back(arena);
+        cached_bytes += capacity;
+        arena = NULL;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    delete[] arena;
+}
+
+
+/**
+ * @brief Counts the change of the memory held by the sessions, growth is refused over the limit
+ *
+ * @param difference change of the memory in Bytes
+ * @return true if OK, false if the limit would be exceeded
+ */
+static bool usage_reserve(long long difference){
+    unsigned long long bytes = __atomic_add_fetch(&usage->bytes, (unsigned long long)difference, __ATOMIC_RELAXED);
+    if (difference <= 0){
+        return true;
+    }
+
+    if (usage->limit > 0 && bytes > usage->limit){
+        __atomic_sub_fetch(&usage->bytes, (unsigned long long)difference, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&usage->refused, 1, __ATOMIC_RELAXED);
+        return false;
+    }
+
+    unsigned long long peak = __atomic_load_n(&usage->bytes_peak, __ATOMIC_RELAXED);
+    while (bytes > peak && !__atomic_compare_exchange_n(&usage->bytes_peak, &peak, bytes, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return true;
+}
+
+
+bool buffer_pool_acquire(session_buffers_t *buffers, size_t receive_size, size_t send_size){
+    //received datagram is followed by zero Bytes (string terminators), as in the receive batch
+    size_t receive_needed = receive_size > 0 ? receive_size + IO_BATCH_PADDING : 0;
+    int receive_class = arena_class(receive_needed);
+    int send_class = arena_class(send_size);
+
+    bool is_receive_replaced = receive_needed > buffers->receive_capacity;
+    bool is_send_replaced = send_size > buffers->send_capacity;
+    if (!is_receive_replaced && !is_send_replaced){
+        return true;
+    }
+
+    size_t receive_capacity = is_receive_replaced ? (size_t)BUFFER_POOL_MIN_ARENA << receive_class : buffers->receive_capacity;
+    size_t send_capacity = is_send_replaced ? (size_t)BUFFER_POOL_MIN_ARENA << send_class : buffers->send_capacity;
+    size_t memory = session_buffers_memory(buffers);
+    if (!usage_reserve((long long)(receive_capacity + send_capacity) - (long long)memory)){
+        return false;
+    }
+
+    char *receive = is_receive_replaced ? arena_take(receive_class) : buffers->receive;
+    char *send = is_send_replaced ? arena_take(send_class) : buffers->send;
+    if ((is_receive_replaced && receive == NULL) || (is_send_replaced && send == NULL)){
+        if (is_receive_replaced) arena_return(receive, receive_capacity);
+        if (is_send_replaced) arena_return(send, send_capacity);
+        usage_reserve((long long)memory - (long long)(receive_capacity + send_capacity));
+        return false;
+    }
+
+    if (memory == 0){
+        __atomic_fetch_add(&usage->sessions, 1, __ATOMIC_RELAXED);
+    }
+    if (is_receive_replaced){
+        arena_return(buffers->receive, buffers->receive_capacity);
+        buffers->receive = receive;
+        buffers->receive_capacity = receive_capacity;
+    }
+    if (is_send_replaced){
+        arena_return(buffers->send, buffers->send_capacity);
+        buffers->send = send;
+        buffers->send_capacity = send_capacity;
+    }
+
+    return true;
+}
+
+void buffer_pool_release(session_buffers_t *buffers){
+    size_t memory = session_buffers_memory(buffers);
+    if (memory == 0){
+        return;
+    }
+
+    arena_return(buffers->receive, buffers->receive_capacity);
+    arena_return(buffers->send, buffers->send_capacity);
+    usage_reserve(-(long long)memory);
+    __atomic_fetch_sub(&usage->sessions, 1, __ATOMIC_RELAXED);
+
+    *buffers = session_buffers_t();
+}
+
+size_t session_buffers_memory(session_buffers_t *buffers){
+    return buffers->receive_capacity + buffers->send_capacity;
+}
+
+buffer_pool_usage_t buffer_pool_get_usage(){
+    buffer_pool_usage_t current;
+    current.bytes = __atomic_load_n(&usage->bytes, __ATOMIC_RELAXED);
+    current.bytes_peak = __atomic_load_n(&usage->bytes_peak, __ATOMIC_RELAXED);
+    current.sessions = __atomic_load_n(&usage->sessions, __ATOMIC_RELAXED);
+    current.refused = __atomic_load_n(&usage->refused, __ATOMIC_RELAXED);
+    current.limit = usage->limit;
+    return current;
+}
+
+void log_buffer_usage(session_buffers_t *buffers){
+    log_flush();        //summary follows the logged packets
+
+    buffer_pool_usage_t current = buffer_pool_get_usage();
+    cerr << "BUFFERS";
+    if (buffers != NULL){
+        cerr << " session=" << session_buffers_memory(buffers);
+    }
+    cerr << " total=" << current.bytes << " peak=" << current.bytes_peak
+         << " sessions=" << current.sessions << " refused=" << current.refused << "\n";
+}
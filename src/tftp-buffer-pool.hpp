@@ -0,0 +1,94 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-buffer-pool.hpp
+ * @brief Pool of the session buffers (receive and send arena per session, reused by all blocks of the transfer
+ * and by the next sessions) and accounting of their memory shared by all processes of the server
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_BUFFER_POOL_HPP
+#define TFTP_BUFFER_POOL_HPP
+
+#include <stddef.h>
+
+#define BUFFER_POOL_MIN_ARENA 4096                      //smallest arena, sizes of the arenas are powers of 2 from it
+#define BUFFER_POOL_CLASSES 21                          //largest arena 4 GiB (window of 65535 blocks of 65464 Bytes)
+#define BUFFER_POOL_CACHE_SIZE (64 * 1024 * 1024)       //free arenas kept by one process for the next sessions
+
+
+//Arenas of one transfer session, taken from the pool once and reused by all blocks
+typedef struct session_buffers {
+    char *receive = NULL;                       //received datagram followed by zero padding
+    char *send = NULL;                          //RRQ: payloads of the window blocks, WRQ: decoded netascii text
+    size_t receive_capacity = 0;                //sizes of the arenas (memory counted for the session)
+    size_t send_capacity = 0;
+} session_buffers_t;
+
+
+//Memory of the arenas held by the sessions of all processes
+typedef struct buffer_pool_usage {
+    unsigned long long bytes;
+    unsigned long long bytes_peak;
+    unsigned long sessions;                     //sessions holding at least one arena
+    unsigned long refused;                      //requests of arenas refused by the limit
+    unsigned long long limit;                   //0 if the memory is not limited
+} buffer_pool_usage_t;
+
+
+/**
+ * @brief Creates the accounting in the shared memory, has to be called before creating child processes or threads.
+ * Without it the memory is counted only by the current process and it is not limited (e.g. in the client).
+ *
+ * @param limit maximal memory of the arenas of all sessions in Bytes (0 if not limited)
+ * @return PROG_RET_CODE_OK if OK, else PROG_RET_CODE_ERR
+ */
+int buffer_pool_init(unsigned long long limit);
+
+
+/**
+ * @brief Provides the session with arenas of at least given sizes. Arenas already big enough are kept,
+ * smaller ones are replaced (their content is not kept). Arenas are not cleared.
+ *
+ * @param buffers arenas of the session
+ * @param receive_size maximal size of a received datagram (0 if the session receives into a shared batch)
+ * @param send_size size of the send arena (0 if not needed)
+ * @return true if OK, false if the limit would be exceeded or the memory can't be allocated (arenas are kept)
+ */
+bool buffer_pool_acquire(session_buffers_t *buffers, size_t receive_size, size_t send_size);
+
+
+/**
+ * @brief Returns the arenas of the session into the pool
+ *
+ * @param buffers arenas of the session
+ */
+void buffer_pool_release(session_buffers_t *buffers);
+
+
+/**
+ * @brief Gets memory of the arenas of the session
+ *
+ * @param buffers arenas of the session
+ * @return memory in Bytes
+ */
+size_t session_buffers_memory(session_buffers_t *buffers);
+
+
+/**
+ * @brief Gets current memory usage of all sessions
+ *
+ * @return copy of the usage
+ */
+buffer_pool_usage_t buffer_pool_get_usage();
+
+
+/**
+ * @brief Writes memory of the session and of all sessions on standard error stream
+ * (`BUFFERS session=bytes total=bytes peak=bytes sessions=n refused=n`)
+ *
+ * @param buffers arenas of the session or NULL (only totals are written)
+ */
+void log_buffer_usage(session_buffers_t *buffers);
+
+#endif
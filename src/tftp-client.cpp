@@ -13,11 +13,63 @@
 #include <netdb.h>
 #include <signal.h>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <chrono>
+#include <sstream>
+#include <thread>
 #include "tftp-communication.hpp"
+#include "tftp-batch-io.hpp"
+#include "tftp-file-source.hpp"
+#include "tftp-multicast.hpp"
+#include "tftp-resume.hpp"
 
 
 #define MIN_NUM_ARGS 5
-#define MAX_NUM_ARGS 9
+#define MAX_NUM_ARGS 19
+
+#define MANIFEST_DEFAULT_CONCURRENCY 4
+#define MANIFEST_MAX_CONCURRENCY 256
+#define MANIFEST_DEFAULT_RETRIES 2
+#define MANIFEST_RETRY_DELAY_MS 500             //delay before the next attempt of the failed job (multiplied by the attempt number)
+
+#define SEGMENTS_MAX 64
+#define SEGMENT_MIN_SIZE (1024 * 1024)          //smaller files are downloaded by fewer sessions
+#define SEGMENT_ALIGNMENT DISK_IO_CHUNK_SIZE    //ranges start at whole chunks of the written file
+
+
+//Structure containing one transfer of the manifest
+typedef struct manifest_job {
+    bool is_rrq;
+    string remote_path;
+    string local_path;
+    bool is_completed = false;
+    unsigned int attempts = 0;
+    unsigned long long bytes = 0;
+    double seconds = 0;                         //duration of the last attempt
+} manifest_job_t;
+
+
+//Structure containing the jobs of the manifest transferred in parallel by one process
+typedef struct manifest {
+    string path = "";                           //empty if a single file is transferred
+    unsigned int concurrency = MANIFEST_DEFAULT_CONCURRENCY;
+    unsigned int retries = MANIFEST_DEFAULT_RETRIES;
+    vector<manifest_job_t> jobs;
+    size_t next_job = 0;                        //next job taken by a thread
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;   //output of the jobs and the statistics
+    io_stats_t io_stats;                        //statistics summed over the threads
+} manifest_t;
+
+
+//Structure containing one range of the file downloaded by own session
+typedef struct file_segment {
+    unsigned long long offset;
+    unsigned long long length;
+    bool is_completed = false;
+    io_stats_t io_stats;                        //statistics of the thread of the session
+} file_segment_t;
 
 
 //Global variables
@@ -31,14 +83,27 @@ void print_help(){
          << "  tftp-client - TFTP client\n"
          << "\n"
          << "USAGE:\n"
-         << "  Run client:\ttftp-client -h hostname [-p port] [-f filepath] -t dest_filepath\n"
+         << "  Run client:\ttftp-client -h hostname [-p port] [-f filepath] [-s size] [--multicast] [--segments count] [--resume] [--blksize size] [--windowsize size] -t dest_filepath\n"
+         << "  Run jobs:\ttftp-client -h hostname [-p port] -m manifest [-j jobs] [-r retries] [--multicast] [--resume] [--blksize size] [--windowsize size]\n"
          << "  Show help:\ttftp-client --help\n"
          << "\n"
          << "OPTIONS:\n"
          << "  -h <VALUE>\thostname or IPv4 address to connect to\n"
          << "  -p <MODE>\thost port number to connect to (if not set, then 69)\n"
          << "  -f <PATH>\tpath to the server file to download (if not set, then upload from stdin)\n"
+         << "  -s <SIZE>\tsize of the uploaded data in Bytes sent as transfer size (if not set, then known only for a regular file on stdin)\n"
+         << "  --multicast\tdownload the file from the multicast group shared with other clients (RFC 2090), if the server offers it\n"
+         << "  --segments <COUNT>\tdownload ranges of the file by given number of sessions at once (offset and length options), if the server offers it\n"
+         << "  --resume\tkeep the file of an interrupted transfer with a sidecar (" << RESUME_SIDECAR_SUFFIX << ") and continue behind its verified\n"
+         << "\t\tprefix in the next run (resume option), if the server offers it\n"
+         << "  --blksize <SIZE>\tblock size requested by the block size option (" << MIN_BLKSIZE_VALUE << " to " << MAX_BLKSIZE_VALUE << "), 'auto' requests the largest\n"
+         << "\t\tblock fitting the path MTU to the server (if not set, then " << DEFAULT_BLOCK_SIZE << " without the option)\n"
+         << "  --windowsize <SIZE>\tnumber of blocks sent before waiting for an Ack requested by the window size option (" << MIN_WINDOWSIZE_VALUE << " to "
+         << MAX_WINDOWSIZE_VALUE << ")\n\t\t(if not set, then " << DEFAULT_WINDOW_SIZE << " without the option)\n"
          << "  -t <PATH>\tpath to the file to save data in\n"
+         << "  -m <PATH>\tmanifest of the transfers, one per line: 'get remote_path local_path' or 'put local_path remote_path'\n"
+         << "  -j <NUMBER>\tnumber of transfers of the manifest running at once (if not set, then " << MANIFEST_DEFAULT_CONCURRENCY << ")\n"
+         << "  -r <NUMBER>\tnumber of retries of a failed transfer of the manifest (if not set, then " << MANIFEST_DEFAULT_RETRIES << ")\n"
          << "\n"
          << "AUTHOR:\n"
          << "  Dalibor Kříčka (xkrick01), 2023\n\n";
@@ -68,8 +133,11 @@ void interrupt_signal_handler(int signum){
  * @param port_host address where a host port will be stored in
  * @param file_path_source address where a source file path will be stored in
  * @param file_path_dest address where a destination file path will be stored in
+ * @param communication_information address where a size of the uploaded data and the multicast, segments, resume, block size and window size settings will be stored in (if given)
+ * @param manifest address where a path to the manifest, number of transfers at once and retries will be stored in (if given)
  */
-void check_program_args(int argc, char *argv[], string *host, int *port_host, string *file_path_source, string *file_path_dest){
+void check_program_args(int argc, char *argv[], string *host, int *port_host, string *file_path_source, string *file_path_dest, communication_info_t *communication_information,
+                        manifest_t *manifest){
     if (argc == 2 && !strcmp(argv[1],"--help")){
         print_help();
     }
@@ -83,6 +151,13 @@ void check_program_args(int argc, char *argv[], string *host, int *port_host, st
     bool dest_filepath_checked = false;
     bool port_checked = false;
     bool filepath_checked = false;
+    bool upload_size_checked = false;
+    bool manifest_checked = false;
+    bool concurrency_checked = false;
+    bool retries_checked = false;
+    bool segments_checked = false;
+    bool blocksize_checked = false;
+    bool window_size_checked = false;
 
     for (int i = 1; i < argc; i++){
     //check -h argument
@@ -121,6 +196,104 @@ void check_program_args(int argc, char *argv[], string *host, int *port_host, st
             }
             *(file_path_source) = argv[i];
         }
+        //check -s argument
+        else if ((strcmp(argv[i],"-s") == 0) && !upload_size_checked){
+            upload_size_checked = true;
+            i++;
+
+            //check size format
+            if (!(regex_match(argv[i], regex("^\\d{1,19}$")))){
+                cout << "ERR: invalid format of upload size (argument -s)\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            communication_information->upload_size_given = true;
+            communication_information->upload_size = stoull(argv[i]);
+        }
+        //check --multicast argument
+        else if ((strcmp(argv[i],"--multicast") == 0) && !communication_information->multicast){
+            communication_information->multicast = true;
+        }
+        //check --resume argument
+        else if ((strcmp(argv[i],"--resume") == 0) && !communication_information->resume){
+            communication_information->resume = true;
+        }
+        //check --blksize argument
+        else if ((strcmp(argv[i],"--blksize") == 0) && !blocksize_checked && i + 1 < argc){
+            blocksize_checked = true;
+            i++;
+
+            //check block size format (auto is resolved when the host is known)
+            if (strcmp(argv[i],"auto") == 0){
+                communication_information->blocksize_auto = true;
+            }
+            else if (!(regex_match(argv[i], regex("^\\d{1,5}$"))) || atoi(argv[i]) < MIN_BLKSIZE_VALUE || atoi(argv[i]) > MAX_BLKSIZE_VALUE){
+                cout << "ERR: invalid block size (argument --blksize, " << MIN_BLKSIZE_VALUE << " to " << MAX_BLKSIZE_VALUE << " or auto)\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            else{
+                communication_information->blocksize = atoi(argv[i]);
+            }
+        }
+        //check --windowsize argument
+        else if ((strcmp(argv[i],"--windowsize") == 0) && !window_size_checked && i + 1 < argc){
+            window_size_checked = true;
+            i++;
+
+            //check window size format
+            if (!(regex_match(argv[i], regex("^\\d{1,5}$"))) || atoi(argv[i]) < MIN_WINDOWSIZE_VALUE || atoi(argv[i]) > MAX_WINDOWSIZE_VALUE){
+                cout << "ERR: invalid window size (argument --windowsize, " << MIN_WINDOWSIZE_VALUE << " to " << MAX_WINDOWSIZE_VALUE << ")\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            communication_information->window_size = atoi(argv[i]);
+        }
+        //check --segments argument
+        else if ((strcmp(argv[i],"--segments") == 0) && !segments_checked && i + 1 < argc){
+            segments_checked = true;
+            i++;
+
+            //check number of segments format
+            if (!(regex_match(argv[i], regex("^[1-9]\\d{0,1}$"))) || atoi(argv[i]) > SEGMENTS_MAX){
+                cout << "ERR: invalid number of segments (argument --segments, maximum is " << SEGMENTS_MAX << ")\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            communication_information->segments = atoi(argv[i]);
+        }
+        //check -m argument
+        else if ((strcmp(argv[i],"-m") == 0) && !manifest_checked){
+            manifest_checked = true;
+            i++;
+
+            //check manifest path format
+            if (!(regex_match(argv[i], regex("^.+$")))){
+                cout << "ERR: invalid manifest path (argument -m)\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            manifest->path = argv[i];
+        }
+        //check -j argument
+        else if ((strcmp(argv[i],"-j") == 0) && !concurrency_checked){
+            concurrency_checked = true;
+            i++;
+
+            //check number of transfers format
+            if (!(regex_match(argv[i], regex("^[1-9]\\d{0,2}$"))) || atoi(argv[i]) > MANIFEST_MAX_CONCURRENCY){
+                cout << "ERR: invalid number of transfers at once (argument -j, maximum is " << MANIFEST_MAX_CONCURRENCY << ")\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            manifest->concurrency = atoi(argv[i]);
+        }
+        //check -r argument
+        else if ((strcmp(argv[i],"-r") == 0) && !retries_checked){
+            retries_checked = true;
+            i++;
+
+            //check number of retries format
+            if (!(regex_match(argv[i], regex("^\\d{1,3}$")))){
+                cout << "ERR: invalid number of retries (argument -r)\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            manifest->retries = atoi(argv[i]);
+        }
         //check -t argument
         else if ((strcmp(argv[i],"-t") == 0) && !dest_filepath_checked){
             dest_filepath_checked = true;
@@ -134,7 +307,8 @@ void check_program_args(int argc, char *argv[], string *host, int *port_host, st
             *(file_path_dest) = argv[i];
         }
         else{
-            cout << "ERR: invalid argument (the client is started using: 'tftp-client -h hostname [-p port] [-f filepath] -t dest_filepath')\n";
+            cout << "ERR: invalid argument (the client is started using: 'tftp-client -h hostname [-p port] [-f filepath] [-s size] [--multicast] [--segments count] [--resume] [--blksize size] [--windowsize size] -t dest_filepath'"
+                 << " or 'tftp-client -h hostname [-p port] -m manifest [-j jobs] [-r retries] [--multicast] [--resume] [--blksize size] [--windowsize size]')\n";
             exit(PROG_RET_CODE_ERR);
         }
     }
@@ -147,10 +321,43 @@ void check_program_args(int argc, char *argv[], string *host, int *port_host, st
         *(file_path_source) = "";
     }
 
+    if (communication_information->resume && communication_information->multicast){
+        cout << "ERR: resume can't be used with multicast (the group sends the whole file)\n";
+        exit(PROG_RET_CODE_ERR);
+    }
+
+    if (manifest_checked){
+        //paths of the transfers are given by the manifest
+        if (filepath_checked || upload_size_checked || dest_filepath_checked || segments_checked){
+            cout << "ERR: arguments -f, -s, -t and --segments can't be used with the manifest (argument -m)\n";
+            exit(PROG_RET_CODE_ERR);
+        }
+        if (!host_name_checked){
+            cout << "ERR: missing required argument (-h hostname)\n";
+            exit(PROG_RET_CODE_ERR);
+        }
+        return;
+    }
+
+    if (concurrency_checked || retries_checked){
+        cout << "ERR: arguments -j and -r are used only with the manifest (argument -m)\n";
+        exit(PROG_RET_CODE_ERR);
+    }
+
     if (!host_name_checked || !dest_filepath_checked){
         cout << "ERR: missing required argument (-h hostname or -t dest_filepath)\n";
         exit(PROG_RET_CODE_ERR);
     }
+
+    if (communication_information->multicast && !filepath_checked){
+        cout << "ERR: multicast is used only for download (argument -f)\n";
+        exit(PROG_RET_CODE_ERR);
+    }
+
+    if (segments_checked && (!filepath_checked || communication_information->multicast || communication_information->resume)){
+        cout << "ERR: segments are used only for download (argument -f) without multicast and resume\n";
+        exit(PROG_RET_CODE_ERR);
+    }
 }
 
 
@@ -178,14 +385,324 @@ struct sockaddr_in set_host_informations(string ip_address, int port){
 }
 
 
+/**
+ * @brief Uploads the data of the source to the server (WRQ)
+ *
+ * @param connection_information connection information (socket, address)
+ * @param communication_information information needed to properly execute a transfer (mode, file paths)
+ * @param option_information information determining transfer options and their values
+ * @param source opened source of the uploaded data
+ * @param buffer buffer for the first response of the server
+ * @return PROG_RET_CODE_OK if the data were uploaded, else PROG_RET_CODE_ERR
+ */
+int upload_from_source(connection_info_t *connection_information, communication_info_t *communication_information, option_info_t *option_information,
+                       file_source_t *source, char *buffer){
+    //setting default options
+    option_info_t default_options;
+    default_options.blocksize = DEFAULT_BLOCK_SIZE;
+    default_options.timeout_interval = DEFAULT_TIMEOUT;
+
+    //address of the server (request uploading the whole data again is sent to the same port)
+    struct sockaddr_in server_address = *(struct sockaddr_in *)connection_information->address;
+
+    tftp_rrq_wrq_packet_t init_communication_packet;
+    string packet_to_be_send = send_wrq_rrq(connection_information, communication_information, &init_communication_packet, option_information, false);
+
+    int bytes_rx = recvfrom_retransmit(connection_information, &default_options, buffer, packet_to_be_send, TID_NOT_SET_YET);
+    if (bytes_rx < 0){
+        return PROG_RET_CODE_ERR;
+    }
+
+    int tid_server = htons(((struct sockaddr_in*)connection_information->address)->sin_port);   //server TID
+
+    char opcode_char[2] = {buffer[0], buffer[1]};
+    ushort received_opcode = chars_to_short(opcode_char);
+
+    if (received_opcode== ERROR_OPCODE){
+        receive_error(connection_information, buffer, bytes_rx);
+        return PROG_RET_CODE_ERR;
+    }
+    else if (chars_to_short(opcode_char) == OACK_OPCODE){
+        if (receive_oack(connection_information, &init_communication_packet.options, buffer, bytes_rx) != PACKET_OK_CODE){
+            return PROG_RET_CODE_ERR;
+        }
+
+        //server keeps the partial file of the interrupted upload, only the rest of the data is sent when they have the same prefix
+        if (init_communication_packet.options.resume_bytes != 0 &&
+            !file_source_resume(source, init_communication_packet.options.resume_bytes, init_communication_packet.options.resume_checksum)){
+            send_error_packet(connection_information, ERR_CODE_OPTIONS_FAILED, "Transfer cancelled - uploaded data differ from the partial file", DEFAULT_TIMEOUT, false);
+
+            //partial file is replaced by the whole data
+            *((struct sockaddr_in *)connection_information->address) = server_address;
+            option_info_t whole_options = *option_information;
+            whole_options.option_resume = false;
+            return upload_from_source(connection_information, communication_information, &whole_options, source, buffer);
+        }
+
+        //continue sending data
+        return read_from_source(connection_information, source, &init_communication_packet.options, tid_server);
+    }
+    else{           //ACK packet
+        if (receive_ack(connection_information, buffer, 0, default_options.timeout_interval) != PACKET_OK_CODE){
+            return PROG_RET_CODE_ERR;
+        }
+
+        //continue sending data
+        return read_from_source(connection_information, source, &default_options, tid_server);
+    }
+}
+
+
+/**
+ * @brief Downloads one range of the file by own session (body of the thread), the range is written at its offset
+ *
+ * @param segment range of the file
+ * @param server_address address of the server
+ * @param communication_information information about the transfer (file paths, mode)
+ * @param option_information transfer options requested by the client
+ */
+void download_segment(file_segment_t *segment, struct sockaddr_in server_address, communication_info_t communication_information, option_info_t option_information){
+    connection_info_t connection_information;
+    connection_information.socket = create_socket();
+    connection_information.address = (struct sockaddr *) &server_address;
+    connection_information.address_size = sizeof(server_address);
+
+    receive_batch_t receive_batch;
+    connection_information.receive_batch = &receive_batch;
+    rto_estimator_t rto;
+    connection_information.rto = &rto;
+    session_buffers_t session_buffers;
+    connection_information.buffers = &session_buffers;
+
+    //only the range is requested, the size of the file is already known
+    option_information.option_transfer_size = false;
+    option_information.option_multicast = false;
+    option_information.option_offset = true;
+    option_information.offset = segment->offset;
+    option_information.option_length = true;
+    option_information.length = segment->length;
+
+    unsigned int first_datagram_size = max(option_information.blocksize, (unsigned int)DEFAULT_BLOCK_SIZE) + DATA_PACKET_OFFSET;
+    tftp_rrq_wrq_packet_t init_communication_packet;
+    char *buffer = NULL;
+    int bytes_rx = -1;
+
+    if (!buffer_pool_acquire(&session_buffers, first_datagram_size, 0)){
+        cout << "ERR: not enough memory for the transfer buffers\n";
+    }
+    else{
+        buffer = session_buffers.receive;
+        string packet_to_be_send = send_wrq_rrq(&connection_information, &communication_information, &init_communication_packet, &option_information, true);
+        bytes_rx = recvfrom_retransmit(&connection_information, &option_information, buffer, packet_to_be_send, TID_NOT_SET_YET);
+    }
+
+    if (bytes_rx >= 0){
+        int tid_server = htons(((struct sockaddr_in*)connection_information.address)->sin_port);   //server TID
+        char opcode_char[2] = {buffer[0], buffer[1]};
+
+        if (chars_to_short(opcode_char) == ERROR_OPCODE){
+            receive_error(&connection_information, buffer, bytes_rx);
+        }
+        else if (chars_to_short(opcode_char) != OACK_OPCODE){
+            cout << "ERR: server sends the whole file instead of the range\n";
+            send_error_packet(&connection_information, ERR_CODE_OPTIONS_FAILED, "Transfer cancelled - range of the file was not accepted", DEFAULT_TIMEOUT, false);
+        }
+        else if (receive_oack(&connection_information, &init_communication_packet.options, buffer, bytes_rx) == PACKET_OK_CODE){
+            if (!init_communication_packet.options.option_offset || init_communication_packet.options.length != segment->length){
+                cout << "ERR: server does not send the requested range of the file\n";
+                send_error_packet(&connection_information, ERR_CODE_OPTIONS_FAILED, "Transfer cancelled - range of the file was not accepted", DEFAULT_TIMEOUT, false);
+            }
+            else{
+                disk_file_t file_write;
+                int error_number = disk_file_open_write_range(&file_write, communication_information.file_path_dest, segment->offset);
+                if (error_number != 0){
+                    send_disk_error(&connection_information, error_number, DEFAULT_TIMEOUT, false);
+                }
+                else{
+                    netascii_state_t netascii_state;
+                    string packet_to_be_send = send_ack(&connection_information, 0);
+                    int write_to_file_ret_code = write_to_file(&connection_information, &init_communication_packet.options, &file_write, packet_to_be_send,
+                                                               communication_information.mode, tid_server, 1, &netascii_state);
+
+                    //whole range has to be received
+                    disk_file_flush(&file_write);
+                    segment->is_completed = write_to_file_ret_code == PROG_RET_CODE_OK &&
+                                            (unsigned long long)file_write.offset - segment->offset == segment->length;
+                    disk_file_close(&file_write);
+                }
+            }
+        }
+    }
+
+    close(connection_information.socket);
+    buffer_pool_release(&session_buffers);
+    segment->io_stats = *get_io_stats();
+}
+
+
+/**
+ * @brief Downloads the ranges of the file by own sessions at once
+ *
+ * @param segments ranges of the file
+ * @param server_address address of the server (port of the requests)
+ * @param communication_information information about the transfer (file paths, mode)
+ * @param option_information transfer options requested by the client
+ * @return PROG_RET_CODE_OK if all ranges were downloaded, else PROG_RET_CODE_ERR
+ */
+int download_ranges(vector<file_segment_t> *segments, struct sockaddr_in server_address, communication_info_t *communication_information,
+                    option_info_t *option_information){
+    vector<thread> threads;
+    for (file_segment_t &segment : *segments){
+        threads.emplace_back(download_segment, &segment, server_address, *communication_information, *option_information);
+    }
+    for (thread &worker : threads){
+        worker.join();
+    }
+
+    //statistics of the sessions are added to the current thread
+    bool is_completed = true;
+    io_stats_t *stats = get_io_stats();
+    for (file_segment_t &segment : *segments){
+        is_completed = is_completed && segment.is_completed;
+        stats->packets_sent += segment.io_stats.packets_sent;
+        stats->send_syscalls += segment.io_stats.send_syscalls;
+        stats->packets_received += segment.io_stats.packets_received;
+        stats->receive_syscalls += segment.io_stats.receive_syscalls;
+        stats->wait_syscalls += segment.io_stats.wait_syscalls;
+    }
+
+    return is_completed ? PROG_RET_CODE_OK : PROG_RET_CODE_ERR;
+}
+
+
+/**
+ * @brief Downloads the file by ranges (offset and length options) downloaded by the sessions at once
+ *
+ * @param server_address address of the server (port of the requests)
+ * @param communication_information information about the transfer (file paths, mode, number of sessions)
+ * @param option_information transfer options requested by the client
+ * @param file_size size of the file reported by the server
+ * @return PROG_RET_CODE_OK if the whole file was downloaded, else PROG_RET_CODE_ERR
+ */
+int download_segments(struct sockaddr_in server_address, communication_info_t *communication_information, option_info_t *option_information,
+                      unsigned long long file_size){
+    //sessions download ranges of the same size (whole chunks of the written file), the last range may be shorter
+    unsigned long long segments_number = min((unsigned long long)communication_information->segments, file_size / SEGMENT_MIN_SIZE);
+    unsigned long long segment_size = (file_size + segments_number - 1) / segments_number;
+    segment_size = (segment_size + SEGMENT_ALIGNMENT - 1) / SEGMENT_ALIGNMENT * SEGMENT_ALIGNMENT;
+
+    vector<file_segment_t> segments;
+    for (unsigned long long offset = 0; offset < file_size; offset += segment_size){
+        file_segment_t segment;
+        segment.offset = offset;
+        segment.length = min(segment_size, file_size - offset);
+        segments.push_back(segment);
+    }
+
+    //ranges are written into the new file of the final size
+    string path_dest = communication_information->file_path_dest;
+    int file_descriptor = open(path_dest.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0666);
+    if (file_descriptor < 0){
+        cout << "ERROR: open - " << strerror(errno) << "\n";
+        return PROG_RET_CODE_ERR;
+    }
+    if (ftruncate(file_descriptor, file_size) < 0){
+        cout << "ERROR: ftruncate - " << strerror(errno) << "\n";
+        close(file_descriptor);
+        remove(path_dest.c_str());
+        return PROG_RET_CODE_ERR;
+    }
+    close(file_descriptor);
+
+    int ret_code = download_ranges(&segments, server_address, communication_information, option_information);
+    if (ret_code != PROG_RET_CODE_OK){
+        remove(path_dest.c_str());      //removing incomplete file, when a range was not downloaded
+    }
+    return ret_code;
+}
+
+
+/**
+ * @brief Downloads the ranges of the file missed from the multicast group by unicast (offset and length options)
+ *
+ * @param server_address address of the server (port of the requests)
+ * @param communication_information information about the transfer (file paths, mode)
+ * @param option_information transfer options requested by the client
+ * @param gaps ranges of the file missed from the group
+ * @return PROG_RET_CODE_OK if all ranges were downloaded, else PROG_RET_CODE_ERR
+ */
+int download_multicast_gaps(struct sockaddr_in server_address, communication_info_t *communication_information, option_info_t *option_information,
+                            vector<multicast_gap_t> *gaps){
+    vector<file_segment_t> segments(gaps->size());
+    for (size_t i = 0; i < gaps->size(); i++){
+        segments[i].offset = (*gaps)[i].offset;
+        segments[i].length = (*gaps)[i].length;
+    }
+
+    if (download_ranges(&segments, server_address, communication_information, option_information) != PROG_RET_CODE_OK){
+        cout << "ERR: blocks missed from the multicast group can't be downloaded\n";
+        return PROG_RET_CODE_ERR;
+    }
+    return PROG_RET_CODE_OK;
+}
+
+
+/**
+ * @brief Opens the downloaded file, resumed download writes behind the prefix accepted by the server
+ * (whole file is written again when the server sends it from the beginning)
+ *
+ * @param file_write file structure
+ * @param communication_information information needed to properly execute a transfer (file paths, resume)
+ * @param negotiated_options negotiated transfer options
+ * @return 0 if OK, else errno
+ */
+int open_download_file(disk_file_t *file_write, communication_info_t *communication_information, option_info_t *negotiated_options){
+    if (!communication_information->resume){
+        return disk_file_open_write(file_write, communication_information->file_path_dest);
+    }
+    return resume_open(file_write, communication_information->file_path_dest, negotiated_options->resume_bytes, negotiated_options->resume_checksum,
+                       negotiated_options->blocksize);
+}
+
+
+/**
+ * @brief Closes the downloaded file, the file of the failed download is removed or kept with its sidecar for the resumed download
+ *
+ * @param file_write file structure
+ * @param communication_information information needed to properly execute a transfer (file paths, resume)
+ * @param blocksize negotiated block size
+ * @param ret_code result of the download
+ * @return ret_code
+ */
+int close_download_file(disk_file_t *file_write, communication_info_t *communication_information, unsigned int blocksize, int ret_code){
+    string path_dest = communication_information->file_path_dest;
+    if (ret_code == PROG_RET_CODE_ERR && communication_information->resume){
+        if (!resume_keep(file_write, path_dest, blocksize)){
+            remove(path_dest.c_str());
+        }
+        return ret_code;
+    }
+
+    disk_file_close(file_write);
+    if (ret_code == PROG_RET_CODE_ERR){
+        remove(path_dest.c_str());      //removing invalid file, when an error occurs
+    }
+    else if (communication_information->resume){
+        resume_discard(path_dest);
+    }
+    return ret_code;
+}
+
+
 /**
  * @brief Handles TFTP communication with server
  *
  * @param connection_information connection information (socket, address)
  * @param communication_information information needed to properly execute a transfer (mode, file paths)
  * @param option_information information determining transfer options and their values
+ * @return PROG_RET_CODE_OK if the file was transferred, else PROG_RET_CODE_ERR
  */
-void execute_transfer(connection_info_t *connection_information, communication_info_t *communication_information, option_info_t *option_information){
+int execute_transfer(connection_info_t *connection_information, communication_info_t *communication_information, option_info_t *option_information){
     //setting default options
     option_info_t default_options;
     default_options.blocksize = DEFAULT_BLOCK_SIZE;
@@ -194,117 +711,359 @@ void execute_transfer(connection_info_t *connection_information, communication_i
     string error_message = "";
     string packet_to_be_send;
 
-    char buffer[DEFAULT_BLOCK_SIZE + DATA_PACKET_OFFSET];
-    bzero(buffer, DEFAULT_BLOCK_SIZE + DATA_PACKET_OFFSET);
+    //first response (Oack or Data of the default size) is received into the session buffers, NETASCII text of the first block is decoded in them
+    unsigned int first_datagram_size = max(option_information->blocksize, (unsigned int)DEFAULT_BLOCK_SIZE) + DATA_PACKET_OFFSET;
+    if (!buffer_pool_acquire(connection_information->buffers, first_datagram_size, communication_information->mode == MODE_NETASCII ? DEFAULT_BLOCK_SIZE + 1 : 0)){
+        cout << "ERR: not enough memory for the transfer buffers\n";
+        return PROG_RET_CODE_ERR;
+    }
+    char *buffer = connection_information->buffers->receive;
 
     tftp_rrq_wrq_packet_t init_communication_packet;
 
     if (communication_information->path_was_given){     //RRQ
-        //testing if the file we want to write in doesn't exist
-        ifstream file_existence_test(communication_information->file_path_dest);
-        if (file_existence_test.is_open()){
+        //testing if the file we want to write in doesn't exist (partial file of an interrupted download is resumed)
+        string path_dest = communication_information->file_path_dest;
+        bool is_partial = communication_information->resume && resume_is_partial(path_dest);
+        ifstream file_existence_test(path_dest);
+        if (file_existence_test.is_open() && !is_partial){
             cout << "ERR: File - file to write to already exists\n";
             file_existence_test.close();
-            return;
+            return PROG_RET_CODE_ERR;
         }
 
-        packet_to_be_send = send_wrq_rrq(connection_information, communication_information, &init_communication_packet, option_information, true, "");
+        //first session asks for the size of the file and the support of ranges, it downloads the whole file when the ranges can't be used
+        struct sockaddr_in server_address = *(struct sockaddr_in *)connection_information->address;
+        option_info_t request_options = *option_information;
+        if (communication_information->segments > 1){
+            request_options.option_transfer_size = true;
+            request_options.option_offset = true;
+            request_options.offset = 0;
+            request_options.option_length = true;
+            request_options.length = 0;
+        }
+        else if (communication_information->multicast){
+            //size of the file gives the last block, so the blocks missed from the group are known even without it
+            request_options.option_transfer_size = true;
+        }
+
+        //server sends only the data behind the verified prefix of the partial file, when its file has the same prefix
+        resume_info_t partial;
+        if (is_partial && !resume_load(path_dest, &partial)){
+            partial = resume_info_t();      //partial file was changed, it's downloaded again
+        }
+        request_options.resume_bytes = partial.bytes;
+        request_options.resume_checksum = partial.checksum;
+
+        packet_to_be_send = send_wrq_rrq(connection_information, communication_information, &init_communication_packet, &request_options, true);
 
         int bytes_rx = recvfrom_retransmit(connection_information, option_information, buffer, packet_to_be_send, TID_NOT_SET_YET);
         if (bytes_rx < 0){
-            return;
+            return PROG_RET_CODE_ERR;
         }
 
         int tid_server = htons(((struct sockaddr_in*)connection_information->address)->sin_port);   //server TID
 
-        ofstream file_write(communication_information->file_path_dest);
+        disk_file_t file_write;
         int write_to_file_ret_code = 0;
+        unsigned int blocksize = DEFAULT_BLOCK_SIZE;
+        netascii_state_t netascii_state;        //CR at the end of a block is converted with the next block
         char opcode_char[2] = {buffer[0], buffer[1]};
 
         if (chars_to_short(opcode_char) == ERROR_OPCODE){
-            receive_error(connection_information, buffer);
-            close_remove_file(file_write, communication_information->file_path_dest);
-            return;
+            receive_error(connection_information, buffer, bytes_rx);
+            return PROG_RET_CODE_ERR;
         }
         else if (chars_to_short(opcode_char) == OACK_OPCODE){
-            if (receive_oack(connection_information, &init_communication_packet.options, buffer) != PACKET_OK_CODE){
-                close_remove_file(file_write, communication_information->file_path_dest);
-                return;
+            if (receive_oack(connection_information, &init_communication_packet.options, buffer, bytes_rx) != PACKET_OK_CODE){
+                return PROG_RET_CODE_ERR;
             }
 
-            packet_to_be_send = send_ack(connection_information, 0);
+            if (init_communication_packet.options.option_offset && init_communication_packet.options.option_transfer_size &&
+                init_communication_packet.options.transfer_size >= 2 * SEGMENT_MIN_SIZE){
+                //server sends ranges of the file - first session is cancelled, the ranges are downloaded by own sessions
+                send_error_packet(connection_information, ERR_CODE_OPTIONS_FAILED, "Transfer cancelled - file is downloaded by ranges", DEFAULT_TIMEOUT, false);
+                return download_segments(server_address, communication_information, option_information, init_communication_packet.options.transfer_size);
+            }
 
-            //continue receiving data
-            write_to_file_ret_code = write_to_file(connection_information, &init_communication_packet.options, file_write, packet_to_be_send, communication_information->mode, tid_server, 1);
+            blocksize = init_communication_packet.options.blocksize;
+            int error_number = open_download_file(&file_write, communication_information, &init_communication_packet.options);
+            if (error_number != 0){
+                send_disk_error(connection_information, error_number, DEFAULT_TIMEOUT, false);
+                return PROG_RET_CODE_ERR;
+            }
+
+            if (init_communication_packet.options.option_multicast){
+                //blocks are received from the group, missing ones are requested by the acks of the master client or downloaded by unicast
+                vector<multicast_gap_t> gaps;
+                write_to_file_ret_code = receive_multicast(connection_information, &init_communication_packet.options, &file_write, tid_server, &gaps);
+                if (write_to_file_ret_code == PROG_RET_CODE_OK && !gaps.empty()){
+                    write_to_file_ret_code = download_multicast_gaps(server_address, communication_information, option_information, &gaps);
+                }
+            }
+            else{
+                packet_to_be_send = send_ack(connection_information, 0);
+
+                //continue receiving data
+                write_to_file_ret_code = write_to_file(connection_information, &init_communication_packet.options, &file_write, packet_to_be_send, communication_information->mode, tid_server, 1, &netascii_state);
+            }
         }
         else{
-            int expected_block_number = 1;
-            if (receive_data(connection_information, buffer, bytes_rx, file_write, communication_information->mode, default_options.timeout_interval, expected_block_number) != PACKET_OK_CODE){
-                close_remove_file(file_write, communication_information->file_path_dest);
-                return;
+            int error_number = open_download_file(&file_write, communication_information, &default_options);
+            if (error_number != 0){
+                send_disk_error(connection_information, error_number, DEFAULT_TIMEOUT, false);
+                return PROG_RET_CODE_ERR;
             }
 
-            packet_to_be_send = send_ack(connection_information, expected_block_number);
+            block_index_t expected_block_index = 1;
+            bool is_last_block = bytes_rx < (DEFAULT_BLOCK_SIZE + DATA_PACKET_OFFSET);
+            if (receive_data(connection_information, buffer, bytes_rx, &file_write, communication_information->mode, &default_options, expected_block_index,
+                             &netascii_state, is_last_block) != PACKET_OK_CODE){
+                return close_download_file(&file_write, communication_information, blocksize, PROG_RET_CODE_ERR);
+            }
+
+            packet_to_be_send = send_ack(connection_information, block_number_from_index(expected_block_index, default_options.rollover));
 
-            if (bytes_rx < (DEFAULT_BLOCK_SIZE + DATA_PACKET_OFFSET)){
-                return;     //end of the transition
+            if (is_last_block){
+                return close_download_file(&file_write, communication_information, blocksize, PROG_RET_CODE_OK);     //end of the transition
             }
 
             //continue receiving data
-            write_to_file_ret_code = write_to_file(connection_information, &default_options, file_write, packet_to_be_send, communication_information->mode, tid_server, ++expected_block_number);
+            write_to_file_ret_code = write_to_file(connection_information, &default_options, &file_write, packet_to_be_send, communication_information->mode, tid_server, ++expected_block_index, &netascii_state);
         }
 
-        file_write.close();
-
-        //removing invalid file, when an error occurs
-        if (write_to_file_ret_code == PROG_RET_CODE_ERR){
-            remove(communication_information->file_path_dest.c_str());
-        }
+        return close_download_file(&file_write, communication_information, blocksize, write_to_file_ret_code);
     }
     else{       //WRQ
-        //creating a path to the temporary file with stdin content
-        srand((unsigned int)time(NULL));
-        string temp_file_path = TEMP_FILE_PATH + to_string(rand()) + ".tmp";
+        //Data blocks are read directly from the standard input (or the file of the manifest job), the window of blocks in flight is the only buffer
+        file_source_t source;
+        if (communication_information->upload_path != ""){
+            if (!file_source_open(&source, communication_information->upload_path, communication_information->mode)){
+                cout << "ERR: File - file to upload can't be opened\n";
+                return PROG_RET_CODE_ERR;
+            }
+        }
+        else{
+            file_source_open_descriptor(&source, STDIN_FILENO, communication_information->mode);
+        }
 
-        packet_to_be_send = send_wrq_rrq(connection_information, communication_information, &init_communication_packet, option_information, false, temp_file_path);
+        int read_from_source_ret_code = upload_from_source(connection_information, communication_information, option_information, &source, buffer);
+        file_source_close(&source);
 
-        int bytes_rx = recvfrom_retransmit(connection_information, &default_options, buffer, packet_to_be_send, TID_NOT_SET_YET);
-        if (bytes_rx < 0){
-            remove(temp_file_path.c_str());
-            return;
-        }
+        return read_from_source_ret_code;
+    }
+}
 
-        int tid_server = htons(((struct sockaddr_in*)connection_information->address)->sin_port);   //server TID
 
-        char opcode_char[2] = {buffer[0], buffer[1]};
-        ushort received_opcode = chars_to_short(opcode_char);
+/**
+ * @brief Reads the jobs of the manifest (empty lines and lines starting with '#' are skipped)
+ *
+ * @param manifest manifest with the path, where the jobs will be stored in
+ * @return true if OK, else false
+ */
+bool manifest_load(manifest_t *manifest){
+    ifstream file(manifest->path);
+    if (!file.is_open()){
+        cout << "ERR: manifest " << manifest->path << " can't be opened\n";
+        return false;
+    }
+
+    string line;
+    int line_number = 0;
+    while (getline(file, line)){
+        line_number++;
 
-        if (received_opcode== ERROR_OPCODE){
-            receive_error(connection_information, buffer);
-            remove(temp_file_path.c_str());
-            return;
+        istringstream fields(line);
+        string direction;
+        if (!(fields >> direction) || direction[0] == '#'){
+            continue;
         }
-        else if (chars_to_short(opcode_char) == OACK_OPCODE){
-            if (receive_oack(connection_information, &init_communication_packet.options, buffer) != PACKET_OK_CODE){
-                remove(temp_file_path.c_str());
-                return;
-            }
 
-            //continue sending data
-            read_from_file(connection_information, temp_file_path, &init_communication_packet.options, communication_information->mode, tid_server);
+        string first_path;
+        string second_path;
+        string rest;
+        if ((direction != "get" && direction != "put") || !(fields >> first_path >> second_path) || (fields >> rest)){
+            cout << "ERR: invalid line " << line_number << " of the manifest (expected 'get remote_path local_path' or 'put local_path remote_path')\n";
+            return false;
         }
-        else{           //ACK packet
-            if (receive_ack(connection_information, buffer, 0, default_options.timeout_interval) != PACKET_OK_CODE){
-                remove(temp_file_path.c_str());
-                return;
+
+        manifest_job_t job;
+        job.is_rrq = direction == "get";
+        job.remote_path = job.is_rrq ? first_path : second_path;
+        job.local_path = job.is_rrq ? second_path : first_path;
+        manifest->jobs.push_back(job);
+    }
+
+    if (manifest->jobs.empty()){
+        cout << "ERR: manifest " << manifest->path << " contains no transfers\n";
+        return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Executes one attempt of the job on a new socket (new TID)
+ *
+ * @param job job of the manifest
+ * @param server_address address of the server (resolved once for all jobs)
+ * @param client_options transfer options requested by the client
+ * @param receive_batch batch of the thread
+ * @param session_buffers arenas of the thread reused by its jobs
+ * @return PROG_RET_CODE_OK if the file was transferred, else PROG_RET_CODE_ERR
+ */
+int manifest_job_attempt(manifest_job_t *job, struct sockaddr_in server_address, option_info_t *client_options, receive_batch_t *receive_batch,
+                         session_buffers_t *session_buffers){
+    communication_info_t communication_information;
+    communication_information.mode = MODE_OCTET;
+    communication_information.path_was_given = job->is_rrq;
+    communication_information.multicast = client_options->option_multicast && job->is_rrq;
+    communication_information.resume = client_options->option_resume;
+    communication_information.file_path_source = job->is_rrq ? job->remote_path : "";
+    communication_information.file_path_dest = job->is_rrq ? job->local_path : job->remote_path;
+
+    if (!job->is_rrq){
+        //transfer size of the uploaded file is always known
+        struct stat file_stat;
+        if (stat(job->local_path.c_str(), &file_stat) < 0 || !S_ISREG(file_stat.st_mode)){
+            cout << "ERR: File - file to upload " << job->local_path << " doesn't exist\n";
+            return PROG_RET_CODE_ERR;
+        }
+        communication_information.upload_path = job->local_path;
+        communication_information.upload_size_given = true;
+        communication_information.upload_size = file_stat.st_size;
+    }
+
+    //options of main, only downloads are requested from the multicast group
+    option_info_t option_information = *client_options;
+    option_information.option_multicast = client_options->option_multicast && job->is_rrq;
+
+    connection_info_t connection_information;
+    connection_information.socket = create_socket();
+    connection_information.address = (struct sockaddr *) &server_address;
+    connection_information.address_size = sizeof(server_address);
+
+    //datagrams left from the previous socket are dropped
+    receive_batch->received = 0;
+    receive_batch->next = 0;
+    connection_information.receive_batch = receive_batch;
+
+    rto_estimator_t rto;
+    connection_information.rto = &rto;
+    connection_information.buffers = session_buffers;
+
+    int ret_code = execute_transfer(&connection_information, &communication_information, &option_information);
+    close(connection_information.socket);
+
+    if (ret_code == PROG_RET_CODE_OK){
+        struct stat file_stat;
+        job->bytes = stat(job->local_path.c_str(), &file_stat) == 0 ? file_stat.st_size : 0;
+    }
+    return ret_code;
+}
+
+
+/**
+ * @brief Writes the result of the job on standard output
+ * (`JOB get|put remote_path local_path OK|FAILED attempts=n bytes=n seconds=x throughput=xMB/s`)
+ *
+ * @param job finished job
+ */
+void manifest_job_print(manifest_job_t *job){
+    cout << "JOB " << (job->is_rrq ? "get " : "put ") << job->remote_path << " " << job->local_path
+         << (job->is_completed ? " OK" : " FAILED") << " attempts=" << job->attempts;
+    if (job->is_completed){
+        cout << " bytes=" << job->bytes << " seconds=" << fixed << setprecision(3) << job->seconds
+             << " throughput=" << (job->seconds > 0 ? job->bytes / job->seconds / 1e6 : 0.0) << "MB/s" << defaultfloat;
+    }
+    cout << "\n";
+}
+
+
+/**
+ * @brief Body of the thread, takes the jobs of the manifest one by one until all are taken
+ *
+ * @param manifest manifest shared by the threads
+ * @param server_address address of the server
+ * @param client_options transfer options requested by the client
+ */
+void manifest_worker(manifest_t *manifest, struct sockaddr_in server_address, option_info_t client_options){
+    receive_batch_t receive_batch;
+    session_buffers_t session_buffers;
+
+    for (size_t i = __atomic_fetch_add(&manifest->next_job, 1, __ATOMIC_RELAXED); i < manifest->jobs.size();
+         i = __atomic_fetch_add(&manifest->next_job, 1, __ATOMIC_RELAXED)){
+        manifest_job_t *job = &manifest->jobs[i];
+
+        while (!job->is_completed && job->attempts <= manifest->retries){
+            if (job->attempts > 0){
+                this_thread::sleep_for(chrono::milliseconds(MANIFEST_RETRY_DELAY_MS * job->attempts));
             }
+            job->attempts++;
 
-            //continue sending data
-            read_from_file(connection_information, temp_file_path, &default_options, communication_information->mode, tid_server);
+            auto start = chrono::steady_clock::now();
+            job->is_completed = manifest_job_attempt(job, server_address, &client_options, &receive_batch, &session_buffers) == PROG_RET_CODE_OK;
+            job->seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
         }
 
-        remove(temp_file_path.c_str());
+        pthread_mutex_lock(&manifest->lock);
+        manifest_job_print(job);
+        pthread_mutex_unlock(&manifest->lock);
     }
+
+    buffer_pool_release(&session_buffers);
+
+    //statistics of the thread are added to the totals
+    io_stats_t *stats = get_io_stats();
+    pthread_mutex_lock(&manifest->lock);
+    manifest->io_stats.packets_sent += stats->packets_sent;
+    manifest->io_stats.send_syscalls += stats->send_syscalls;
+    manifest->io_stats.packets_received += stats->packets_received;
+    manifest->io_stats.receive_syscalls += stats->receive_syscalls;
+    manifest->io_stats.wait_syscalls += stats->wait_syscalls;
+    pthread_mutex_unlock(&manifest->lock);
+}
+
+
+/**
+ * @brief Transfers the jobs of the manifest by the given number of threads, failed jobs are retried.
+ * Summary of all jobs is written on standard output
+ * (`MANIFEST jobs=n completed=n failed=n bytes=n seconds=x throughput=xMB/s`).
+ *
+ * @param manifest loaded manifest
+ * @param server_address address of the server (resolved once for all jobs)
+ * @param client_options transfer options requested by the client (same for all jobs)
+ * @return PROG_RET_CODE_OK if all jobs were transferred, else PROG_RET_CODE_ERR
+ */
+int run_manifest(manifest_t *manifest, struct sockaddr_in server_address, option_info_t *client_options){
+    auto start = chrono::steady_clock::now();
+
+    unsigned int threads_number = min((size_t)manifest->concurrency, manifest->jobs.size());
+    vector<thread> threads;
+    for (unsigned int i = 0; i < threads_number; i++){
+        threads.emplace_back(manifest_worker, manifest, server_address, *client_options);
+    }
+    for (thread &worker : threads){
+        worker.join();
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    unsigned long long bytes = 0;
+    size_t completed = 0;
+    for (manifest_job_t &job : manifest->jobs){
+        if (job.is_completed){
+            bytes += job.bytes;
+            completed++;
+        }
+    }
+
+    cout << "MANIFEST jobs=" << manifest->jobs.size() << " completed=" << completed << " failed=" << manifest->jobs.size() - completed
+         << " bytes=" << bytes << " seconds=" << fixed << setprecision(3) << seconds
+         << " throughput=" << (seconds > 0 ? bytes / seconds / 1e6 : 0.0) << "MB/s" << defaultfloat << "\n";
+    log_io_stats(&manifest->io_stats);
+
+    return completed == manifest->jobs.size() ? PROG_RET_CODE_OK : PROG_RET_CODE_ERR;
 }
 
 
@@ -314,22 +1073,26 @@ int main(int argc, char *argv[]) {
     string host;
     int port_host;
 
-    check_program_args(argc, argv, &host, &port_host, &file_path_source, &file_path_dest);
+    //defining transfer communication information
+    communication_info_t communication_information;
+    manifest_t manifest;
 
-    socket_client = create_socket();
+    check_program_args(argc, argv, &host, &port_host, &file_path_source, &file_path_dest, &communication_information, &manifest);
+
+    if (manifest.path != "" && !manifest_load(&manifest)){
+        return PROG_RET_CODE_ERR;
+    }
 
     signal(SIGINT, interrupt_signal_handler);
 
+    //host is resolved once, also for all jobs of the manifest
     struct sockaddr_in server_address = set_host_informations(host, port_host);
 
-    //defining transfer connection information
-    connection_info_t connection_information;
-    connection_information.socket = socket_client;
-    connection_information.address = (struct sockaddr *) &server_address;
-    connection_information.address_size = sizeof(server_address);
+    //largest block, that is not fragmented on the path to the server
+    if (communication_information.blocksize_auto){
+        communication_information.blocksize = path_mtu_blocksize(&server_address);
+    }
 
-    //defining transfer communication information
-    communication_info_t communication_information;
     communication_information.mode = MODE_OCTET;
     communication_information.path_was_given = file_path_source == "" ? false : true;
     communication_information.file_path_source = file_path_source;
@@ -337,15 +1100,51 @@ int main(int argc, char *argv[]) {
 
     //defining transfer option information
     option_info_t option_information;
-    option_information.option_blocksize = false;
-    option_information.blocksize = 512;
+    option_information.option_blocksize = communication_information.blocksize != 0;
+    option_information.blocksize = option_information.option_blocksize ? communication_information.blocksize : DEFAULT_BLOCK_SIZE;
     option_information.option_transfer_size = false;
     option_information.option_timeout_interval = false;
     option_information.timeout_interval = 2;
+    option_information.option_utimeout_interval = false;
+    option_information.utimeout_interval = 0;
+    option_information.option_window_size = communication_information.window_size != 0;
+    option_information.window_size = option_information.option_window_size ? communication_information.window_size : DEFAULT_WINDOW_SIZE;
+    option_information.option_rollover = false;
+    option_information.rollover = DEFAULT_ROLLOVER;
+    option_information.option_multicast = communication_information.multicast;
+    option_information.option_resume = communication_information.resume;
+
+    //jobs of the manifest are transferred by own sockets with the same options
+    if (manifest.path != ""){
+        return run_manifest(&manifest, server_address, &option_information);
+    }
+
+    socket_client = create_socket();
+
+    //defining transfer connection information
+    connection_info_t connection_information;
+    connection_information.socket = socket_client;
+    connection_information.address = (struct sockaddr *) &server_address;
+    connection_information.address_size = sizeof(server_address);
+
+    //datagrams waiting on the socket are received at once
+    receive_batch_t receive_batch;
+    connection_information.receive_batch = &receive_batch;
+
+    //retransmission timeout adapts to the round-trip time
+    rto_estimator_t rto;
+    connection_information.rto = &rto;
+
+    //arenas reused by all blocks of the transfer
+    session_buffers_t session_buffers;
+    connection_information.buffers = &session_buffers;
+
+    int ret_code = execute_transfer(&connection_information, &communication_information, &option_information);
 
-    execute_transfer(&connection_information, &communication_information, &option_information);
+    log_io_stats(get_io_stats());
+    buffer_pool_release(&session_buffers);
 
     close(socket_client);
 
-    return 0;
+    return ret_code;
 }
\ No newline at end of file
@@ -6,7 +6,17 @@
  */
 
 
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
 #include "tftp-communication.hpp"
+#include "tftp-batch-io.hpp"
+#include "tftp-file-source.hpp"
+#include "tftp-metrics.hpp"
+#include "tftp-resume.hpp"
+#include "tftp-shaper.hpp"
 
 int create_socket()
 {
@@ -22,32 +32,63 @@ int create_socket()
 }
 
 
-void close_remove_file(ofstream &file_stream, string file_to_be_remove){
-    file_stream.close();
-    remove(file_to_be_remove.c_str());
+unsigned int path_mtu_blocksize(const struct sockaddr_in *address){
+    int probe_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (probe_socket < 0){
+        return MAX_BLKSIZE_VALUE;
+    }
+
+    //nothing is sent, connecting only chooses the route to the host
+    int mtu = 0;
+    socklen_t mtu_size = sizeof(mtu);
+    int discover = IP_PMTUDISC_DO;
+    if (setsockopt(probe_socket, IPPROTO_IP, IP_MTU_DISCOVER, &discover, sizeof(discover)) < 0 ||
+        connect(probe_socket, (const struct sockaddr *)address, sizeof(*address)) < 0 ||
+        getsockopt(probe_socket, IPPROTO_IP, IP_MTU, &mtu, &mtu_size) < 0){
+        mtu = 0;
+    }
+    close(probe_socket);
+
+    if (mtu <= IP_UDP_HEADERS_SIZE + DATA_PACKET_OFFSET){
+        return MAX_BLKSIZE_VALUE;
+    }
+    unsigned int blocksize = mtu - IP_UDP_HEADERS_SIZE - DATA_PACKET_OFFSET;
+    return max((unsigned int)MIN_BLKSIZE_VALUE, min(blocksize, (unsigned int)MAX_BLKSIZE_VALUE));
 }
 
 
-unsigned int get_cin_size(string temp_path){
-    namespace fs = std::filesystem;
+void close_remove_file(disk_file_t *file, string file_to_be_remove){
+    disk_file_close(file);
+    remove(file_to_be_remove.c_str());
+}
 
-    char data_block[CLIENT_READ_FILE_SIZE];
-    int loaded_actual;
-    ofstream file_write(temp_path);
 
-    //writing standard input into temporary file
-    while ((loaded_actual = cin.read(data_block, CLIENT_READ_FILE_SIZE).gcount()) != 0){
-        file_write.write(data_block, loaded_actual);
+bool get_cin_size(unsigned long long *size){
+    struct stat file_stat;
+    if (fstat(STDIN_FILENO, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)){
+        return false;
     }
 
-    file_write.close();
-    return (unsigned int) fs::file_size(temp_path);
+    //part of the file may be already consumed by the shell
+    off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (offset < 0 || offset > file_stat.st_size){
+        offset = 0;
+    }
+    *(size) = file_stat.st_size - offset;
+    return true;
 }
 
 int negotiate_option_client(option_info_t *client_options, option_info_t *server_options, string* error_message){
     if ((server_options->option_blocksize && !client_options->option_blocksize) ||
         (server_options->option_timeout_interval && !client_options->option_timeout_interval) ||
-        (server_options->option_transfer_size && !client_options->option_transfer_size)){
+        (server_options->option_utimeout_interval && !client_options->option_utimeout_interval) ||
+        (server_options->option_transfer_size && !client_options->option_transfer_size) ||
+        (server_options->option_window_size && !client_options->option_window_size) ||
+        (server_options->option_rollover && !client_options->option_rollover) ||
+        (server_options->option_multicast && !client_options->option_multicast) ||
+        (server_options->option_offset && !client_options->option_offset) ||
+        (server_options->option_length && !client_options->option_length) ||
+        (server_options->option_resume && !client_options->option_resume)){
             return ERR_CODE_OPTIONS_FAILED;     //server must not send an option which client didnt requested
         }
 
@@ -76,6 +117,88 @@ int negotiate_option_client(option_info_t *client_options, option_info_t *server
     else{
         client_options->timeout_interval = DEFAULT_TIMEOUT;
     }
+    if (client_options->option_utimeout_interval && server_options->option_utimeout_interval){    //negotiate utimeout interval option
+        if (client_options->utimeout_interval != server_options->utimeout_interval ||
+         server_options->utimeout_interval < MIN_UTIMEOUT_VALUE ||
+         server_options->utimeout_interval > MAX_UTIMEOUT_VALUE){
+            *(error_message) = "Utimeout interval - offered value was not accepted";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+    }
+    else{
+        client_options->utimeout_interval = 0;
+    }
+    if (client_options->option_window_size && server_options->option_window_size){      //negotiate window size option
+        if (client_options->window_size < server_options->window_size ||
+         server_options->window_size < MIN_WINDOWSIZE_VALUE ||
+         server_options->window_size > MAX_WINDOWSIZE_VALUE){
+            *(error_message) = "Window size - offered value was not accepted";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+        else{
+            client_options->window_size = server_options->window_size;
+        }
+    }
+    else{
+        client_options->window_size = DEFAULT_WINDOW_SIZE;
+    }
+
+    if (client_options->option_rollover && server_options->option_rollover){        //negotiate rollover option
+        if (client_options->rollover != server_options->rollover){
+            *(error_message) = "Rollover - offered value was not accepted";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+    }
+    else{
+        client_options->rollover = DEFAULT_ROLLOVER;
+    }
+
+    if (client_options->option_multicast && server_options->option_multicast){      //multicast group assigned by the server
+        if (server_options->multicast_port == 0 || !IN_MULTICAST(ntohl(server_options->multicast_address))){
+            *(error_message) = "Multicast - offered group is not a multicast address and port";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+        client_options->multicast_address = server_options->multicast_address;
+        client_options->multicast_port = server_options->multicast_port;
+        client_options->multicast_master = server_options->multicast_master;
+    }
+    else{
+        client_options->option_multicast = false;      //file is received by unicast
+    }
+
+    if (client_options->option_offset && server_options->option_offset){      //range of the file sent by the server
+        if (server_options->offset != client_options->offset ||
+         (client_options->option_length && !server_options->option_length) ||
+         (client_options->length != 0 && server_options->length > client_options->length)){
+            *(error_message) = "Offset and length - offered range was not accepted";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+        client_options->length = server_options->option_length ? server_options->length : 0;
+    }
+    else{
+        //whole file is sent
+        client_options->option_offset = false;
+        client_options->option_length = false;
+        client_options->offset = 0;
+        client_options->length = 0;
+    }
+
+    if (client_options->option_resume && server_options->option_resume){      //prefix of the file, that the transfer continues behind
+        //offered prefix of the download is accepted or the whole file is sent, prefix of the upload is chosen by the server
+        if (client_options->resume_bytes != 0 && server_options->resume_bytes != 0 &&
+            (server_options->resume_bytes != client_options->resume_bytes || server_options->resume_checksum != client_options->resume_checksum)){
+            *(error_message) = "Resume - offered prefix was not accepted";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+        client_options->resume_bytes = server_options->resume_bytes;
+        client_options->resume_checksum = server_options->resume_checksum;
+    }
+    else{
+        //transfer starts from the beginning
+        client_options->option_resume = false;
+        client_options->resume_bytes = 0;
+        client_options->resume_checksum = ADLER32_INITIAL;
+    }
 
     return PACKET_OK_CODE;
 }
@@ -88,7 +211,8 @@ int negotiate_option_server(option_info_t *client_options, option_info_t *server
             return ERR_CODE_OPTIONS_FAILED;
         }
         else{
-            server_options->blocksize = client_options->blocksize;
+            //bigger blocks would be fragmented on the path to the client, the client accepts a smaller value
+            server_options->blocksize = min(client_options->blocksize, server_options->blocksize_limit);
         }
     }
     else{
@@ -109,22 +233,159 @@ int negotiate_option_server(option_info_t *client_options, option_info_t *server
         server_options->timeout_interval = DEFAULT_TIMEOUT;
     }
 
+    //set server utimeout interval option
+    if (client_options->option_utimeout_interval && server_options->option_utimeout_interval){
+        if (client_options->utimeout_interval < MIN_UTIMEOUT_VALUE || client_options->utimeout_interval > MAX_UTIMEOUT_VALUE){
+            *(error_message) = "Utimeout interval - offered value is outside of range of alloved values <10000, 255000000>";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+        else{
+            server_options->utimeout_interval = client_options->utimeout_interval;
+        }
+    }
+    else{
+        server_options->utimeout_interval = 0;
+    }
+
+    //set server window size option
+    if (client_options->option_window_size && server_options->option_window_size){
+        if (client_options->window_size < MIN_WINDOWSIZE_VALUE || client_options->window_size > MAX_WINDOWSIZE_VALUE){
+            *(error_message) = "Window size - offered value is outside of range of alloved values <1, 65535>";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+        else{
+            server_options->window_size = client_options->window_size;
+        }
+    }
+    else{
+        server_options->window_size = DEFAULT_WINDOW_SIZE;
+    }
+
+    //set server rollover option
+    if (client_options->option_rollover && server_options->option_rollover){
+        if (client_options->rollover > 1){
+            *(error_message) = "Rollover - offered value is outside of range of alloved values <0, 1>";
+            return ERR_CODE_OPTIONS_FAILED;
+        }
+        else{
+            server_options->rollover = client_options->rollover;
+        }
+    }
+    else{
+        server_options->rollover = DEFAULT_ROLLOVER;
+    }
+
+    //set server range of the file (offset and length options)
+    if (client_options->option_offset && server_options->option_offset){
+        server_options->offset = client_options->offset;
+        server_options->length = client_options->option_length ? client_options->length : 0;
+    }
+    else{
+        server_options->offset = 0;
+        server_options->length = 0;
+    }
+
+    //set server resume of the interrupted transfer (prefix is verified by negotiate_range_server or negotiate_resume_upload_server)
+    if (client_options->option_resume && server_options->option_resume){
+        server_options->resume_bytes = client_options->resume_bytes;
+        server_options->resume_checksum = client_options->resume_checksum;
+    }
+    else{
+        server_options->option_resume = false;
+        server_options->resume_bytes = 0;
+        server_options->resume_checksum = ADLER32_INITIAL;
+    }
+
     return PACKET_OK_CODE;
 }
 
-int recvfrom_timeout(connection_info_t *connection_information, option_info_t *option_information, char *buffer, int times_retransmitted){
+
+void negotiate_range_server(option_info_t *server_options, string path, string mode, resume_check_t *prefix_check){
+    struct stat file_stat;
+    if (mode == MODE_NETASCII || stat(path.c_str(), &file_stat) < 0){
+        //converted data are longer than the file, whole file is sent
+        server_options->option_offset = false;
+        server_options->option_length = false;
+        server_options->offset = 0;
+        server_options->length = 0;
+        server_options->resume_bytes = 0;
+        server_options->resume_checksum = ADLER32_INITIAL;
+        return;
+    }
+
+    //resumed download continues behind the prefix of the client, when the file has the same prefix (not combined with a range)
+    if (server_options->resume_bytes != 0){
+        bool is_same_prefix = false;
+        if (prefix_check != NULL){
+            is_same_prefix = server_options->offset == 0 && server_options->length == 0 && prefix_check->is_valid &&
+                             prefix_check->bytes == server_options->resume_bytes && prefix_check->checksum == server_options->resume_checksum;
+        }
+        else{
+            unsigned int checksum = ADLER32_INITIAL;
+            int file_descriptor = open(path.c_str(), O_RDONLY);
+            is_same_prefix = file_descriptor >= 0 && server_options->offset == 0 && server_options->length == 0 &&
+                             resume_checksum_file(file_descriptor, 0, server_options->resume_bytes, &checksum) &&
+                             checksum == server_options->resume_checksum;
+            if (file_descriptor >= 0){
+                close(file_descriptor);
+            }
+        }
+
+        if (is_same_prefix){
+            server_options->offset = server_options->resume_bytes;
+        }
+        else{
+            server_options->resume_bytes = 0;
+            server_options->resume_checksum = ADLER32_INITIAL;
+        }
+    }
+
+    unsigned long long file_size = file_stat.st_size;
+    server_options->offset = min(server_options->offset, file_size);
+    if (server_options->length == 0 || server_options->length > file_size - server_options->offset){
+        server_options->length = file_size - server_options->offset;
+    }
+}
+
+void negotiate_resume_upload_server(option_info_t *server_options, string path, string mode, resume_check_t *prefix_check){
+    //client uploads the rest of the partial file kept by the interrupted upload, when its data have the same prefix
+    resume_info_t partial;
+    bool is_valid = false;
+    if (server_options->option_resume && mode != MODE_NETASCII){
+        //prefix verified in the background is used only while the sidecar records the same prefix
+        is_valid = prefix_check == NULL ? resume_load(path, &partial) :
+                   resume_read(path, &partial) && (partial.is_verified || (prefix_check->is_valid &&
+                   partial.bytes == prefix_check->bytes && partial.checksum == prefix_check->checksum));
+    }
+
+    if (is_valid){
+        server_options->resume_bytes = partial.bytes;
+        server_options->resume_checksum = partial.checksum;
+    }
+    else{
+        server_options->resume_bytes = 0;
+        server_options->resume_checksum = ADLER32_INITIAL;
+    }
+}
+
+int recvfrom_timeout(connection_info_t *connection_information, option_info_t *option_information, char *buffer, int times_retransmitted, bool adaptive_timeout){
     fd_set read_sockets;
     FD_ZERO(&read_sockets);
     FD_SET(connection_information->socket, &read_sockets);
 
-    int current_timeout_interval = option_information->timeout_interval;
-    if (times_retransmitted != 0){
-        current_timeout_interval *= (EXPONENTIAL_BACKOFF_MULTIPLIER * times_retransmitted);
+    //estimated timeout (millisecond resolution) or the negotiated one, with exponential backoff
+    rto_estimator_t *rto = adaptive_timeout ? connection_information->rto : NULL;
+    unsigned long current_timeout_us = rto_timeout_us(rto, option_information, times_retransmitted);
+
+    receive_batch_t *batch = connection_information->receive_batch;
+    unsigned int datagram_size = option_information->blocksize + DATA_PACKET_OFFSET;
+    if (batch != NULL && batch->next < batch->received){
+        return receive_batch_copy(connection_information, batch, buffer, datagram_size);      //already received datagram
     }
 
-    //Exponenitial backoff
-    struct timeval timeout = {current_timeout_interval, 0};
+    struct timeval timeout = {(time_t)(current_timeout_us / 1000000), (suseconds_t)(current_timeout_us % 1000000)};
 
+    get_io_stats()->wait_syscalls++;
     int selected = select(connection_information->socket + 1 , &read_sockets , NULL , NULL , &timeout);
     if(selected == -1){
         cout << "ERROR: select - error\n";
@@ -135,24 +396,82 @@ int recvfrom_timeout(connection_info_t *connection_information, option_info_t *o
         return ERR_CODE_TIMEOUT;
     }
 
-    return recvfrom(connection_information->socket, buffer, option_information->blocksize + 4, 0,
+    if (batch != NULL){
+        //receiving all waiting datagrams at once
+        if (batch->slot_size != datagram_size + IO_BATCH_PADDING){
+            receive_batch_prepare(batch, datagram_size);
+        }
+        if (receive_batch_fill(batch, connection_information->socket, MSG_DONTWAIT) < 0){
+            return -1;
+        }
+        return receive_batch_copy(connection_information, batch, buffer, datagram_size);
+    }
+
+    get_io_stats()->receive_syscalls++;
+    int bytes_rx = recvfrom(connection_information->socket, buffer, datagram_size, 0,
                     connection_information->address, &connection_information->address_size);
+    if (bytes_rx >= 0){
+        memset(buffer + bytes_rx, 0, IO_BATCH_PADDING);     //buffer is reused without clearing, parsing relies on the zero Bytes
+        get_io_stats()->packets_received++;
+        metrics_count_received(1, bytes_rx);
+    }
+    return bytes_rx;
+}
+
+int receive_batch_copy(connection_info_t *connection_information, receive_batch_t *batch, char *buffer, unsigned int buffer_size){
+    int bytes_rx;
+    struct sockaddr_in source_address;
+
+    char *datagram = receive_batch_next(batch, &bytes_rx, &source_address);
+    if (datagram == NULL){
+        return -1;
+    }
+
+    bytes_rx = min((unsigned int)bytes_rx, buffer_size);
+    memcpy(buffer, datagram, bytes_rx);
+    memset(buffer + bytes_rx, 0, IO_BATCH_PADDING);
+    memcpy(connection_information->address, &source_address, sizeof(source_address));
+    connection_information->address_size = sizeof(source_address);
+    return bytes_rx;
 }
 
 int recvfrom_retransmit(connection_info_t *connection_information, option_info_t *option_information, char *buffer, string packet, int tid_expected){
+    deque<string> packets = {packet};
+    return recvfrom_retransmit(connection_information, option_information, buffer, packets, tid_expected);
+}
+
+int recvfrom_retransmit(connection_info_t *connection_information, option_info_t *option_information, char *buffer, deque<string> &packets, int tid_expected){
+    return recvfrom_retransmit(connection_information, option_information, buffer, &packets, NULL, tid_expected);
+}
+
+int recvfrom_retransmit(connection_info_t *connection_information, option_info_t *option_information, char *buffer, data_window_t *window, int tid_expected){
+    return recvfrom_retransmit(connection_information, option_information, buffer, NULL, window, tid_expected);
+}
+
+int recvfrom_retransmit(connection_info_t *connection_information, option_info_t *option_information, char *buffer, deque<string> *packets, data_window_t *window, int tid_expected){
     int return_value = -1;
-    for (int i = 0; i <= MAX_RETRANSMIT_ATTEMPTS; i++){
-        if (i == MAX_RETRANSMIT_ATTEMPTS){
+    for (int i = 0; ; i++){
+        if (rto_give_up(connection_information->rto, option_information, i)){
+            metrics_count_timeout();
             return -1;
         }
 
         return_value = recvfrom_timeout(connection_information, option_information, buffer, i);
 
         if (return_value == ERR_CODE_TIMEOUT){
-            //retransmit packet
-            int bytes_tx = sendto(connection_information->socket, packet.c_str(), packet.size(), 0,
-                            connection_information->address, connection_information->address_size);
-            if (bytes_tx < 0) cout << "ERROR: sendto - client WRQ/RRQ packet\n";
+            rto_sample_cancel(connection_information->rto);
+            metrics_count_retransmission();
+
+            //retransmit packets (whole window is sent again from the last acked block)
+            if (window != NULL){
+                send_data_blocks(connection_information, window);
+                if (window->is_failed){
+                    return -1;
+                }
+            }
+            else{
+                send_packets(connection_information, *packets);
+            }
         }
         else if (return_value < 0){
             return -1;
@@ -161,7 +480,7 @@ int recvfrom_retransmit(connection_info_t *connection_information, option_info_t
             //checking if the TID of host is valid
             if((htons(((struct sockaddr_in*)connection_information->address)->sin_port) != tid_expected) && tid_expected != TID_NOT_SET_YET){
                 i--;
-                log_stranger_packet(connection_information, buffer);
+                log_stranger_packet(connection_information, buffer, return_value);
                 string error_message = "Invalid TID - Transfer ID doesn't match established communication";
                 send_error_packet(connection_information, ERR_CODE_UNKNOWN_TID, error_message, DEFAULT_TIMEOUT, false);
                 continue;
@@ -175,7 +494,7 @@ int recvfrom_retransmit(connection_info_t *connection_information, option_info_t
     return return_value;
 }
 
-string send_wrq_rrq(connection_info_t *connection_information, communication_info_t *communication_information, tftp_rrq_wrq_packet_t *init_communication_packet, option_info_t *option_information, bool is_rrq, string temp_path){
+string send_wrq_rrq(connection_info_t *connection_information, communication_info_t *communication_information, tftp_rrq_wrq_packet_t *init_communication_packet, option_info_t *option_information, bool is_rrq){
     init_communication_packet->mode = communication_information->mode;
     init_communication_packet->options = *option_information;
 
@@ -186,16 +505,25 @@ string send_wrq_rrq(connection_info_t *connection_information, communication_inf
         init_communication_packet->opcode = RRQ_OPCODE;
     }
     else{
-        //setting WRQ packet
-        init_communication_packet->options.transfer_size = get_cin_size(temp_path);
+        //setting WRQ packet, transfer size is sent only when the size of the input is known
+        unsigned long long cin_size;
+        if (communication_information->upload_size_given){
+            init_communication_packet->options.option_transfer_size = true;
+            init_communication_packet->options.transfer_size = communication_information->upload_size;
+        }
+        else if (get_cin_size(&cin_size)){
+            init_communication_packet->options.transfer_size = cin_size;
+        }
+        else{
+            init_communication_packet->options.option_transfer_size = false;
+        }
         init_communication_packet->filename = communication_information->file_path_dest;
         init_communication_packet->opcode = WRQ_OPCODE;
     }
 
     string packet = serialize_packet_struct(init_communication_packet);
 
-    int bytes_tx = sendto(connection_information->socket, packet.c_str(), packet.size(), 0,
-                            connection_information->address, connection_information->address_size);
+    int bytes_tx = send_packet(connection_information, packet);
     if (bytes_tx < 0) cout << "ERROR: sendto - client WRQ/RRQ packet\n";
 
     return packet;
@@ -207,25 +535,74 @@ string send_ack(connection_info_t *connection_information, int block_number){
 
     string ack_packet = serialize_packet_struct(&ack_packet_struct);
 
-    int bytes_tx = sendto(connection_information->socket, ack_packet.c_str(), ack_packet.size(), 0,
-                            connection_information->address, connection_information->address_size);
+    int bytes_tx = send_packet(connection_information, ack_packet);
     if (bytes_tx < 0) cout << "ERROR: sendto - sending acknowledgment\n";
 
     return ack_packet;
 }
 
-string send_data(connection_info_t *connection_information, int block_number, char *data_block, int loaded_actual){
+int send_data(connection_info_t *connection_information, data_block_t *block){
+    struct iovec iovecs[2] = {{block->header, DATA_PACKET_OFFSET}, {block->payload, block->payload_size}};
+
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_name = connection_information->address;
+    message.msg_namelen = connection_information->address_size;
+    message.msg_iov = iovecs;
+    message.msg_iovlen = 2;
+
+    get_io_stats()->send_syscalls++;
+    int bytes_tx = sendmsg(connection_information->socket, &message, 0);
+    if (bytes_tx < 0){
+        cout << "ERROR: sendmsg - sending data\n";
+    }
+    else{
+        get_io_stats()->packets_sent++;
+        metrics_count_sent(1, bytes_tx);
+    }
+
+    return bytes_tx;
+}
+
+bool acquire_session_buffers(connection_info_t *connection_information, size_t receive_size, size_t send_size){
+    if (buffer_pool_acquire(connection_information->buffers, receive_size, send_size)){
+        return true;
+    }
+
+    cout << "ERROR: session buffers - memory limit reached\n";
+    send_error_packet(connection_information, ERR_CODE_NOT_DEF, "Server busy - not enough memory for the session", DEFAULT_TIMEOUT, false);
+    return false;
+}
+
+void data_window_init(data_window_t *window, unsigned int window_size, unsigned int blocksize, char *payloads){
+    window->blocks.assign(window_size, data_block_t());
+    window->payloads = payloads;
+    window->blocksize = blocksize;
+    window->first = 0;
+    window->count = 0;
+    window->is_failed = false;
+}
+
+data_block_t *data_window_push(data_window_t *window, ushort block_number){
+    unsigned int slot = (window->first + window->count++) % window->blocks.size();
+
     tftp_data_packet_t data_packet_struct;
     data_packet_struct.block_number = block_number;
-    data_packet_struct.data = data_block;
 
-    string data_packet = serialize_packet_struct(&data_packet_struct, loaded_actual);
+    data_block_t *block = &window->blocks[slot];
+    serialize_data_header(&data_packet_struct, block->header);
+    block->payload = window->payloads != NULL ? window->payloads + (size_t)slot * window->blocksize : NULL;
+    block->payload_size = 0;
+    return block;
+}
 
-    int bytes_tx = sendto(connection_information->socket, data_packet.c_str(), data_packet.size(), 0,
-                            connection_information->address, connection_information->address_size);
-    if (bytes_tx < 0) cout << "ERROR: sendto - sending data\n";
+data_block_t *data_window_at(data_window_t *window, unsigned int index){
+    return &window->blocks[(window->first + index) % window->blocks.size()];
+}
 
-    return data_packet;
+void data_window_pop(data_window_t *window, unsigned int acked_count){
+    window->first = (window->first + acked_count) % window->blocks.size();
+    window->count -= acked_count;
 }
 
 string send_oack(connection_info_t *connection_information, option_info_t *init_options, option_info_t *server_options, string path, bool is_rrq){
@@ -240,23 +617,64 @@ string send_oack(connection_info_t *connection_information, option_info_t *init_
     if (!init_options->option_timeout_interval){
         server_options->option_timeout_interval = false;
     }
+    if (!init_options->option_utimeout_interval){
+        server_options->option_utimeout_interval = false;
+    }
+    if (!init_options->option_window_size){
+        server_options->option_window_size = false;
+    }
+    if (!init_options->option_rollover){
+        server_options->option_rollover = false;
+    }
+    if (!init_options->option_multicast){
+        server_options->option_multicast = false;
+    }
+    if (!init_options->option_offset || !is_rrq){
+        server_options->option_offset = false;
+    }
+    if (!init_options->option_length || !server_options->option_offset){
+        server_options->option_length = false;
+    }
+    if (!init_options->option_resume){
+        server_options->option_resume = false;
+    }
     if (!init_options->option_transfer_size){
         server_options->option_transfer_size = false;
     }
     else{
-        server_options->transfer_size = is_rrq ? (unsigned int) fs::file_size(path) : init_options->transfer_size;
+        server_options->transfer_size = is_rrq ? (unsigned long long) fs::file_size(path) : init_options->transfer_size;
     }
 
     oack_packet_struct.options = *server_options;
 
     string oack_packet = serialize_packet_struct(&oack_packet_struct);
-    int bytes_tx = sendto(connection_information->socket, oack_packet.c_str(), oack_packet.size(), 0,
-                            connection_information->address, connection_information->address_size);
+    int bytes_tx = send_packet(connection_information, oack_packet);
     if (bytes_tx < 0) cout << "ERROR: sendto - server initialization communication acknowledgment\n";
 
     return oack_packet;
 }
 
+int send_disk_error(connection_info_t *connection_information, int error_number, unsigned int error_timeout, bool timeout_enable){
+    int error_code;
+    string error_message;
+    if (error_number == ENOSPC || error_number == EDQUOT || error_number == EFBIG){
+        error_code = ERR_CODE_DISK_FULL;
+        error_message = "Disk full or allocation exceeded";
+    }
+    else if (error_number == EACCES || error_number == EPERM || error_number == EROFS){
+        error_code = ERR_CODE_ACCESS_VIOLATION;
+        error_message = "Access violation";
+    }
+    else{
+        error_code = ERR_CODE_NOT_DEF;
+        error_message = string("Writing into the file has failed - ") + strerror(error_number);
+    }
+
+    cout << "ERROR: writing into the file - " << strerror(error_number) << "\n";
+    send_error_packet(connection_information, error_code, error_message, error_timeout, timeout_enable);
+    return error_code;
+}
+
 string send_error_packet(connection_info_t *connection_information, int error_code, string error_message, unsigned int error_timeout, bool timeout_enable){
     tftp_error_packet_t error_packet_struct;
     error_packet_struct.error_code = error_code;
@@ -264,20 +682,20 @@ string send_error_packet(connection_info_t *connection_information, int error_co
 
     option_info_t option_information_err;
     option_information_err.timeout_interval = error_timeout;
-    char buffer[option_information_err.blocksize + DATA_PACKET_OFFSET];
+    char buffer[DEFAULT_BLOCK_SIZE + DATA_PACKET_OFFSET + IO_BATCH_PADDING];      //any reply only ends the waiting
 
     string error_packet = serialize_packet_struct(&error_packet_struct);
+    metrics_count_error(error_code, true);
 
     for(int i = 0; i < MAX_RETRANSMIT_ATTEMPTS; i++){
-        int bytes_tx = sendto(connection_information->socket, error_packet.c_str(), error_packet.size(), 0,
-                                connection_information->address, connection_information->address_size);
+        int bytes_tx = send_packet(connection_information, error_packet);
         if (bytes_tx < 0) cout << ("ERROR: sendto - sending error\n");
 
         if (!timeout_enable){
             break;
         }
 
-        int recv_timeout_ret_code = recvfrom_timeout(connection_information, &option_information_err, buffer, i);
+        int recv_timeout_ret_code = recvfrom_timeout(connection_information, &option_information_err, buffer, i, false);
         if (recv_timeout_ret_code == ERR_CODE_TIMEOUT){
             //error message was most probably successfully delivered
             break;
@@ -290,22 +708,27 @@ string send_error_packet(connection_info_t *connection_information, int error_co
     return error_packet;
 }
 
-int receive_wrq_rrq(connection_info_t *connection_information, tftp_rrq_wrq_packet_t *init_communication_packet, char *buffer){
+int receive_wrq_rrq(connection_info_t *connection_information, tftp_rrq_wrq_packet_t *init_communication_packet, char *buffer, int bytes_rx){
     string error_message;
-    deserialize_packet_struct(init_communication_packet, buffer);
+    if (deserialize_packet_struct(init_communication_packet, buffer, bytes_rx) != PACKET_OK_CODE){
+        error_message = "Malformed request packet";
+        send_error_packet(connection_information, ERR_CODE_ILLEGAL_OPERATION, error_message, DEFAULT_TIMEOUT, false);
+        return ERR_CODE_ILLEGAL_OPERATION;
+    }
 
     //log
     log_wrq_rrq(connection_information, init_communication_packet);
 
     int return_code = check_packet_content(init_communication_packet, &error_message);
     if (return_code != PACKET_OK_CODE){
-        send_error_packet(connection_information, return_code, error_message);
+        send_error_packet(connection_information, return_code, error_message, DEFAULT_TIMEOUT, false);
         return return_code;
     }
     return PACKET_OK_CODE;
 }
 
-int receive_ack(connection_info_t *connection_information, char *buffer, int expected_block_number, unsigned int timeout){
+int receive_ack(connection_info_t *connection_information, char *buffer, block_index_t expected_block_index, unsigned int timeout, unsigned int blocks_in_flight,
+                block_index_t *acked_block_index, unsigned int rollover){
     string error_message;
 
     tftp_ack_packet_t ack_packet_init;
@@ -314,19 +737,27 @@ int receive_ack(connection_info_t *connection_information, char *buffer, int exp
     //log
     log_ack(connection_information, &ack_packet_init);
 
-    int return_code = check_packet_content(&ack_packet_init, expected_block_number, &error_message);
+    if (acked_block_index != NULL){
+        *(acked_block_index) = block_index_from_number(ack_packet_init.block_number, expected_block_index, rollover);
+    }
+
+    int return_code = check_packet_content(&ack_packet_init, expected_block_index, &error_message, blocks_in_flight, rollover);
     if (return_code == ERR_CODE_ILLEGAL_OPERATION){
         send_error_packet(connection_information, return_code, error_message, timeout);
     }
     return return_code;
 }
 
-int receive_oack(connection_info_t *connection_information, option_info_t *init_options, char *buffer){
+int receive_oack(connection_info_t *connection_information, option_info_t *init_options, char *buffer, int bytes_rx){
     namespace fs = std::filesystem;
     string error_message;
 
     tftp_oack_packet_t oack_packet_struct;
-    deserialize_packet_struct(&oack_packet_struct, buffer);
+    if (deserialize_packet_struct(&oack_packet_struct, buffer, bytes_rx) != PACKET_OK_CODE){
+        error_message = "Malformed OACK packet";
+        send_error_packet(connection_information, ERR_CODE_ILLEGAL_OPERATION, error_message);
+        return ERR_CODE_ILLEGAL_OPERATION;
+    }
 
     //log
     log_oack(connection_information, &oack_packet_struct);
@@ -344,10 +775,15 @@ int receive_oack(connection_info_t *connection_information, option_info_t *init_
             return ERR_CODE_DISK_FULL;
         }
     }
+
+    //transfer size is known only when the server sent it (size of the downloaded file)
+    init_options->option_transfer_size = oack_packet_struct.options.option_transfer_size;
+    init_options->transfer_size = oack_packet_struct.options.transfer_size;
     return PACKET_OK_CODE;
 }
 
-int receive_data(connection_info_t *connection_information, char *buffer, int bytes_read, ofstream &file_write, string mode, unsigned int timeout, int expected_block_number){
+int receive_data(connection_info_t *connection_information, char *buffer, int bytes_read, disk_file_t *file_write, string mode, option_info_t *options, block_index_t expected_block_index,
+                 netascii_state_t *netascii_state, bool is_last_block){
     string error_message;
 
     tftp_data_packet_t data_packet;
@@ -355,48 +791,68 @@ int receive_data(connection_info_t *connection_information, char *buffer, int by
 
     log_data(connection_information, &data_packet);
 
-    int return_code = check_packet_content(&data_packet, expected_block_number, &error_message);
+    int return_code = check_packet_content(&data_packet, expected_block_index, &error_message, options->window_size, options->rollover);
     if (return_code == ERR_CODE_ILLEGAL_OPERATION){
-        send_error_packet(connection_information, return_code, error_message, timeout);
+        send_error_packet(connection_information, return_code, error_message, options->timeout_interval);
         return return_code;
     }
-    else if (return_code == DUPLICATED_PACKET){
+    else if (return_code == DUPLICATED_PACKET || return_code == OUT_OF_ORDER_PACKET){
         return return_code;
     }
 
-    //formating NETASCII data (to linux notation).
-    if (mode == MODE_NETASCII){
-        for (int i = 0; i < bytes_read - DATA_PACKET_OFFSET; i++){
-            if (data_packet.data[i] == CR_VALUE){
-                if (data_packet.data[i + 1] == '\n'){
-                    memmove(&data_packet.data[i], &data_packet.data[i + 1], bytes_read - i - 1);
-                    bytes_read--;
-                    i--;
-                }
-                else if(data_packet.data[i + 1] == '\x00'){
-                    memmove(&data_packet.data[i + 1], &data_packet.data[i + 2], bytes_read - i - 2);
-                    bytes_read--;
-                }
-            }
-        }
-    }
-
     //writing data into the file
-    file_write.write(data_packet.data, bytes_read - DATA_PACKET_OFFSET);
+    int error_number = write_data_block(file_write, data_packet.data, bytes_read - DATA_PACKET_OFFSET, mode, netascii_state, is_last_block,
+                                        connection_information->buffers->send);
+    if (error_number != 0){
+        return send_disk_error(connection_information, error_number, options->timeout_interval);
+    }
 
     return PACKET_OK_CODE;
 }
 
-void receive_error(connection_info_t *connection_information, char *buffer){
+int write_data_block(disk_file_t *file_write, char *data, int data_size, string mode, netascii_state_t *netascii_state, bool is_last_block, char *text){
+    int error_number;
+    if (mode != MODE_NETASCII){
+        error_number = disk_file_write(file_write, data, data_size);
+    }
+    else{
+        //formating NETASCII data (to linux notation), CR at the end of the last block is written as it is
+        size_t text_size = netascii_decode(data, data_size, text, netascii_state);
+        if (is_last_block){
+            text_size += netascii_decode_end(text + text_size, netascii_state);
+        }
+        error_number = disk_file_write(file_write, text, text_size);
+    }
+
+    //the last Ack confirms, that the whole file is written
+    if (error_number == 0 && is_last_block){
+        error_number = disk_file_flush(file_write);
+    }
+    return error_number;
+}
+
+void receive_error(connection_info_t *connection_information, char *buffer, int bytes_rx){
     tftp_error_packet_t error_packet_struct;
-    deserialize_packet_struct(&error_packet_struct, buffer);
+    deserialize_packet_struct(&error_packet_struct, buffer, bytes_rx);      //malformed message is logged as received
     log_error(connection_information, &error_packet_struct);
+    metrics_count_error(error_packet_struct.error_code, false);
 }
 
-int write_to_file(connection_info_t *connection_information, option_info_t *options, ofstream &file_write, string packet_to_be_send, string mode, int tid_expected, int expected_block_number){
+int write_to_file(connection_info_t *connection_information, option_info_t *options, disk_file_t *file_write, string packet_to_be_send, string mode, int tid_expected, block_index_t expected_block_index,
+                  netascii_state_t *netascii_state){
     string error_message = "";
     int datagram_size = options->blocksize + DATA_PACKET_OFFSET;
-    char buffer[datagram_size];
+
+    //received Data and decoded NETASCII text are stored in the arenas of the session, reused by all blocks
+    if (!acquire_session_buffers(connection_information, datagram_size, mode == MODE_NETASCII ? options->blocksize + 1 : 0)){
+        return PROG_RET_CODE_ERR;
+    }
+    char *buffer = connection_information->buffers->receive;
+    deque<string> packets_in_flight = {packet_to_be_send};     //last sent Ack, retransmitted on timeout
+
+    unsigned int window_size = options->window_size;
+    unsigned int received_in_window = 0;
+    bool gap_acked = false;
 
     while (true){
 
@@ -404,49 +860,81 @@ int write_to_file(connection_info_t *connection_information, option_info_t *opti
         int bytes_rx;
         int receive_data_ret_code;
         do{
-            bzero(buffer, datagram_size);
-
-            bytes_rx = recvfrom_retransmit(connection_information, options, buffer, packet_to_be_send, tid_expected);
+            bytes_rx = recvfrom_retransmit(connection_information, options, buffer, packets_in_flight, tid_expected);
             if (bytes_rx < 0){
                 return PROG_RET_CODE_ERR;
             }
 
             char opcode_char[2] = {buffer[0], buffer[1]};
             if (chars_to_short(opcode_char) == ERROR_OPCODE){
-                receive_error(connection_information, buffer);
+                receive_error(connection_information, buffer, bytes_rx);
                 return PROG_RET_CODE_ERR;
             }
 
-            receive_data_ret_code = receive_data(connection_information, buffer, bytes_rx, file_write, mode, options->timeout_interval, expected_block_number);
+            receive_data_ret_code = receive_data(connection_information, buffer, bytes_rx, file_write, mode, options, expected_block_index,
+                                                 netascii_state, bytes_rx < datagram_size);
 
-            if (receive_data_ret_code == ERR_CODE_ILLEGAL_OPERATION){
+            if(receive_data_ret_code == PACKET_OK_CODE){
+                break;
+            }
+            else if (receive_data_ret_code != DUPLICATED_PACKET && receive_data_ret_code != OUT_OF_ORDER_PACKET){
+                //illegal operation or failed writing into the file
                 return PROG_RET_CODE_ERR;
             }
-            else if(receive_data_ret_code == PACKET_OK_CODE){
-                break;
+            else if(receive_data_ret_code == OUT_OF_ORDER_PACKET){
+                //block of the window was lost - acknowledging the last in-order block once, sender goes back to it
+                rto_sample_cancel(connection_information->rto);
+                if (!gap_acked){
+                    packets_in_flight.front() = send_ack(connection_information, block_number_from_index(expected_block_index - 1, options->rollover));
+                    gap_acked = true;
+                    received_in_window = 0;
+                }
+                continue;
+            }
+
+            //duplicated Data - retransmitting the ack only for the last acked block (whole window is sent again)
+            char block_number_char[2] = {buffer[2], buffer[3]};
+            if (chars_to_short(block_number_char) != block_number_from_index(expected_block_index - 1, options->rollover)){
+                continue;
             }
 
-            int bytes_tx = sendto(connection_information->socket, packet_to_be_send.c_str(), packet_to_be_send.size(), 0,
-                            connection_information->address, connection_information->address_size);
+            rto_sample_cancel(connection_information->rto);
+            int bytes_tx = send_packet(connection_information, packets_in_flight.front());
             if (bytes_tx < 0) cout << "ERROR: sendto - sending data\n";
         }
         while(receive_data_ret_code);
 
-        packet_to_be_send = send_ack(connection_information, expected_block_number);
+        rto_sample_finish(connection_information->rto, expected_block_index);
+        gap_acked = false;
+        received_in_window++;
 
-        expected_block_number++;
+        //acknowledging whole window (or the last block) at once
+        ushort acked_block_number = block_number_from_index(expected_block_index, options->rollover);
+        if (received_in_window >= window_size || bytes_rx < datagram_size){
+            packets_in_flight.front() = send_ack(connection_information, acked_block_number);
+            received_in_window = 0;
+            rto_sample_start(connection_information->rto, expected_block_index + 1);     //round trip ends by the next Data
+        }
+        else{
+            //prepared for retransmission on timeout, acknowledges all blocks received so far
+            tftp_ack_packet_t ack_packet_struct;
+            ack_packet_struct.block_number = acked_block_number;
+            packets_in_flight.front() = serialize_packet_struct(&ack_packet_struct);
+        }
+
+        expected_block_index++;
 
         //end transfer if number of received Bytes is lovwer than datagram size
         if (bytes_rx < (datagram_size)){
             for(int i = 0; i < MAX_RETRANSMIT_ATTEMPTS; i++){
-                int recv_timeout_ret_code = recvfrom_timeout(connection_information, options, buffer, 0);
+                //waiting whole negotiated timeout, sender may not estimate the round-trip time
+                int recv_timeout_ret_code = recvfrom_timeout(connection_information, options, buffer, 0, false);
                 if (recv_timeout_ret_code == ERR_CODE_TIMEOUT){
                     //error message was most probably successfully delivered
                     break;
                 }
 
-                int bytes_tx = sendto(connection_information->socket, packet_to_be_send.c_str(), packet_to_be_send.size(), i,
-                                        connection_information->address, connection_information->address_size);
+                int bytes_tx = send_packet(connection_information, packets_in_flight.front());
                 if (bytes_tx < 0) cout << ("ERROR: sendto - sending error\n");
 
                 //retransmit
@@ -458,202 +946,249 @@ int write_to_file(connection_info_t *connection_information, option_info_t *opti
 }
 
 int read_from_file(connection_info_t *connection_information, string filename, option_info_t *options, string mode, int tid_expected){
+    file_source_t source;
+    file_source_open_range(&source, filename, mode, options->offset, options->length);
+
+    int return_code = read_from_source(connection_information, &source, options, tid_expected);
+
+    file_source_close(&source);
+    return return_code;
+}
+
+int read_from_source(connection_info_t *connection_information, file_source_t *source, option_info_t *options, int tid_expected){
     string error_message = "";
-    string packet_to_be_send;
 
     int datagram_size = options->blocksize + DATA_PACKET_OFFSET;
 
-    char buffer[datagram_size];
-    char data_block[options->blocksize];
+    //payloads of the window blocks (not needed for a mapped file) and received Acks are stored in the arenas of the session
+    size_t payloads_size = source->is_mapped ? 0 : (size_t)options->window_size * options->blocksize;
+    if (!acquire_session_buffers(connection_information, datagram_size, payloads_size)){
+        return 1;
+    }
+    char *buffer = connection_information->buffers->receive;
 
-    unsigned int loaded_actual = 0;
-    bool lf_on_new = false;
-    bool null_on_new = false;
+    data_window_t window;                   //sent and still unacknowledged Data blocks
+    data_window_init(&window, options->window_size, options->blocksize, source->is_mapped ? NULL : connection_information->buffers->send);
 
-    ushort current_block_number = 1;
+    unsigned int loaded_actual = 0;
+    bool last_block_sent = false;
+    bool window_resent = false;
 
-    ifstream file_read(filename);
+    block_index_t current_block_index = 1;  //the oldest unacknowledged block
+    block_index_t next_block_index = 1;     //block to be read and sent next (block numbers wrap around, positions not)
 
     //reading data from file (with format to NETASCII mode)
     do{
-        bzero(data_block, options->blocksize);
-        loaded_actual = 0;
-
-        if (lf_on_new){
-            data_block[loaded_actual++] = '\n';
-            lf_on_new = false;
+        //filling the window, new blocks are sent at once (shaped session sends the blocks its tokens allow
+        //and sleeps until the tokens refill, the client acknowledges only the whole window)
+        unsigned int first_new_block = window.count;
+        while (window.count < options->window_size && !last_block_sent){
+            unsigned int allowed_blocks = shaper_wait(connection_information->shaper, datagram_size);
+            unsigned int first_burst_block = window.count;
+            while (window.count < options->window_size && !last_block_sent && allowed_blocks-- > 0){
+                data_block_t *block = data_window_push(&window, block_number_from_index(next_block_index, options->rollover));
+                loaded_actual = file_source_load_block(source, block, next_block_index++ - 1, options->blocksize);
+
+                //end transfer if number of sent data Bytes is lovwer than block size
+                last_block_sent = loaded_actual < options->blocksize;
+            }
+            send_data_blocks(connection_information, &window, first_burst_block);
         }
-        else if (null_on_new){
-            data_block[loaded_actual++] = '\x00';
-            null_on_new = false;
+        if (source->is_failed || window.is_failed){
+            send_error_packet(connection_information, ERR_CODE_NOT_DEF, "File was truncated during the transfer", options->timeout_interval, false);
+            return 1;
         }
-        while (loaded_actual < options->blocksize){
-            char c;
-            file_read.get(c);
-            if (file_read.eof()){
-                break;
-            }
-            else if (c == '\n' && mode == MODE_NETASCII){
-                data_block[loaded_actual++] = CR_VALUE;
-                if (loaded_actual == options->blocksize){
-                    lf_on_new = true;
-                }
-                else{
-                    data_block[loaded_actual++] = c;
-                }
-            }
-            else if (c == CR_VALUE && mode == MODE_NETASCII){
-                data_block[loaded_actual++] = CR_VALUE;
-                if (loaded_actual == options->blocksize){
-                    null_on_new = true;
-                }
-                else{
-                    data_block[loaded_actual++] = '\x00';
-                }
-            }
-            else{
-                data_block[loaded_actual++] = c;
-            }
+        if (first_new_block < window.count){
+            rto_sample_start(connection_information->rto, next_block_index - 1);        //round trip ends by the Ack of the newest block
         }
 
-        packet_to_be_send = send_data(connection_information, current_block_number, data_block, loaded_actual);
-
-
-        //handlig duplicated recieved Acks
-        int receive_ack_ret_code;
-        do {
-            bzero(buffer, datagram_size);
-
-            int bytes_rx = recvfrom_retransmit(connection_information, options, buffer, packet_to_be_send, tid_expected);
-            if (bytes_rx < 0){
-                file_read.close();
-                return 1;
-            }
+        int bytes_rx = recvfrom_retransmit(connection_information, options, buffer, &window, tid_expected);
+        if (bytes_rx < 0 && window.is_failed){
+            send_error_packet(connection_information, ERR_CODE_NOT_DEF, "File was truncated during the transfer", options->timeout_interval, false);
+            return 1;
+        }
+        else if (bytes_rx < 0){
+            return 1;
+        }
 
-            char opcode_char[2] = {buffer[0], buffer[1]};
-            if (chars_to_short(opcode_char) == ERROR_OPCODE){
-                receive_error(connection_information, buffer);
-                file_read.close();
-                return 1;
-            }
+        char opcode_char[2] = {buffer[0], buffer[1]};
+        if (chars_to_short(opcode_char) == ERROR_OPCODE){
+            receive_error(connection_information, buffer, bytes_rx);
+            return 1;
+        }
+        else if (chars_to_short(opcode_char) == OACK_OPCODE && current_block_index == 1){
+            continue;       //retransmitted Oack (sending of the first window took too long), same as a duplicated Ack 0
+        }
 
-            receive_ack_ret_code = receive_ack(connection_information, buffer, current_block_number, options->timeout_interval);
+        block_index_t acked_block_index;
+        int receive_ack_ret_code = receive_ack(connection_information, buffer, next_block_index - 1, options->timeout_interval,
+                                               window.count, &acked_block_index, options->rollover);
 
-            if (receive_ack_ret_code == ERR_CODE_ILLEGAL_OPERATION){
-                file_read.close();
-                return 1;
-            }
-            else if(receive_ack_ret_code == PACKET_OK_CODE){
-                break;
+        if (receive_ack_ret_code == ERR_CODE_ILLEGAL_OPERATION){
+            return 1;
+        }
+        else if(receive_ack_ret_code == PACKET_OK_CODE){
+            //sliding the window behind the acked block (ack is cumulative)
+            rto_sample_finish(connection_information->rto, acked_block_index);
+            data_window_pop(&window, acked_block_index - current_block_index + 1);
+            current_block_index = acked_block_index + 1;
+            window_resent = false;
+
+            if (window.count == 0){
+                continue;
             }
-
+        }
+        else if (options->window_size == DEFAULT_WINDOW_SIZE || window_resent || acked_block_index != current_block_index - 1){
             //Sorcerer's Apprentice Syndrome - Data should be never send from sender again on duplicate ACK
-            // int bytes_tx = sendto(connection_information->socket, packet_to_be_send.c_str(), packet_to_be_send.size(), 0,
-            //                 connection_information->address, connection_information->address_size);
-            // if (bytes_tx < 0) cout << "ERROR: sendto - sending data\n";
+            continue;
         }
-        while(receive_ack_ret_code == DUPLICATED_PACKET);
-
-        current_block_number++;
 
-        bzero(data_block, options->blocksize );
+        //receiver reported a lost block of the window - going back to the last acked block (only once per ack)
+        rto_sample_cancel(connection_information->rto);
+        send_data_blocks(connection_information, &window);
+        window_resent = true;
     }
-    while(loaded_actual >= options->blocksize); //end transfer if number of sent data Bytes is lovwer than block size
+    while(window.count != 0 || !last_block_sent);
 
-    file_read.close();
     return 0;
 }
 
-int get_destination_port(int socket){
-    struct sockaddr client_server_addr;
-    socklen_t client_server_addr_len = sizeof(client_server_addr);
-    getsockname(socket, &client_server_addr, &client_server_addr_len);
-    return htons(((struct sockaddr_in*)&client_server_addr)->sin_port);
-}
-
 void log_wrq_rrq(connection_info_t *connection_information, tftp_rrq_wrq_packet_t *packet){
-    string packet_type;
-    if (packet->opcode == RRQ_OPCODE){
-        packet_type = "RRQ ";
+    log_event_t event = packet->opcode == RRQ_OPCODE ? LOG_EVENT_RRQ : LOG_EVENT_WRQ;
+    if (!log_is_enabled(event)){
+        return;
+    }
+
+    string detail;
+    if (log_get_format() == LOG_FORMAT_JSON){
+        detail = ",\"file\":\"" + log_json_escape(packet->filename) + "\",\"mode\":\"" + log_json_escape(packet->mode) + "\"";
     }
     else{
-        packet_type = "WRQ ";
+        detail = " \"" + packet->filename + "\" " + packet->mode;
     }
+    detail += log_options(&packet->options);
 
-    cerr << packet_type
-        << inet_ntoa((((struct sockaddr_in*)connection_information->address)->sin_addr))
-        << ":"
-        << htons(((struct sockaddr_in*)connection_information->address)->sin_port)
-        << " \"" << packet->filename << "\" "
-        << packet->mode;
-
-    log_options(&packet->options);
-    cerr << "\n";
+    log_context_update(&connection_information->log_context, connection_information->socket, connection_information->address, false);
+    log_write(event, &connection_information->log_context, 0, detail);
 }
 
 void log_data(connection_info_t *connection_information, tftp_data_packet_t *packet){
-    cerr << "DATA "
-        << inet_ntoa((((struct sockaddr_in*)connection_information->address)->sin_addr))
-        << ":"
-        << htons(((struct sockaddr_in*)connection_information->address)->sin_port)
-        << ":"
-        << get_destination_port(connection_information->socket)
-        << " " << packet->block_number << "\n";
+    if (!log_is_enabled(LOG_EVENT_DATA, packet->block_number)){
+        return;
+    }
+
+    log_context_update(&connection_information->log_context, connection_information->socket, connection_information->address, true);
+    log_write(LOG_EVENT_DATA, &connection_information->log_context, packet->block_number, "");
 }
 
 void log_ack(connection_info_t *connection_information, tftp_ack_packet_t *packet){
-    cerr << "ACK "
-        << inet_ntoa((((struct sockaddr_in*)connection_information->address)->sin_addr))
-        << ":"
-        << htons(((struct sockaddr_in*)connection_information->address)->sin_port)
-        << " " << packet->block_number << "\n";
+    if (!log_is_enabled(LOG_EVENT_ACK, packet->block_number)){
+        return;
+    }
+
+    log_context_update(&connection_information->log_context, connection_information->socket, connection_information->address, false);
+    log_write(LOG_EVENT_ACK, &connection_information->log_context, packet->block_number, "");
 }
 
 void log_error(connection_info_t *connection_information, tftp_error_packet_t *packet){
-    cerr << "ERROR "
-        << inet_ntoa((((struct sockaddr_in*)connection_information->address)->sin_addr))
-        << ":"
-        << htons(((struct sockaddr_in*)connection_information->address)->sin_port)
-        << ":"
-        << get_destination_port(connection_information->socket)
-        << " " << packet->error_code
-        << " \"" << packet->error_message << "\" \n";
+    if (!log_is_enabled(LOG_EVENT_ERROR)){
+        return;
+    }
+
+    string detail;
+    if (log_get_format() == LOG_FORMAT_JSON){
+        detail = ",\"message\":\"" + log_json_escape(packet->error_message) + "\"";
+    }
+    else{
+        detail = " \"" + packet->error_message + "\" ";
+    }
+
+    log_context_update(&connection_information->log_context, connection_information->socket, connection_information->address, true);
+    log_write(LOG_EVENT_ERROR, &connection_information->log_context, packet->error_code, detail);
 }
 
 void log_oack(connection_info_t *connection_information, tftp_oack_packet_t *packet){
-    cerr << "OACK "
-        << inet_ntoa((((struct sockaddr_in*)connection_information->address)->sin_addr))
-        << ":"
-        << htons(((struct sockaddr_in*)connection_information->address)->sin_port);
-    log_options(&packet->options);
-    cerr << "\n";
+    if (!log_is_enabled(LOG_EVENT_OACK)){
+        return;
+    }
+
+    log_context_update(&connection_information->log_context, connection_information->socket, connection_information->address, false);
+    log_write(LOG_EVENT_OACK, &connection_information->log_context, 0, log_options(&packet->options));
 }
 
-void log_options(option_info_t *options){
+string log_options(option_info_t *options){
+    bool is_json = log_get_format() == LOG_FORMAT_JSON;
+    string formatted;
+
     for (int i = 0; i < SUPPORTED_OPTIONS_NUMBER; i++){
+        string name;
+        unsigned long long value = 0;
         if (options->option_order[i] == TRANSFER_SIZE){
-            cerr << " " << "tsize" << "=" << options->transfer_size;
+            name = "tsize";
+            value = options->transfer_size;
         }
         else if (options->option_order[i] == TIMEOUT){
-            cerr << " " << "timeout" << "=" << options->timeout_interval;
+            name = "timeout";
+            value = options->timeout_interval;
+        }
+        else if (options->option_order[i] == UTIMEOUT){
+            name = "utimeout";
+            value = options->utimeout_interval;
         }
         else if (options->option_order[i] == BLOCKSIZE){
-            cerr << " " << "blksize" << "=" << options->blocksize;
+            name = "blksize";
+            value = options->blocksize;
+        }
+        else if (options->option_order[i] == WINDOW_SIZE){
+            name = "windowsize";
+            value = options->window_size;
+        }
+        else if (options->option_order[i] == ROLLOVER){
+            name = "rollover";
+            value = options->rollover;
+        }
+        else if (options->option_order[i] == OFFSET){
+            name = "offset";
+            value = options->offset;
+        }
+        else if (options->option_order[i] == LENGTH){
+            name = "length";
+            value = options->length;
+        }
+        else if (options->option_order[i] == MULTICAST || options->option_order[i] == RESUME){
+            //options with a text value
+            string text_name = options->option_order[i] == MULTICAST ? "multicast" : "resume";
+            string text_value = options->option_order[i] == MULTICAST ? format_multicast_value(options)
+                                                                      : to_string(options->resume_bytes) + "," + to_string(options->resume_checksum);
+            formatted += is_json ? (formatted.empty() ? "" : ",") + ("\"" + text_name + "\":\"" + text_value + "\"") : " " + text_name + "=" + text_value;
+            continue;
         }
         else{
             break;
         }
+
+        if (is_json){
+            formatted += (formatted.empty() ? "" : ",") + ("\"" + name + "\":") + to_string(value);
+        }
+        else{
+            formatted += " " + name + "=" + to_string(value);
+        }
     }
 
+    if (is_json){
+        return ",\"options\":{" + formatted + "}";
+    }
+    return formatted;
 }
 
-void log_stranger_packet(connection_info_t *connection_information, char* buffer){
+void log_stranger_packet(connection_info_t *connection_information, char* buffer, int bytes_rx){
     char opcode_char[2] = {buffer[0], buffer[1]};
     ushort opcode = chars_to_short(opcode_char);
     if (opcode == RRQ_OPCODE || opcode == WRQ_OPCODE){
         tftp_rrq_wrq_packet_t packet_struct_wr;
-        deserialize_packet_struct(&packet_struct_wr, buffer);
-        log_wrq_rrq(connection_information, &packet_struct_wr);
+        if (deserialize_packet_struct(&packet_struct_wr, buffer, bytes_rx) == PACKET_OK_CODE){
+            log_wrq_rrq(connection_information, &packet_struct_wr);
+        }
     }
     else if (opcode == DATA_OPCODE){
         tftp_data_packet_t packet_struct_d;
@@ -667,12 +1202,13 @@ void log_stranger_packet(connection_info_t *connection_information, char* buffer
     }
     else if (opcode == ERROR_OPCODE){
         tftp_error_packet_t packet_struct_e;
-        deserialize_packet_struct(&packet_struct_e, buffer);
+        deserialize_packet_struct(&packet_struct_e, buffer, bytes_rx);
         log_error(connection_information, &packet_struct_e);
     }
     else if (opcode == OACK_OPCODE){
         tftp_oack_packet_t packet_struct_o;
-        deserialize_packet_struct(&packet_struct_o, buffer);
-        log_oack(connection_information, &packet_struct_o);
+        if (deserialize_packet_struct(&packet_struct_o, buffer, bytes_rx) == PACKET_OK_CODE){
+            log_oack(connection_information, &packet_struct_o);
+        }
     }
 }
\ No newline at end of file
@@ -6,19 +6,31 @@
  */
 
 
+#ifndef TFTP_COMMUNICATION_HPP
+#define TFTP_COMMUNICATION_HPP
+
 #include <fstream>
 #include <arpa/inet.h>
 #include <string.h>
 #include <filesystem>
+#include <deque>
+#include <memory>
+#include <vector>
 #include "tftp-packet-structures.hpp"
-
-#define CLIENT_READ_FILE_SIZE 2048
-#define TEMP_FILE_PATH "temp/temp_cin_file"
-
-#define MIN_BLKSIZE_VALUE 8
-#define MAX_BLKSIZE_VALUE 65464
+#include "tftp-netascii.hpp"
+#include "tftp-rto.hpp"
+#include "tftp-disk-io.hpp"
+#include "tftp-resume.hpp"
+#include "tftp-log.hpp"
+#include "tftp-buffer-pool.hpp"
+
+#define IP_UDP_HEADERS_SIZE 28          //IPv4 header without options and UDP header carrying every Data packet
 #define MIN_TIMEOUT_VALUE 1
 #define MAX_TIMEOUT_VALUE 255
+#define MIN_UTIMEOUT_VALUE 10000
+#define MAX_UTIMEOUT_VALUE 255000000
+#define MIN_WINDOWSIZE_VALUE 1
+#define MAX_WINDOWSIZE_VALUE 65535
 
 #define ERR_CODE_SELECT  -3
 #define ERR_CODE_TIMEOUT -2
@@ -31,20 +43,58 @@
 #define EXPONENTIAL_BACKOFF_MULTIPLIER 2
 
 
+struct receive_batch;
+struct file_source;
+
+
 //Structure containing connection information
 typedef struct connection_info {
     int socket;
     struct sockaddr *address;
     socklen_t address_size;
+    struct receive_batch *receive_batch = NULL;     //datagrams received at once (if batching is used)
+    rto_estimator_t *rto = NULL;                    //round-trip time estimate (if adaptive timeout is used)
+    session_buffers_t *buffers = NULL;              //arenas of the session (has to be set for the transfer of the file)
+    struct shaper_session *shaper = NULL;           //bandwidth shaping of the sent Data (NULL if not shaped)
+    log_context_t log_context;                      //addresses formatted for the log
 } connection_info_t;
 
 
+//Structure containing a Data packet prepared for scatter/gather sending (header and reference to the payload)
+typedef struct data_block {
+    char header[DATA_PACKET_OFFSET];
+    char *payload;
+    unsigned int payload_size = 0;
+} data_block_t;
+
+
+//Structure containing Data blocks sent and not acknowledged yet (ring of window size slots)
+typedef struct data_window {
+    vector<data_block_t> blocks;
+    char *payloads = NULL;                      //payload buffers of the slots (send arena of the session), NULL when
+                                                //payloads reference data stored elsewhere (mapped file)
+    unsigned int blocksize = 0;
+    unsigned int first = 0;                     //slot of the oldest unacknowledged block
+    unsigned int count = 0;                     //number of blocks in flight
+    bool is_failed = false;                     //payload couldn't be read by sendmmsg (EFAULT, mapped file was truncated)
+} data_window_t;
+
+
 //Structure containing connection information
 typedef struct communication_info {
     bool path_was_given;
     string mode = MODE_OCTET;
     string file_path_source;
     string file_path_dest;
+    bool upload_size_given = false;         //size of the uploaded data was given by the argument
+    unsigned long long upload_size = 0;
+    bool multicast = false;                 //file is requested from the multicast group (RFC 2090)
+    string upload_path = "";                //uploaded file (job of the manifest), standard input is uploaded if empty
+    unsigned int segments = 1;              //number of sessions downloading ranges of the file at once
+    bool resume = false;                    //interrupted transfer is kept and resumed (resume option)
+    unsigned int blocksize = 0;             //requested block size (0 if the block size option is not used)
+    bool blocksize_auto = false;            //block size is chosen by the path MTU to the server
+    unsigned int window_size = 0;           //requested window size (0 if the window size option is not used)
 } communication_info_t;
 
 
@@ -57,22 +107,33 @@ int create_socket();
 
 
 /**
- * @brief Closes stream and then removes a file
+ * @brief Finds the largest block size, whose Data packet fits the path MTU to the host (a lost fragment of
+ * a fragmented block would lose the whole block). The MTU is read from a socket connected to the host,
+ * so it is the MTU of the outgoing interface or the smaller path MTU already discovered by the kernel.
+ *
+ * @param address address of the host
+ * @return block size in the range of the block size option, MAX_BLKSIZE_VALUE if the MTU is unknown
+ */
+unsigned int path_mtu_blocksize(const struct sockaddr_in *address);
+
+
+/**
+ * @brief Closes file and then removes it
  *
- * @param file_stream file stream to be closed
+ * @param file file to be closed
  * @param file_to_be_remove path to the file that should be removed
  */
-void close_remove_file(ofstream &file_stream, string file_to_be_remove);
+void close_remove_file(disk_file_t *file, string file_to_be_remove);
 
 
 /**
- * @brief Creates a temporary file filled with data from standard input a return it's size
+ * @brief Gets size of the data on standard input, size is known only when a regular file is redirected to it
  *
- * @param temp_path path to the temporary file
+ * @param size address, where size of the remaining data in Bytes will be stored
  *
- * @return size of the temporary file in Bytes
+ * @return true if the size is known, else false (pipe, terminal)
  */
-unsigned int get_cin_size(string temp_path);
+bool get_cin_size(unsigned long long *size);
 
 
 /**
@@ -99,16 +160,60 @@ int negotiate_option_client(option_info_t *client_options, option_info_t *server
 int negotiate_option_server(option_info_t *client_options, option_info_t *server_options, string* error_message);
 
 
+/**
+ * @brief Limits the negotiated range of the downloaded file (offset and length options) by the size of the file,
+ * the length sent in the Oack is the size of the range. Range is not sent in netascii mode, the whole file is sent then.
+ * Resumed download starts behind the prefix of the client, when the prefix of the file has the same checksum
+ * (resume option is sent with 0, when the whole file is sent).
+ *
+ * @param server_options negotiated options of the transfer
+ * @param path path to the downloaded file
+ * @param mode transfer mode
+ * @param prefix_check completed check of the prefix of the client (NULL, the prefix is checksummed by the call)
+ */
+void negotiate_range_server(option_info_t *server_options, string path, string mode, resume_check_t *prefix_check = NULL);
+
+
+/**
+ * @brief Offers the prefix of the partial file kept by the interrupted upload (WRQ with the resume option), the prefix
+ * recorded in the sidecar is verified against the file (the sidecar is trusted, while the file wasn't changed since
+ * it was written). Upload starts from the beginning when there is no valid partial file or in netascii mode (resume
+ * option is sent with 0 then).
+ *
+ * @param server_options negotiated options of the transfer
+ * @param path path to the uploaded file
+ * @param mode transfer mode
+ * @param prefix_check completed check of the recorded prefix (NULL, the prefix is checksummed by the call, when needed)
+ */
+void negotiate_resume_upload_server(option_info_t *server_options, string path, string mode, resume_check_t *prefix_check = NULL);
+
+
 /**
  * @brief Recieves a packet or detects timeout
  *
  * @param connection_information connection information
  * @param option_information options associated to the current transfer
- * @param buffer address, where will be received data stored
+ * @param buffer address, where will be received data stored (datagram is followed by zero padding, buffer has to
+ * hold the negotiated datagram size and IO_BATCH_PADDING Bytes)
+ * @param times_retransmitted number of retransmissions of the current packets (exponential backoff)
+ * @param adaptive_timeout true if the estimated round-trip timeout of the connection can be used, else the negotiated timeout is waited
  *
  * @return received number of bytes or -4 on timeout
  */
-int recvfrom_timeout(connection_info_t *connection_information, option_info_t *option_information, char *buffer, int times_retransmitted);
+int recvfrom_timeout(connection_info_t *connection_information, option_info_t *option_information, char *buffer, int times_retransmitted, bool adaptive_timeout = true);
+
+
+/**
+ * @brief Copies the next datagram from the receive batch into the buffer and sets its source address to the connection
+ *
+ * @param connection_information connection information
+ * @param batch receive batch
+ * @param buffer address, where will be the datagram stored (followed by zero padding)
+ * @param buffer_size maximal size of the datagram (without padding)
+ *
+ * @return number of copied bytes or -1 if the batch is empty
+ */
+int receive_batch_copy(connection_info_t *connection_information, struct receive_batch *batch, char *buffer, unsigned int buffer_size);
 
 
 /**
@@ -125,6 +230,50 @@ int recvfrom_timeout(connection_info_t *connection_information, option_info_t *o
 int recvfrom_retransmit(connection_info_t *connection_information, option_info_t *option_information, char *buffer, string packet, int tid_expected);
 
 
+/**
+ * @brief Retransmits all packets of the window on timeout and eventually checks if the packet came from the expected source
+ *
+ * @param connection_information connection information
+ * @param option_information options associated to the current transfer
+ * @param buffer address, where will be received data stored
+ * @param packets sent and still unacknowledged packets, that are going to be retransmit on timeout (in order)
+ * @param tid_expected expected TID
+ *
+ * @return received number of bytes or -1 when an error occurs
+ */
+int recvfrom_retransmit(connection_info_t *connection_information, option_info_t *option_information, char *buffer, deque<string> &packets, int tid_expected);
+
+
+/**
+ * @brief Retransmits all Data blocks of the window on timeout and eventually checks if the packet came from the expected source
+ *
+ * @param connection_information connection information
+ * @param option_information options associated to the current transfer
+ * @param buffer address, where will be received data stored
+ * @param window sent and still unacknowledged Data blocks, that are going to be retransmit on timeout
+ * @param tid_expected expected TID
+ *
+ * @return received number of bytes or -1 when an error occurs
+ */
+int recvfrom_retransmit(connection_info_t *connection_information, option_info_t *option_information, char *buffer, data_window_t *window, int tid_expected);
+
+
+/**
+ * @brief Retransmits the packets or the Data blocks of the window (the other one is NULL) on timeout
+ * and eventually checks if the packet came from the expected source
+ *
+ * @param connection_information connection information
+ * @param option_information options associated to the current transfer
+ * @param buffer address, where will be received data stored
+ * @param packets packets to be retransmit on timeout or NULL
+ * @param window Data blocks to be retransmit on timeout or NULL
+ * @param tid_expected expected TID
+ *
+ * @return received number of bytes or -1 when an error occurs
+ */
+int recvfrom_retransmit(connection_info_t *connection_information, option_info_t *option_information, char *buffer, deque<string> *packets, data_window_t *window, int tid_expected);
+
+
 /**
  * @brief Creates and then sends an initialization packet RRQ or WRQ
  *
@@ -133,11 +282,10 @@ int recvfrom_retransmit(connection_info_t *connection_information, option_info_t
  * @param init_communication_packet structure of WRQ or RRQ packet to be filled with options information
  * @param option_information transfer options suggested by the client
  * @param is_rrq is RRQ packet going to be send
- * @param temp_path path to the temporary file
  *
  * @return stream of bytes representing sent RRQ or WRQ packet
  */
-string send_wrq_rrq(connection_info_t *connection_information, communication_info_t *communication_information, tftp_rrq_wrq_packet_t *init_communication_packet, option_info_t *option_information, bool is_rrq, string temp_path);
+string send_wrq_rrq(connection_info_t *connection_information, communication_info_t *communication_information, tftp_rrq_wrq_packet_t *init_communication_packet, option_info_t *option_information, bool is_rrq);
 
 
 /**
@@ -151,15 +299,65 @@ string send_ack(connection_info_t *connection_information, int block_number);
 
 
 /**
- * @brief Creates and then sends an Data packet
+ * @brief Sends a Data packet, header and payload are passed to sendmsg separately (payload is not copied)
  *
  * @param connection_information connection information
- * @param block_number block number of data packet
- * @param data_block data to be sent
- * @param loaded_actual size of data in Bytes
- * @return stream of bytes representing sent Data packet
+ * @param block Data block to be sent
+ * @return number of sent Bytes or -1 when an error occurs
+ */
+int send_data(connection_info_t *connection_information, data_block_t *block);
+
+
+/**
+ * @brief Provides the session of the connection with arenas for the transfer, sends Error packet when they are refused
+ * (memory limit of the server)
+ *
+ * @param connection_information connection information with set session buffers
+ * @param receive_size maximal size of a received datagram (0 if not needed)
+ * @param send_size size of the send arena (0 if not needed)
+ * @return true if OK, else false
+ */
+bool acquire_session_buffers(connection_info_t *connection_information, size_t receive_size, size_t send_size);
+
+
+/**
+ * @brief Prepares the window for a transfer with given options (no block is in flight)
+ *
+ * @param window window structure
+ * @param window_size maximal number of blocks in flight
+ * @param blocksize size of the data block
+ * @param payloads buffer for the payloads of all slots (window size * block size Bytes) or NULL if payloads are referenced
+ */
+void data_window_init(data_window_t *window, unsigned int window_size, unsigned int blocksize, char *payloads);
+
+
+/**
+ * @brief Adds a new block behind the last block in flight
+ *
+ * @param window window structure
+ * @param block_number block number of the new block
+ * @return block with written header, payload points to the buffer of the slot (blocksize Bytes) or is NULL without own buffers
+ */
+data_block_t *data_window_push(data_window_t *window, ushort block_number);
+
+
+/**
+ * @brief Gets the block in flight
+ *
+ * @param window window structure
+ * @param index position of the block in the window (0 is the oldest unacknowledged block)
+ * @return address of the block
  */
-string send_data(connection_info_t *connection_information, int block_number, char *data_block, int loaded_actual);
+data_block_t *data_window_at(data_window_t *window, unsigned int index);
+
+
+/**
+ * @brief Removes the oldest blocks from the window (they were acknowledged)
+ *
+ * @param window window structure
+ * @param acked_count number of blocks to be removed
+ */
+void data_window_pop(data_window_t *window, unsigned int acked_count);
 
 
 /**
@@ -189,14 +387,28 @@ string send_error_packet(connection_info_t *connection_information, int error_co
 
 
 /**
- * @brief Processes the received RRQ or WRQ packet (deserializes and checks content)
+ * @brief Sends an Error packet describing failed writing into the file (no space left is reported as Disk full)
+ *
+ * @param connection_information connection information
+ * @param error_number errno of the failed write
+ * @param error_timeout time to wait
+ * @param timeout_enable is timeout enabled
+ * @return sent TFTP error code
+ */
+int send_disk_error(connection_info_t *connection_information, int error_number, unsigned int error_timeout = DEFAULT_TIMEOUT, bool timeout_enable = true);
+
+
+/**
+ * @brief Processes the received RRQ or WRQ packet (deserializes and checks content), invalid request is answered
+ * by an Error packet without waiting (the listening process keeps receiving the requests)
  *
  * @param connection_information connection information
  * @param init_communication_packet structure of WRQ or RRQ packet to be filled with options information
  * @param buffer received packet data
+ * @param bytes_rx size of the received packet
  * @return -1 if OK, else return code according to a possible TFTP error codes
  */
-int receive_wrq_rrq(connection_info_t *connection_information, tftp_rrq_wrq_packet_t *init_communication_packet, char *buffer);
+int receive_wrq_rrq(connection_info_t *connection_information, tftp_rrq_wrq_packet_t *init_communication_packet, char *buffer, int bytes_rx);
 
 
 /**
@@ -204,11 +416,15 @@ int receive_wrq_rrq(connection_info_t *connection_information, tftp_rrq_wrq_pack
  *
  * @param connection_information connection information
  * @param buffer received packet data
- * @param expected_block_number expected data block number that should be acked
+ * @param expected_block_index position of the highest data block that was sent and can be acked
  * @param timeout time to wait on error packet sent
+ * @param blocks_in_flight number of sent and still unacknowledged data blocks
+ * @param acked_block_index address, where the position of the acked block will be stored (if not NULL)
+ * @param rollover block number following 65535 (0 or 1)
  * @return -1 if OK, else return code according to a possible TFTP error codes
  */
-int receive_ack(connection_info_t *connection_information, char *buffer, int expected_block_number, unsigned int timeout);
+int receive_ack(connection_info_t *connection_information, char *buffer, block_index_t expected_block_index, unsigned int timeout, unsigned int blocks_in_flight = 1,
+                block_index_t *acked_block_index = NULL, unsigned int rollover = DEFAULT_ROLLOVER);
 
 
 /**
@@ -217,24 +433,45 @@ int receive_ack(connection_info_t *connection_information, char *buffer, int exp
  * @param connection_information connection information
  * @param init_options transfer options suggested by the client
  * @param buffer received packet data
+ * @param bytes_rx size of the received packet
  * @return -1 if OK, else return code according to a possible TFTP error codes
  */
-int receive_oack(connection_info_t *connection_information, option_info_t *init_options, char *buffer);
+int receive_oack(connection_info_t *connection_information, option_info_t *init_options, char *buffer, int bytes_rx);
 
 
 /**
- * @brief Processes the received Data packet (deserializes and checks content). Format NETASCII data (to linux notation).
+ * @brief Processes the received Data packet (deserializes and checks content). Format NETASCII data (to linux notation)
+ * in the send arena of the session.
  *
  * @param connection_information connection information
  * @param buffer received packet data
  * @param bytes_read size of received Data packet
- * @param file_write file stream, that data should be write to
+ * @param file_write file, that data should be write to
  * @param mode tranfer mode (netascii or octet)
- * @param timeout time to wait on error packet sent
- * @param expected_block_number expected data block number
+ * @param options options associated to the current transfer (timeout, window size, rollover)
+ * @param expected_block_index position of the expected data block
+ * @param netascii_state state of the NETASCII conversion between blocks of the transfer
+ * @param is_last_block true if the packet is smaller than the negotiated datagram size (end of the transfer)
  * @return -1 if OK, else return code according to a possible TFTP error codes
  */
-int receive_data(connection_info_t *connection_information, char *buffer, int bytes_read, ofstream &file_write, string mode, unsigned int timeout, int expected_block_number);
+int receive_data(connection_info_t *connection_information, char *buffer, int bytes_read, disk_file_t *file_write, string mode, option_info_t *options, block_index_t expected_block_index,
+                 netascii_state_t *netascii_state, bool is_last_block);
+
+
+/**
+ * @brief Writes data of the Data packet into the file, NETASCII data are formatted to linux notation (CR LF to LF, CR NUL to CR).
+ * Data are only queued to be written in the background, the last block waits until the whole file is written.
+ *
+ * @param file_write file, that data should be write to
+ * @param data data of the Data packet
+ * @param data_size size of the data in Bytes
+ * @param mode tranfer mode (netascii or octet)
+ * @param netascii_state state of the NETASCII conversion between blocks of the transfer
+ * @param is_last_block true if the data are the last block of the transfer
+ * @param text buffer for the decoded NETASCII data (at least data_size + 1 Bytes, not used in octet mode)
+ * @return 0 if OK, else errno of a failed write
+ */
+int write_data_block(disk_file_t *file_write, char *data, int data_size, string mode, netascii_state_t *netascii_state, bool is_last_block, char *text);
 
 
 /**
@@ -242,26 +479,34 @@ int receive_data(connection_info_t *connection_information, char *buffer, int by
  *
  * @param connection_information connection information
  * @param buffer received packet data
+ * @param bytes_rx size of the received packet
  */
-void receive_error(connection_info_t *connection_information, char *buffer);
+void receive_error(connection_info_t *connection_information, char *buffer, int bytes_rx);
+
 
 
 /**
  * @brief Handles whole part of data receiving of the transfer. Receives data, sends acks and writing into file.
+ * Acknowledges each window of blocks (RFC 7440), or the last in-order block when a block of the window is lost.
  *
  * @param connection_information connection information
  * @param options options associated to the current transfer
- * @param file_write file stream, that data should be write to
+ * @param file_write file, that data should be write to
  * @param packet_to_be_send stream of bytes representing sent Ack/Oack packet
  * @param mode tranfer mode (netascii or octet)
  * @param tid_expected expected TID
+ * @param expected_block_index position of the first expected Data packet
+ * @param netascii_state state of the NETASCII conversion between blocks of the transfer
  * @return -1 if OK, else return code according to a possible TFTP error codes
  */
-int write_to_file(connection_info_t *connection_information, option_info_t *options, ofstream &file_write, string packet_to_be_send, string mode, int tid_expected, int expected_block_number);
+int write_to_file(connection_info_t *connection_information, option_info_t *options, disk_file_t *file_write, string packet_to_be_send, string mode, int tid_expected, block_index_t expected_block_index,
+                  netascii_state_t *netascii_state);
 
 
 /**
  * @brief Handles whole part of data sending of the transfer. Sends data, receives acks and reading from file.
+ * Keeps up to window size blocks in flight and goes back to the last acked block when the receiver reports a loss.
+ * Only the negotiated range of the file (offset and length options) is sent.
  *
  * @param connection_information connection information
  * @param filename file name, that data should be read from
@@ -274,16 +519,19 @@ int read_from_file(connection_info_t *connection_information, string filename, o
 
 
 /**
- * @brief Gets the destination port from given socket
+ * @brief Handles whole part of data sending of the transfer from an opened source (file or standard input)
  *
- * @param socket socket
- * @return destination port
+ * @param connection_information connection information
+ * @param source opened source of the Data blocks
+ * @param options options associated to the current transfer
+ * @param tid_expected expected TID
+ * @return -1 if OK, else return code according to a possible TFTP error codes
  */
-int get_destination_port(int socket);
+int read_from_source(connection_info_t *connection_information, struct file_source *source, option_info_t *options, int tid_expected);
 
 
 /**
- * @brief Writes log of received RRQ or WRQ packet on standard error stream
+ * @brief Logs received RRQ or WRQ packet (written on standard error stream in the background)
  *
  * @param connection_information connection information
  * @param packet RRQ or WRQ packet structure
@@ -292,7 +540,7 @@ void log_wrq_rrq(connection_info_t *connection_information, tftp_rrq_wrq_packet_
 
 
 /**
- * @brief Writes log of received Data packet on standard error stream
+ * @brief Logs received Data packet (written on standard error stream in the background)
  *
  * @param connection_information connection information
  * @param packet Data packet structure
@@ -301,7 +549,7 @@ void log_data(connection_info_t *connection_information, tftp_data_packet_t *pac
 
 
 /**
- * @brief Writes log of received Ack packet on standard error stream
+ * @brief Logs received Ack packet (written on standard error stream in the background)
  *
  * @param connection_information connection information
  * @param packet Ack packet structure
@@ -310,7 +558,7 @@ void log_ack(connection_info_t *connection_information, tftp_ack_packet_t *packe
 
 
 /**
- * @brief Writes log of received Error packet on standard error stream
+ * @brief Logs received Error packet (written on standard error stream in the background)
  *
  * @param connection_information connection information
  * @param packet Error packet structure
@@ -319,7 +567,7 @@ void log_error(connection_info_t *connection_information, tftp_error_packet_t *p
 
 
 /**
- * @brief Writes log of received Oack packet on standard error stream
+ * @brief Logs received Oack packet (written on standard error stream in the background)
  *
  * @param connection_information connection information
  * @param packet Oack packet structure
@@ -328,11 +576,12 @@ void log_oack(connection_info_t *connection_information, tftp_oack_packet_t *pac
 
 
 /**
- * @brief Writes log of option structure on standard error stream
+ * @brief Formats the requested options for the log
  *
  * @param options option structure
+ * @return options in the log format
  */
-void log_options(option_info_t *options);
+string log_options(option_info_t *options);
 
 
 /**
@@ -340,5 +589,8 @@ void log_options(option_info_t *options);
  *
  * @param connection_information connection information
  * @param buffer received packet data
+ * @param bytes_rx size of the received packet
  */
-void log_stranger_packet(connection_info_t *connection_information, char* buffer);
\ No newline at end of file
+void log_stranger_packet(connection_info_t *connection_information, char* buffer, int bytes_rx);
+
+#endif
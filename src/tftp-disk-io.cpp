@@ -0,0 +1,646 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-disk-io.cpp
+ * @brief Asynchronous disk I/O (io_uring with a thread pool fallback), read-ahead and write-behind of transferred files
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "tftp-disk-io.hpp"
+#include "tftp-resume.hpp"
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+
+//Backends of the asynchronous disk I/O
+enum disk_io_backend{
+    DISK_IO_NONE,           //not started yet
+    DISK_IO_URING,
+    DISK_IO_THREADS
+};
+
+
+//Structure containing the asynchronous I/O backend of one thread
+typedef struct disk_io {
+    disk_io_backend backend = DISK_IO_NONE;
+    unsigned int in_flight = 0;                 //submitted and not reaped requests
+
+    //io_uring
+    int ring_fd = -1;
+    void *sq_ring = MAP_FAILED;
+    void *cq_ring = MAP_FAILED;
+    size_t sq_ring_size = 0;
+    size_t cq_ring_size = 0;
+    void *sqes = MAP_FAILED;
+    size_t sqes_size = 0;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+
+    //thread pool
+    vector<thread> workers;
+    mutex lock;
+    condition_variable submitted_signal;
+    condition_variable completed_signal;
+    deque<disk_request_t *> submitted;
+    vector<disk_request_t *> completed;
+    bool stopping = false;
+
+    ~disk_io();
+} disk_io_t;
+
+
+thread_local disk_io_t disk_io;
+
+
+
+
+/**
+ * @brief Reads or writes the whole request synchronously (worker of the thread pool)
+ *
+ * @param request request to be executed
+ */
+static void disk_request_execute(disk_request_t *request){
+    size_t transferred = 0;
+    while (transferred < request->size){
+        ssize_t result;
+        if (request->is_write){
+            result = pwrite(request->fd, request->buffer.get() + transferred, request->size - transferred, request->offset + transferred);
+        }
+        else{
+            result = pread(request->fd, request->buffer.get() + transferred, request->size - transferred, request->offset + transferred);
+        }
+
+        if (result < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            request->result = -errno;
+            return;
+        }
+        else if (result == 0){
+            break;
+        }
+        transferred += result;
+    }
+
+    request->result = transferred;
+}
+
+
+/**
+ * @brief Worker thread of the thread pool backend
+ *
+ * @param io backend structure of the thread, which submits the requests
+ */
+static void disk_io_worker(disk_io_t *io){
+    unique_lock<mutex> guard(io->lock);
+    while (true){
+        io->submitted_signal.wait(guard, [io]{return io->stopping || !io->submitted.empty();});
+        if (io->submitted.empty()){
+            return;
+        }
+
+        disk_request_t *request = io->submitted.front();
+        io->submitted.pop_front();
+
+        guard.unlock();
+        disk_request_execute(request);
+        guard.lock();
+
+        io->completed.push_back(request);
+        io->completed_signal.notify_one();
+    }
+}
+
+
+#ifdef __NR_io_uring_setup
+/**
+ * @brief Sets up the io_uring instance and maps its rings
+ *
+ * @param io backend structure
+ * @return true if io_uring can be used, else false (not supported or not permitted)
+ */
+static bool disk_io_uring_setup(disk_io_t *io){
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    io->ring_fd = syscall(__NR_io_uring_setup, DISK_IO_QUEUE_DEPTH, &params);
+    if (io->ring_fd < 0){
+        io->ring_fd = -1;
+        return false;
+    }
+
+    io->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    io->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP){
+        io->sq_ring_size = io->cq_ring_size = max(io->sq_ring_size, io->cq_ring_size);
+    }
+
+    io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring_fd, IORING_OFF_SQ_RING);
+    if (io->sq_ring == MAP_FAILED){
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP){
+        io->cq_ring = io->sq_ring;
+    }
+    else{
+        io->cq_ring = mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring_fd, IORING_OFF_CQ_RING);
+        if (io->cq_ring == MAP_FAILED){
+            return false;
+        }
+    }
+
+    io->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ring_fd, IORING_OFF_SQES);
+    if (io->sqes == MAP_FAILED){
+        return false;
+    }
+
+    char *sq = (char *)io->sq_ring;
+    char *cq = (char *)io->cq_ring;
+    io->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    io->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    io->sq_array = (unsigned *)(sq + params.sq_off.array);
+    io->cq_head = (unsigned *)(cq + params.cq_off.head);
+    io->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    io->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    io->cqes = cq + params.cq_off.cqes;
+
+    return true;
+}
+#endif
+
+
+/**
+ * @brief Releases the io_uring instance (also a partially set up one)
+ *
+ * @param io backend structure
+ */
+static void disk_io_uring_release(disk_io_t *io){
+    if (io->sqes != MAP_FAILED){
+        munmap(io->sqes, io->sqes_size);
+        io->sqes = MAP_FAILED;
+    }
+    if (io->cq_ring != MAP_FAILED && io->cq_ring != io->sq_ring){
+        munmap(io->cq_ring, io->cq_ring_size);
+    }
+    io->cq_ring = MAP_FAILED;
+    if (io->sq_ring != MAP_FAILED){
+        munmap(io->sq_ring, io->sq_ring_size);
+        io->sq_ring = MAP_FAILED;
+    }
+    if (io->ring_fd != -1){
+        close(io->ring_fd);
+        io->ring_fd = -1;
+    }
+}
+
+
+disk_io::~disk_io(){
+    if (backend == DISK_IO_THREADS){
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        submitted_signal.notify_all();
+        for (auto &worker : workers){
+            worker.join();
+        }
+    }
+    disk_io_uring_release(this);
+}
+
+
+/**
+ * @brief Gets the backend of the current thread, starts it on the first use (io_uring if possible, else thread pool)
+ *
+ * @return backend structure of the current thread
+ */
+static disk_io_t *disk_io_get(){
+    disk_io_t *io = &disk_io;
+    if (io->backend != DISK_IO_NONE){
+        return io;
+    }
+
+#ifdef __NR_io_uring_setup
+    if (disk_io_uring_setup(io)){
+        io->backend = DISK_IO_URING;
+        return io;
+    }
+    disk_io_uring_release(io);
+#endif
+
+    io->backend = DISK_IO_THREADS;
+    for (int i = 0; i < DISK_IO_POOL_THREADS; i++){
+        io->workers.emplace_back(disk_io_worker, io);
+    }
+    return io;
+}
+
+
+/**
+ * @brief Marks completed requests as done
+ *
+ * @param io backend structure
+ * @param wait wait for at least one completion
+ */
+static void disk_io_reap(disk_io_t *io, bool wait){
+    if (io->in_flight == 0){
+        return;
+    }
+
+#ifdef __NR_io_uring_setup
+    if (io->backend == DISK_IO_URING){
+        unsigned head = *io->cq_head;
+        if (wait && head == __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)){
+            while (syscall(__NR_io_uring_enter, io->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno == EINTR);
+        }
+
+        while (head != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)){
+            struct io_uring_cqe *cqe = &((struct io_uring_cqe *)io->cqes)[head & *io->cq_mask];
+            disk_request_t *request = (disk_request_t *)(uintptr_t)cqe->user_data;
+            request->result = cqe->res;
+            request->done = true;
+            io->in_flight--;
+            head++;
+        }
+        __atomic_store_n(io->cq_head, head, __ATOMIC_RELEASE);
+        return;
+    }
+#endif
+
+    vector<disk_request_t *> completed;
+    {
+        unique_lock<mutex> guard(io->lock);
+        if (wait){
+            io->completed_signal.wait(guard, [io]{return !io->completed.empty();});
+        }
+        completed.swap(io->completed);
+    }
+
+    for (auto request : completed){
+        request->done = true;
+        io->in_flight--;
+    }
+}
+
+
+/**
+ * @brief Submits the request to the backend (waits if the queue of the thread is full)
+ *
+ * @param request request to be submitted
+ */
+static void disk_io_submit(disk_request_t *request){
+    disk_io_t *io = disk_io_get();
+    while (io->in_flight >= DISK_IO_QUEUE_DEPTH){
+        disk_io_reap(io, true);
+    }
+
+    request->iovec.iov_base = request->buffer.get();
+    request->iovec.iov_len = request->size;
+    io->in_flight++;
+
+#ifdef __NR_io_uring_setup
+    if (io->backend == DISK_IO_URING){
+        unsigned tail = *io->sq_tail;
+        unsigned index = tail & *io->sq_mask;
+        struct io_uring_sqe *sqe = &((struct io_uring_sqe *)io->sqes)[index];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = request->is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = request->fd;
+        sqe->off = request->offset;
+        sqe->addr = (uintptr_t)&request->iovec;
+        sqe->len = 1;
+        sqe->user_data = (uintptr_t)request;
+
+        io->sq_array[index] = index;
+        __atomic_store_n(io->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+        if (syscall(__NR_io_uring_enter, io->ring_fd, 1, 0, 0, NULL, 0) < 0){
+            //not submitted, execute it synchronously
+            __atomic_store_n(io->sq_tail, tail, __ATOMIC_RELEASE);
+            disk_request_execute(request);
+            request->done = true;
+            io->in_flight--;
+        }
+        return;
+    }
+#endif
+
+    {
+        lock_guard<mutex> guard(io->lock);
+        io->submitted.push_back(request);
+    }
+    io->submitted_signal.notify_one();
+}
+
+
+/**
+ * @brief Waits until the request is completed
+ *
+ * @param request submitted request
+ */
+static void disk_request_wait(disk_request_t *request){
+    while (!request->done){
+        disk_io_reap(&disk_io, true);
+    }
+}
+
+
+/**
+ * @brief Removes finished writes of the file and records their errors
+ *
+ * @param file file structure opened for writing
+ * @param wait_all wait for all writes of the file
+ */
+static void disk_file_collect_writes(disk_file_t *file, bool wait_all){
+    disk_io_reap(&disk_io, false);
+
+    for (auto it = file->requests.begin(); it != file->requests.end();){
+        disk_request_t *request = it->get();
+        if (wait_all){
+            disk_request_wait(request);
+        }
+        if (!request->done){
+            it++;
+            continue;
+        }
+
+        if (file->error == 0){
+            if (request->result < 0){
+                file->error = -request->result;
+            }
+            else if ((size_t)request->result < request->size){
+                file->error = ENOSPC;
+            }
+        }
+        it = file->requests.erase(it);
+    }
+}
+
+
+/**
+ * @brief Submits the filled part of the chunk to be written (waits if the file has too many writes in flight)
+ *
+ * @param file file structure opened for writing
+ */
+static void disk_file_submit_chunk(disk_file_t *file){
+    disk_file_collect_writes(file, false);
+    while (file->requests.size() >= DISK_IO_CHUNKS_PER_FILE){
+        disk_request_wait(file->requests.front().get());
+        disk_file_collect_writes(file, false);
+    }
+
+    unique_ptr<disk_request_t> request(new disk_request_t);
+    request->is_write = true;
+    request->fd = file->fd;
+    request->buffer = move(file->chunk);
+    request->size = file->chunk_used;
+    request->offset = file->offset;
+
+    file->offset += file->chunk_used;
+    file->chunk_used = 0;
+
+    disk_io_submit(request.get());
+    file->requests.push_back(move(request));
+}
+
+
+/**
+ * @brief Submits reads of the following chunks of the file up to the read-ahead limit
+ *
+ * @param file file structure opened for reading
+ */
+static void disk_file_read_ahead(disk_file_t *file){
+    while (file->requests.size() < DISK_IO_CHUNKS_PER_FILE && file->offset < file->size){
+        unique_ptr<disk_request_t> request(new disk_request_t);
+        request->is_write = false;
+        request->fd = file->fd;
+        request->size = min((off_t)DISK_IO_CHUNK_SIZE, file->size - file->offset);
+        request->buffer.reset(new char[request->size]);
+        request->offset = file->offset;
+
+        file->offset += request->size;
+
+        disk_io_submit(request.get());
+        file->requests.push_back(move(request));
+    }
+}
+
+
+int disk_file_open_write(disk_file_t *file, string path){
+    file->fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (file->fd == -1){
+        return errno;
+    }
+
+    file->offset = 0;
+    file->size = 0;
+    file->chunk_used = 0;
+    file->error = 0;
+    file->is_checksummed = false;
+    return 0;
+}
+
+
+int disk_file_open_write_range(disk_file_t *file, string path, off_t offset){
+    file->fd = open(path.c_str(), O_WRONLY | O_CREAT, 0666);
+    if (file->fd == -1){
+        return errno;
+    }
+
+    file->offset = offset;
+    file->size = 0;
+    file->chunk_used = 0;
+    file->error = 0;
+    file->is_checksummed = false;
+    return 0;
+}
+
+
+int disk_file_open_append(disk_file_t *file, string path, off_t size){
+    int error_number = disk_file_open_write_range(file, path, size);
+    if (error_number == 0 && ftruncate(file->fd, size) == -1){
+        error_number = errno;
+        close(file->fd);
+        file->fd = -1;
+    }
+    return error_number;
+}
+
+
+bool disk_file_open_read(disk_file_t *file, string path){
+    return disk_file_open_read_range(file, path, 0, 0);
+}
+
+
+bool disk_file_open_read_range(disk_file_t *file, string path, unsigned long long offset, unsigned long long length){
+    file->fd = open(path.c_str(), O_RDONLY);
+    if (file->fd == -1){
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(file->fd, &file_stat) == -1){
+        close(file->fd);
+        file->fd = -1;
+        return false;
+    }
+
+    file->offset = min((unsigned long long)file_stat.st_size, offset);
+    file->size = (length == 0 || length > (unsigned long long)(file_stat.st_size - file->offset)) ? file_stat.st_size : file->offset + length;
+    file->chunk_used = 0;
+    file->error = 0;
+
+    disk_file_read_ahead(file);
+    return true;
+}
+
+
+bool disk_file_is_open(disk_file_t *file){
+    return file->fd != -1;
+}
+
+
+int disk_file_write(disk_file_t *file, const char *data, size_t size){
+    if (file->is_checksummed){
+        file->checksum = adler32_update(file->checksum, data, size);
+    }
+
+    while (size > 0 && file->error == 0){
+        if (!file->chunk){
+            file->chunk.reset(new char[DISK_IO_CHUNK_SIZE]);
+        }
+
+        size_t copied = min(size, DISK_IO_CHUNK_SIZE - file->chunk_used);
+        memcpy(file->chunk.get() + file->chunk_used, data, copied);
+        file->chunk_used += copied;
+        data += copied;
+        size -= copied;
+
+        if (file->chunk_used == DISK_IO_CHUNK_SIZE){
+            disk_file_submit_chunk(file);
+        }
+    }
+
+    return file->error;
+}
+
+
+int disk_file_write_at(disk_file_t *file, const char *data, size_t size, off_t offset){
+    //data following the data written so far are merged into the chunks
+    if (offset == file->offset + (off_t)file->chunk_used){
+        return disk_file_write(file, data, size);
+    }
+
+    //chunks in flight are finished first, so they can't overwrite the data
+    if (disk_file_flush(file) != 0){
+        return file->error;
+    }
+
+    while (size > 0){
+        ssize_t written = pwrite(file->fd, data, size, offset);
+        if (written < 0 && errno == EINTR){
+            continue;
+        }
+        if (written < 0){
+            file->error = errno;
+            break;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+
+    return file->error;
+}
+
+
+int disk_file_flush(disk_file_t *file){
+    if (file->chunk_used > 0 && file->error == 0){
+        disk_file_submit_chunk(file);
+    }
+    disk_file_collect_writes(file, true);
+
+    return file->error;
+}
+
+
+size_t disk_file_read(disk_file_t *file, char *buffer, size_t size){
+    size_t copied = 0;
+    while (copied < size && !file->requests.empty() && file->error == 0){
+        disk_request_t *request = file->requests.front().get();
+        disk_request_wait(request);
+        if (request->result < 0){
+            file->error = -request->result;
+            break;
+        }
+
+        size_t available = request->result - file->chunk_used;
+        size_t read_size = min(available, size - copied);
+        memcpy(buffer + copied, request->buffer.get() + file->chunk_used, read_size);
+        file->chunk_used += read_size;
+        copied += read_size;
+
+        if (file->chunk_used == (size_t)request->result){
+            if ((size_t)request->result < request->size){
+                //file was shortened since it was opened, following chunks are not valid
+                file->size = file->offset = request->offset + request->result;
+                for (auto &following : file->requests){
+                    disk_request_wait(following.get());
+                }
+                file->requests.clear();
+            }
+            else{
+                file->requests.pop_front();
+            }
+            file->chunk_used = 0;
+            disk_file_read_ahead(file);
+        }
+    }
+
+    return copied;
+}
+
+
+void disk_file_close(disk_file_t *file){
+    if (file->fd == -1){
+        return;
+    }
+
+    if (file->chunk){
+        disk_file_flush(file);
+    }
+    for (auto &request : file->requests){
+        disk_request_wait(request.get());
+    }
+    file->requests.clear();
+    file->chunk.reset();
+    file->chunk_used = 0;
+
+    close(file->fd);
+    file->fd = -1;
+}
+
+
+const char *disk_io_backend_name(){
+    return disk_io_get()->backend == DISK_IO_URING ? "io_uring" : "threads";
+}
@@ -0,0 +1,177 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-disk-io.hpp
+ * @brief Asynchronous disk I/O (io_uring with a thread pool fallback), read-ahead and write-behind of transferred files
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_DISK_IO_HPP
+#define TFTP_DISK_IO_HPP
+
+#include <sys/uio.h>
+#include <deque>
+#include <memory>
+#include <string>
+
+#define DISK_IO_QUEUE_DEPTH 64              //requests in flight at once (per thread)
+#define DISK_IO_CHUNK_SIZE (64 * 1024)      //data of one request, Data blocks are merged into chunks
+#define DISK_IO_CHUNKS_PER_FILE 4           //queued writes or read-ahead chunks of one file (bounded memory)
+#define DISK_IO_POOL_THREADS 2              //threads of the fallback backend
+
+using namespace std;
+
+
+//One asynchronous read or write of a chunk of the file
+typedef struct disk_request {
+    bool is_write;
+    int fd;
+    unique_ptr<char[]> buffer;
+    size_t size;                                //requested size in Bytes
+    off_t offset;
+    struct iovec iovec;                         //buffer description for io_uring
+    ssize_t result = 0;                         //transferred Bytes or -errno
+    bool done = false;                          //set by the thread owning the file when the completion is reaped
+} disk_request_t;
+
+
+//File read or written through the asynchronous backend of the current thread
+typedef struct disk_file {
+    int fd = -1;
+    off_t offset = 0;                           //offset of the next submitted chunk
+    off_t size = 0;                             //read: end of the read data (size of the file when it was opened)
+    deque<unique_ptr<disk_request_t>> requests; //submitted chunks (read: in order of the file)
+    unique_ptr<char[]> chunk;                   //write: chunk being filled
+    size_t chunk_used = 0;                      //write: filled part of the chunk, read: consumed part of the first chunk
+    int error = 0;                              //errno of the first failed request
+    bool is_checksummed = false;                //write: data of disk_file_write are added to the checksum (resumed transfer)
+    unsigned int checksum = 1;                  //write: Adler-32 checksum of the file up to the written data
+} disk_file_t;
+
+
+/**
+ * @brief Opens (creates or truncates) the file for writing
+ *
+ * @param file file structure
+ * @param path path to the file
+ * @return 0 if OK, else errno
+ */
+int disk_file_open_write(disk_file_t *file, string path);
+
+
+/**
+ * @brief Opens the file for sequential reading with read-ahead
+ *
+ * @param file file structure
+ * @param path path to the file
+ * @return true if the file was opened, else false
+ */
+bool disk_file_open_read(disk_file_t *file, string path);
+
+
+/**
+ * @brief Opens the file for sequential reading of the range with read-ahead (range is limited by the end of the file)
+ *
+ * @param file file structure
+ * @param path path to the file
+ * @param offset first Byte of the range
+ * @param length size of the range in Bytes (0 up to the end of the file)
+ * @return true if the file was opened, else false
+ */
+bool disk_file_open_read_range(disk_file_t *file, string path, unsigned long long offset, unsigned long long length);
+
+
+/**
+ * @brief Opens (creates) the file for writing from the offset, the file is not truncated (e.g. a range of
+ * the file written by one or more transfers)
+ *
+ * @param file file structure
+ * @param path path to the file
+ * @param offset offset of the first written Byte
+ * @return 0 if OK, else errno
+ */
+int disk_file_open_write_range(disk_file_t *file, string path, off_t offset);
+
+
+/**
+ * @brief Opens (creates) the file for writing behind its first Bytes (e.g. a resumed transfer), the rest
+ * of the file is cut off
+ *
+ * @param file file structure
+ * @param path path to the file
+ * @param size size of the kept beginning of the file in Bytes
+ * @return 0 if OK, else errno
+ */
+int disk_file_open_append(disk_file_t *file, string path, off_t size);
+
+
+/**
+ * @brief Checks whether the file is open
+ *
+ * @param file file structure
+ * @return true if the file is open, else false
+ */
+bool disk_file_is_open(disk_file_t *file);
+
+
+/**
+ * @brief Copies the data behind the data written so far, full chunks are written in the background. Waits
+ * only when the file has too many chunks in flight.
+ *
+ * @param file file structure opened for writing
+ * @param data data to be written
+ * @param size size of the data in Bytes
+ * @return 0 if OK, else errno of a failed write (also of earlier data)
+ */
+int disk_file_write(disk_file_t *file, const char *data, size_t size);
+
+
+/**
+ * @brief Writes the data at the offset (e.g. blocks received out of order). Data following the data written
+ * so far are merged into the chunks, other data are written synchronously after the chunks in flight.
+ *
+ * @param file file structure opened for writing
+ * @param data data to be written
+ * @param size size of the data in Bytes
+ * @param offset offset in the file
+ * @return 0 if OK, else errno of a failed write (also of earlier data)
+ */
+int disk_file_write_at(disk_file_t *file, const char *data, size_t size, off_t offset);
+
+
+/**
+ * @brief Writes the rest of the data and waits until all writes of the file are finished
+ *
+ * @param file file structure opened for writing
+ * @return 0 if OK, else errno of a failed write
+ */
+int disk_file_flush(disk_file_t *file);
+
+
+/**
+ * @brief Reads the next data of the file, following chunks are read ahead in the background
+ *
+ * @param file file structure opened for reading
+ * @param buffer address, where the data will be stored
+ * @param size size of the buffer
+ * @return size of the read data in Bytes (lower than size only at the end of the file or on an error)
+ */
+size_t disk_file_read(disk_file_t *file, char *buffer, size_t size);
+
+
+/**
+ * @brief Writes the rest of the data (if opened for writing), waits for all requests of the file and closes it
+ *
+ * @param file file structure
+ */
+void disk_file_close(disk_file_t *file);
+
+
+/**
+ * @brief Gets the name of the backend used by the current thread (backend is started on the first use)
+ *
+ * @return "io_uring" or "threads"
+ */
+const char *disk_io_backend_name();
+
+#endif
@@ -0,0 +1,322 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-file-cache.cpp
+ * @brief Server-wide cache of the file contents in shared memory (shared by sessions, worker threads and child processes)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include <iostream>
+#include <vector>
+#include "tftp-file-cache.hpp"
+#include "tftp-packet-structures.hpp"
+
+
+static file_cache_t *file_cache = NULL;
+static char *file_cache_arena = NULL;
+
+
+/**
+ * @brief Frees the entry (must be called with the lock held)
+ *
+ * @param entry entry to be freed
+ */
+static void file_cache_free_entry(cache_entry_t *entry){
+    entry->state = ENTRY_FREE;
+    file_cache->stats.entries--;
+    file_cache->stats.bytes_used -= entry->size;
+}
+
+
+/**
+ * @brief Checks the process loading the content of the entry was terminated (e.g. killed child process)
+ *
+ * @param entry entry of the cache
+ * @return true if the entry is loading and its loader is gone, else false
+ */
+static bool file_cache_loader_is_gone(cache_entry_t *entry){
+    return entry->state == ENTRY_LOADING && kill(entry->loader_pid, 0) < 0 && errno == ESRCH;
+}
+
+
+/**
+ * @brief Frees the entries, that will never be loaded, because their loader is gone (must be called with the lock held)
+ */
+static void file_cache_reclaim(){
+    for (cache_entry_t &entry : file_cache->entries){
+        if (file_cache_loader_is_gone(&entry)){
+            file_cache_free_entry(&entry);
+        }
+    }
+}
+
+
+/**
+ * @brief Locks the cache, lock held by a terminated process is taken over (entries it was loading are freed)
+ */
+static void file_cache_lock(){
+    if (pthread_mutex_lock(&file_cache->lock) == EOWNERDEAD){
+        pthread_mutex_consistent(&file_cache->lock);
+        file_cache_reclaim();
+    }
+}
+
+
+/**
+ * @brief Unlocks the cache
+ */
+static void file_cache_unlock(){
+    pthread_mutex_unlock(&file_cache->lock);
+}
+
+
+/**
+ * @brief Finds the free space of given size in the arena (must be called with the lock held)
+ *
+ * @param size required size
+ * @param offset address, where the position of the free space will be stored
+ * @return true if the space was found, else false
+ */
+static bool file_cache_find_space(size_t size, size_t *offset){
+    vector<pair<size_t, size_t>> used_spaces;
+    for (cache_entry_t &entry : file_cache->entries){
+        if (entry.state != ENTRY_FREE){
+            used_spaces.push_back({entry.offset, entry.size});
+        }
+    }
+    sort(used_spaces.begin(), used_spaces.end());
+
+    //first fit between used spaces
+    size_t gap_start = 0;
+    for (auto &used_space : used_spaces){
+        if (used_space.first - gap_start >= size){
+            break;
+        }
+        gap_start = used_space.first + used_space.second;
+    }
+
+    *(offset) = gap_start;
+    return file_cache->budget - gap_start >= size;
+}
+
+
+/**
+ * @brief Evicts one not used entry chosen by the CLOCK algorithm (must be called with the lock held)
+ *
+ * @return true if an entry was evicted, else false (all entries are used)
+ */
+static bool file_cache_evict(){
+    //two rounds, in the first one reference bits may be only cleared
+    for (unsigned int i = 0; i < 2 * FILE_CACHE_MAX_ENTRIES; i++){
+        cache_entry_t *entry = &file_cache->entries[file_cache->clock_hand];
+        file_cache->clock_hand = (file_cache->clock_hand + 1) % FILE_CACHE_MAX_ENTRIES;
+
+        if (file_cache_loader_is_gone(entry)){
+            file_cache_free_entry(entry);       //space of the abandoned content is not an eviction
+            return true;
+        }
+        if (entry->state != ENTRY_READY || entry->references != 0){
+            continue;
+        }
+        if (entry->recently_used){
+            entry->recently_used = false;
+            continue;
+        }
+
+        file_cache_free_entry(entry);
+        file_cache->stats.evictions++;
+        return true;
+    }
+    return false;
+}
+
+
+/**
+ * @brief Reads the whole file into the arena and checks, that it was not changed meanwhile
+ *
+ * @param entry entry of the file
+ * @return true if the content was read, else false
+ */
+static bool file_cache_load(cache_entry_t *entry){
+    int file_descriptor = open(entry->path, O_RDONLY);
+    if (file_descriptor < 0){
+        return false;
+    }
+
+    size_t loaded = 0;
+    while (loaded < entry->size){
+        ssize_t bytes_read = pread(file_descriptor, file_cache_arena + entry->offset + loaded, entry->size - loaded, loaded);
+        if (bytes_read <= 0){
+            break;
+        }
+        loaded += bytes_read;
+    }
+
+    struct stat file_stat;
+    bool is_valid = loaded == entry->size && fstat(file_descriptor, &file_stat) == 0 &&
+                    (size_t)file_stat.st_size == entry->size &&
+                    file_stat.st_mtim.tv_sec == entry->mtime_sec && file_stat.st_mtim.tv_nsec == entry->mtime_nsec;
+
+    close(file_descriptor);
+    return is_valid;
+}
+
+
+int file_cache_init(size_t budget){
+    size_t header_size = (sizeof(file_cache_t) + 4095) & ~(size_t)4095;
+
+    //shared anonymous mapping is inherited by child processes, arena pages are allocated on the first use
+    void *memory = mmap(NULL, header_size + budget, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED){
+        cout << "ERROR: mmap - file cache\n";
+        return PROG_RET_CODE_ERR;
+    }
+
+    file_cache = new (memory) file_cache_t();
+    file_cache_arena = (char *)memory + header_size;
+    file_cache->budget = budget;
+    file_cache->clock_hand = 0;
+    file_cache->stats.bytes_budget = budget;
+
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&file_cache->lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+
+    return PROG_RET_CODE_OK;
+}
+
+int file_cache_acquire(string path, char **data, size_t *size){
+    struct stat file_stat;
+    if (file_cache == NULL || path.size() >= FILE_CACHE_MAX_PATH || stat(path.c_str(), &file_stat) < 0 ||
+        !S_ISREG(file_stat.st_mode) || file_stat.st_size == 0 || (size_t)file_stat.st_size > file_cache->budget){
+        return FILE_CACHE_NO_ENTRY;     //file can not be cached
+    }
+
+    file_cache_lock();
+
+    int free_index = FILE_CACHE_NO_ENTRY;
+    for (int i = 0; i < FILE_CACHE_MAX_ENTRIES; i++){
+        cache_entry_t *entry = &file_cache->entries[i];
+        if (entry->state == ENTRY_FREE || strcmp(entry->path, path.c_str()) != 0){
+            if (entry->state == ENTRY_FREE && free_index == FILE_CACHE_NO_ENTRY){
+                free_index = i;
+            }
+            continue;
+        }
+
+        bool is_same_version = entry->size == (size_t)file_stat.st_size &&
+                               entry->mtime_sec == file_stat.st_mtim.tv_sec && entry->mtime_nsec == file_stat.st_mtim.tv_nsec;
+        if (is_same_version && entry->state == ENTRY_READY){
+            entry->references++;
+            entry->recently_used = true;
+            file_cache->stats.hits++;
+            *(data) = file_cache_arena + entry->offset;
+            *(size) = entry->size;
+            file_cache_unlock();
+            return i;
+        }
+        else if (is_same_version && !file_cache_loader_is_gone(entry)){
+            //file is being loaded by another transfer, this one reads it from the disk
+            file_cache->stats.misses++;
+            file_cache_unlock();
+            return FILE_CACHE_NO_ENTRY;
+        }
+        else if (entry->references == 0 || file_cache_loader_is_gone(entry)){
+            //content of the changed file is not valid anymore, content of the terminated loader is never completed
+            file_cache_free_entry(entry);
+            if (free_index == FILE_CACHE_NO_ENTRY){
+                free_index = i;
+            }
+        }
+    }
+
+    file_cache->stats.misses++;
+
+    //making space for the new content
+    size_t offset;
+    while (free_index == FILE_CACHE_NO_ENTRY || !file_cache_find_space(file_stat.st_size, &offset)){
+        if (!file_cache_evict()){
+            file_cache_unlock();
+            return FILE_CACHE_NO_ENTRY;
+        }
+        if (free_index == FILE_CACHE_NO_ENTRY){
+            for (int i = 0; i < FILE_CACHE_MAX_ENTRIES && free_index == FILE_CACHE_NO_ENTRY; i++){
+                if (file_cache->entries[i].state == ENTRY_FREE) free_index = i;
+            }
+        }
+    }
+
+    cache_entry_t *entry = &file_cache->entries[free_index];
+    entry->state = ENTRY_LOADING;
+    strcpy(entry->path, path.c_str());
+    entry->mtime_sec = file_stat.st_mtim.tv_sec;
+    entry->mtime_nsec = file_stat.st_mtim.tv_nsec;
+    entry->size = file_stat.st_size;
+    entry->offset = offset;
+    entry->references = 1;
+    entry->recently_used = true;
+    entry->loader_pid = getpid();
+    file_cache->stats.entries++;
+    file_cache->stats.bytes_used += entry->size;
+
+    file_cache_unlock();
+
+    //reading from the disk without holding the lock
+    bool is_loaded = file_cache_load(entry);
+
+    file_cache_lock();
+    if (!is_loaded){
+        file_cache_free_entry(entry);
+        file_cache_unlock();
+        return FILE_CACHE_NO_ENTRY;
+    }
+    entry->state = ENTRY_READY;
+    file_cache_unlock();
+
+    *(data) = file_cache_arena + entry->offset;
+    *(size) = entry->size;
+    return free_index;
+}
+
+void file_cache_release(int entry_index){
+    if (file_cache == NULL || entry_index == FILE_CACHE_NO_ENTRY){
+        return;
+    }
+
+    file_cache_lock();
+    file_cache->entries[entry_index].references--;
+    file_cache_unlock();
+}
+
+bool file_cache_get_stats(file_cache_stats_t *stats){
+    if (file_cache == NULL){
+        return false;
+    }
+
+    file_cache_lock();
+    *(stats) = file_cache->stats;
+    file_cache_unlock();
+    return true;
+}
+
+void log_file_cache_stats(){
+    file_cache_stats_t stats;
+    if (!file_cache_get_stats(&stats)){
+        return;
+    }
+
+    cerr << "CACHE hits=" << stats.hits << " misses=" << stats.misses << " evictions=" << stats.evictions
+        << " entries=" << stats.entries << " used=" << stats.bytes_used << "/" << stats.bytes_budget << "\n";
+}
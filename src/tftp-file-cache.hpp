@@ -0,0 +1,109 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-file-cache.hpp
+ * @brief Server-wide cache of the file contents in shared memory (shared by sessions, worker threads and child processes)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_FILE_CACHE_HPP
+#define TFTP_FILE_CACHE_HPP
+
+#include <pthread.h>
+#include <sys/types.h>
+#include <string>
+
+using namespace std;
+
+#define FILE_CACHE_MAX_ENTRIES 256
+#define FILE_CACHE_MAX_PATH 256
+#define FILE_CACHE_NO_ENTRY -1
+
+
+//States of the cache entry
+enum cache_entry_state{
+    ENTRY_FREE,
+    ENTRY_LOADING,          //content is being read from the disk by the first requester
+    ENTRY_READY
+};
+
+
+//Structure containing a single cached file (identified by path, modification time and size)
+typedef struct cache_entry {
+    cache_entry_state state = ENTRY_FREE;
+    char path[FILE_CACHE_MAX_PATH];
+    long mtime_sec;
+    long mtime_nsec;
+    size_t size;
+    size_t offset;                  //position of the content in the arena
+    unsigned int references;        //number of transfers using the content
+    bool recently_used;             //CLOCK reference bit
+    pid_t loader_pid;               //process reading the content (entry is reclaimed, when it's gone while loading)
+} cache_entry_t;
+
+
+//Structure containing statistics of the cache
+typedef struct file_cache_stats {
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    unsigned long evictions = 0;
+    unsigned int entries = 0;
+    size_t bytes_used = 0;
+    size_t bytes_budget = 0;
+} file_cache_stats_t;
+
+
+//Structure placed at the beginning of the shared memory, the arena with contents follows it
+typedef struct file_cache {
+    pthread_mutex_t lock;           //process shared, robust
+    size_t budget;                  //size of the arena
+    unsigned int clock_hand;
+    file_cache_stats_t stats;
+    cache_entry_t entries[FILE_CACHE_MAX_ENTRIES];
+} file_cache_t;
+
+
+/**
+ * @brief Creates the cache in the shared memory, has to be called before creating child processes or threads
+ *
+ * @param budget maximal number of Bytes of cached file contents
+ * @return PROG_RET_CODE_OK if OK, else PROG_RET_CODE_ERR
+ */
+int file_cache_init(size_t budget);
+
+
+/**
+ * @brief Gets the content of the file from the cache, the file is read from the disk and cached when it's missing
+ * or was changed. Content stays valid until it's released
+ *
+ * @param path path to the file
+ * @param data address, where the address of the content will be stored
+ * @param size address, where the size of the content will be stored
+ * @return index of the used entry or FILE_CACHE_NO_ENTRY if the content can not be provided by the cache
+ */
+int file_cache_acquire(string path, char **data, size_t *size);
+
+
+/**
+ * @brief Releases the content acquired by file_cache_acquire, so it can be evicted
+ *
+ * @param entry_index index of the entry
+ */
+void file_cache_release(int entry_index);
+
+
+/**
+ * @brief Gets the current statistics of the cache
+ *
+ * @param stats address, where the statistics will be stored
+ * @return true if the cache is used, else false
+ */
+bool file_cache_get_stats(file_cache_stats_t *stats);
+
+
+/**
+ * @brief Writes statistics of the cache (hits, misses, evictions) on standard error stream, if the cache is used
+ */
+void log_file_cache_stats();
+
+#endif
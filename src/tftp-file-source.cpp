@@ -0,0 +1,293 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-file-source.cpp
+ * @brief Source of the Data blocks of a transferred file (memory mapping for octet mode, asynchronous reading otherwise)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include "tftp-file-source.hpp"
+#include "tftp-resume.hpp"
+
+
+/**
+ * @brief Maps the whole file into the memory for sequential reading
+ *
+ * @param source source structure
+ * @param filename path to the file
+ * @return true if the file was mapped, else false
+ */
+static bool file_source_map(file_source_t *source, string filename){
+    int file_descriptor = open(filename.c_str(), O_RDONLY);
+    if (file_descriptor < 0){
+        return false;
+    }
+
+    struct stat file_stat;
+    if (fstat(file_descriptor, &file_stat) < 0 || !S_ISREG(file_stat.st_mode)){
+        close(file_descriptor);
+        return false;
+    }
+
+    source->file_size = file_stat.st_size;
+    source->mapping = NULL;
+    if (source->file_size != 0){    //empty file can not be mapped, it has no blocks with data
+        void *mapping = mmap(NULL, source->file_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+        if (mapping == MAP_FAILED){
+            close(file_descriptor);
+            return false;
+        }
+        madvise(mapping, source->file_size, MADV_SEQUENTIAL);
+        source->mapping = (char *)mapping;
+    }
+
+    //mapping stays valid after closing the descriptor, it's kept to find out the file was truncated
+    if (source->mapping != NULL){
+        source->map_descriptor = file_descriptor;
+    }
+    else{
+        close(file_descriptor);
+    }
+    source->is_mapped = true;
+    return true;
+}
+
+
+/**
+ * @brief Checks the mapped file was not truncated before its data up to the end are accessed (pages behind
+ * the end of the file can't be read, the process would get SIGBUS and sendmmsg would fail with EFAULT)
+ *
+ * @param source source structure with the mapped file
+ * @param end end of the accessed data in the mapping
+ * @return true if the data can be accessed, else false (source is failed)
+ */
+static bool file_source_check_size(file_source_t *source, size_t end){
+    if (source->map_descriptor < 0 || end <= source->checked_end){
+        return !source->is_failed;      //cached content (a copy of the file) and the checked part are not checked again
+    }
+
+    struct stat file_stat;
+    if (fstat(source->map_descriptor, &file_stat) < 0 || (size_t)file_stat.st_size < source->file_size){
+        cout << "ERROR: mapped file was truncated during the transfer\n";
+        source->is_failed = true;
+        return false;
+    }
+
+    source->checked_end = min(source->range_end, end + FILE_SOURCE_READ_AHEAD);
+    return true;
+}
+
+
+/**
+ * @brief Reads the next data of the file (already read ahead) or the descriptor. Reading from the descriptor
+ * (pipe) is repeated, until the buffer is full or the end of the input is reached.
+ *
+ * @param source source structure
+ * @param buffer address, where the data will be stored
+ * @param size size of the buffer
+ * @return size of the read data in Bytes (lower than size only at the end of the input)
+ */
+static size_t file_source_read(file_source_t *source, char *buffer, size_t size){
+    if (source->file_descriptor < 0){
+        return disk_file_read(&source->file_read, buffer, size);
+    }
+
+    size_t read_total = 0;
+    while (read_total < size){
+        ssize_t read_actual = read(source->file_descriptor, buffer + read_total, size - read_total);
+        if (read_actual < 0 && errno == EINTR){
+            continue;
+        }
+        else if (read_actual < 0){
+            cout << "ERROR: read - reading the input data\n";
+            break;
+        }
+        else if (read_actual == 0){
+            break;      //end of the input
+        }
+        read_total += read_actual;
+    }
+    return read_total;
+}
+
+
+/**
+ * @brief Loads the next block of the text converted to NETASCII (LF to CR LF, CR to CR NUL)
+ *
+ * @param source source structure
+ * @param data_block address, where the loaded data block will be stored
+ * @param blocksize maximal size of the data block
+ * @return size of the loaded data block in Bytes
+ */
+static unsigned int file_source_load_netascii(file_source_t *source, char *data_block, unsigned int blocksize){
+    if (source->netascii_input.size() < blocksize){
+        source->netascii_input.resize(blocksize);
+    }
+
+    unsigned int loaded_actual = 0;
+    while (loaded_actual < blocksize){
+        if (source->netascii_input_start == source->netascii_input_end){
+            //reading the next part of the text
+            source->netascii_input_start = 0;
+            source->netascii_input_end = file_source_read(source, source->netascii_input.data(), source->netascii_input.size());
+            if (source->netascii_input_end == 0 && !source->netascii_state.has_pending){
+                break;
+            }
+        }
+
+        size_t consumed;
+        loaded_actual += netascii_encode(source->netascii_input.data() + source->netascii_input_start,
+                                         source->netascii_input_end - source->netascii_input_start, &consumed,
+                                         data_block + loaded_actual, blocksize - loaded_actual, &source->netascii_state);
+        source->netascii_input_start += consumed;
+    }
+
+    return loaded_actual;
+}
+
+
+/**
+ * @brief Limits the sent blocks of the mapped file to the range
+ *
+ * @param source source structure with the mapped file
+ * @param offset first Byte of the range
+ * @param length size of the range in Bytes (0 up to the end of the file)
+ */
+static void file_source_set_range(file_source_t *source, unsigned long long offset, unsigned long long length){
+    source->range_offset = min((unsigned long long)source->file_size, offset);
+    source->range_end = (length == 0 || length > source->file_size - source->range_offset) ? source->file_size : source->range_offset + length;
+    source->prefetch_offset = source->range_offset;
+}
+
+bool file_source_open(file_source_t *source, string filename, string mode){
+    return file_source_open_range(source, filename, mode, 0, 0);
+}
+
+bool file_source_open_range(file_source_t *source, string filename, string mode, unsigned long long offset, unsigned long long length){
+    source->mode = mode;
+    source->is_mapped = false;
+    source->file_descriptor = -1;
+    source->netascii_input_start = 0;
+    source->netascii_input_end = 0;
+    source->netascii_state = netascii_state_t();
+    source->cache_entry = FILE_CACHE_NO_ENTRY;
+    source->prefetch_offset = 0;
+    source->map_descriptor = -1;
+    source->checked_end = 0;
+    source->is_failed = false;
+
+    if (mode != MODE_NETASCII){
+        source->cache_entry = file_cache_acquire(filename, &source->mapping, &source->file_size);
+        if (source->cache_entry != FILE_CACHE_NO_ENTRY){
+            source->is_mapped = true;
+            file_source_set_range(source, offset, length);
+            return true;
+        }
+        if (file_source_map(source, filename)){
+            file_source_set_range(source, offset, length);
+            return true;
+        }
+    }
+
+    return disk_file_open_read_range(&source->file_read, filename, offset, length);
+}
+
+void file_source_open_descriptor(file_source_t *source, int file_descriptor, string mode){
+    source->mode = mode;
+    source->is_mapped = false;
+    source->file_descriptor = file_descriptor;
+    source->netascii_input_start = 0;
+    source->netascii_input_end = 0;
+    source->netascii_state = netascii_state_t();
+    source->cache_entry = FILE_CACHE_NO_ENTRY;
+    source->map_descriptor = -1;
+    source->is_failed = false;
+}
+
+bool file_source_resume(file_source_t *source, unsigned long long bytes, unsigned int checksum){
+    if (source->mode == MODE_NETASCII){
+        return false;       //converted data don't match the file
+    }
+
+    if (source->is_mapped){
+        if (bytes > source->range_end - source->range_offset || !file_source_check_size(source, source->range_offset + bytes) ||
+            adler32_update(ADLER32_INITIAL, source->mapping + source->range_offset, bytes) != checksum){
+            return false;
+        }
+        source->range_offset += bytes;
+        source->prefetch_offset = source->range_offset;
+        return true;
+    }
+
+    //prefix of the regular file on the descriptor is read without moving the descriptor, a pipe can't be skipped
+    struct stat file_stat;
+    off_t start = source->file_descriptor < 0 ? -1 : lseek(source->file_descriptor, 0, SEEK_CUR);
+    unsigned int prefix_checksum;
+    if (start < 0 || fstat(source->file_descriptor, &file_stat) < 0 || !S_ISREG(file_stat.st_mode) ||
+        !resume_checksum_file(source->file_descriptor, start, bytes, &prefix_checksum) || prefix_checksum != checksum){
+        return false;
+    }
+    return lseek(source->file_descriptor, start + bytes, SEEK_SET) >= 0;
+}
+
+void file_source_close(file_source_t *source){
+    if (source->cache_entry != FILE_CACHE_NO_ENTRY){
+        file_cache_release(source->cache_entry);
+        source->cache_entry = FILE_CACHE_NO_ENTRY;
+        source->mapping = NULL;
+        source->is_mapped = false;
+    }
+    else if (source->is_mapped){
+        if (source->mapping != NULL){
+            munmap(source->mapping, source->file_size);
+            source->mapping = NULL;
+        }
+        if (source->map_descriptor >= 0){
+            close(source->map_descriptor);
+            source->map_descriptor = -1;
+        }
+        source->is_mapped = false;
+    }
+    disk_file_close(&source->file_read);
+    source->file_descriptor = -1;       //descriptor is owned by the caller
+}
+
+unsigned int file_source_load_block(file_source_t *source, data_block_t *block, unsigned long block_index, unsigned int blocksize){
+    if (!source->is_mapped && source->mode == MODE_NETASCII){
+        block->payload_size = file_source_load_netascii(source, block->payload, blocksize);
+        return block->payload_size;
+    }
+    else if (!source->is_mapped){
+        //octet data are loaded without any conversion
+        block->payload_size = file_source_read(source, block->payload, blocksize);
+        return block->payload_size;
+    }
+
+    size_t offset = source->range_offset + block_index * blocksize;
+    if (offset >= source->range_end){
+        //block behind the end of the range (last block of the range with size divisible by the block size)
+        block->payload = source->mapping;
+        block->payload_size = 0;
+    }
+    else if (!file_source_check_size(source, min(source->range_end, offset + blocksize))){
+        block->payload = source->mapping;
+        block->payload_size = 0;
+    }
+    else{
+        //paging in the following part of the mapped file (cached content is already in the memory)
+        size_t prefetch_end = min(source->range_end, offset + FILE_SOURCE_READ_AHEAD);
+        while (source->cache_entry == FILE_CACHE_NO_ENTRY && source->prefetch_offset < prefetch_end){
+            madvise(source->mapping + source->prefetch_offset, min((size_t)FILE_SOURCE_READ_AHEAD, source->file_size - source->prefetch_offset), MADV_WILLNEED);
+            source->prefetch_offset += FILE_SOURCE_READ_AHEAD;
+        }
+
+        block->payload = source->mapping + offset;
+        block->payload_size = min((size_t)blocksize, source->range_end - offset);
+    }
+    return block->payload_size;
+}
@@ -0,0 +1,113 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-file-source.hpp
+ * @brief Source of the Data blocks of a transferred file (memory mapping for octet mode, asynchronous reading otherwise)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_FILE_SOURCE_HPP
+#define TFTP_FILE_SOURCE_HPP
+
+#include "tftp-communication.hpp"
+#include "tftp-file-cache.hpp"
+#include "tftp-disk-io.hpp"
+
+#define FILE_SOURCE_READ_AHEAD (1024 * 1024)    //mapped file is paged in this far ahead of the sent blocks
+
+
+//Structure containing the file, that Data blocks are read from
+typedef struct file_source {
+    string mode;
+    bool is_mapped = false;                     //blocks are slices of the mapping
+    char *mapping = NULL;                       //mapped file or cached content (NULL for an empty file)
+    size_t file_size = 0;
+    size_t range_offset = 0;                    //sent range of the mapped file (offset and length options)
+    size_t range_end = 0;
+    int cache_entry = FILE_CACHE_NO_ENTRY;      //entry of the server cache, that provides the content
+    size_t prefetch_offset = 0;                 //end of the mapping already advised to be paged in
+    int map_descriptor = -1;                    //descriptor of the mapped file, its size is checked before the blocks are sent
+    size_t checked_end = 0;                     //end of the mapping checked to be still backed by the file
+    bool is_failed = false;                     //mapped file was truncated during the transfer (its pages can't be sent)
+
+    disk_file_t file_read;                      //file read ahead in the background, when it is not mapped
+    int file_descriptor = -1;                   //descriptor read synchronously instead of the file (standard input), -1 if not used
+    vector<char> netascii_input;                //text read from the stream and not converted yet
+    size_t netascii_input_start = 0;
+    size_t netascii_input_end = 0;
+    netascii_state_t netascii_state;            //pair of CR LF or CR NUL straddling the blocks
+} file_source_t;
+
+
+/**
+ * @brief Opens the file, in octet mode the content is taken from the server cache or the file is mapped
+ * into the memory (file is read through the asynchronous disk I/O when both fail)
+ *
+ * @param source source structure
+ * @param filename path to the file
+ * @param mode transfer mode
+ * @return true if the file was opened, else false
+ */
+bool file_source_open(file_source_t *source, string filename, string mode);
+
+
+/**
+ * @brief Opens the file as file_source_open, only the given range of the file is sent (block 1 starts at the offset).
+ * Range is limited by the end of the file.
+ *
+ * @param source source structure
+ * @param filename path to the file
+ * @param mode transfer mode
+ * @param offset first Byte of the range
+ * @param length size of the range in Bytes (0 up to the end of the file)
+ * @return true if the file was opened, else false
+ */
+bool file_source_open_range(file_source_t *source, string filename, string mode, unsigned long long offset, unsigned long long length);
+
+
+/**
+ * @brief Opens the source reading from the given descriptor (e.g. standard input). Data are read as they come,
+ * blocks of the transfer are sent before the end of the input is reached.
+ *
+ * @param source source structure
+ * @param file_descriptor open descriptor, that is not closed by the source
+ * @param mode transfer mode
+ */
+void file_source_open_descriptor(file_source_t *source, int file_descriptor, string mode);
+
+
+/**
+ * @brief Skips the prefix of the data already kept by the receiver of the resumed transfer, block 1 starts behind it.
+ * Only the mapped file and the regular file on the descriptor in octet mode can skip it (the descriptor is seeked).
+ *
+ * @param source opened source structure, no block was loaded yet
+ * @param bytes size of the prefix in Bytes
+ * @param checksum Adler-32 checksum of the prefix kept by the receiver
+ * @return true if the data have the same prefix and it was skipped, else false (source is not changed)
+ */
+bool file_source_resume(file_source_t *source, unsigned long long bytes, unsigned int checksum);
+
+
+/**
+ * @brief Unmaps or closes the file
+ *
+ * @param source source structure
+ */
+void file_source_close(file_source_t *source);
+
+
+/**
+ * @brief Loads the data of the block. Mapped block is addressed by its index and only referenced by the
+ * payload (no copy, no seek), otherwise the next data of the file are loaded into the payload buffer.
+ * Size of the mapped file is checked each FILE_SOURCE_READ_AHEAD Bytes, when the file was truncated,
+ * the source is failed (is_failed is set) and no data are loaded.
+ *
+ * @param source source structure
+ * @param block Data block, that payload should be set
+ * @param block_index index of the block from the beginning of the file (starting with 0)
+ * @param blocksize size of the data block
+ * @return size of the loaded data in Bytes
+ */
+unsigned int file_source_load_block(file_source_t *source, data_block_t *block, unsigned long block_index, unsigned int blocksize);
+
+#endif
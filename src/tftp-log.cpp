@@ -0,0 +1,365 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-log.cpp
+ * @brief Asynchronous packet log (lock-free ring buffer written on standard error stream by a background thread)
+ * with log levels, sampling of Data and Ack packets and text or JSON lines output
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/socket.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "tftp-log.hpp"
+
+
+//Record of one logged packet, formatted by the background thread
+typedef struct log_record {
+    log_event_t event;
+    unsigned long long time_us;                 //wall clock time of the packet
+    unsigned long long number;                  //block number or error code
+    char address[INET_ADDRSTRLEN];
+    int port;
+    int local_port;
+    size_t detail_size;
+    char detail[LOG_DETAIL_SIZE];
+} log_record_t;
+
+
+//Slot of the ring buffer, the sequence number says whether the slot is free or filled for the current lap
+typedef struct log_slot {
+    unsigned long sequence;
+    log_record_t record;
+} log_slot_t;
+
+
+static log_level_t log_level = LOG_LEVEL_PACKET;
+static log_format_t log_format = LOG_FORMAT_TEXT;
+static unsigned int log_sample_rate = 1;
+
+static log_slot_t log_ring[LOG_RING_SIZE];
+static unsigned long log_head = 0;              //position of the next queued record (shared by the producers)
+static unsigned long log_tail = 0;              //position of the next written record (only under log_flush_lock)
+static unsigned long log_dropped = 0;           //Data and Ack records dropped since the last write
+
+static bool log_started = false;                //background thread of the current process is running
+static bool log_handlers_registered = false;
+static pthread_mutex_t log_start_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t log_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const char *log_event_names[] = {"RRQ", "WRQ", "DATA", "ACK", "ERROR", "OACK"};
+
+
+void log_configure(log_level_t level, log_format_t format, unsigned int sample_rate){
+    log_level = level;
+    log_format = format;
+    log_sample_rate = sample_rate > 0 ? sample_rate : 1;
+}
+
+log_format_t log_get_format(){
+    return log_format;
+}
+
+bool log_is_enabled(log_event_t event, unsigned long long block_number){
+    switch (event){
+        case LOG_EVENT_ERROR:
+            return log_level >= LOG_LEVEL_ERROR;
+        case LOG_EVENT_DATA:
+        case LOG_EVENT_ACK:
+            return log_level >= LOG_LEVEL_PACKET && block_number % log_sample_rate == 0;
+        default:
+            return log_level >= LOG_LEVEL_INFO;
+    }
+}
+
+void log_context_update(log_context_t *context, int socket, struct sockaddr *address, bool local_port){
+    struct sockaddr_in *address_in = (struct sockaddr_in *)address;
+    if (address_in->sin_addr.s_addr != context->address || ntohs(address_in->sin_port) != context->port){
+        context->address = address_in->sin_addr.s_addr;
+        context->port = ntohs(address_in->sin_port);
+        inet_ntop(AF_INET, &address_in->sin_addr, context->address_string, INET_ADDRSTRLEN);
+    }
+
+    //local port is known after the socket is bound (by the first sent packet at the latest)
+    if (local_port && (socket != context->socket || context->local_port == 0)){
+        struct sockaddr_in local_address;
+        socklen_t local_address_size = sizeof(local_address);
+        context->socket = socket;
+        context->local_port = 0;
+        if (getsockname(socket, (struct sockaddr *)&local_address, &local_address_size) == 0){
+            context->local_port = ntohs(local_address.sin_port);
+        }
+    }
+}
+
+string log_json_escape(const string &value){
+    string escaped;
+    for (unsigned char c : value){
+        if (c == '"' || c == '\\'){
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c < 0x20){
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        }
+        else{
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+
+/**
+ * @brief Formats the record in the output format
+ *
+ * @param record logged record
+ * @param output string the line is appended to
+ */
+static void log_format_record(log_record_t *record, string *output){
+    bool has_local_port = record->event == LOG_EVENT_DATA || record->event == LOG_EVENT_ERROR;
+    bool has_number = record->event == LOG_EVENT_DATA || record->event == LOG_EVENT_ACK || record->event == LOG_EVENT_ERROR;
+
+    if (log_format == LOG_FORMAT_JSON){
+        *output += "{\"time_us\":" + to_string(record->time_us) + ",\"event\":\"" + log_event_names[record->event] +
+                   "\",\"address\":\"" + record->address + "\",\"port\":" + to_string(record->port);
+        if (has_local_port){
+            *output += ",\"local_port\":" + to_string(record->local_port);
+        }
+        if (has_number){
+            *output += (record->event == LOG_EVENT_ERROR ? ",\"code\":" : ",\"block\":") + to_string(record->number);
+        }
+        output->append(record->detail, record->detail_size);
+        *output += "}\n";
+    }
+    else{
+        *output += string(log_event_names[record->event]) + " " + record->address + ":" + to_string(record->port);
+        if (has_local_port){
+            *output += ":" + to_string(record->local_port);
+        }
+        if (has_number){
+            *output += " " + to_string(record->number);
+        }
+        output->append(record->detail, record->detail_size);
+        *output += "\n";
+    }
+}
+
+
+/**
+ * @brief Writes the whole buffer on standard error stream
+ *
+ * @param output formatted records
+ */
+static void log_output(string *output){
+    size_t written = 0;
+    while (written < output->size()){
+        ssize_t result = write(STDERR_FILENO, output->data() + written, output->size() - written);
+        if (result < 0 && errno == EINTR){
+            continue;
+        }
+        if (result <= 0){
+            break;
+        }
+        written += result;
+    }
+    output->clear();
+}
+
+
+/**
+ * @brief Writes all queued records, caller holds log_flush_lock
+ *
+ * @return true if something was written, else false
+ */
+static bool log_drain(){
+    string output;
+    bool is_written = false;
+
+    while (true){
+        log_slot_t *slot = &log_ring[log_tail & (LOG_RING_SIZE - 1)];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != log_tail + 1){
+            break;      //no more filled slots
+        }
+
+        log_format_record(&slot->record, &output);
+        __atomic_store_n(&slot->sequence, log_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+        log_tail++;
+
+        if (output.size() >= LOG_WRITE_SIZE){
+            log_output(&output);
+            is_written = true;
+        }
+    }
+
+    unsigned long dropped = __atomic_exchange_n(&log_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0){
+        output += log_format == LOG_FORMAT_JSON ? "{\"event\":\"LOG\",\"dropped\":" + to_string(dropped) + "}\n"
+                                                : "LOG dropped " + to_string(dropped) + "\n";
+    }
+
+    if (!output.empty()){
+        log_output(&output);
+        is_written = true;
+    }
+
+    return is_written;
+}
+
+void log_flush(){
+    if (!__atomic_load_n(&log_started, __ATOMIC_ACQUIRE)){
+        return;
+    }
+
+    pthread_mutex_lock(&log_flush_lock);
+    log_drain();
+    pthread_mutex_unlock(&log_flush_lock);
+}
+
+
+/**
+ * @brief Writes the queued records at the end of the process (gives up, if the writing thread is stuck)
+ */
+static void log_flush_at_exit(){
+    if (!__atomic_load_n(&log_started, __ATOMIC_ACQUIRE)){
+        return;
+    }
+
+    for (int i = 0; i < 100; i++){
+        if (pthread_mutex_trylock(&log_flush_lock) == 0){
+            log_drain();
+            pthread_mutex_unlock(&log_flush_lock);
+            return;
+        }
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+}
+
+
+/**
+ * @brief Forgets the records of the parent in the child process, the child starts its own background thread
+ */
+static void log_reset_in_child(){
+    pthread_mutex_init(&log_start_lock, NULL);
+    pthread_mutex_init(&log_flush_lock, NULL);
+    log_started = false;
+}
+
+
+/**
+ * @brief Loop of the background thread, sleeps longer while nothing is logged
+ */
+static void log_writer(){
+    int sleep_ms = 1;
+    while (true){
+        pthread_mutex_lock(&log_flush_lock);
+        bool is_written = log_drain();
+        pthread_mutex_unlock(&log_flush_lock);
+
+        if (is_written){
+            sleep_ms = 1;
+        }
+        else{
+            this_thread::sleep_for(chrono::milliseconds(sleep_ms));
+            sleep_ms = min(sleep_ms * 2, LOG_IDLE_SLEEP_MAX_MS);
+        }
+    }
+}
+
+
+/**
+ * @brief Empties the ring buffer and starts the background thread of the current process
+ */
+static void log_start(){
+    pthread_mutex_lock(&log_start_lock);
+
+    if (!log_started){
+        log_head = 0;
+        log_tail = 0;
+        log_dropped = 0;
+        for (unsigned long i = 0; i < LOG_RING_SIZE; i++){
+            log_ring[i].sequence = i;
+        }
+
+        if (!log_handlers_registered){
+            log_handlers_registered = true;
+            pthread_atfork(NULL, NULL, log_reset_in_child);
+            atexit(log_flush_at_exit);
+        }
+
+        thread(log_writer).detach();
+        __atomic_store_n(&log_started, true, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&log_start_lock);
+}
+
+void log_write(log_event_t event, log_context_t *context, unsigned long long number, const string &detail){
+    if (!__atomic_load_n(&log_started, __ATOMIC_ACQUIRE)){
+        log_start();
+    }
+
+    //claiming a free slot (multiple producers), the record is visible to the writer after its sequence is set
+    log_slot_t *slot;
+    unsigned long position = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+    while (true){
+        slot = &log_ring[position & (LOG_RING_SIZE - 1)];
+        long difference = (long)__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (long)position;
+
+        if (difference == 0){
+            if (__atomic_compare_exchange_n(&log_head, &position, position + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+                break;
+            }
+        }
+        else if (difference < 0){
+            //ring is full - packets are sampled anyway, other events wait for the writer
+            if (event == LOG_EVENT_DATA || event == LOG_EVENT_ACK){
+                __atomic_fetch_add(&log_dropped, 1, __ATOMIC_RELAXED);
+                return;
+            }
+            sched_yield();
+            position = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+        }
+        else{
+            position = __atomic_load_n(&log_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    log_record_t *record = &slot->record;
+    record->event = event;
+    record->time_us = (unsigned long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+    record->number = number;
+    memcpy(record->address, context->address_string, INET_ADDRSTRLEN);
+    record->port = context->port;
+    record->local_port = context->local_port;
+
+    //too long detail would break the JSON object, it's marked instead
+    if (detail.size() <= LOG_DETAIL_SIZE){
+        memcpy(record->detail, detail.data(), detail.size());
+        record->detail_size = detail.size();
+    }
+    else if (log_format == LOG_FORMAT_JSON){
+        record->detail_size = snprintf(record->detail, LOG_DETAIL_SIZE, ",\"truncated\":true");
+    }
+    else{
+        memcpy(record->detail, detail.data(), LOG_DETAIL_SIZE);
+        record->detail_size = LOG_DETAIL_SIZE;
+    }
+
+    __atomic_store_n(&slot->sequence, position + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,127 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-log.hpp
+ * @brief Asynchronous packet log (lock-free ring buffer written on standard error stream by a background thread)
+ * with log levels, sampling of Data and Ack packets and text or JSON lines output
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_LOG_HPP
+#define TFTP_LOG_HPP
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <string>
+
+using namespace std;
+
+#define LOG_RING_SIZE 1024                      //records waiting for the background thread (power of 2)
+#define LOG_DETAIL_SIZE 512                     //formatted part of a record specific to the event
+#define LOG_WRITE_SIZE (64 * 1024)              //records written on the stream by one system call
+#define LOG_IDLE_SLEEP_MAX_MS 32                //longest sleep of the background thread when nothing is logged
+
+
+//Logged events (packets)
+typedef enum log_event {
+    LOG_EVENT_RRQ,
+    LOG_EVENT_WRQ,
+    LOG_EVENT_DATA,
+    LOG_EVENT_ACK,
+    LOG_EVENT_ERROR,
+    LOG_EVENT_OACK
+} log_event_t;
+
+
+//Log levels, every level contains the events of the lower levels
+typedef enum log_level {
+    LOG_LEVEL_NONE,
+    LOG_LEVEL_ERROR,                            //Error packets
+    LOG_LEVEL_INFO,                             //requests and Oack packets
+    LOG_LEVEL_PACKET                            //Data and Ack packets
+} log_level_t;
+
+
+//Output formats
+typedef enum log_format {
+    LOG_FORMAT_TEXT,                            //lines of the original format ("DATA address:port:port block")
+    LOG_FORMAT_JSON                             //JSON object per line
+} log_format_t;
+
+
+//Addresses of the connection formatted only when they change (not per packet)
+typedef struct log_context {
+    in_addr_t address = 0;                      //remote address the string was formatted for
+    int port = -1;                              //remote port
+    char address_string[INET_ADDRSTRLEN] = "";
+    int socket = -1;                            //socket the local port was read for
+    int local_port = 0;                         //local port (0 until the socket is bound)
+} log_context_t;
+
+
+/**
+ * @brief Sets the logged events and the output format, has to be called before the first record is logged
+ *
+ * @param level highest logged level
+ * @param format output format
+ * @param sample_rate every n-th Data and Ack packet of a transfer is logged (by the block number)
+ */
+void log_configure(log_level_t level, log_format_t format, unsigned int sample_rate);
+
+
+/**
+ * @brief Checks whether the event should be logged (level and sampling)
+ *
+ * @param event logged event
+ * @param block_number block number of Data and Ack packets
+ * @return true if the event is logged, else false
+ */
+bool log_is_enabled(log_event_t event, unsigned long long block_number = 0);
+
+
+/**
+ * @brief Gets the output format
+ *
+ * @return output format
+ */
+log_format_t log_get_format();
+
+
+/**
+ * @brief Updates the context, addresses are formatted (and the local port read) only when they changed
+ *
+ * @param context context of the connection
+ * @param socket local socket
+ * @param address remote address
+ * @param local_port true if the local port is needed
+ */
+void log_context_update(log_context_t *context, int socket, struct sockaddr *address, bool local_port);
+
+
+/**
+ * @brief Queues the record for the background thread (started on the first record). Data and Ack packets are
+ * dropped when the queue is full, other events wait for a free place.
+ *
+ * @param event logged event
+ * @param context context of the connection
+ * @param number block number or error code
+ * @param detail formatted part specific to the event (in the output format)
+ */
+void log_write(log_event_t event, log_context_t *context, unsigned long long number, const string &detail);
+
+
+/**
+ * @brief Writes all queued records on the stream (e.g. before other output or the end of the process)
+ */
+void log_flush();
+
+
+/**
+ * @brief Escapes the string to be placed in a JSON string
+ *
+ * @param value string to escape
+ * @return escaped string
+ */
+string log_json_escape(const string &value);
+
+#endif
@@ -0,0 +1,590 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-metrics.cpp
+ * @brief Server-wide counters and histograms in shared memory (updated lock-free by sessions, worker threads and
+ * child processes), Prometheus text page and periodic statistics dump
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <new>
+#include <regex>
+#include <sstream>
+#include <thread>
+#include <vector>
+#include "tftp-metrics.hpp"
+#include "tftp-packet-structures.hpp"
+#include "tftp-buffer-pool.hpp"
+
+
+static metrics_t *metrics = NULL;
+
+static const unsigned long long duration_bounds_us[] = METRICS_DURATION_BOUNDS_US;
+static const char *error_code_names[METRICS_ERROR_CODES] = {"0", "1", "2", "3", "4", "5", "6", "7", "8"};
+static const char *drop_reason_names[METRICS_DROP_REASONS] = {"duplicate", "sessions", "rate"};
+
+
+//Connection of the scrape served by the exporter thread (non-blocking, polled with the listening socket)
+typedef struct metrics_connection {
+    int socket;
+    string response;                            //page rendered, when the request was read (empty before)
+    size_t sent = 0;
+    chrono::steady_clock::time_point deadline;  //connection is closed, when it's not answered until then
+} metrics_connection_t;
+
+
+/**
+ * @brief Adds the value to the shared counter
+ *
+ * @param counter counter in the shared memory
+ * @param value added value
+ */
+template <typename T>
+static inline void metrics_add(T *counter, T value){
+    __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @brief Reads the shared counter
+ *
+ * @param counter counter in the shared memory
+ * @return current value
+ */
+template <typename T>
+static inline T metrics_load(T *counter){
+    return __atomic_load_n(counter, __ATOMIC_RELAXED);
+}
+
+
+int metrics_init(){
+    void *memory = mmap(NULL, sizeof(metrics_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED){
+        cout << "ERROR: mmap - metrics\n";
+        return PROG_RET_CODE_ERR;
+    }
+
+    metrics = new (memory) metrics_t();
+
+    return PROG_RET_CODE_OK;
+}
+
+
+/**
+ * @brief Counts the request of the file, the file gets its slot in the table on the first request
+ *
+ * @param filename requested file
+ */
+static void metrics_count_file(string filename){
+    //FNV-1a hash of the name, 0 marks a free slot
+    unsigned long long hash = 14695981039346656037ULL;
+    for (unsigned char c : filename){
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    if (hash == 0){
+        hash = 1;
+    }
+
+    for (int i = 0; i < METRICS_MAX_FILES; i++){
+        metrics_file_t *file = &metrics->files[(hash + i) % METRICS_MAX_FILES];
+
+        unsigned long long slot_hash = __atomic_load_n(&file->hash, __ATOMIC_ACQUIRE);
+        if (slot_hash == 0){
+            //claim the free slot, the name is visible after the ready flag is set
+            if (__atomic_compare_exchange_n(&file->hash, &slot_hash, hash, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+                strncpy(file->name, filename.c_str(), METRICS_MAX_FILE_NAME - 1);
+                __atomic_store_n(&file->ready, true, __ATOMIC_RELEASE);
+                slot_hash = hash;
+            }
+        }
+
+        if (slot_hash == hash){
+            metrics_add(&file->requests, 1UL);
+            return;
+        }
+    }
+
+    metrics_add(&metrics->file_requests_other, 1UL);
+}
+
+
+void metrics_session_start(bool is_rrq, string filename){
+    if (metrics == NULL){
+        return;
+    }
+
+    metrics_add(&metrics->sessions_started[is_rrq ? 0 : 1], 1UL);
+    metrics_add(&metrics->sessions_active, 1L);
+    metrics_count_file(filename);
+}
+
+
+void metrics_session_end(bool is_completed, metrics_time_t start){
+    if (metrics == NULL){
+        return;
+    }
+
+    unsigned long long duration_us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+
+    int bucket = 0;
+    while (bucket < METRICS_DURATION_BUCKETS - 1 && duration_us > duration_bounds_us[bucket]){
+        bucket++;
+    }
+
+    metrics_add(&metrics->duration_buckets[bucket], 1UL);
+    metrics_add(&metrics->duration_sum_us, duration_us);
+    metrics_add(is_completed ? &metrics->sessions_completed : &metrics->sessions_failed, 1UL);
+    metrics_add(&metrics->sessions_active, -1L);
+}
+
+
+void metrics_count_sent(unsigned long packets, unsigned long long bytes){
+    if (metrics != NULL){
+        metrics_add(&metrics->packets_sent, packets);
+        metrics_add(&metrics->bytes_sent, bytes);
+    }
+}
+
+
+void metrics_count_received(unsigned long packets, unsigned long long bytes){
+    if (metrics != NULL){
+        metrics_add(&metrics->packets_received, packets);
+        metrics_add(&metrics->bytes_received, bytes);
+    }
+}
+
+
+void metrics_count_retransmission(){
+    if (metrics != NULL){
+        metrics_add(&metrics->retransmissions, 1UL);
+    }
+}
+
+
+void metrics_count_timeout(){
+    if (metrics != NULL){
+        metrics_add(&metrics->timeouts, 1UL);
+    }
+}
+
+
+void metrics_count_error(int error_code, bool is_sent){
+    if (metrics != NULL && error_code >= 0 && error_code < METRICS_ERROR_CODES){
+        metrics_add(is_sent ? &metrics->errors_sent[error_code] : &metrics->errors_received[error_code], 1UL);
+    }
+}
+
+
+void metrics_count_request_dropped(int reason){
+    if (metrics != NULL && reason >= 0 && reason < METRICS_DROP_REASONS){
+        metrics_add(&metrics->requests_dropped[reason], 1UL);
+    }
+}
+
+
+void metrics_count_throttle(unsigned long long duration_us){
+    if (metrics != NULL){
+        metrics_add(&metrics->throttles, 1UL);
+        metrics_add(&metrics->throttled_us, duration_us);
+    }
+}
+
+
+/**
+ * @brief Escapes the value of a Prometheus label
+ *
+ * @param value label value
+ * @return escaped value
+ */
+static string metrics_escape_label(string value){
+    string escaped;
+    for (char c : value){
+        if (c == '\\' || c == '"'){
+            escaped += '\\';
+            escaped += c;
+        }
+        else if (c == '\n'){
+            escaped += "\\n";
+        }
+        else{
+            escaped += c;
+        }
+    }
+
+    return escaped;
+}
+
+
+/**
+ * @brief Adds the metric header to the page
+ *
+ * @param page page being created
+ * @param name name of the metric
+ * @param type type of the metric
+ * @param help description of the metric
+ */
+static void metrics_header(ostringstream &page, const char *name, const char *type, const char *help){
+    page << "# HELP " << name << " " << help << "\n";
+    page << "# TYPE " << name << " " << type << "\n";
+}
+
+
+/**
+ * @brief Sums the errors of all codes
+ *
+ * @param errors counters of the error codes
+ * @return sum of the counters
+ */
+static unsigned long metrics_sum_errors(unsigned long *errors){
+    unsigned long sum = 0;
+    for (int i = 0; i < METRICS_ERROR_CODES; i++){
+        sum += metrics_load(&errors[i]);
+    }
+
+    return sum;
+}
+
+
+string metrics_render(){
+    ostringstream page;
+    if (metrics == NULL){
+        return page.str();
+    }
+
+    metrics_header(page, "tftp_sessions_started_total", "counter", "Accepted requests.");
+    page << "tftp_sessions_started_total{type=\"rrq\"} " << metrics_load(&metrics->sessions_started[0]) << "\n";
+    page << "tftp_sessions_started_total{type=\"wrq\"} " << metrics_load(&metrics->sessions_started[1]) << "\n";
+
+    metrics_header(page, "tftp_sessions_active", "gauge", "Transfers in progress.");
+    page << "tftp_sessions_active " << metrics_load(&metrics->sessions_active) << "\n";
+
+    metrics_header(page, "tftp_sessions_finished_total", "counter", "Ended transfers by their result.");
+    page << "tftp_sessions_finished_total{result=\"completed\"} " << metrics_load(&metrics->sessions_completed) << "\n";
+    page << "tftp_sessions_finished_total{result=\"failed\"} " << metrics_load(&metrics->sessions_failed) << "\n";
+
+    metrics_header(page, "tftp_session_duration_seconds", "histogram", "Duration of the ended transfers.");
+    unsigned long cumulative = 0;
+    for (int i = 0; i < METRICS_DURATION_BUCKETS; i++){
+        cumulative += metrics_load(&metrics->duration_buckets[i]);
+        page << "tftp_session_duration_seconds_bucket{le=\"";
+        if (i < METRICS_DURATION_BUCKETS - 1){
+            page << duration_bounds_us[i] / 1e6;
+        }
+        else{
+            page << "+Inf";
+        }
+        page << "\"} " << cumulative << "\n";
+    }
+    page << "tftp_session_duration_seconds_sum " << fixed << setprecision(6)
+         << metrics_load(&metrics->duration_sum_us) / 1e6 << defaultfloat << "\n";
+    page << "tftp_session_duration_seconds_count " << cumulative << "\n";
+
+    metrics_header(page, "tftp_packets_sent_total", "counter", "Sent UDP datagrams.");
+    page << "tftp_packets_sent_total " << metrics_load(&metrics->packets_sent) << "\n";
+    metrics_header(page, "tftp_packets_received_total", "counter", "Received UDP datagrams.");
+    page << "tftp_packets_received_total " << metrics_load(&metrics->packets_received) << "\n";
+    metrics_header(page, "tftp_bytes_sent_total", "counter", "Sent UDP payload in Bytes.");
+    page << "tftp_bytes_sent_total " << metrics_load(&metrics->bytes_sent) << "\n";
+    metrics_header(page, "tftp_bytes_received_total", "counter", "Received UDP payload in Bytes.");
+    page << "tftp_bytes_received_total " << metrics_load(&metrics->bytes_received) << "\n";
+
+    metrics_header(page, "tftp_retransmissions_total", "counter", "Timeouts followed by sending the packets again.");
+    page << "tftp_retransmissions_total " << metrics_load(&metrics->retransmissions) << "\n";
+    metrics_header(page, "tftp_timeouts_total", "counter", "Transfers abandoned after the retransmissions.");
+    page << "tftp_timeouts_total " << metrics_load(&metrics->timeouts) << "\n";
+
+    metrics_header(page, "tftp_errors_sent_total", "counter", "Sent Error packets by the error code.");
+    for (int i = 0; i < METRICS_ERROR_CODES; i++){
+        page << "tftp_errors_sent_total{code=\"" << error_code_names[i] << "\"} " << metrics_load(&metrics->errors_sent[i]) << "\n";
+    }
+    metrics_header(page, "tftp_errors_received_total", "counter", "Received Error packets by the error code.");
+    for (int i = 0; i < METRICS_ERROR_CODES; i++){
+        page << "tftp_errors_received_total{code=\"" << error_code_names[i] << "\"} " << metrics_load(&metrics->errors_received[i]) << "\n";
+    }
+
+    metrics_header(page, "tftp_requests_dropped_total", "counter", "Requests dropped by the admission control by the reason.");
+    for (int i = 0; i < METRICS_DROP_REASONS; i++){
+        page << "tftp_requests_dropped_total{reason=\"" << drop_reason_names[i] << "\"} " << metrics_load(&metrics->requests_dropped[i]) << "\n";
+    }
+
+    metrics_header(page, "tftp_throttles_total", "counter", "Waits of the sessions for the tokens of the bandwidth limits.");
+    page << "tftp_throttles_total " << metrics_load(&metrics->throttles) << "\n";
+    metrics_header(page, "tftp_throttled_seconds_total", "counter", "Time the sessions waited for the tokens of the bandwidth limits.");
+    page << "tftp_throttled_seconds_total " << fixed << setprecision(6) << metrics_load(&metrics->throttled_us) / 1e6 << defaultfloat << "\n";
+
+    buffer_pool_usage_t buffers = buffer_pool_get_usage();
+    metrics_header(page, "tftp_buffer_bytes", "gauge", "Memory of the session buffers in Bytes.");
+    page << "tftp_buffer_bytes " << buffers.bytes << "\n";
+    metrics_header(page, "tftp_buffer_bytes_peak", "gauge", "Highest memory of the session buffers in Bytes.");
+    page << "tftp_buffer_bytes_peak " << buffers.bytes_peak << "\n";
+    metrics_header(page, "tftp_buffer_sessions", "gauge", "Sessions holding buffers.");
+    page << "tftp_buffer_sessions " << buffers.sessions << "\n";
+    metrics_header(page, "tftp_buffer_limit_bytes", "gauge", "Limit of the memory of the session buffers in Bytes (0 if not limited).");
+    page << "tftp_buffer_limit_bytes " << buffers.limit << "\n";
+    metrics_header(page, "tftp_buffer_refused_total", "counter", "Sessions refused by the memory limit.");
+    page << "tftp_buffer_refused_total " << buffers.refused << "\n";
+
+    metrics_header(page, "tftp_file_requests_total", "counter", "Requests by the file (files over the table size are counted as \"other\").");
+    for (int i = 0; i < METRICS_MAX_FILES; i++){
+        metrics_file_t *file = &metrics->files[i];
+        if (__atomic_load_n(&file->ready, __ATOMIC_ACQUIRE)){
+            page << "tftp_file_requests_total{file=\"" << metrics_escape_label(file->name) << "\"} " << metrics_load(&file->requests) << "\n";
+        }
+    }
+    page << "tftp_file_requests_total{file=\"other\"} " << metrics_load(&metrics->file_requests_other) << "\n";
+
+    return page.str();
+}
+
+
+/**
+ * @brief Creates the listening socket of the Prometheus page
+ *
+ * @param address port on the loopback or path to a Unix socket
+ * @return descriptor of the socket, -1 on an error
+ */
+static int metrics_listen(string address){
+    int sock;
+
+    if (address.find('/') != string::npos){
+        struct sockaddr_un unix_address = {};
+        if (address.size() >= sizeof(unix_address.sun_path)){
+            cout << "ERROR: metrics socket path is too long\n";
+            return -1;
+        }
+        unix_address.sun_family = AF_UNIX;
+        strcpy(unix_address.sun_path, address.c_str());
+        unlink(address.c_str());
+
+        sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (sock < 0 || bind(sock, (struct sockaddr *)&unix_address, sizeof(unix_address)) < 0){
+            cout << "ERROR: bind - metrics socket " << address << "\n";
+            if (sock >= 0){
+                close(sock);
+            }
+            return -1;
+        }
+    }
+    else{
+        if (!regex_match(address, regex("^[0-9]+$")) || stoul(address) > 65535){
+            cout << "ERROR: invalid metrics address " << address << "\n";
+            return -1;
+        }
+
+        struct sockaddr_in tcp_address = {};
+        tcp_address.sin_family = AF_INET;
+        tcp_address.sin_port = htons(stoul(address));
+        tcp_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        int enable = 1;
+        sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (sock >= 0){
+            setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+        }
+        if (sock < 0 || bind(sock, (struct sockaddr *)&tcp_address, sizeof(tcp_address)) < 0){
+            cout << "ERROR: bind - metrics port " << address << "\n";
+            if (sock >= 0){
+                close(sock);
+            }
+            return -1;
+        }
+    }
+
+    if (listen(sock, 16) < 0){
+        cout << "ERROR: listen - metrics socket\n";
+        close(sock);
+        return -1;
+    }
+
+    return sock;
+}
+
+
+/**
+ * @brief Accepts the waiting connections of the scrapes, connections over the limit are closed
+ *
+ * @param sock descriptor of the listening socket
+ * @param connections connections in progress
+ */
+static void metrics_accept(int sock, vector<metrics_connection_t> *connections){
+    while (true){
+        int connection = accept4(sock, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+        if (connection < 0){
+            return;     //no more waiting connections
+        }
+        if (connections->size() >= METRICS_MAX_CONNECTIONS){
+            close(connection);
+            continue;
+        }
+
+        metrics_connection_t metrics_connection;
+        metrics_connection.socket = connection;
+        metrics_connection.deadline = chrono::steady_clock::now() + chrono::milliseconds(METRICS_CONNECTION_TIMEOUT_MS);
+        connections->push_back(metrics_connection);
+    }
+}
+
+
+/**
+ * @brief Answers the connection by the Prometheus page (any request is answered), reads and writes only
+ * what the socket takes without blocking
+ *
+ * @param connection connection of the scrape
+ * @return true if the connection is finished (answered or failed), else false
+ */
+static bool metrics_serve(metrics_connection_t *connection){
+    if (connection->response.empty()){
+        //request is read only to not reset the connection, its content does not matter
+        char request[1024];
+        ssize_t received = recv(connection->socket, request, sizeof(request), 0);
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return false;
+        }
+        else if (received < 0){
+            return true;
+        }
+
+        string body = metrics_render();
+        connection->response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                               to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    }
+
+    while (connection->sent < connection->response.size()){
+        ssize_t result = send(connection->socket, connection->response.data() + connection->sent,
+                              connection->response.size() - connection->sent, MSG_NOSIGNAL);
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return false;
+        }
+        else if (result <= 0){
+            return true;
+        }
+        connection->sent += result;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Writes the statistics of the last interval on standard error stream
+ *
+ * @param previous values at the end of the previous interval (updated)
+ * @param interval_s length of the interval in seconds
+ */
+static void metrics_dump(metrics_t *previous, unsigned int interval_s){
+    metrics_t current;
+    current.sessions_active = metrics_load(&metrics->sessions_active);
+    current.sessions_completed = metrics_load(&metrics->sessions_completed);
+    current.sessions_failed = metrics_load(&metrics->sessions_failed);
+    current.bytes_sent = metrics_load(&metrics->bytes_sent);
+    current.bytes_received = metrics_load(&metrics->bytes_received);
+    current.retransmissions = metrics_load(&metrics->retransmissions);
+    current.timeouts = metrics_load(&metrics->timeouts);
+    current.errors_sent[0] = metrics_sum_errors(metrics->errors_sent);
+
+    cerr << "STATS active=" << current.sessions_active
+         << " completed=" << current.sessions_completed - previous->sessions_completed
+         << " failed=" << current.sessions_failed - previous->sessions_failed
+         << " sent_B/s=" << (current.bytes_sent - previous->bytes_sent) / interval_s
+         << " received_B/s=" << (current.bytes_received - previous->bytes_received) / interval_s
+         << " retransmissions=" << current.retransmissions - previous->retransmissions
+         << " timeouts=" << current.timeouts - previous->timeouts
+         << " errors=" << current.errors_sent[0] - previous->errors_sent[0]
+         << " buffers_B=" << buffer_pool_get_usage().bytes << "\n";
+
+    previous->sessions_completed = current.sessions_completed;
+    previous->sessions_failed = current.sessions_failed;
+    previous->bytes_sent = current.bytes_sent;
+    previous->bytes_received = current.bytes_received;
+    previous->retransmissions = current.retransmissions;
+    previous->timeouts = current.timeouts;
+    previous->errors_sent[0] = current.errors_sent[0];
+}
+
+
+/**
+ * @brief Loop of the exporter thread
+ *
+ * @param sock descriptor of the listening socket (-1 if the page is not served)
+ * @param interval_s interval of the statistics (0 if not written)
+ */
+static void metrics_exporter(int sock, unsigned int interval_s){
+    //heap allocated, the structure with the file table is too large for the stack
+    unique_ptr<metrics_t> previous(new metrics_t());
+    auto next_dump = chrono::steady_clock::now() + chrono::seconds(interval_s);
+    vector<metrics_connection_t> connections;       //slow scrapes don't delay the dump or other scrapes
+
+    while (true){
+        //waiting until the next dump or the deadline of the oldest connection
+        auto now = chrono::steady_clock::now();
+        long long timeout_ms = -1;
+        if (interval_s > 0){
+            timeout_ms = max(0LL, (long long)chrono::duration_cast<chrono::milliseconds>(next_dump - now).count());
+        }
+        if (!connections.empty()){
+            long long remaining = max(0LL, (long long)chrono::duration_cast<chrono::milliseconds>(connections.front().deadline - now).count());
+            timeout_ms = timeout_ms < 0 ? remaining : min(timeout_ms, remaining);
+        }
+
+        vector<struct pollfd> poll_fds;
+        if (sock >= 0){
+            poll_fds.push_back({sock, POLLIN, 0});
+        }
+        for (metrics_connection_t &connection : connections){
+            poll_fds.push_back({connection.socket, (short)(connection.response.empty() ? POLLIN : POLLOUT), 0});
+        }
+        int ready = poll(poll_fds.data(), poll_fds.size(), timeout_ms);
+
+        //connections are served before the new ones are accepted (their poll results follow the listening socket)
+        now = chrono::steady_clock::now();
+        unsigned int first_connection = sock >= 0 ? 1 : 0;
+        for (size_t i = connections.size(); i-- > 0;){
+            bool is_finished = now >= connections[i].deadline;
+            if (!is_finished && ready > 0 && poll_fds[first_connection + i].revents != 0){
+                is_finished = metrics_serve(&connections[i]);
+            }
+            if (is_finished){
+                close(connections[i].socket);
+                connections.erase(connections.begin() + i);
+            }
+        }
+        if (ready > 0 && sock >= 0 && (poll_fds[0].revents & POLLIN)){
+            metrics_accept(sock, &connections);
+        }
+
+        if (interval_s > 0 && chrono::steady_clock::now() >= next_dump){
+            metrics_dump(previous.get(), interval_s);
+            next_dump += chrono::seconds(interval_s);
+        }
+    }
+}
+
+
+int metrics_start_exporter(string address, unsigned int interval_s){
+    if (metrics == NULL || (address.empty() && interval_s == 0)){
+        return PROG_RET_CODE_OK;
+    }
+
+    int sock = -1;
+    if (!address.empty()){
+        sock = metrics_listen(address);
+        if (sock < 0){
+            return PROG_RET_CODE_ERR;
+        }
+    }
+
+    thread(metrics_exporter, sock, interval_s).detach();
+
+    return PROG_RET_CODE_OK;
+}
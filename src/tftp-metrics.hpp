@@ -0,0 +1,164 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-metrics.hpp
+ * @brief Server-wide counters and histograms in shared memory (updated lock-free by sessions, worker threads and
+ * child processes), Prometheus text page and periodic statistics dump
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_METRICS_HPP
+#define TFTP_METRICS_HPP
+
+#include <chrono>
+#include <string>
+
+using namespace std;
+
+#define METRICS_MAX_FILES 256                   //files with own request counter, other files are counted together
+#define METRICS_MAX_FILE_NAME 128
+#define METRICS_ERROR_CODES 9                   //TFTP error codes 0-8
+#define METRICS_DROP_REASONS 3                  //requests dropped as duplicates, over the sessions limit and over the address rate
+#define METRICS_DURATION_BUCKETS 9              //upper bounds of the session duration histogram (the last one is +Inf)
+#define METRICS_DURATION_BOUNDS_US {1000, 10000, 100000, 500000, 1000000, 5000000, 10000000, 60000000}
+#define METRICS_MAX_CONNECTIONS 16              //scrapes served at once, further connections are closed
+#define METRICS_CONNECTION_TIMEOUT_MS 1000      //scrape, that isn't answered in this time, is closed
+
+typedef chrono::steady_clock::time_point metrics_time_t;
+
+
+//Request counter of a single file (slot of the hash table)
+typedef struct metrics_file {
+    unsigned long long hash;                    //0 if the slot is free
+    bool ready;                                 //name is written
+    char name[METRICS_MAX_FILE_NAME];
+    unsigned long requests;
+} metrics_file_t;
+
+
+//Structure placed in the shared memory, all values are updated by atomic operations
+typedef struct metrics {
+    unsigned long sessions_started[2];          //RRQ, WRQ
+    long sessions_active;
+    unsigned long sessions_completed;
+    unsigned long sessions_failed;
+    unsigned long duration_buckets[METRICS_DURATION_BUCKETS];
+    unsigned long long duration_sum_us;
+
+    unsigned long packets_sent;
+    unsigned long packets_received;
+    unsigned long long bytes_sent;
+    unsigned long long bytes_received;
+    unsigned long retransmissions;              //timeouts followed by sending the packets again
+    unsigned long timeouts;                     //transfers abandoned after the retransmissions
+    unsigned long errors_sent[METRICS_ERROR_CODES];
+    unsigned long errors_received[METRICS_ERROR_CODES];
+    unsigned long requests_dropped[METRICS_DROP_REASONS];
+    unsigned long throttles;                    //waits of the sessions for the tokens of the bandwidth shaping
+    unsigned long long throttled_us;
+
+    unsigned long file_requests_other;          //requests of files, that did not fit into the table
+    metrics_file_t files[METRICS_MAX_FILES];
+} metrics_t;
+
+
+/**
+ * @brief Creates the metrics in the shared memory, has to be called before creating child processes or threads.
+ * Counting functions do nothing until the metrics are created (e.g. in the client).
+ *
+ * @return PROG_RET_CODE_OK if OK, else PROG_RET_CODE_ERR
+ */
+int metrics_init();
+
+
+/**
+ * @brief Counts the new session and the request of its file
+ *
+ * @param is_rrq session was initiated by RRQ
+ * @param filename requested file
+ */
+void metrics_session_start(bool is_rrq, string filename);
+
+
+/**
+ * @brief Counts the ended session and its duration
+ *
+ * @param is_completed whole file was transferred
+ * @param start time of the request
+ */
+void metrics_session_end(bool is_completed, metrics_time_t start);
+
+
+/**
+ * @brief Counts sent packets
+ *
+ * @param packets number of packets
+ * @param bytes size of the packets in Bytes
+ */
+void metrics_count_sent(unsigned long packets, unsigned long long bytes);
+
+
+/**
+ * @brief Counts received packets
+ *
+ * @param packets number of packets
+ * @param bytes size of the packets in Bytes
+ */
+void metrics_count_received(unsigned long packets, unsigned long long bytes);
+
+
+/**
+ * @brief Counts the timeout followed by sending the packets again
+ */
+void metrics_count_retransmission();
+
+
+/**
+ * @brief Counts the transfer abandoned after the retransmissions
+ */
+void metrics_count_timeout();
+
+
+/**
+ * @brief Counts the sent or received Error packet
+ *
+ * @param error_code TFTP error code
+ * @param is_sent packet was sent by the server
+ */
+void metrics_count_error(int error_code, bool is_sent);
+
+
+/**
+ * @brief Counts the request dropped by the admission control
+ *
+ * @param reason reason of the drop (admission_result_t below ADMISSION_ACCEPTED)
+ */
+void metrics_count_request_dropped(int reason);
+
+
+/**
+ * @brief Counts the wait of the session for the tokens of the bandwidth shaping
+ *
+ * @param duration_us duration of the wait in microseconds
+ */
+void metrics_count_throttle(unsigned long long duration_us);
+
+
+/**
+ * @brief Creates the Prometheus text page of the current values
+ *
+ * @return page in the text exposition format
+ */
+string metrics_render();
+
+
+/**
+ * @brief Starts the thread serving the Prometheus page and writing the periodic statistics
+ *
+ * @param address port on the loopback or path to a Unix socket (empty if the page is not served)
+ * @param interval_s interval of the statistics written on standard error stream (0 if not written)
+ * @return PROG_RET_CODE_OK if OK, else PROG_RET_CODE_ERR
+ */
+int metrics_start_exporter(string address, unsigned int interval_s);
+
+#endif
@@ -0,0 +1,390 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-multicast.cpp
+ * @brief Multicast transfer (RFC 2090) - sockets of the group and receiving of the file from the group by the client
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include "tftp-multicast.hpp"
+#include "tftp-batch-io.hpp"
+#include "tftp-metrics.hpp"
+
+
+bool multicast_local_address(struct sockaddr_in *peer_address, struct in_addr *local_address){
+    //connecting the datagram socket only selects the route, nothing is sent
+    int route_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (route_socket < 0){
+        return false;
+    }
+
+    struct sockaddr_in bound_address;
+    socklen_t bound_address_size = sizeof(bound_address);
+    bool is_found = connect(route_socket, (struct sockaddr *)peer_address, sizeof(*peer_address)) == 0 &&
+                    getsockname(route_socket, (struct sockaddr *)&bound_address, &bound_address_size) == 0;
+    close(route_socket);
+
+    if (is_found){
+        *(local_address) = bound_address.sin_addr;
+    }
+    return is_found;
+}
+
+int create_multicast_sender(struct sockaddr_in *client_address){
+    struct in_addr interface_address;
+    if (!multicast_local_address(client_address, &interface_address)){
+        return -1;
+    }
+
+    int group_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (group_socket < 0){
+        return -1;
+    }
+
+    unsigned char ttl = MULTICAST_TTL;
+    unsigned char loop = 1;         //clients on the host of the server receive the group too
+    if (setsockopt(group_socket, IPPROTO_IP, IP_MULTICAST_IF, &interface_address, sizeof(interface_address)) < 0 ||
+        setsockopt(group_socket, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl)) < 0 ||
+        setsockopt(group_socket, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop)) < 0){
+        close(group_socket);
+        return -1;
+    }
+
+    return group_socket;
+}
+
+int create_multicast_receiver(struct sockaddr_in *group_address, struct sockaddr_in *server_address){
+    struct ip_mreq membership;
+    membership.imr_multiaddr = group_address->sin_addr;
+    if (!multicast_local_address(server_address, &membership.imr_interface)){
+        return -1;
+    }
+
+    int group_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (group_socket < 0){
+        return -1;
+    }
+
+    //bound to the group address, so only Data of the group are received
+    int enable = 1;
+    if (setsockopt(group_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) < 0 ||
+        bind(group_socket, (struct sockaddr *)group_address, sizeof(*group_address)) < 0 ||
+        setsockopt(group_socket, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0){
+        close(group_socket);
+        return -1;
+    }
+
+    return group_socket;
+}
+
+
+//State of the file received from the group
+typedef struct multicast_receiver {
+    vector<bool> received_blocks;               //blocks written to the file by their index
+    block_index_t in_order_block_index = 0;     //all blocks up to this one were received
+    block_index_t last_block_index = 0;         //index of the last block of the file (0 while not known)
+    unsigned long long file_size = 0;           //size of the file (known with the last block index)
+    unsigned int received_since_ack = 0;        //master: blocks received since the last ack
+    bool is_gap_acked = false;                  //master: missing block was already reported
+    bool is_master = false;
+} multicast_receiver_t;
+
+
+/**
+ * @brief Acknowledges the last block received in order (the server continues sending from the following block)
+ *
+ * @param connection_information connection information (transfer socket, address of the server)
+ * @param option_information negotiated transfer options
+ * @param receiver state of the received file
+ */
+static void multicast_ack(connection_info_t *connection_information, option_info_t *option_information, multicast_receiver_t *receiver){
+    send_ack(connection_information, block_number_from_index(receiver->in_order_block_index, option_information->rollover));
+    receiver->received_since_ack = 0;
+}
+
+
+/**
+ * @brief Processes the Data packet received from the group, writes a new block and acknowledges it as the master client
+ *
+ * @param connection_information connection information (transfer socket, address of the server)
+ * @param option_information negotiated transfer options
+ * @param receiver state of the received file
+ * @param file_write file the data are written to
+ * @param buffer received packet data
+ * @param bytes_rx size of the received packet
+ * @return PACKET_OK_CODE if OK, else errno of a failed write
+ */
+static int multicast_receive_block(connection_info_t *connection_information, option_info_t *option_information, multicast_receiver_t *receiver,
+                                   disk_file_t *file_write, char *buffer, int bytes_rx){
+    tftp_data_packet_t data_packet;
+    deserialize_packet_struct(&data_packet, buffer);
+
+    //server offers the group only for files of at most 65535 blocks, the block number is the index of the block
+    block_index_t block_index = data_packet.block_number;
+    unsigned int payload_size = bytes_rx - DATA_PACKET_OFFSET;
+    if (data_packet.opcode != DATA_OPCODE || block_index == 0 || payload_size > option_information->blocksize ||
+        (receiver->last_block_index != 0 && block_index > receiver->last_block_index)){
+        return PACKET_OK_CODE;      //not a block of the file
+    }
+
+    if (block_index >= receiver->received_blocks.size()){
+        receiver->received_blocks.resize(block_index + 1, false);
+    }
+
+    if (receiver->received_blocks[block_index]){
+        //window sent again after the lost ack of the master - acknowledging its last block again
+        if (receiver->is_master && block_index == receiver->in_order_block_index){
+            multicast_ack(connection_information, option_information, receiver);
+        }
+        return PACKET_OK_CODE;
+    }
+
+    int error_number = disk_file_write_at(file_write, data_packet.data, payload_size, (off_t)(block_index - 1) * option_information->blocksize);
+    if (error_number != 0){
+        return error_number;
+    }
+
+    receiver->received_blocks[block_index] = true;
+    if (payload_size < option_information->blocksize){
+        receiver->last_block_index = block_index;
+        receiver->file_size = (unsigned long long)(block_index - 1) * option_information->blocksize + payload_size;
+    }
+
+    bool is_gap = block_index > receiver->in_order_block_index + 1;
+    while (receiver->in_order_block_index + 1 < receiver->received_blocks.size() && receiver->received_blocks[receiver->in_order_block_index + 1]){
+        receiver->in_order_block_index++;
+        receiver->is_gap_acked = false;
+    }
+
+    if (!receiver->is_master){
+        return PACKET_OK_CODE;
+    }
+
+    //acknowledging whole window, the last block or a missing block (only once, the server goes back to it)
+    receiver->received_since_ack++;
+    if (receiver->received_since_ack >= option_information->window_size || block_index == receiver->last_block_index ||
+        (is_gap && !receiver->is_gap_acked)){
+        receiver->is_gap_acked = is_gap;
+        multicast_ack(connection_information, option_information, receiver);
+    }
+    return PACKET_OK_CODE;
+}
+
+
+/**
+ * @brief Stores the ranges of the missing blocks (neighbouring blocks are joined into one range, empty last block is not needed).
+ * Every range is downloaded by own session, so the nearest ranges are joined, until there are at most MULTICAST_MAX_GAPS.
+ *
+ * @param option_information negotiated transfer options
+ * @param receiver state of the received file with the known last block
+ * @param gaps address where the ranges will be stored in
+ */
+static void multicast_find_gaps(option_info_t *option_information, multicast_receiver_t *receiver, vector<multicast_gap_t> *gaps){
+    unsigned long long blocksize = option_information->blocksize;
+    vector<multicast_gap_t> missing;
+    for (block_index_t block_index = receiver->in_order_block_index + 1; block_index <= receiver->last_block_index; block_index++){
+        if (block_index < receiver->received_blocks.size() && receiver->received_blocks[block_index]){
+            continue;
+        }
+
+        unsigned long long offset = (unsigned long long)(block_index - 1) * blocksize;
+        unsigned long long length = min(blocksize, receiver->file_size - offset);
+        if (length == 0){
+            continue;
+        }
+
+        if (!missing.empty() && missing.back().offset + missing.back().length == offset){
+            missing.back().length += length;
+        }
+        else{
+            missing.push_back({offset, length});
+        }
+    }
+
+    //ranges separated by the fewest received Bytes are joined
+    vector<bool> is_joined(missing.size(), false);
+    if (missing.size() > MULTICAST_MAX_GAPS){
+        //received Bytes before the range and its index
+        vector<pair<unsigned long long, size_t>> distances;
+        for (size_t i = 1; i < missing.size(); i++){
+            distances.push_back({missing[i].offset - (missing[i - 1].offset + missing[i - 1].length), i});
+        }
+        size_t joined_number = missing.size() - MULTICAST_MAX_GAPS;
+        nth_element(distances.begin(), distances.begin() + joined_number, distances.end());
+        for (size_t i = 0; i < joined_number; i++){
+            is_joined[distances[i].second] = true;
+        }
+    }
+
+    for (size_t i = 0; i < missing.size(); i++){
+        if (is_joined[i]){
+            gaps->back().length = missing[i].offset + missing[i].length - gaps->back().offset;
+        }
+        else{
+            gaps->push_back(missing[i]);
+        }
+    }
+}
+
+
+int receive_multicast(connection_info_t *connection_information, option_info_t *option_information, disk_file_t *file_write, int tid_expected,
+                      vector<multicast_gap_t> *gaps){
+    struct sockaddr_in server_address = *((struct sockaddr_in *)connection_information->address);
+    struct sockaddr_in group_address;
+    memset(&group_address, 0, sizeof(group_address));
+    group_address.sin_family = AF_INET;
+    group_address.sin_port = htons(option_information->multicast_port);
+    group_address.sin_addr.s_addr = option_information->multicast_address;
+
+    int group_socket = create_multicast_receiver(&group_address, &server_address);
+    if (group_socket < 0){
+        cout << "ERROR: multicast - group can't be joined\n";
+        send_error_packet(connection_information, ERR_CODE_NOT_DEF, "Multicast - group can't be joined");
+        return PROG_RET_CODE_ERR;
+    }
+
+    multicast_receiver_t receiver;
+    receiver.is_master = option_information->multicast_master;
+    if (option_information->option_transfer_size){
+        receiver.last_block_index = option_information->transfer_size / option_information->blocksize + 1;
+        receiver.file_size = option_information->transfer_size;
+        receiver.received_blocks.resize(receiver.last_block_index + 1, false);
+    }
+
+    //the master client starts the transfer
+    if (receiver.is_master){
+        multicast_ack(connection_information, option_information, &receiver);
+    }
+
+    char *buffer = connection_information->buffers->receive;
+    unsigned int datagram_size = option_information->blocksize + DATA_PACKET_OFFSET;
+    int return_code = PROG_RET_CODE_ERR;
+    int idle_timeouts = 0;
+    bool is_group_left = false;         //missing blocks are downloaded by unicast
+
+    while (receiver.last_block_index == 0 || receiver.in_order_block_index < receiver.last_block_index){
+        fd_set read_sockets;
+        FD_ZERO(&read_sockets);
+        FD_SET(connection_information->socket, &read_sockets);
+        FD_SET(group_socket, &read_sockets);
+
+        unsigned long timeout_us = get_timeout_us(option_information);
+        struct timeval timeout = {(time_t)(timeout_us / 1000000), (suseconds_t)(timeout_us % 1000000)};
+
+        get_io_stats()->wait_syscalls++;
+        int selected = select(max(connection_information->socket, group_socket) + 1, &read_sockets, NULL, NULL, &timeout);
+        if (selected < 0 && errno == EINTR){
+            continue;
+        }
+        else if (selected < 0){
+            cout << "ERROR: select - error\n";
+            break;
+        }
+        else if (selected == 0){
+            if (++idle_timeouts > MULTICAST_IDLE_TIMEOUTS){
+                //group stopped sending, missing blocks of the file of the known size are downloaded by unicast
+                is_group_left = receiver.last_block_index != 0;
+                if (!is_group_left){
+                    cout << "recvfrom - timeout\n";
+                }
+                break;
+            }
+            //ack of the master could be lost
+            if (receiver.is_master){
+                multicast_ack(connection_information, option_information, &receiver);
+            }
+            continue;
+        }
+
+        if (FD_ISSET(group_socket, &read_sockets)){
+            struct sockaddr_in sender_address;
+            socklen_t sender_address_size = sizeof(sender_address);
+
+            get_io_stats()->receive_syscalls++;
+            int bytes_rx = recvfrom(group_socket, buffer, datagram_size, 0, (struct sockaddr *)&sender_address, &sender_address_size);
+            if (bytes_rx >= DATA_PACKET_OFFSET && sender_address.sin_addr.s_addr == server_address.sin_addr.s_addr){
+                memset(buffer + bytes_rx, 0, IO_BATCH_PADDING);
+                get_io_stats()->packets_received++;
+                metrics_count_received(1, bytes_rx);
+                idle_timeouts = 0;
+
+                int error_number = multicast_receive_block(connection_information, option_information, &receiver, file_write, buffer, bytes_rx);
+                if (error_number != PACKET_OK_CODE){
+                    send_disk_error(connection_information, error_number);
+                    break;
+                }
+
+                //group sent the last block - blocks missed by other clients than the master are downloaded by unicast
+                block_index_t last_block_index = receiver.last_block_index;
+                if (!receiver.is_master && last_block_index != 0 && last_block_index < receiver.received_blocks.size() &&
+                    receiver.received_blocks[last_block_index] && receiver.in_order_block_index < last_block_index){
+                    is_group_left = true;
+                    break;
+                }
+            }
+        }
+
+        if (FD_ISSET(connection_information->socket, &read_sockets)){
+            get_io_stats()->receive_syscalls++;
+            int bytes_rx = recvfrom(connection_information->socket, buffer, datagram_size, 0,
+                                    connection_information->address, &connection_information->address_size);
+            if (bytes_rx < 2){
+                continue;
+            }
+            memset(buffer + bytes_rx, 0, IO_BATCH_PADDING);
+            get_io_stats()->packets_received++;
+            metrics_count_received(1, bytes_rx);
+
+            if (htons(((struct sockaddr_in *)connection_information->address)->sin_port) != tid_expected){
+                log_stranger_packet(connection_information, buffer, bytes_rx);
+                send_error_packet(connection_information, ERR_CODE_UNKNOWN_TID, "Invalid TID - Transfer ID doesn't match established communication", DEFAULT_TIMEOUT, false);
+                *((struct sockaddr_in *)connection_information->address) = server_address;
+                continue;
+            }
+            idle_timeouts = 0;
+
+            char opcode_char[2] = {buffer[0], buffer[1]};
+            ushort opcode = chars_to_short(opcode_char);
+            if (opcode == ERROR_OPCODE){
+                receive_error(connection_information, buffer, bytes_rx);
+                break;
+            }
+            else if (opcode == OACK_OPCODE){
+                //server has chosen other master client
+                tftp_oack_packet_t oack_packet_struct;
+                if (deserialize_packet_struct(&oack_packet_struct, buffer, bytes_rx) == PACKET_OK_CODE && oack_packet_struct.options.option_multicast){
+                    log_oack(connection_information, &oack_packet_struct);
+                    receiver.is_master = oack_packet_struct.options.multicast_master;
+                    receiver.is_gap_acked = false;
+                    if (receiver.is_master){
+                        multicast_ack(connection_information, option_information, &receiver);
+                    }
+                }
+            }
+        }
+    }
+
+    if (is_group_left){
+        multicast_find_gaps(option_information, &receiver, gaps);
+    }
+
+    if (is_group_left || (receiver.last_block_index != 0 && receiver.in_order_block_index == receiver.last_block_index)){
+        //whole file is received (or its missing ranges are known) - the last block ends the session of the client on the server
+        int error_number = disk_file_flush(file_write);
+        if (error_number != 0){
+            send_disk_error(connection_information, error_number);
+        }
+        else{
+            send_ack(connection_information, block_number_from_index(receiver.last_block_index, option_information->rollover));
+            return_code = PROG_RET_CODE_OK;
+        }
+    }
+
+    close(group_socket);
+    return return_code;
+}
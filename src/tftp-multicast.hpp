@@ -0,0 +1,75 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-multicast.hpp
+ * @brief Multicast transfer (RFC 2090) - sockets of the group and receiving of the file from the group by the client
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_MULTICAST_HPP
+#define TFTP_MULTICAST_HPP
+
+#include "tftp-communication.hpp"
+
+#define MULTICAST_TTL 1                     //Data are sent to the local network only
+#define MULTICAST_IDLE_TIMEOUTS 16          //timeouts without any packet from the server, after which the client gives up
+#define MULTICAST_MAX_GAPS 8                //ranges missed from the group downloaded by unicast at most (nearest ones are joined)
+
+
+/**
+ * @brief Gets the local address of the interface, that the host is reached through
+ *
+ * @param peer_address address of the host
+ * @param local_address address, where the local address will be stored
+ * @return true if OK, else false
+ */
+bool multicast_local_address(struct sockaddr_in *peer_address, struct in_addr *local_address);
+
+
+/**
+ * @brief Creates the socket sending Data to the group through the interface, that the client is reached through
+ *
+ * @param client_address address of the client, that the group is created for
+ * @return file descriptor of the socket, -1 if an error occurs
+ */
+int create_multicast_sender(struct sockaddr_in *client_address);
+
+
+/**
+ * @brief Creates the socket receiving Data of the group (the group is joined on the interface, that the server
+ * is reached through, more clients on the host may receive the same group)
+ *
+ * @param group_address multicast address and port of the group
+ * @param server_address address of the server
+ * @return file descriptor of the socket, -1 if an error occurs
+ */
+int create_multicast_receiver(struct sockaddr_in *group_address, struct sockaddr_in *server_address);
+
+
+//Range of the file missed from the group, that is downloaded by unicast (offset and length options)
+typedef struct multicast_gap {
+    unsigned long long offset;
+    unsigned long long length;
+} multicast_gap_t;
+
+
+/**
+ * @brief Receives the file from the multicast group (Oack with the multicast option was already received).
+ * Blocks are written at their offsets in any order. The master client acknowledges the last block received
+ * in order, so the server sends the missing blocks again. Other clients only listen, until the group sends
+ * the last block of the file (or stops sending), then they leave the group and their missing blocks are
+ * returned as ranges of the file downloaded by unicast (at most MULTICAST_MAX_GAPS, nearest missing blocks are
+ * joined with the received blocks between them). Last block is acknowledged by every client, when it
+ * has the whole file or leaves the group.
+ *
+ * @param connection_information connection information (transfer socket, address of the server)
+ * @param option_information negotiated transfer options with the multicast group
+ * @param file_write file the data are written to
+ * @param tid_expected port of the server
+ * @param gaps address where the ranges of the file missed from the group will be stored in
+ * @return PROG_RET_CODE_OK if the whole file was received or its missing ranges are known, else PROG_RET_CODE_ERR
+ */
+int receive_multicast(connection_info_t *connection_information, option_info_t *option_information, disk_file_t *file_write, int tid_expected,
+                      vector<multicast_gap_t> *gaps);
+
+#endif
@@ -0,0 +1,215 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-netascii.cpp
+ * @brief Conversion between Linux text and netascii (vectorized scanning for CR and LF)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include "tftp-netascii.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NETASCII_X86
+#endif
+
+
+//Copies Bytes until CR (or also LF) is found, returns the number of copied Bytes
+typedef size_t (*copy_plain_function_t)(const char *input, char *output, size_t size, bool stop_on_lf);
+
+
+/**
+ * @brief Copies Bytes one by one until CR (or LF when required) is found
+ *
+ * @param input data to be copied
+ * @param output address, where the data will be copied to
+ * @param size maximal number of Bytes to be copied
+ * @param stop_on_lf true if LF ends the copying too
+ * @return number of copied Bytes (position of the found CR or LF)
+ */
+static size_t copy_plain_scalar(const char *input, char *output, size_t size, bool stop_on_lf){
+    for (size_t i = 0; i < size; i++){
+        char c = input[i];
+        if (c == NETASCII_CR || (stop_on_lf && c == '\n')){
+            return i;
+        }
+        output[i] = c;
+    }
+    return size;
+}
+
+
+#ifdef NETASCII_X86
+/**
+ * @brief Copies 16 Bytes at once until CR (or LF when required) is found (chunk with the found Byte is stored too,
+ * Bytes behind it are overwritten by the caller)
+ *
+ * @param input data to be copied
+ * @param output address, where the data will be copied to
+ * @param size maximal number of Bytes to be copied
+ * @param stop_on_lf true if LF ends the copying too
+ * @return number of copied Bytes (position of the found CR or LF)
+ */
+static size_t copy_plain_sse2(const char *input, char *output, size_t size, bool stop_on_lf){
+    const __m128i cr = _mm_set1_epi8(NETASCII_CR);
+    const __m128i lf = _mm_set1_epi8('\n');
+
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16){
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(input + i));
+        __m128i found = _mm_cmpeq_epi8(chunk, cr);
+        if (stop_on_lf){
+            found = _mm_or_si128(found, _mm_cmpeq_epi8(chunk, lf));
+        }
+        _mm_storeu_si128((__m128i *)(output + i), chunk);
+
+        int mask = _mm_movemask_epi8(found);
+        if (mask != 0){
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + copy_plain_scalar(input + i, output + i, size - i, stop_on_lf);
+}
+
+
+/**
+ * @brief Copies 32 Bytes at once until CR (or LF when required) is found, AVX2 variant of copy_plain_sse2
+ *
+ * @param input data to be copied
+ * @param output address, where the data will be copied to
+ * @param size maximal number of Bytes to be copied
+ * @param stop_on_lf true if LF ends the copying too
+ * @return number of copied Bytes (position of the found CR or LF)
+ */
+__attribute__((target("avx2")))
+static size_t copy_plain_avx2(const char *input, char *output, size_t size, bool stop_on_lf){
+    const __m256i cr = _mm256_set1_epi8(NETASCII_CR);
+    const __m256i lf = _mm256_set1_epi8('\n');
+
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32){
+        __m256i chunk = _mm256_loadu_si256((const __m256i *)(input + i));
+        __m256i found = _mm256_cmpeq_epi8(chunk, cr);
+        if (stop_on_lf){
+            found = _mm256_or_si256(found, _mm256_cmpeq_epi8(chunk, lf));
+        }
+        _mm256_storeu_si256((__m256i *)(output + i), chunk);
+
+        unsigned int mask = _mm256_movemask_epi8(found);
+        if (mask != 0){
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + copy_plain_sse2(input + i, output + i, size - i, stop_on_lf);
+}
+#endif
+
+
+/**
+ * @brief Copies Bytes until CR (or LF when required) is found with the best variant supported by the processor
+ *
+ * @param input data to be copied
+ * @param output address, where the data will be copied to
+ * @param size maximal number of Bytes to be copied
+ * @param stop_on_lf true if LF ends the copying too
+ * @return number of copied Bytes (position of the found CR or LF)
+ */
+static size_t copy_plain(const char *input, char *output, size_t size, bool stop_on_lf){
+#ifdef NETASCII_X86
+    static const copy_plain_function_t copy_function = __builtin_cpu_supports("avx2") ? copy_plain_avx2 : copy_plain_sse2;
+#else
+    static const copy_plain_function_t copy_function = copy_plain_scalar;
+#endif
+    return copy_function(input, output, size, stop_on_lf);
+}
+
+
+size_t netascii_encode(const char *input, size_t input_size, size_t *consumed, char *output, size_t output_size, netascii_state_t *state){
+    size_t input_position = 0;
+    size_t output_position = 0;
+
+    //finishing the pair started in the previous block
+    if (state->has_pending && output_size > 0){
+        output[output_position++] = state->pending;
+        state->has_pending = false;
+    }
+
+    while (input_position < input_size && output_position < output_size){
+        size_t input_left = input_size - input_position;
+        size_t output_left = output_size - output_position;
+        size_t plain_size = input_left < output_left ? input_left : output_left;
+        size_t copied = copy_plain(input + input_position, output + output_position, plain_size, true);
+        input_position += copied;
+        output_position += copied;
+        if (copied == plain_size){
+            break;
+        }
+
+        //LF is sent as CR LF, CR as CR NUL
+        char second = input[input_position++] == '\n' ? '\n' : '\x00';
+        output[output_position++] = NETASCII_CR;
+        if (output_position < output_size){
+            output[output_position++] = second;
+        }
+        else{
+            state->pending = second;
+            state->has_pending = true;
+        }
+    }
+
+    *(consumed) = input_position;
+    return output_position;
+}
+
+size_t netascii_decode(const char *input, size_t input_size, char *output, netascii_state_t *state){
+    size_t input_position = 0;
+    size_t output_position = 0;
+
+    //CR from the end of the previous block
+    if (state->cr_pending && input_size > 0){
+        state->cr_pending = false;
+        if (input[0] == '\n'){
+            output[output_position++] = '\n';
+            input_position++;
+        }
+        else{
+            output[output_position++] = NETASCII_CR;
+            input_position += input[0] == '\x00';
+        }
+    }
+
+    while (input_position < input_size){
+        size_t copied = copy_plain(input + input_position, output + output_position, input_size - input_position, false);
+        input_position += copied;
+        output_position += copied;
+        if (input_position == input_size){
+            break;
+        }
+
+        //found CR, meaning is given by the following Byte
+        if (input_position + 1 == input_size){
+            state->cr_pending = true;
+            break;
+        }
+        char next = input[input_position + 1];
+        if (next == '\n'){
+            output[output_position++] = '\n';
+            input_position += 2;
+        }
+        else{
+            output[output_position++] = NETASCII_CR;
+            input_position += next == '\x00' ? 2 : 1;
+        }
+    }
+
+    return output_position;
+}
+
+size_t netascii_decode_end(char *output, netascii_state_t *state){
+    if (!state->cr_pending){
+        return 0;
+    }
+    state->cr_pending = false;
+    output[0] = NETASCII_CR;
+    return 1;
+}
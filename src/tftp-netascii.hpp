@@ -0,0 +1,60 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-netascii.hpp
+ * @brief Conversion between Linux text and netascii (vectorized scanning for CR and LF)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_NETASCII_HPP
+#define TFTP_NETASCII_HPP
+
+#include <stddef.h>
+
+#define NETASCII_CR 13
+
+
+//Structure containing state of the conversion, that passes to the next block
+typedef struct netascii_state {
+    char pending = 0;               //encoding: second Byte of CR LF or CR NUL pair, that didn't fit into the previous block
+    bool has_pending = false;
+    bool cr_pending = false;        //decoding: CR at the end of the previous block, its meaning depends on the next Byte
+} netascii_state_t;
+
+
+/**
+ * @brief Converts Linux text to netascii (LF to CR LF, CR to CR NUL) until the output is full or the input is consumed
+ *
+ * @param input text to be converted
+ * @param input_size size of the text
+ * @param consumed address, where the number of consumed input Bytes will be stored
+ * @param output address, where the converted data will be stored
+ * @param output_size maximal size of the converted data
+ * @param state state of the conversion
+ * @return size of the converted data
+ */
+size_t netascii_encode(const char *input, size_t input_size, size_t *consumed, char *output, size_t output_size, netascii_state_t *state);
+
+
+/**
+ * @brief Converts netascii to Linux text (CR LF to LF, CR NUL to CR), CR at the end of the input is kept in the state
+ *
+ * @param input data to be converted
+ * @param input_size size of the data
+ * @param output address, where the converted text will be stored (at least input_size + 1 Bytes)
+ * @param state state of the conversion
+ * @return size of the converted text
+ */
+size_t netascii_decode(const char *input, size_t input_size, char *output, netascii_state_t *state);
+
+
+/**
+ * @brief Ends the decoding, CR kept at the end of the last block is written as it is
+ *
+ * @param output address, where the rest of the text will be stored (at least 1 Byte)
+ * @param state state of the conversion
+ * @return size of the rest of the text
+ */
+size_t netascii_decode_end(char *output, netascii_state_t *state);
+
+#endif
@@ -6,6 +6,10 @@
  */
 
 
+#include <arpa/inet.h>
+#include <climits>
+#include <string.h>
+#include <algorithm>
 #include "tftp-packet-structures.hpp"
 
 
@@ -37,19 +41,45 @@ string serialize_packet_struct(tftp_rrq_wrq_packet_t *packet_struct){
 }
 
 
+ushort block_number_from_index(block_index_t block_index, unsigned int rollover){
+    if (rollover == 1 && block_index != 0){
+        return (block_index - 1) % 65535 + 1;      //block number 0 is skipped
+    }
+    return block_index & 0xFFFF;
+}
+
+
+block_index_t block_index_from_number(ushort block_number, block_index_t reference_index, unsigned int rollover){
+    if (rollover == 1 && block_number == 0){
+        return 0;       //only the request can be acknowledged by the block number 0
+    }
+
+    //positions with the same block number differ by the period
+    block_index_t period = rollover == 1 ? 65535 : 65536;
+    block_index_t difference = (block_number + period - reference_index % period) % period;
+
+    if (difference <= period / 2 || reference_index < period - difference){
+        return reference_index + difference;
+    }
+    return reference_index - (period - difference);
+}
+
+
+void serialize_data_header(tftp_data_packet_t *packet_struct, char *header){
+    short_to_chars(packet_struct->opcode, header);
+    short_to_chars(packet_struct->block_number, header + 2);
+}
+
+
 string serialize_packet_struct(tftp_data_packet_t *packet_struct, int loaded_data_number){
-    char opcode_char[2];
-    short_to_chars(packet_struct->opcode, opcode_char);
-    char block_number_char[2];
-    short_to_chars(packet_struct->block_number, block_number_char);
+    char header[DATA_PACKET_OFFSET];
+    serialize_data_header(packet_struct, header);
 
-    string sequence_build = "";
-    sequence_build = block_number_char[1] + sequence_build;
-    sequence_build = block_number_char[0] + sequence_build;
-    sequence_build = opcode_char[1] + sequence_build;
-    sequence_build = opcode_char[0] + sequence_build;
+    string sequence_build;
+    sequence_build.reserve(DATA_PACKET_OFFSET + loaded_data_number);
+    sequence_build.append(header, DATA_PACKET_OFFSET);
     sequence_build.append(packet_struct->data, loaded_data_number);
-    
+
     return sequence_build;
 }
 
@@ -107,37 +137,52 @@ string serialize_option_info(option_info_t *option_information){
         sequence += "timeout";
         sequence += '\x00' + to_string(option_information->timeout_interval) + '\x00';
     }
+    if (option_information->option_utimeout_interval){
+        sequence += "utimeout";
+        sequence += '\x00' + to_string(option_information->utimeout_interval) + '\x00';
+    }
     if (option_information->option_blocksize){
         sequence += "blksize";
         sequence += '\x00' + to_string(option_information->blocksize) + '\x00';
     }
+    if (option_information->option_window_size){
+        sequence += "windowsize";
+        sequence += '\x00' + to_string(option_information->window_size) + '\x00';
+    }
+    if (option_information->option_rollover){
+        sequence += "rollover";
+        sequence += '\x00' + to_string(option_information->rollover) + '\x00';
+    }
+    if (option_information->option_multicast){
+        sequence += "multicast";
+        sequence += '\x00' + format_multicast_value(option_information) + '\x00';
+    }
+    if (option_information->option_offset){
+        sequence += "offset";
+        sequence += '\x00' + to_string(option_information->offset) + '\x00';
+    }
+    if (option_information->option_length){
+        sequence += "length";
+        sequence += '\x00' + to_string(option_information->length) + '\x00';
+    }
+    if (option_information->option_resume){
+        sequence += "resume";
+        sequence += '\x00' + to_string(option_information->resume_bytes) + "," + to_string(option_information->resume_checksum) + '\x00';
+    }
     return sequence;
 }
 
 
-void deserialize_packet_struct(tftp_rrq_wrq_packet_t *packet_struct, char *sequence){
-    char opcode_char[2] = {sequence[0], sequence[1]};
-    
-    int i = 2;
-    string filename = "";
-    string mode = "";
-
-    //deserializing file name
-    while (sequence[i] != '\0'){
-        filename += sequence[i++];
+string format_multicast_value(option_info_t *option_information){
+    if (option_information->multicast_port == 0){
+        return "";      //request, the group is chosen by the server
     }
 
-    i++;
-
-    //deserializing mode
-    while (sequence[i] != '\0'){
-        mode += tolower(sequence[i++]);
-    }
+    char address[INET_ADDRSTRLEN];
+    struct in_addr group_address = {option_information->multicast_address};
+    inet_ntop(AF_INET, &group_address, address, INET_ADDRSTRLEN);
 
-    packet_struct->opcode = chars_to_short(opcode_char);
-    packet_struct->filename = filename;
-    packet_struct->mode = mode;
-    deserialize_option_info(&packet_struct->options, sequence, ++i);
+    return string(address) + "," + to_string(option_information->multicast_port) + "," + (option_information->multicast_master ? "1" : "0");
 }
 
 
@@ -160,77 +205,360 @@ void deserialize_packet_struct(tftp_ack_packet_t *packet_struct, char *sequence)
 }
 
 
-void deserialize_packet_struct(tftp_error_packet_t *packet_struct, char *sequence){
-    char opcode_char[2] = {sequence[0], sequence[1]};
-    char error_code_char[2] = {sequence[2], sequence[3]};
+/**
+ * @brief Reads the unsigned short number stored in network order
+ *
+ * @param number_chars two Bytes of the number
+ * @return read number
+ */
+static ushort read_short(const char *number_chars){
+    return ((unsigned char)number_chars[0] << 8) | (unsigned char)number_chars[1];
+}
+
 
-    string error_message = "";
+/**
+ * @brief Views the zero terminated string starting at the position and moves the position behind its zero Byte
+ *
+ * @param sequence received packet
+ * @param size size of the packet in Bytes
+ * @param position position of the string, moved behind the string
+ * @param field address, where the view of the string (without the zero Byte) will be stored
+ * @return true if the string is terminated within the packet, else false
+ */
+static bool next_string(const char *sequence, size_t size, size_t *position, string_view *field){
+    if (*position >= size){
+        return false;
+    }
 
-    //deserializing error message
-    for (int i = 4; sequence[i] != '\0'; i++){
-        error_message += sequence[i];
+    const char *end = (const char *)memchr(sequence + *position, '\x00', size - *position);
+    if (end == NULL){
+        return false;
     }
 
-    packet_struct->opcode = chars_to_short(opcode_char);
-    packet_struct->error_code = chars_to_short(error_code_char);
-    packet_struct->error_message = error_message;
+    *field = string_view(sequence + *position, end - (sequence + *position));
+    *position = end - sequence + 1;
+    return true;
 }
 
 
-void deserialize_packet_struct(tftp_oack_packet_t *packet_struct, char *sequence){
-    char opcode_char[2] = {sequence[0], sequence[1]};
+/**
+ * @brief Parses decimal number of the option value, tsize, offset and length may be bigger than 4 GB
+ *
+ * @param value option value
+ * @param number address, where the number will be stored
+ * @return true if the value is a decimal number fitting in 64 bits, else false
+ */
+static bool parse_number(string_view value, unsigned long long *number){
+    if (value.empty()){
+        return false;
+    }
 
-    packet_struct->opcode = chars_to_short(opcode_char);
-    deserialize_option_info(&packet_struct->options, sequence, 2);
+    unsigned long long result = 0;
+    for (char c : value){
+        if (c < '0' || c > '9' || result > (ULLONG_MAX - (c - '0')) / 10){
+            return false;
+        }
+        result = result * 10 + (c - '0');
+    }
+
+    *number = result;
+    return true;
 }
 
 
-void deserialize_option_info(option_info_t *option_information, char *sequence, int options_start_index){
-    string option;
-    string value;
-    int order_number = 0;
+/**
+ * @brief Parses value of the multicast option, empty value (request) or `address,port,mc` (Oack, address and port
+ * may be empty when only the master client changes)
+ *
+ * @param value option value
+ * @param address address, where the group address will be stored (kept for an empty field)
+ * @param port address, where the group port will be stored (kept for an empty field)
+ * @param master address, where the master client flag will be stored
+ * @return true if the value is valid, else false
+ */
+static bool parse_multicast(string_view value, unsigned int *address, unsigned int *port, bool *master){
+    if (value.empty()){
+        return true;
+    }
 
-    //deserializing options
-    for (int i = options_start_index; sequence[i] != '\x00';){
-        option = "";
-        value = "";
+    size_t address_end = value.find(',');
+    size_t port_end = address_end == string_view::npos ? string_view::npos : value.find(',', address_end + 1);
+    if (port_end == string_view::npos){
+        return false;
+    }
 
-        //deserializing option name
-        while (sequence[i] != '\x00'){
-            option += tolower(sequence[i++]);
+    string_view address_field = value.substr(0, address_end);
+    string_view port_field = value.substr(address_end + 1, port_end - address_end - 1);
+    string_view master_field = value.substr(port_end + 1);
+
+    if (!address_field.empty()){
+        char address_string[INET_ADDRSTRLEN];
+        struct in_addr group_address;
+        if (address_field.size() >= INET_ADDRSTRLEN){
+            return false;
+        }
+        memcpy(address_string, address_field.data(), address_field.size());
+        address_string[address_field.size()] = '\x00';
+        if (inet_pton(AF_INET, address_string, &group_address) != 1){
+            return false;
         }
-        i++;
+        *address = group_address.s_addr;
+    }
 
-        //deserializing option value
-        while (sequence[i] != '\x00'){
-            value += sequence[i++];
+    unsigned long long port_number;
+    if (!port_field.empty()){
+        if (!parse_number(port_field, &port_number) || port_number == 0 || port_number > 65535){
+            return false;
         }
-        i++;
+        *port = port_number;
+    }
+
+    if (master_field != "0" && master_field != "1"){
+        return false;
+    }
+    *master = master_field == "1";
+    return true;
+}
+
+
+/**
+ * @brief Parses value of the resume option `bytes,checksum` (size of the prefix of the file and its Adler-32 checksum)
+ *
+ * @param value option value
+ * @param bytes address, where the size of the prefix will be stored
+ * @param checksum address, where the checksum will be stored
+ * @return true if the value is valid, else false
+ */
+static bool parse_resume(string_view value, unsigned long long *bytes, unsigned int *checksum){
+    size_t bytes_end = value.find(',');
+    if (bytes_end == string_view::npos){
+        return false;
+    }
+
+    unsigned long long checksum_number;
+    if (!parse_number(value.substr(0, bytes_end), bytes) || !parse_number(value.substr(bytes_end + 1), &checksum_number) ||
+        checksum_number > UINT_MAX){
+        return false;
+    }
+    *checksum = checksum_number;
+    return true;
+}
 
-        int value_int;
 
-        try{
-            value_int = stoi(value);
+bool equals_ignore_case(string_view value, string_view lowercase){
+    if (value.size() != lowercase.size()){
+        return false;
+    }
+
+    for (size_t i = 0; i < value.size(); i++){
+        char c = value[i];
+        if (c >= 'A' && c <= 'Z'){
+            c += 'a' - 'A';
         }
-        catch(exception &err){
-            continue;
+        if (c != lowercase[i]){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int parse_options(const char *sequence, size_t size, option_info_t *option_information){
+    int order_number = 0;
+    size_t position = 0;
+
+    while (position < size){
+        string_view option;
+        string_view value;
+        if (!next_string(sequence, size, &position, &option)){
+            return ERR_CODE_ILLEGAL_OPERATION;
+        }
+        if (option.empty()){
+            break;      //zero padding behind the options
+        }
+        if (!next_string(sequence, size, &position, &value)){
+            return ERR_CODE_ILLEGAL_OPERATION;
+        }
+
+        options option_type;
+        bool *option_enabled;
+        if (equals_ignore_case(option, "blksize")){
+            option_type = BLOCKSIZE;
+            option_enabled = &option_information->option_blocksize;
+        }
+        else if (equals_ignore_case(option, "timeout")){
+            option_type = TIMEOUT;
+            option_enabled = &option_information->option_timeout_interval;
+        }
+        else if (equals_ignore_case(option, "tsize")){
+            option_type = TRANSFER_SIZE;
+            option_enabled = &option_information->option_transfer_size;
+        }
+        else if (equals_ignore_case(option, "windowsize")){
+            option_type = WINDOW_SIZE;
+            option_enabled = &option_information->option_window_size;
+        }
+        else if (equals_ignore_case(option, "utimeout")){
+            option_type = UTIMEOUT;
+            option_enabled = &option_information->option_utimeout_interval;
+        }
+        else if (equals_ignore_case(option, "rollover")){
+            option_type = ROLLOVER;
+            option_enabled = &option_information->option_rollover;
         }
-        if (option == "blksize"){
-            option_information->option_blocksize = true;
-            option_information->blocksize = value_int;
-            option_information->option_order[order_number++] = BLOCKSIZE;
+        else if (equals_ignore_case(option, "multicast")){
+            option_type = MULTICAST;
+            option_enabled = &option_information->option_multicast;
         }
-        else if (option == "timeout"){
-            option_information->option_timeout_interval = true;
-            option_information->timeout_interval = value_int;
-            option_information->option_order[order_number++] = TIMEOUT;
+        else if (equals_ignore_case(option, "offset")){
+            option_type = OFFSET;
+            option_enabled = &option_information->option_offset;
         }
-        else if (option == "tsize"){
-            option_information->option_transfer_size = true;
-            option_information->transfer_size = value_int;
-            option_information->option_order[order_number++] = TRANSFER_SIZE;
+        else if (equals_ignore_case(option, "length")){
+            option_type = LENGTH;
+            option_enabled = &option_information->option_length;
         }
+        else if (equals_ignore_case(option, "resume")){
+            option_type = RESUME;
+            option_enabled = &option_information->option_resume;
+        }
+        else{
+            continue;   //unknown options are ignored (RFC 2347)
+        }
+
+        unsigned long long value_number = 0;
+        unsigned int multicast_address = option_information->multicast_address;
+        unsigned int multicast_port = option_information->multicast_port;
+        bool multicast_master = false;
+        unsigned int resume_checksum = ADLER32_INITIAL;
+        bool is_valid;
+        if (option_type == MULTICAST){
+            is_valid = parse_multicast(value, &multicast_address, &multicast_port, &multicast_master);
+        }
+        else if (option_type == RESUME){
+            is_valid = parse_resume(value, &value_number, &resume_checksum);
+        }
+        else{
+            is_valid = parse_number(value, &value_number);
+        }
+        if (!is_valid){
+            continue;
+        }
+        unsigned int value_int = min(value_number, (unsigned long long)UINT_MAX);     //too big values fail the range checks
+
+        //repeated option would overflow the order of options
+        if (*option_enabled){
+            return ERR_CODE_ILLEGAL_OPERATION;
+        }
+        *option_enabled = true;
+        option_information->option_order[order_number++] = option_type;
+
+        switch (option_type){
+            case BLOCKSIZE:     option_information->blocksize = value_int; break;
+            case TIMEOUT:       option_information->timeout_interval = value_int; break;
+            case TRANSFER_SIZE: option_information->transfer_size = value_number; break;
+            case WINDOW_SIZE:   option_information->window_size = value_int; break;
+            case UTIMEOUT:      option_information->utimeout_interval = value_int; break;
+            case ROLLOVER:      option_information->rollover = value_int; break;
+            case OFFSET:        option_information->offset = value_number; break;
+            case LENGTH:        option_information->length = value_number; break;
+            case RESUME:
+                option_information->resume_bytes = value_number;
+                option_information->resume_checksum = resume_checksum;
+                break;
+            case MULTICAST:
+                option_information->multicast_address = multicast_address;
+                option_information->multicast_port = multicast_port;
+                option_information->multicast_master = multicast_master;
+                break;
+            default:            break;
+        }
+    }
+
+    return PACKET_OK_CODE;
+}
+
+
+int parse_request(const char *sequence, size_t size, tftp_request_view_t *request){
+    if (size < 2){
+        return ERR_CODE_ILLEGAL_OPERATION;
     }
+    request->opcode = read_short(sequence);
+
+    size_t position = 2;
+    if (!next_string(sequence, size, &position, &request->filename) || request->filename.empty() ||
+        !next_string(sequence, size, &position, &request->mode)){
+        return ERR_CODE_ILLEGAL_OPERATION;
+    }
+
+    return parse_options(sequence + position, size - position, &request->options);
+}
+
+
+int parse_error(const char *sequence, size_t size, tftp_error_view_t *error){
+    if (size < 4){
+        return ERR_CODE_ILLEGAL_OPERATION;
+    }
+    error->opcode = read_short(sequence);
+    error->error_code = read_short(sequence + 2);
+
+    size_t position = 4;
+    if (!next_string(sequence, size, &position, &error->error_message)){
+        error->error_message = string_view(sequence + 4, size - 4);
+        return ERR_CODE_ILLEGAL_OPERATION;
+    }
+
+    return PACKET_OK_CODE;
+}
+
+
+int deserialize_packet_struct(tftp_rrq_wrq_packet_t *packet_struct, const char *sequence, size_t size){
+    tftp_request_view_t request;
+    int return_code = parse_request(sequence, size, &request);
+    if (return_code != PACKET_OK_CODE){
+        return return_code;
+    }
+
+    packet_struct->opcode = request.opcode;
+    packet_struct->filename = string(request.filename);
+    packet_struct->options = request.options;
+
+    //known modes are stored without allocation, others only for the error message
+    if (equals_ignore_case(request.mode, MODE_OCTET)){
+        packet_struct->mode = MODE_OCTET;
+    }
+    else if (equals_ignore_case(request.mode, MODE_NETASCII)){
+        packet_struct->mode = MODE_NETASCII;
+    }
+    else{
+        packet_struct->mode = string(request.mode);
+        transform(packet_struct->mode.begin(), packet_struct->mode.end(), packet_struct->mode.begin(), ::tolower);
+    }
+
+    return PACKET_OK_CODE;
+}
+
+
+int deserialize_packet_struct(tftp_error_packet_t *packet_struct, const char *sequence, size_t size){
+    tftp_error_view_t error;
+    int return_code = parse_error(sequence, size, &error);
+    if (size >= 4){
+        packet_struct->opcode = error.opcode;
+        packet_struct->error_code = error.error_code;
+        packet_struct->error_message = string(error.error_message);
+    }
+
+    return return_code;
+}
+
+
+int deserialize_packet_struct(tftp_oack_packet_t *packet_struct, const char *sequence, size_t size){
+    if (size < 2){
+        return ERR_CODE_ILLEGAL_OPERATION;
+    }
+
+    packet_struct->opcode = read_short(sequence);
+    return parse_options(sequence + 2, size - 2, &packet_struct->options);
 }
 
 
@@ -249,17 +577,19 @@ int check_packet_content(tftp_rrq_wrq_packet_t *packet_struct, string *error_mes
 }
 
 
-int check_packet_content(tftp_ack_packet_t *packet_struct, ushort expected_block_number, string *error_message){
+int check_packet_content(tftp_ack_packet_t *packet_struct, block_index_t expected_block_index, string *error_message, unsigned int blocks_in_flight,
+                         unsigned int rollover){
     if (packet_struct->opcode != ACK_OPCODE){
         *(error_message) = "Expected ACK packet";
         return ERR_CODE_ILLEGAL_OPERATION;
     }
 
-    if (packet_struct->block_number > expected_block_number){
+    block_index_t block_index = block_index_from_number(packet_struct->block_number, expected_block_index, rollover);
+    if (block_index > expected_block_index){
         *(error_message) = "Inconsistent acknowledgement - Expected block number is bigger than recieved.";
         return ERR_CODE_ILLEGAL_OPERATION;
     }
-    else if (packet_struct->block_number < expected_block_number){
+    else if (block_index + blocks_in_flight <= expected_block_index){     //acks block before the unacked ones
         return DUPLICATED_PACKET;
     }
 
@@ -267,23 +597,26 @@ int check_packet_content(tftp_ack_packet_t *packet_struct, ushort expected_block
 }
 
 
-int check_packet_content(tftp_data_packet_t *packet_struct, ushort expected_block_number, string *error_message){
+int check_packet_content(tftp_data_packet_t *packet_struct, block_index_t expected_block_index, string *error_message, unsigned int window_size,
+                         unsigned int rollover){
     if (packet_struct->opcode != DATA_OPCODE){
         *(error_message) = "Expected DATA packet";
         return ERR_CODE_ILLEGAL_OPERATION;
     }
 
-    if (packet_struct->block_number < 1){
-        string received_str = to_string(packet_struct->block_number);
+    block_index_t block_index = block_index_from_number(packet_struct->block_number, expected_block_index, rollover);
+    if (block_index < 1){
         *(error_message) = "DATA packet block number has to be greater than 0 ";
         return ERR_CODE_ILLEGAL_OPERATION;
     }
-    else if (packet_struct->block_number > expected_block_number){
-        string received_str = to_string(packet_struct->block_number);
+    else if (block_index > expected_block_index && block_index - expected_block_index < window_size){
+        return OUT_OF_ORDER_PACKET;     //some preceding block of the window was lost
+    }
+    else if (block_index > expected_block_index){
         *(error_message) = "DATA packet block number cannot be higher than the expected block number";
         return ERR_CODE_ILLEGAL_OPERATION;
     }
-    else if (packet_struct->block_number < expected_block_number){
+    else if (block_index < expected_block_index){
         return DUPLICATED_PACKET;
     }
 
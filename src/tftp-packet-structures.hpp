@@ -6,7 +6,11 @@
  */
 
 
+#ifndef TFTP_PACKET_STRUCTURES_HPP
+#define TFTP_PACKET_STRUCTURES_HPP
+
 #include <iostream>
+#include <string_view>
 
 using namespace std;
 
@@ -19,6 +23,7 @@ using namespace std;
 
 #define DATA_PACKET_OFFSET 4
 
+#define OUT_OF_ORDER_PACKET        -3
 #define DUPLICATED_PACKET          -2
 #define PACKET_OK_CODE             -1
 #define ERR_CODE_NOT_DEF            0
@@ -40,32 +45,63 @@ using namespace std;
 #define DEFAULT_TFTP_PORT 69
 
 #define DEFAULT_BLOCK_SIZE 512
+#define MIN_BLKSIZE_VALUE 8
+#define MAX_BLKSIZE_VALUE 65464
 #define DEFAULT_TIMEOUT    5
-#define SUPPORTED_OPTIONS_NUMBER 3
+#define DEFAULT_WINDOW_SIZE 1
+#define DEFAULT_ROLLOVER 0
+#define SUPPORTED_OPTIONS_NUMBER 10
+#define ADLER32_INITIAL 1           //Adler-32 checksum of no data
 
 
 typedef unsigned short int ushort;
+typedef unsigned long long block_index_t;          //position of the block in the transfer (block number without rollover)
 
 
 enum options{
    NONE = -1,
    BLOCKSIZE,
    TRANSFER_SIZE,
-   TIMEOUT
+   TIMEOUT,
+   WINDOW_SIZE,
+   ROLLOVER,
+   UTIMEOUT,
+   MULTICAST,
+   OFFSET,
+   LENGTH,
+   RESUME
 };
 
 
 //Structure containing transfer option information
 typedef struct option_info {
    unsigned int blocksize = DEFAULT_BLOCK_SIZE;    //block size value
-   unsigned int transfer_size;                     //transfer size value
+   unsigned int blocksize_limit = MAX_BLKSIZE_VALUE; //largest block size accepted by the server (path MTU to the client)
+   unsigned long long transfer_size;               //transfer size value
    unsigned int timeout_interval;                  //timeout value
+   unsigned int utimeout_interval = 0;             //timeout value in microseconds (0 if not negotiated)
+   unsigned int window_size = DEFAULT_WINDOW_SIZE; //window size value (RFC 7440)
+   unsigned int rollover = DEFAULT_ROLLOVER;       //block number following 65535 (0 or 1)
+   unsigned int multicast_address = 0;             //multicast group address in network byte order (RFC 2090, 0 in the request)
+   unsigned int multicast_port = 0;                //multicast group port (0 in the request)
+   bool multicast_master = false;                  //client is the master client, that acknowledges the blocks
+   unsigned long long offset = 0;                  //first Byte of the downloaded range of the file (non-standard)
+   unsigned long long length = 0;                  //size of the downloaded range (0 up to the end of the file)
+   unsigned long long resume_bytes = 0;            //prefix of the file kept by the interrupted transfer (non-standard, 0 from the beginning)
+   unsigned int resume_checksum = ADLER32_INITIAL; //Adler-32 checksum of the prefix
 
    bool option_blocksize = false;                  //block size option enabled
    bool option_transfer_size = false;              //transfer size option enabled
    bool option_timeout_interval = false;           //timeout option enabled
-
-    options option_order[SUPPORTED_OPTIONS_NUMBER] = {NONE, NONE, NONE};   //array defining order of incoming options
+   bool option_utimeout_interval = false;          //utimeout option enabled
+   bool option_window_size = false;                //window size option enabled
+   bool option_rollover = false;                   //rollover option enabled
+   bool option_multicast = false;                  //multicast option enabled
+   bool option_offset = false;                     //offset option enabled
+   bool option_length = false;                     //length option enabled
+   bool option_resume = false;                     //resume option enabled
+
+    options option_order[SUPPORTED_OPTIONS_NUMBER] = {NONE, NONE, NONE, NONE, NONE, NONE, NONE, NONE, NONE, NONE};   //array defining order of incoming options
 } option_info_t;
 
 
@@ -78,6 +114,23 @@ typedef struct tftp_rrq_wrq_packet {
 } tftp_rrq_wrq_packet_t;
 
 
+//Write or Read request viewed in the receive buffer (strings are not copied, valid while the buffer is)
+typedef struct tftp_request_view {
+   ushort opcode;
+   string_view filename;
+   string_view mode;                               //mode as received (any letter case)
+   option_info_t options;
+} tftp_request_view_t;
+
+
+//Error packet viewed in the receive buffer
+typedef struct tftp_error_view {
+   ushort opcode;
+   ushort error_code;
+   string_view error_message;
+} tftp_error_view_t;
+
+
 //Structure containing data of TFTP Data packet
 typedef struct tftp_data_packet {
    ushort opcode = DATA_OPCODE;
@@ -127,6 +180,37 @@ void short_to_chars(ushort short_number, char *number_chars);
 ushort chars_to_short(char *number_chars);
 
 
+/**
+ * @brief Converts the position of the block in the transfer to the block number sent in packets
+ *
+ * @param block_index position of the block (0 for the request acknowledgement, 1 for the first Data block)
+ * @param rollover block number following 65535 (0 or 1)
+ * @return block number
+ */
+ushort block_number_from_index(block_index_t block_index, unsigned int rollover);
+
+
+/**
+ * @brief Converts the received block number to the position of the block in the transfer, the position
+ * nearest to the reference position is chosen (block numbers repeat after rollover)
+ *
+ * @param block_number received block number
+ * @param reference_index position of the expected block
+ * @param rollover block number following 65535 (0 or 1)
+ * @return position of the block
+ */
+block_index_t block_index_from_number(ushort block_number, block_index_t reference_index, unsigned int rollover);
+
+
+/**
+ * @brief Writes the header (opcode and block number) of a Data packet
+ *
+ * @param packet_struct Data packet structure
+ * @param header address of the array of DATA_PACKET_OFFSET chars, that the header should be stored in
+ */
+void serialize_data_header(tftp_data_packet_t *packet_struct, char *header);
+
+
 /**
  * @brief Serialize a Write or Read request packet structure to a stream of bytes
  *
@@ -189,12 +273,12 @@ string serialize_option_info(option_info_t *option_information);
 
 
 /**
- * @brief Deserialize a stream of bytes into a Write or Read request packet structure
+ * @brief Formats the value of the multicast option (empty in the request, `address,port,mc` in the Oack)
  *
- * @param packet_struct Write or Read request packet structure, that the result should be stored in
- * @param sequence stream of bytes that should be deserialized
+ * @param option_information options structure
+ * @return value of the option
  */
-void deserialize_packet_struct(tftp_rrq_wrq_packet_t *packet_struct, char *sequence);
+string format_multicast_value(option_info_t *option_information);
 
 
 /**
@@ -216,31 +300,82 @@ void deserialize_packet_struct(tftp_ack_packet_t *packet_struct, char *sequence)
 
 
 /**
- * @brief Deserialize a stream of bytes into a Error packet structure
+ * @brief Compares the string with a lowercase string regardless of the letter case (without allocation)
  *
- * @param packet_struct Error packet structure, that the result should be stored in
+ * @param value compared string
+ * @param lowercase lowercase string
+ * @return true if the strings are equal, else false
+ */
+bool equals_ignore_case(string_view value, string_view lowercase);
+
+
+/**
+ * @brief Parses transfer options (pairs of zero terminated name and value), unknown options and options with
+ * a non-numeric value (multicast: value not empty nor `address,port,mc`, resume: value not `bytes,checksum`) are ignored, zero Byte in place of the name
+ * ends the options
+ *
+ * @param sequence options part of the packet
+ * @param size size of the options part in Bytes
+ * @param option_information option structure, that the result should be stored in (without options set before)
+ * @return -1 if OK, ERR_CODE_ILLEGAL_OPERATION if a string is not terminated or an option is repeated
+ */
+int parse_options(const char *sequence, size_t size, option_info_t *option_information);
+
+
+/**
+ * @brief Parses the Write or Read request, strings are viewed in the packet
+ *
+ * @param sequence received packet
+ * @param size size of the packet in Bytes
+ * @param request request view, that the result should be stored in
+ * @return -1 if OK, ERR_CODE_ILLEGAL_OPERATION if the packet is malformed
+ */
+int parse_request(const char *sequence, size_t size, tftp_request_view_t *request);
+
+
+/**
+ * @brief Parses the Error packet, the message is viewed in the packet (message without zero Byte is viewed up to
+ * the end of the packet)
+ *
+ * @param sequence received packet
+ * @param size size of the packet in Bytes
+ * @param error error view, that the result should be stored in
+ * @return -1 if OK, ERR_CODE_ILLEGAL_OPERATION if the packet is malformed
+ */
+int parse_error(const char *sequence, size_t size, tftp_error_view_t *error);
+
+
+/**
+ * @brief Deserialize a stream of bytes into a Write or Read request packet structure (mode is converted to lowercase)
+ *
+ * @param packet_struct Write or Read request packet structure, that the result should be stored in
  * @param sequence stream of bytes that should be deserialized
+ * @param size size of the stream in Bytes
+ * @return -1 if OK, ERR_CODE_ILLEGAL_OPERATION if the packet is malformed
  */
-void deserialize_packet_struct(tftp_error_packet_t *packet_struct, char *sequence);
+int deserialize_packet_struct(tftp_rrq_wrq_packet_t *packet_struct, const char *sequence, size_t size);
 
 
 /**
- * @brief Deserialize a stream of bytes into a Oack packet structure
+ * @brief Deserialize a stream of bytes into a Error packet structure
  *
- * @param packet_struct Oack packet structure, that the result should be stored in
+ * @param packet_struct Error packet structure, that the result should be stored in
  * @param sequence stream of bytes that should be deserialized
+ * @param size size of the stream in Bytes
+ * @return -1 if OK, ERR_CODE_ILLEGAL_OPERATION if the packet is malformed
  */
-void deserialize_packet_struct(tftp_oack_packet_t *packet_struct, char *sequence);
+int deserialize_packet_struct(tftp_error_packet_t *packet_struct, const char *sequence, size_t size);
 
 
 /**
- * @brief Deserialize a stream of bytes into a Data packet structure
+ * @brief Deserialize a stream of bytes into a Oack packet structure
  *
- * @param option_information option structure, that the result should be stored in
- * @param sequence stream of packet bytes that should be deserialized
- * @param options_start_index index of the byte from the stream, that options information starts on
+ * @param packet_struct Oack packet structure, that the result should be stored in
+ * @param sequence stream of bytes that should be deserialized
+ * @param size size of the stream in Bytes
+ * @return -1 if OK, ERR_CODE_ILLEGAL_OPERATION if the packet is malformed
  */
-void deserialize_option_info(option_info_t *option_information, char *sequence, int options_start_index);
+int deserialize_packet_struct(tftp_oack_packet_t *packet_struct, const char *sequence, size_t size);
 
 
 /**
@@ -258,21 +393,29 @@ int check_packet_content(tftp_rrq_wrq_packet_t *packet_struct, string *error_mes
  * @brief Checks if the content of Ack packet is valid
  *
  * @param packet_struct Ack packet structure, that should be checked
- * @param expected_block_number expected data block number that should be acked
+ * @param expected_block_index position of the highest data block that was sent and can be acked
  * @param error_message address of string, where error message will be stored if an error occurs
+ * @param blocks_in_flight number of sent and still unacknowledged data blocks (any of them can be acked)
+ * @param rollover block number following 65535 (0 or 1)
  *
  * @return -1 if OK, else return code according to a possible TFTP error codes
  */
-int check_packet_content(tftp_ack_packet_t *packet_struct, ushort expected_block_number, string *error_message);
+int check_packet_content(tftp_ack_packet_t *packet_struct, block_index_t expected_block_index, string *error_message, unsigned int blocks_in_flight = 1,
+                         unsigned int rollover = DEFAULT_ROLLOVER);
 
 
 /**
  * @brief Checks if the content of Data packet is valid
  *
  * @param packet_struct Data structure, that should be checked
- * @param expected_block_number expected data block number
+ * @param expected_block_index position of the expected data block
  * @param error_message address of string, where error message will be stored if an error occurs
+ * @param window_size negotiated window size (blocks within the window are only out of order, not illegal)
+ * @param rollover block number following 65535 (0 or 1)
  *
  * @return -1 if OK, else return code according to a possible TFTP error codes
  */
-int check_packet_content(tftp_data_packet_t *packet_struct, ushort expected_block_number, string *error_message);
\ No newline at end of file
+int check_packet_content(tftp_data_packet_t *packet_struct, block_index_t expected_block_index, string *error_message, unsigned int window_size = DEFAULT_WINDOW_SIZE,
+                         unsigned int rollover = DEFAULT_ROLLOVER);
+
+#endif
@@ -0,0 +1,273 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-resume.cpp
+ * @brief Resuming of the interrupted transfers (partial file kept with a sidecar recording its verified prefix)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include "tftp-resume.hpp"
+
+
+unsigned int adler32_update(unsigned int checksum, const char *data, size_t size){
+    unsigned long sum_a = checksum & 0xffff;
+    unsigned long sum_b = checksum >> 16;
+
+    while (size > 0){
+        //modulo is counted once per ADLER32_NMAX Bytes
+        size_t part = min(size, (size_t)ADLER32_NMAX);
+        size -= part;
+        for (size_t i = 0; i < part; i++){
+            sum_a += (unsigned char)data[i];
+            sum_b += sum_a;
+        }
+        data += part;
+        sum_a %= ADLER32_MODULUS;
+        sum_b %= ADLER32_MODULUS;
+    }
+
+    return (sum_b << 16) | sum_a;
+}
+
+bool resume_checksum_file(int file_descriptor, off_t offset, unsigned long long size, unsigned int *checksum){
+    unique_ptr<char[]> buffer(new char[RESUME_READ_SIZE]);
+    unsigned int result = ADLER32_INITIAL;
+
+    while (size > 0){
+        ssize_t read_actual = pread(file_descriptor, buffer.get(), min(size, (unsigned long long)RESUME_READ_SIZE), offset);
+        if (read_actual < 0 && errno == EINTR){
+            continue;
+        }
+        else if (read_actual <= 0){
+            return false;       //file is shorter than the prefix
+        }
+        result = adler32_update(result, buffer.get(), read_actual);
+        offset += read_actual;
+        size -= read_actual;
+    }
+
+    *(checksum) = result;
+    return true;
+}
+
+bool resume_is_partial(string path){
+    struct stat sidecar_stat;
+    return stat((path + RESUME_SIDECAR_SUFFIX).c_str(), &sidecar_stat) == 0;
+}
+
+/**
+ * @brief Gets the size and the modification time of the file
+ *
+ * @param path path to the file
+ * @param size address, where the size will be stored
+ * @param modified_ns address, where the modification time in nanoseconds will be stored
+ * @return true if OK, else false
+ */
+static bool resume_file_state(string path, unsigned long long *size, long long *modified_ns){
+    struct stat file_stat;
+    if (stat(path.c_str(), &file_stat) < 0){
+        return false;
+    }
+    *(size) = file_stat.st_size;
+    *(modified_ns) = file_stat.st_mtim.tv_sec * 1000000000LL + file_stat.st_mtim.tv_nsec;
+    return true;
+}
+
+/**
+ * @brief Writes the sidecar of the partial file with the current size and modification time of the file, the sidecar is replaced at once (an interrupted write never
+ * leaves a half written record)
+ *
+ * @param path path to the partial file
+ * @param info recorded progress of the transfer
+ * @return true if OK, else false
+ */
+static bool resume_record(string path, resume_info_t *info){
+    string sidecar_path = path + RESUME_SIDECAR_SUFFIX;
+    string temporary_path = sidecar_path + ".tmp";
+
+    if (!resume_file_state(path, &info->file_size, &info->modified_ns)){
+        return false;
+    }
+
+    ofstream sidecar(temporary_path, ios::trunc);
+    sidecar << "bytes=" << info->bytes << " block=" << info->block << " blksize=" << info->blocksize
+            << " adler32=" << info->checksum << " size=" << info->file_size << " mtime=" << info->modified_ns << "\n";
+    sidecar.close();
+    if (sidecar.fail() || rename(temporary_path.c_str(), sidecar_path.c_str()) < 0){
+        remove(temporary_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+int resume_open(disk_file_t *file, string path, unsigned long long bytes, unsigned int checksum, unsigned int blocksize){
+    int error_number = disk_file_open_append(file, path, bytes);
+    if (error_number != 0){
+        return error_number;
+    }
+    file->is_checksummed = true;
+    file->checksum = checksum;
+
+    resume_info_t info;
+    info.bytes = bytes;
+    info.block = bytes / blocksize;
+    info.blocksize = blocksize;
+    info.checksum = checksum;
+    if (!resume_record(path, &info)){
+        disk_file_close(file);
+        return EIO;
+    }
+    return 0;
+}
+
+bool resume_keep(disk_file_t *file, string path, unsigned int blocksize){
+    int error_number = disk_file_flush(file);
+
+    resume_info_t info;
+    info.bytes = file->offset;
+    info.block = info.bytes / blocksize;
+    info.blocksize = blocksize;
+    info.checksum = file->checksum;
+    disk_file_close(file);
+
+    if (!resume_is_partial(path)){
+        return true;        //file belongs to another transfer
+    }
+    if (error_number != 0 || info.bytes == 0 || !resume_record(path, &info)){
+        resume_discard(path);
+        return false;
+    }
+    return true;
+}
+
+bool resume_read(string path, resume_info_t *info){
+    ifstream sidecar(path + RESUME_SIDECAR_SUFFIX);
+    string record;
+    if (!getline(sidecar, record)){
+        return false;
+    }
+
+    //sidecar without the state of the file (older version) is never verified
+    int fields = sscanf(record.c_str(), "bytes=%llu block=%llu blksize=%u adler32=%u size=%llu mtime=%lld", &info->bytes,
+                        &info->block, &info->blocksize, &info->checksum, &info->file_size, &info->modified_ns);
+    if (fields != 4 && fields != 6){
+        return false;
+    }
+
+    unsigned long long file_size;
+    long long modified_ns;
+    info->is_verified = fields == 6 && resume_file_state(path, &file_size, &modified_ns) &&
+                        file_size == info->file_size && modified_ns == info->modified_ns && info->bytes <= file_size;
+    return true;
+}
+
+/**
+ * @brief Checks the file has the prefix with the checksum
+ *
+ * @param path path to the file
+ * @param bytes size of the prefix
+ * @param checksum expected Adler-32 checksum of the prefix
+ * @return true if the prefix is the same, else false
+ */
+static bool resume_verify_prefix(string path, unsigned long long bytes, unsigned int checksum){
+    int file_descriptor = open(path.c_str(), O_RDONLY);
+    if (file_descriptor < 0){
+        return false;
+    }
+
+    unsigned int file_checksum;
+    bool is_valid = resume_checksum_file(file_descriptor, 0, bytes, &file_checksum) && file_checksum == checksum;
+    close(file_descriptor);
+    return is_valid;
+}
+
+bool resume_load(string path, resume_info_t *info){
+    if (!resume_read(path, info)){
+        return false;
+    }
+
+    //prefix is resumed only when the file still contains the recorded data
+    return info->is_verified || resume_verify_prefix(path, info->bytes, info->checksum);
+}
+
+void resume_discard(string path){
+    remove((path + RESUME_SIDECAR_SUFFIX).c_str());
+}
+
+
+/**
+ * @brief Thread of the checker, verifies the submitted prefixes in order
+ *
+ * @param checker checker structure
+ */
+static void resume_checker_worker(resume_checker_t *checker){
+    unique_lock<mutex> guard(checker->lock);
+    while (true){
+        checker->submitted_signal.wait(guard, [checker]{return checker->stopping || !checker->submitted.empty();});
+        if (checker->stopping){
+            return;
+        }
+
+        shared_ptr<resume_check_t> check = checker->submitted.front();
+        checker->submitted.pop_front();
+
+        guard.unlock();
+        check->is_valid = resume_verify_prefix(check->path, check->bytes, check->checksum);
+        guard.lock();
+
+        //write fails only when the counter is full, the event descriptor is readable then anyway
+        checker->completed.push_back(check);
+        uint64_t count = 1;
+        ssize_t written = write(checker->event_fd, &count, sizeof(count));
+        (void)written;
+    }
+}
+
+bool resume_checker_init(resume_checker_t *checker){
+    checker->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (checker->event_fd < 0){
+        return false;
+    }
+    checker->worker = thread(resume_checker_worker, checker);
+    return true;
+}
+
+void resume_checker_submit(resume_checker_t *checker, shared_ptr<resume_check_t> check){
+    lock_guard<mutex> guard(checker->lock);
+    checker->submitted.push_back(check);
+    checker->submitted_signal.notify_one();
+}
+
+void resume_checker_collect(resume_checker_t *checker, vector<shared_ptr<resume_check_t>> *completed){
+    //counter is reset first, checks completed meanwhile signal it again
+    uint64_t count;
+    ssize_t read_actual = read(checker->event_fd, &count, sizeof(count));
+    (void)read_actual;
+
+    lock_guard<mutex> guard(checker->lock);
+    completed->insert(completed->end(), checker->completed.begin(), checker->completed.end());
+    checker->completed.clear();
+}
+
+resume_checker::~resume_checker(){
+    if (worker.joinable()){
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        submitted_signal.notify_all();
+        worker.join();
+    }
+    if (event_fd >= 0){
+        close(event_fd);
+    }
+}
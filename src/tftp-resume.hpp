@@ -0,0 +1,181 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-resume.hpp
+ * @brief Resuming of the interrupted transfers (partial file kept with a sidecar recording its verified prefix)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_RESUME_HPP
+#define TFTP_RESUME_HPP
+
+#include <sys/types.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "tftp-packet-structures.hpp"
+#include "tftp-disk-io.hpp"
+
+#define RESUME_SIDECAR_SUFFIX ".tftp-resume"       //sidecar is stored next to the partial file
+#define RESUME_READ_SIZE (1024 * 1024)              //prefix of the file is checksummed by reads of this size
+#define ADLER32_MODULUS 65521
+#define ADLER32_NMAX 5552                           //Bytes summed before the sums could overflow 32 bits
+
+
+//Progress of the interrupted transfer recorded in the sidecar
+typedef struct resume_info {
+    unsigned long long bytes = 0;                   //prefix of the file written in order, the transfer continues behind it
+    unsigned long long block = 0;                   //last acknowledged block of the prefix (whole blocks of the block size)
+    unsigned int blocksize = DEFAULT_BLOCK_SIZE;
+    unsigned int checksum = ADLER32_INITIAL;        //Adler-32 checksum of the prefix
+    unsigned long long file_size = 0;               //size of the partial file, when the sidecar was written
+    long long modified_ns = -1;                     //modification time of the partial file, when the sidecar was written
+    bool is_verified = false;                       //partial file wasn't changed since the sidecar was written
+} resume_info_t;
+
+
+//Verification of the prefix of the file (Adler-32 checksum counted by the thread of the checker)
+typedef struct resume_check {
+    int owner = -1;                                 //identifier of the requester (transfer socket of the session)
+    string path;
+    unsigned long long bytes = 0;                   //size of the prefix
+    unsigned int checksum = ADLER32_INITIAL;        //expected checksum of the prefix
+    bool is_valid = false;                          //file has the prefix (set, when the check is completed)
+} resume_check_t;
+
+
+//Thread verifying the prefixes in the background, completed checks are announced by the event descriptor
+typedef struct resume_checker {
+    int event_fd = -1;                              //readable, when there are completed checks
+    thread worker;
+    mutex lock;
+    condition_variable submitted_signal;
+    deque<shared_ptr<resume_check_t>> submitted;
+    vector<shared_ptr<resume_check_t>> completed;
+    bool stopping = false;
+
+    ~resume_checker();
+} resume_checker_t;
+
+
+/**
+ * @brief Adds the data to the Adler-32 checksum (rolling checksum of the prefix of the file)
+ *
+ * @param checksum checksum of the preceding data (ADLER32_INITIAL at the beginning)
+ * @param data added data
+ * @param size size of the data in Bytes
+ * @return checksum including the data
+ */
+unsigned int adler32_update(unsigned int checksum, const char *data, size_t size);
+
+
+/**
+ * @brief Counts the Adler-32 checksum of the part of the file (the offset of the descriptor is not changed)
+ *
+ * @param file_descriptor descriptor of the file opened for reading
+ * @param offset first Byte of the part
+ * @param size size of the part in Bytes
+ * @param checksum address, where the checksum will be stored
+ * @return true if OK, false if the file is shorter or it can't be read
+ */
+bool resume_checksum_file(int file_descriptor, off_t offset, unsigned long long size, unsigned int *checksum);
+
+
+/**
+ * @brief Checks whether the file is a partial file of an interrupted transfer (it has the sidecar)
+ *
+ * @param path path to the file
+ * @return true if the sidecar exists, else false
+ */
+bool resume_is_partial(string path);
+
+
+/**
+ * @brief Opens the file of the transfer, that continues behind the prefix (0 from the beginning). The rest of the file
+ * is cut off, written data are added to the rolling checksum of the prefix and the sidecar records the prefix, until
+ * the transfer is finished (the file of a killed process is resumed from the prefix).
+ *
+ * @param file file structure
+ * @param path path to the file
+ * @param bytes size of the prefix in Bytes
+ * @param checksum Adler-32 checksum of the prefix
+ * @param blocksize block size of the transfer
+ * @return 0 if OK, else errno
+ */
+int resume_open(disk_file_t *file, string path, unsigned long long bytes, unsigned int checksum, unsigned int blocksize);
+
+
+/**
+ * @brief Closes the file of the interrupted transfer opened by resume_open, all data written in order
+ * are recorded in the sidecar with their rolling checksum. File replaced meanwhile by another transfer
+ * (its sidecar was removed) is left untouched.
+ *
+ * @param file file structure
+ * @param path path to the file
+ * @param blocksize block size of the transfer
+ * @return true if the file is kept, false if it should be removed (no data or a failed write)
+ */
+bool resume_keep(disk_file_t *file, string path, unsigned int blocksize);
+
+
+/**
+ * @brief Reads the sidecar of the partial file, the recorded prefix is verified, when the size and the modification
+ * time of the file are the same as when the sidecar was written (the prefix isn't read)
+ *
+ * @param path path to the partial file
+ * @param info address, where the recorded progress will be stored
+ * @return true if the sidecar was read, false if it is missing or invalid
+ */
+bool resume_read(string path, resume_info_t *info);
+
+
+/**
+ * @brief Reads the sidecar of the partial file and verifies the recorded prefix against the file (the prefix
+ * is checksummed only when the file was changed since the sidecar was written)
+ *
+ * @param path path to the partial file
+ * @param info address, where the recorded progress will be stored
+ * @return true if the prefix can be resumed, false if the sidecar is missing or invalid or the prefix was changed
+ */
+bool resume_load(string path, resume_info_t *info);
+
+
+/**
+ * @brief Starts the thread of the checker
+ *
+ * @param checker checker structure
+ * @return true if OK, else false
+ */
+bool resume_checker_init(resume_checker_t *checker);
+
+
+/**
+ * @brief Submits the check to the thread of the checker
+ *
+ * @param checker checker structure
+ * @param check verified prefix
+ */
+void resume_checker_submit(resume_checker_t *checker, shared_ptr<resume_check_t> check);
+
+
+/**
+ * @brief Takes the completed checks (called, when the event descriptor is readable)
+ *
+ * @param checker checker structure
+ * @param completed address, where the completed checks will be stored
+ */
+void resume_checker_collect(resume_checker_t *checker, vector<shared_ptr<resume_check_t>> *completed);
+
+
+/**
+ * @brief Removes the sidecar (the file was transferred completely or it is replaced)
+ *
+ * @param path path to the file
+ */
+void resume_discard(string path);
+
+#endif
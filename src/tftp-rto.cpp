@@ -0,0 +1,94 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-rto.cpp
+ * @brief Adaptive retransmission timeout (RFC 6298 round-trip time estimator)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include "tftp-rto.hpp"
+#include "tftp-communication.hpp"
+
+
+unsigned long get_timeout_us(option_info_t *options){
+    if (options->utimeout_interval != 0){
+        return options->utimeout_interval;
+    }
+    return (unsigned long)options->timeout_interval * 1000000;
+}
+
+/**
+ * @brief Updates the estimate by the measured round-trip time (RFC 6298, section 2)
+ *
+ * @param rto estimator structure
+ * @param rtt_us measured round-trip time in microseconds
+ */
+static void rto_update(rto_estimator_t *rto, unsigned long rtt_us){
+    if (rto->rto_us == 0){
+        //first measurement
+        rto->srtt_us = rtt_us;
+        rto->rttvar_us = rtt_us / 2;
+    }
+    else{
+        //RTTVAR = 3/4 * RTTVAR + 1/4 * |SRTT - R|, SRTT = 7/8 * SRTT + 1/8 * R
+        unsigned long deviation = rto->srtt_us > rtt_us ? rto->srtt_us - rtt_us : rtt_us - rto->srtt_us;
+        rto->rttvar_us = (3 * rto->rttvar_us + deviation) / 4;
+        rto->srtt_us = (7 * rto->srtt_us + rtt_us) / 8;
+    }
+
+    rto->rto_us = max((unsigned long)RTO_MIN_US, rto->srtt_us + max((unsigned long)RTO_GRANULARITY_US, RTO_VARIANCE_MULTIPLIER * rto->rttvar_us));
+}
+
+void rto_sample_start(rto_estimator_t *rto, block_index_t block_index){
+    if (rto == NULL || rto->sample_pending){
+        return;
+    }
+
+    rto->sample_pending = true;
+    rto->sample_block_index = block_index;
+    rto->sample_start = chrono::steady_clock::now();
+}
+
+void rto_sample_finish(rto_estimator_t *rto, block_index_t block_index){
+    if (rto == NULL || !rto->sample_pending || block_index < rto->sample_block_index){
+        return;
+    }
+
+    auto rtt = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - rto->sample_start);
+    rto->sample_pending = false;
+    rto_update(rto, rtt.count());
+}
+
+void rto_sample_cancel(rto_estimator_t *rto){
+    if (rto != NULL){
+        rto->sample_pending = false;
+    }
+}
+
+unsigned long rto_timeout_us(rto_estimator_t *rto, option_info_t *options, int times_retransmitted){
+    unsigned long timeout_limit = get_timeout_us(options);
+    unsigned long backoff_limit = timeout_limit * (times_retransmitted != 0 ? EXPONENTIAL_BACKOFF_MULTIPLIER * times_retransmitted : 1);
+    if (rto == NULL){
+        return backoff_limit;
+    }
+
+    //Exponential backoff of the estimated timeout
+    unsigned long timeout = min(rto->rto_us != 0 ? rto->rto_us : (unsigned long)RTO_INITIAL_US, timeout_limit);
+    return min(timeout << min(times_retransmitted, RTO_MAX_BACKOFF_SHIFT), backoff_limit);
+}
+
+bool rto_give_up(rto_estimator_t *rto, option_info_t *options, int times_retransmitted){
+    if (times_retransmitted < MAX_RETRANSMIT_ATTEMPTS){
+        return false;
+    }
+
+    unsigned long waited_us = 0;
+    unsigned long patience_us = 0;
+    for (int i = 0; i < times_retransmitted; i++){
+        waited_us += rto_timeout_us(rto, options, i);
+    }
+    for (int i = 0; i < MAX_RETRANSMIT_ATTEMPTS; i++){
+        patience_us += rto_timeout_us(NULL, options, i);
+    }
+    return waited_us >= patience_us;
+}
@@ -0,0 +1,95 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-rto.hpp
+ * @brief Adaptive retransmission timeout (RFC 6298 round-trip time estimator)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_RTO_HPP
+#define TFTP_RTO_HPP
+
+#include <chrono>
+#include "tftp-packet-structures.hpp"
+
+#define RTO_INITIAL_US 1000000      //retransmission timeout before the first measurement
+#define RTO_MIN_US 10000            //lower bound of the retransmission timeout
+#define RTO_GRANULARITY_US 1000     //clock granularity (timeouts have millisecond resolution)
+#define RTO_VARIANCE_MULTIPLIER 4   //K from RFC 6298
+#define RTO_MAX_BACKOFF_SHIFT 20    //doubling stops long before the timeout could overflow
+
+
+typedef chrono::steady_clock::time_point rto_time_t;
+
+
+//Structure containing round-trip time estimate of a single transfer session
+typedef struct rto_estimator {
+    unsigned long srtt_us = 0;                  //smoothed round-trip time
+    unsigned long rttvar_us = 0;                //round-trip time variation
+    unsigned long rto_us = 0;                   //retransmission timeout, 0 until the first measurement
+
+    bool sample_pending = false;                //a round trip is being measured
+    block_index_t sample_block_index = 0;       //position of the block, whose reception ends the measurement
+    rto_time_t sample_start;
+} rto_estimator_t;
+
+
+/**
+ * @brief Gets the negotiated timeout (utimeout takes precedence over timeout)
+ *
+ * @param options options associated to the current transfer
+ * @return timeout in microseconds
+ */
+unsigned long get_timeout_us(option_info_t *options);
+
+
+/**
+ * @brief Starts measuring of the round-trip time, when no measurement is running (one sample per round trip)
+ *
+ * @param rto estimator structure (nothing is done if NULL)
+ * @param block_index position of the block (Ack or Data), whose reception ends the measurement
+ */
+void rto_sample_start(rto_estimator_t *rto, block_index_t block_index);
+
+
+/**
+ * @brief Ends the measurement if the received block covers the measured one and updates the estimate
+ *
+ * @param rto estimator structure (nothing is done if NULL)
+ * @param block_index position of the received in-order block (Ack or Data)
+ */
+void rto_sample_finish(rto_estimator_t *rto, block_index_t block_index);
+
+
+/**
+ * @brief Drops the running measurement, round trip of a retransmitted packet is ambiguous (Karn's algorithm)
+ *
+ * @param rto estimator structure (nothing is done if NULL)
+ */
+void rto_sample_cancel(rto_estimator_t *rto);
+
+
+/**
+ * @brief Gets the time to wait for a response. Estimated timeout is clamped by the negotiated timeout
+ * and doubled with every retransmission (never longer than the backoff of the negotiated timeout).
+ *
+ * @param rto estimator structure (negotiated timeout is used if NULL)
+ * @param options options associated to the current transfer
+ * @param times_retransmitted number of retransmissions of the current packets
+ * @return timeout in microseconds
+ */
+unsigned long rto_timeout_us(rto_estimator_t *rto, option_info_t *options, int times_retransmitted);
+
+
+/**
+ * @brief Checks whether the transfer should be abandoned. Short estimated timeouts are retransmitted more times,
+ * so the peer is given at least the time of the retransmissions with the negotiated timeout.
+ *
+ * @param rto estimator structure (negotiated timeout is used if NULL)
+ * @param options options associated to the current transfer
+ * @param times_retransmitted number of retransmissions of the current packets
+ * @return true if the retransmissions should end, else false
+ */
+bool rto_give_up(rto_estimator_t *rto, option_info_t *options, int times_retransmitted);
+
+#endif
@@ -0,0 +1,1326 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-server-engine.cpp
+ * @brief Event-driven server engine (all transfer sessions as non-blocking state machines in one process)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <thread>
+#include "tftp-server-engine.hpp"
+#include "tftp-metrics.hpp"
+#include "tftp-multicast.hpp"
+#include "tftp-resume.hpp"
+#include "tftp-admission.hpp"
+
+
+namespace fs = std::filesystem;
+
+
+static set<unsigned int> multicast_ports_used;      //ports of the multicast groups of all workers
+static pthread_mutex_t multicast_ports_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * @brief Sets the retransmission deadline of the session (estimated timeout with exponential backoff as in recvfrom_timeout,
+ * dallying session waits the whole negotiated timeout)
+ *
+ * @param engine engine structure
+ * @param session session structure
+ */
+static void session_arm_timer(engine_t *engine, engine_session_t *session){
+    engine->timers.erase({session->deadline, session->socket});
+
+    unsigned long current_timeout_us;
+    if (session->state == SESSION_DALLYING){
+        current_timeout_us = get_timeout_us(&session->options);
+    }
+    else{
+        current_timeout_us = rto_timeout_us(&session->rto, &session->options, session->times_retransmitted);
+    }
+
+    session->deadline = chrono::steady_clock::now() + chrono::microseconds(current_timeout_us);
+    engine->timers.insert({session->deadline, session->socket});
+}
+
+
+/**
+ * @brief Deschedules the session until the tokens of its bandwidth limits refill (the deadline is the end of the wait,
+ * the retransmission timeout is set again, when the whole window is sent)
+ *
+ * @param engine engine structure
+ * @param session session structure
+ * @param delay_us time until the next Data packet can be sent
+ */
+static void session_arm_throttle(engine_t *engine, engine_session_t *session, long long delay_us){
+    engine->timers.erase({session->deadline, session->socket});
+
+    shaper_throttle_begin(&session->shaper);
+    session->is_throttled = true;
+    session->deadline = chrono::steady_clock::now() + chrono::microseconds(max(delay_us, 1LL));
+    engine->timers.insert({session->deadline, session->socket});
+}
+
+
+/**
+ * @brief Reserves a port for the new multicast group, groups of all workers use different ports
+ *
+ * @param first_port multicast port given to the server
+ * @return reserved port, 0 if all ports of the groups are used
+ */
+static unsigned int multicast_port_acquire(unsigned int first_port){
+    unsigned int reserved_port = 0;
+
+    pthread_mutex_lock(&multicast_ports_lock);
+    for (unsigned int port = first_port; port < first_port + ENGINE_MULTICAST_MAX_GROUPS && port <= 65535; port++){
+        if (multicast_ports_used.insert(port).second){
+            reserved_port = port;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&multicast_ports_lock);
+
+    return reserved_port;
+}
+
+
+/**
+ * @brief Releases the port of the ended multicast group
+ *
+ * @param port reserved port
+ */
+static void multicast_port_release(unsigned int port){
+    pthread_mutex_lock(&multicast_ports_lock);
+    multicast_ports_used.erase(port);
+    pthread_mutex_unlock(&multicast_ports_lock);
+}
+
+
+/**
+ * @brief Ends the multicast group, that has no more clients
+ *
+ * @param engine engine structure
+ * @param group group structure
+ */
+static void multicast_group_close(engine_t *engine, engine_multicast_group_t *group){
+    close(group->connection_information.socket);
+    file_source_close(&group->file_source);
+
+    multicast_port_release(ntohs(group->group_address.sin_port));
+
+    engine->multicast_groups.erase(group->key);
+}
+
+
+/**
+ * @brief Makes the oldest client of the group the master client (by the Oack with the flag set), the group
+ * continues sending from the first block the new master client misses
+ *
+ * @param engine engine structure
+ * @param group group structure without the master client
+ */
+static void multicast_elect_master(engine_t *engine, engine_multicast_group_t *group){
+    if (group->members.empty()){
+        return;
+    }
+
+    engine_session_t *session = engine->sessions[group->members.front()].get();
+    group->master_socket = session->socket;
+    session->options.multicast_master = true;
+
+    tftp_oack_packet_t oack_packet_struct;
+    oack_packet_struct.options = session->options;
+    session->packets_in_flight = {serialize_packet_struct(&oack_packet_struct)};
+    send_packets(&session->connection_information, session->packets_in_flight);
+
+    session->state = SESSION_OACK_SENT;
+    session->times_retransmitted = 0;
+    rto_sample_start(&session->rto, 0);
+    session_arm_timer(engine, session);
+}
+
+
+/**
+ * @brief Removes the client from its multicast group, the master client is replaced by the next client,
+ * group without clients is closed
+ *
+ * @param engine engine structure
+ * @param session session of the client
+ */
+static void multicast_leave(engine_t *engine, engine_session_t *session){
+    engine_multicast_group_t *group = session->multicast_group;
+    session->multicast_group = NULL;
+
+    group->members.erase(find(group->members.begin(), group->members.end(), session->socket));
+    if (group->master_socket == session->socket){
+        group->master_socket = -1;
+        multicast_elect_master(engine, group);
+    }
+
+    if (group->members.empty()){
+        multicast_group_close(engine, group);
+    }
+}
+
+
+/**
+ * @brief Ends the session, closes its socket and files (incomplete uploaded file is removed or kept with its sidecar,
+ * when the resume option was negotiated)
+ *
+ * @param engine engine structure
+ * @param session session structure
+ */
+static void session_close(engine_t *engine, engine_session_t *session){
+    int session_socket = session->socket;
+
+    engine->timers.erase({session->deadline, session_socket});
+    epoll_ctl(engine->epoll_fd, EPOLL_CTL_DEL, session_socket, NULL);
+    close(session_socket);
+
+    if (session->multicast_group != NULL){
+        multicast_leave(engine, session);
+    }
+
+    file_source_close(&session->file_source);
+    if (disk_file_is_open(&session->file_write)){
+        //removing invalid file, when the transfer was not finished
+        if (!session->options.option_resume){
+            disk_file_close(&session->file_write);
+            remove(session->file_path.c_str());
+        }
+        else if (!resume_keep(&session->file_write, session->file_path, session->options.blocksize)){
+            remove(session->file_path.c_str());
+        }
+    }
+
+    metrics_session_end(session->is_complete, session->started);
+    admission_session_end(&session->client_address);
+    if (session->connection_information.shaper != NULL){
+        shaper_throttle_end(&session->shaper);
+        log_shaper_usage(&session->shaper);
+    }
+    buffer_pool_release(&session->buffers);
+    engine->sessions.erase(session_socket);
+
+    //summary of the I/O system calls, the cache and the buffers, when all transfers are done
+    if (engine->sessions.empty()){
+        log_io_stats(get_io_stats());
+        log_file_cache_stats();
+        log_buffer_usage(NULL);
+    }
+}
+
+
+/**
+ * @brief Sends the error packet to the client (without waiting, engine never blocks) and ends the session
+ *
+ * @param engine engine structure
+ * @param session session structure
+ * @param error_code error code to include to the packet
+ * @param error_message error message to include to the packet
+ */
+static void session_fail(engine_t *engine, engine_session_t *session, int error_code, string error_message){
+    send_error_packet(&session->connection_information, error_code, error_message, DEFAULT_TIMEOUT, false);
+    session_close(engine, session);
+}
+
+
+/**
+ * @brief Sends all packets waiting for acknowledgement again
+ *
+ * @param session session structure
+ */
+static void session_resend(engine_session_t *session){
+    rto_sample_cancel(&session->rto);     //round trip of a retransmitted packet is ambiguous
+
+    if (session->state == SESSION_SENDING){
+        send_data_blocks(&session->connection_information, &session->data_window);
+    }
+    else if (session->state == SESSION_MULTICAST){
+        send_data_blocks(&session->multicast_group->connection_information, &session->multicast_group->data_window);
+    }
+    else{
+        send_packets(&session->connection_information, session->packets_in_flight);
+    }
+}
+
+
+/**
+ * @brief Sends the error packet to all clients of the group and ends their sessions (the group is closed with
+ * the last one, no new master client is elected)
+ *
+ * @param engine engine structure
+ * @param group group structure
+ * @param error_code error code to include to the packets
+ * @param error_message error message to include to the packets
+ */
+static void multicast_group_fail(engine_t *engine, engine_multicast_group_t *group, int error_code, string error_message){
+    group->master_socket = -1;
+
+    vector<int> members(group->members.begin(), group->members.end());
+    for (int member_socket : members){
+        session_fail(engine, engine->sessions[member_socket].get(), error_code, error_message);
+    }
+}
+
+
+/**
+ * @brief Ends the sending session (or all sessions of its multicast group), when the blocks of its file can't be sent,
+ * because the mapped file was truncated
+ *
+ * @param engine engine structure
+ * @param session session structure
+ * @return true if the session was ended, else false
+ */
+static bool session_end_failed_source(engine_t *engine, engine_session_t *session){
+    if (session->multicast_group != NULL){
+        engine_multicast_group_t *group = session->multicast_group;
+        if (!group->file_source.is_failed && !group->data_window.is_failed){
+            return false;
+        }
+        multicast_group_fail(engine, group, ERR_CODE_NOT_DEF, "File was truncated during the transfer");
+        return true;
+    }
+
+    if (!session->file_source.is_failed && !session->data_window.is_failed){
+        return false;
+    }
+    session_fail(engine, session, ERR_CODE_NOT_DEF, "File was truncated during the transfer");
+    return true;
+}
+
+
+/**
+ * @brief Reads and sends data blocks until the window is full, ends the session when the whole file is acked
+ *
+ * @param engine engine structure
+ * @param session session structure
+ */
+static void session_fill_window(engine_t *engine, engine_session_t *session){
+    data_window_t *window = &session->data_window;
+    shaper_session_t *shaper = session->connection_information.shaper;
+    unsigned int datagram_size = session->options.blocksize + DATA_PACKET_OFFSET;
+
+    //new blocks of the window are sent at once, shaped session sends only the blocks its tokens allow
+    unsigned int allowed_blocks = shaper_allowed_datagrams(shaper, datagram_size);
+    unsigned int first_new_block = window->count;
+    while (window->count < session->options.window_size && !session->last_block_sent && allowed_blocks-- > 0){
+        data_block_t *block = data_window_push(window, block_number_from_index(session->next_block_index, session->options.rollover));
+        file_source_load_block(&session->file_source, block, session->next_block_index++ - 1, session->options.blocksize);
+
+        //end transfer if number of sent data Bytes is lovwer than block size
+        session->last_block_sent = block->payload_size < session->options.blocksize;
+    }
+    if (first_new_block < window->count && !session->file_source.is_failed){
+        send_data_blocks(&session->connection_information, window, first_new_block);
+        rto_sample_start(&session->rto, session->next_block_index - 1);
+    }
+    if (session_end_failed_source(engine, session)){
+        return;
+    }
+
+    if (window->count == 0 && session->last_block_sent){
+        session->is_complete = true;
+        session_close(engine, session);      //whole file was sent and acked
+        return;
+    }
+
+    //rest of the window is sent, when the tokens refill (the client acknowledges only the whole window)
+    if (window->count < session->options.window_size && !session->last_block_sent){
+        session_arm_throttle(engine, session, shaper_delay_us(shaper, datagram_size));
+        return;
+    }
+
+    shaper_throttle_end(shaper);
+    session->is_throttled = false;
+    session_arm_timer(engine, session);
+}
+
+
+/**
+ * @brief Reads and sends data blocks to the group until the window is full
+ *
+ * @param engine engine structure
+ * @param group group structure
+ * @param master session of the master client, that the retransmission timeout belongs to
+ */
+static void multicast_fill_window(engine_t *engine, engine_multicast_group_t *group, engine_session_t *master){
+    data_window_t *window = &group->data_window;
+
+    //every block is read once for all clients of the group
+    unsigned int first_new_block = window->count;
+    while (window->count < group->options.window_size && !group->last_block_sent){
+        data_block_t *block = data_window_push(window, block_number_from_index(group->next_block_index, group->options.rollover));
+        file_source_load_block(&group->file_source, block, group->next_block_index++ - 1, group->options.blocksize);
+        group->last_block_sent = group->next_block_index > group->last_block_index;
+    }
+    if (first_new_block < window->count && !group->file_source.is_failed){
+        send_data_blocks(&group->connection_information, window, first_new_block);
+        rto_sample_start(&master->rto, group->next_block_index - 1);
+    }
+    if (session_end_failed_source(engine, master)){
+        return;
+    }
+
+    session_arm_timer(engine, master);
+}
+
+
+/**
+ * @brief Processes the Ack packet received by the session of the multicast group. Ack of the last block ends
+ * the session of any client, other acks of the master client move the window of the group.
+ *
+ * @param engine engine structure
+ * @param session session structure
+ * @param ack_packet received Ack packet
+ */
+static void multicast_handle_ack(engine_t *engine, engine_session_t *session, tftp_ack_packet_t *ack_packet){
+    engine_multicast_group_t *group = session->multicast_group;
+    bool is_master = group->master_socket == session->socket;
+
+    if (ack_packet->opcode != ACK_OPCODE){
+        session_fail(engine, session, ERR_CODE_ILLEGAL_OPERATION, "Expected ACK packet");
+        return;
+    }
+
+    //files of the groups have at most 65535 blocks, so the block number is the index of the block
+    block_index_t acked_block_index = ack_packet->block_number;
+    if (acked_block_index >= group->last_block_index){
+        session->is_complete = true;
+        session_close(engine, session);      //client has the whole file, the next client becomes the master
+        return;
+    }
+    if (!is_master){
+        return;
+    }
+
+    bool is_restarted = session->state == SESSION_OACK_SENT || acked_block_index + 1 < group->current_block_index ||
+                        acked_block_index >= group->next_block_index;
+
+    rto_sample_finish(&session->rto, acked_block_index);
+    session->packets_in_flight.clear();
+    session->state = SESSION_MULTICAST;
+    session->times_retransmitted = 0;
+
+    if (is_restarted){
+        //new master client misses other blocks - the group continues from its first missing block
+        data_window_pop(&group->data_window, group->data_window.count);
+        group->current_block_index = acked_block_index + 1;
+        group->next_block_index = acked_block_index + 1;
+        group->last_block_sent = false;
+        group->window_resent = false;
+    }
+    else if (acked_block_index >= group->current_block_index){
+        //sliding the window behind the acked block (ack is cumulative)
+        data_window_pop(&group->data_window, acked_block_index - group->current_block_index + 1);
+        group->current_block_index = acked_block_index + 1;
+        group->window_resent = false;
+
+        //master client reported a lost block of the window - going back to the last acked block
+        if (group->data_window.count != 0){
+            session_resend(session);
+            group->window_resent = true;
+        }
+    }
+    else if (!group->window_resent){
+        //master client reported a loss of the oldest block of the window (only once per ack)
+        session_resend(session);
+        group->window_resent = true;
+    }
+
+    multicast_fill_window(engine, group, session);
+}
+
+
+/**
+ * @brief Processes the Ack packet received by RRQ session
+ *
+ * @param engine engine structure
+ * @param session session structure
+ * @param connection_information connection information of the received packet
+ * @param buffer received packet data
+ */
+static void session_handle_ack(engine_t *engine, engine_session_t *session, connection_info_t *connection_information, char *buffer){
+    string error_message;
+
+    tftp_ack_packet_t ack_packet;
+    deserialize_packet_struct(&ack_packet, buffer);
+    log_ack(connection_information, &ack_packet);
+
+    if (session->multicast_group != NULL){
+        multicast_handle_ack(engine, session, &ack_packet);
+        return;
+    }
+
+    if (session->state == SESSION_OACK_SENT){
+        int return_code = check_packet_content(&ack_packet, 0, &error_message);
+        if (return_code == ERR_CODE_ILLEGAL_OPERATION){
+            session_fail(engine, session, return_code, error_message);
+            return;
+        }
+
+        //options acknowledged, starting the data transfer
+        rto_sample_finish(&session->rto, 0);
+        session->packets_in_flight.clear();
+        session->state = SESSION_SENDING;
+        session->times_retransmitted = 0;
+        session_fill_window(engine, session);
+        return;
+    }
+
+    block_index_t expected_block_index = session->next_block_index - 1;
+    block_index_t acked_block_index = block_index_from_number(ack_packet.block_number, expected_block_index, session->options.rollover);
+    int return_code = check_packet_content(&ack_packet, expected_block_index, &error_message, session->data_window.count, session->options.rollover);
+    if (return_code == ERR_CODE_ILLEGAL_OPERATION){
+        session_fail(engine, session, return_code, error_message);
+        return;
+    }
+    else if (return_code == PACKET_OK_CODE){
+        //sliding the window behind the acked block (ack is cumulative)
+        rto_sample_finish(&session->rto, acked_block_index);
+        data_window_pop(&session->data_window, acked_block_index - session->current_block_index + 1);
+        session->current_block_index = acked_block_index + 1;
+        session->window_resent = false;
+        session->times_retransmitted = 0;
+
+        //receiver reported a lost block of the window - going back to the last acked block
+        if (session->data_window.count != 0){
+            session_resend(session);
+            session->window_resent = true;
+        }
+
+        session_fill_window(engine, session);
+    }
+    else if (session->options.window_size != DEFAULT_WINDOW_SIZE && !session->window_resent &&
+             acked_block_index == session->current_block_index - 1){
+        //receiver reported a loss of the oldest block of the window (only once per ack, Sorcerer's Apprentice Syndrome)
+        session_resend(session);
+        session->window_resent = true;
+    }
+}
+
+
+/**
+ * @brief Processes the Data packet received by WRQ session
+ *
+ * @param engine engine structure
+ * @param session session structure
+ * @param connection_information connection information of the received packet
+ * @param buffer received packet data
+ * @param bytes_rx size of the received packet
+ */
+static void session_handle_data(engine_t *engine, engine_session_t *session, connection_info_t *connection_information, char *buffer, int bytes_rx){
+    string error_message;
+
+    tftp_data_packet_t data_packet;
+    deserialize_packet_struct(&data_packet, buffer);
+    log_data(connection_information, &data_packet);
+
+    if (session->state == SESSION_DALLYING){
+        //last ack was lost, the client sent the last data again
+        if (data_packet.opcode == DATA_OPCODE && session->times_retransmitted < MAX_RETRANSMIT_ATTEMPTS){
+            session_resend(session);
+            session->times_retransmitted++;
+        }
+        return;
+    }
+
+    int return_code = check_packet_content(&data_packet, session->expected_block_index, &error_message, session->options.window_size, session->options.rollover);
+    ushort last_acked_block_number = block_number_from_index(session->expected_block_index - 1, session->options.rollover);
+    if (return_code == ERR_CODE_ILLEGAL_OPERATION){
+        session_fail(engine, session, return_code, error_message);
+        return;
+    }
+    else if (return_code == OUT_OF_ORDER_PACKET){
+        //block of the window was lost - acknowledging the last in-order block once, client goes back to it
+        if (!session->gap_acked){
+            rto_sample_cancel(&session->rto);
+            session->packets_in_flight = {send_ack(&session->connection_information, last_acked_block_number)};
+            session->gap_acked = true;
+            session->received_in_window = 0;
+        }
+        return;
+    }
+    else if (return_code == DUPLICATED_PACKET){
+        //retransmitting the ack only for the last acked block (whole window is sent again)
+        if (data_packet.block_number == last_acked_block_number){
+            session_resend(session);
+        }
+        return;
+    }
+
+    rto_sample_finish(&session->rto, session->expected_block_index);
+
+    bool is_last_block = bytes_rx < (int)(session->options.blocksize + DATA_PACKET_OFFSET);
+    int error_number = write_data_block(&session->file_write, data_packet.data, bytes_rx - DATA_PACKET_OFFSET, session->mode, &session->netascii_state, is_last_block,
+                                        session->buffers.send);
+    if (error_number != 0){
+        send_disk_error(&session->connection_information, error_number, DEFAULT_TIMEOUT, false);
+        session_close(engine, session);
+        return;
+    }
+
+    session->gap_acked = false;
+    session->received_in_window++;
+    session->times_retransmitted = 0;
+
+    //acknowledging whole window (or the last block) at once
+    ushort acked_block_number = block_number_from_index(session->expected_block_index, session->options.rollover);
+    if (session->received_in_window >= session->options.window_size || is_last_block){
+        session->packets_in_flight = {send_ack(&session->connection_information, acked_block_number)};
+        session->received_in_window = 0;
+        rto_sample_start(&session->rto, session->expected_block_index + 1);
+    }
+    else{
+        //prepared for retransmission on timeout, acknowledges all blocks received so far
+        tftp_ack_packet_t ack_packet_struct;
+        ack_packet_struct.block_number = acked_block_number;
+        session->packets_in_flight = {serialize_packet_struct(&ack_packet_struct)};
+    }
+
+    session->expected_block_index++;
+
+    if (is_last_block){
+        disk_file_close(&session->file_write);
+        resume_discard(session->file_path);     //partial file of another transfer could be replaced meanwhile
+        session->state = SESSION_DALLYING;
+        session->is_complete = true;
+    }
+
+    session_arm_timer(engine, session);
+}
+
+
+/**
+ * @brief Handles the retransmission timeout of the session
+ *
+ * @param engine engine structure
+ * @param session session structure
+ */
+static void session_handle_timeout(engine_t *engine, engine_session_t *session){
+    if (session->is_throttled){
+        //tokens of the session refilled
+        session_fill_window(engine, session);
+        return;
+    }
+
+    if (session->state == SESSION_DALLYING){
+        //last ack was most probably successfully delivered
+        session_close(engine, session);
+        return;
+    }
+
+    if (rto_give_up(&session->rto, &session->options, session->times_retransmitted)){
+        cout << "recvfrom - timeout\n";
+        metrics_count_timeout();
+        session_close(engine, session);
+        return;
+    }
+
+    session_resend(session);
+    metrics_count_retransmission();
+    if ((session->state == SESSION_SENDING || session->state == SESSION_MULTICAST) && session_end_failed_source(engine, session)){
+        return;
+    }
+    session->times_retransmitted++;
+    session_arm_timer(engine, session);
+}
+
+
+/**
+ * @brief Adds the client to the multicast group of the file (group is created for the first client, that
+ * becomes the master client), sets the multicast option of the session
+ *
+ * @param engine engine structure
+ * @param session session of the client with the opened file and negotiated options
+ * @return true if the client joined the group, false if the file is sent by unicast
+ */
+static bool multicast_join(engine_t *engine, engine_session_t *session){
+    //blocks of the group are addressed by their index, the file has to be mapped
+    block_index_t last_block_index = session->file_source.file_size / session->options.blocksize + 1;
+    if (!session->file_source.is_mapped || last_block_index > ENGINE_MULTICAST_MAX_BLOCKS){
+        return false;
+    }
+
+    //only clients with the same options can share the Data
+    string key = session->file_path + '\x00' + to_string(session->options.blocksize) + '\x00' +
+                 to_string(session->options.window_size) + '\x00' + to_string(session->options.rollover);
+
+    engine_multicast_group_t *group;
+    auto group_it = engine->multicast_groups.find(key);
+    if (group_it != engine->multicast_groups.end()){
+        group = group_it->second.get();
+        file_source_close(&session->file_source);       //blocks are read from the file of the group
+    }
+    else{
+        unsigned int port = multicast_port_acquire(engine->server_options.multicast_port);
+        if (port == 0){
+            return false;
+        }
+        int group_socket = create_multicast_sender(&session->client_address);
+        if (group_socket < 0){
+            multicast_port_release(port);
+            return false;
+        }
+
+        unique_ptr<engine_multicast_group_t> group_owner(new engine_multicast_group_t());
+        group = group_owner.get();
+        group->key = key;
+        memset(&group->group_address, 0, sizeof(group->group_address));
+        group->group_address.sin_family = AF_INET;
+        group->group_address.sin_port = htons(port);
+        group->group_address.sin_addr.s_addr = engine->server_options.multicast_address;
+        group->connection_information.socket = group_socket;
+        group->connection_information.address = (struct sockaddr *)&group->group_address;
+        group->connection_information.address_size = sizeof(group->group_address);
+        group->options = session->options;
+        group->file_source = move(session->file_source);
+        session->file_source = file_source_t();
+        group->last_block_index = last_block_index;
+        data_window_init(&group->data_window, group->options.window_size, group->options.blocksize, NULL);
+        engine->multicast_groups[key] = move(group_owner);
+    }
+
+    session->multicast_group = group;
+    group->members.push_back(session->socket);
+    if (group->master_socket == -1){
+        group->master_socket = session->socket;
+    }
+
+    session->options.multicast_address = group->group_address.sin_addr.s_addr;
+    session->options.multicast_port = ntohs(group->group_address.sin_port);
+    session->options.multicast_master = group->master_socket == session->socket;
+    return true;
+}
+
+
+/**
+ * @brief Submits the check of the prefix of the resumed transfer, that can't be trusted without reading it (RRQ:
+ * prefix of the client, WRQ: prefix of the partial file changed since its sidecar was written)
+ *
+ * @param engine engine structure
+ * @param session session of the request, its transfer options are negotiated
+ * @return true if the check was submitted (the request is answered after it), else false
+ */
+static bool session_submit_resume_check(engine_t *engine, engine_session_t *session){
+    if (engine->resume_checker.event_fd < 0 || session->mode == MODE_NETASCII){
+        return false;
+    }
+
+    shared_ptr<resume_check_t> check(new resume_check_t());
+    if (session->state == SESSION_SENDING){
+        //prefix is compared only when the whole file is requested (see negotiate_range_server)
+        if (session->options.resume_bytes == 0 || session->options.offset != 0 || session->options.length != 0){
+            return false;
+        }
+        check->bytes = session->options.resume_bytes;
+        check->checksum = session->options.resume_checksum;
+    }
+    else{
+        resume_info_t partial;
+        if (!session->options.option_resume || !resume_read(session->file_path, &partial) || partial.is_verified){
+            return false;
+        }
+        check->bytes = partial.bytes;
+        check->checksum = partial.checksum;
+    }
+
+    check->owner = session->socket;
+    check->path = session->file_path;
+    session->resume_check = check;
+    resume_checker_submit(&engine->resume_checker, check);
+    return true;
+}
+
+
+/**
+ * @brief Opens the file of the session and sends the first response to the request (Oack, Data or Ack)
+ *
+ * @param engine engine structure
+ * @param session session of the request, its transfer options are negotiated
+ */
+static void session_respond(engine_t *engine, engine_session_t *session){
+    bool options_used = session->options_used;
+    option_info_t *requested_options = &session->requested_options;
+    shared_ptr<resume_check_t> prefix_check = move(session->resume_check);     //packets of the client are handled from now
+
+    if (session->state == SESSION_SENDING){    //RRQ
+        if (options_used){
+            negotiate_range_server(&session->options, session->file_path, session->mode, prefix_check.get());
+        }
+
+        //testing if the file we want to read from exists
+        if (!file_source_open_range(&session->file_source, session->file_path, session->mode, session->options.offset, session->options.length)){
+            session_fail(engine, session, ERR_CODE_FILE_NOT_FOUND, "File - file to read from doesn't exists");
+            return;
+        }
+
+        //clients requesting the same file share the multicast group, the file is sent by unicast when they can't (or a range is requested)
+        if (requested_options->option_multicast && session->options.option_multicast && !requested_options->option_offset &&
+            session->options.resume_bytes == 0){
+            options_used = multicast_join(engine, session) || options_used;
+        }
+        session->options.option_multicast = session->multicast_group != NULL;
+
+        if (session->multicast_group != NULL){
+            //only the master client is waited for, other clients receive the Data of the group
+            string oack_packet = send_oack(&session->connection_information, requested_options, &session->options, session->file_path, true);
+            if (session->options.multicast_master){
+                session->packets_in_flight = {oack_packet};
+                session->state = SESSION_OACK_SENT;
+                rto_sample_start(&session->rto, 0);
+                session_arm_timer(engine, session);
+            }
+            else{
+                session->state = SESSION_MULTICAST;
+            }
+            return;
+        }
+
+        //payloads of the window (not needed for a mapped file), Acks are received into the batch of the engine
+        size_t payloads_size = session->file_source.is_mapped ? 0 : (size_t)session->options.window_size * session->options.blocksize;
+        if (!acquire_session_buffers(&session->connection_information, 0, payloads_size)){
+            session_close(engine, session);
+            return;
+        }
+        data_window_init(&session->data_window, session->options.window_size, session->options.blocksize, session->buffers.send);
+
+        if (options_used){
+            //RRQ communication with options (OACK response)
+            session->packets_in_flight = {send_oack(&session->connection_information, requested_options, &session->options, session->file_path, true)};
+            session->state = SESSION_OACK_SENT;
+            rto_sample_start(&session->rto, 0);
+            session_arm_timer(engine, session);
+        }
+        else{
+            //RRQ communication without options (Data response)
+            session_fill_window(engine, session);
+        }
+    }
+    else{   //WRQ
+        //testing if the file we want to write in doesn't exist (partial file of an interrupted upload may be replaced)
+        if (fs::exists(session->file_path) && !resume_is_partial(session->file_path)){
+            session_fail(engine, session, ERR_CODE_FILE_EXISTS, "File - file to write to already exists");
+            return;
+        }
+
+        //testing if there is enough free space on the server to receive a file
+        if (requested_options->option_transfer_size &&
+            fs::space("./").available < requested_options->transfer_size){
+            session_fail(engine, session, ERR_CODE_DISK_FULL, "Transfer size - not enough space on disk to download the file");
+            return;
+        }
+
+        //decoded NETASCII text, Data are received into the batch of the engine
+        if (session->mode == MODE_NETASCII && !acquire_session_buffers(&session->connection_information, 0, session->options.blocksize + 1)){
+            session_close(engine, session);
+            return;
+        }
+
+        //upload continues behind the prefix of the partial file, the sidecar is kept until the upload is finished
+        int error_number;
+        if (options_used){
+            negotiate_resume_upload_server(&session->options, session->file_path, session->mode, prefix_check.get());
+        }
+        if (session->options.option_resume){
+            error_number = resume_open(&session->file_write, session->file_path, session->options.resume_bytes, session->options.resume_checksum,
+                                       session->options.blocksize);
+        }
+        else{
+            resume_discard(session->file_path);
+            error_number = disk_file_open_write(&session->file_write, session->file_path);
+        }
+        if (error_number != 0){
+            send_disk_error(&session->connection_information, error_number, DEFAULT_TIMEOUT, false);
+            session_close(engine, session);
+            return;
+        }
+
+        if (options_used){
+            //WRQ communication with options (OACK response)
+            session->packets_in_flight = {send_oack(&session->connection_information, requested_options, &session->options, session->file_path, false)};
+        }
+        else{
+            //WRQ communication without options (ACK response)
+            session->packets_in_flight = {send_ack(&session->connection_information, 0)};
+        }
+        rto_sample_start(&session->rto, 1);
+        session_arm_timer(engine, session);
+    }
+}
+
+
+/**
+ * @brief Creates a session for the received RRQ or WRQ packet and sends the first response (Oack, Data or Ack)
+ *
+ * @param engine engine structure
+ * @param client_address address of the client
+ * @param buffer received packet data
+ * @param bytes_rx size of the received packet
+ */
+static void engine_handle_request(engine_t *engine, struct sockaddr_in *client_address, char *buffer, int bytes_rx){
+    string error_message;
+
+    connection_info_t listen_connection;
+    listen_connection.socket = engine->listen_socket;
+    listen_connection.address = (struct sockaddr *)client_address;
+    listen_connection.address_size = sizeof(*client_address);
+
+    char opcode_char[2] = {buffer[0], buffer[1]};
+    if (chars_to_short(opcode_char) == ERROR_OPCODE){
+        receive_error(&listen_connection, buffer, bytes_rx);
+        return;
+    }
+
+    tftp_rrq_wrq_packet_t init_communication_packet;
+    if (deserialize_packet_struct(&init_communication_packet, buffer, bytes_rx) != PACKET_OK_CODE){
+        send_error_packet(&listen_connection, ERR_CODE_ILLEGAL_OPERATION, "Malformed request packet", DEFAULT_TIMEOUT, false);
+        return;
+    }
+    log_wrq_rrq(&listen_connection, &init_communication_packet);
+
+    int return_code = check_packet_content(&init_communication_packet, &error_message);
+    if (return_code != PACKET_OK_CODE){
+        send_error_packet(&listen_connection, return_code, error_message, DEFAULT_TIMEOUT, false);
+        return;
+    }
+
+    admission_result_t admission = admission_request(client_address);
+    if (admission == ADMISSION_DUPLICATE){
+        return;     //retransmitted request, the session already answered the first one
+    }
+    else if (admission != ADMISSION_ACCEPTED){
+        send_error_packet(&listen_connection, ERR_CODE_NOT_DEF, admission_error_message(admission), DEFAULT_TIMEOUT, false);
+        return;
+    }
+
+    //new socket that maintain communication with certain user
+    int socket_transfer = socket(AF_INET, SOCK_DGRAM, 0);
+    if (socket_transfer < 0){
+        admission_session_end(client_address);
+        error_message = "Server busy - no more sessions can be handled";
+        send_error_packet(&listen_connection, ERR_CODE_NOT_DEF, error_message, DEFAULT_TIMEOUT, false);
+        return;
+    }
+
+    unique_ptr<engine_session_t> session_owner(new engine_session_t());
+    engine_session_t *session = session_owner.get();
+    session->socket = socket_transfer;
+    session->client_address = *client_address;
+    session->connection_information.socket = socket_transfer;
+    session->connection_information.address = (struct sockaddr *)&session->client_address;
+    session->connection_information.address_size = sizeof(session->client_address);
+    session->connection_information.buffers = &session->buffers;
+    if (shaper_session_start(&session->shaper, client_address)){
+        session->connection_information.shaper = &session->shaper;      //sent Data are limited by the bandwidth limits
+    }
+    session->tid_client = htons(client_address->sin_port);
+    session->file_path = engine->root_dirpath + "/" + init_communication_packet.filename;
+    session->mode = init_communication_packet.mode;
+    session->options = engine->server_options;
+    session->deadline = chrono::steady_clock::now();
+    session->started = session->deadline;
+    session->state = init_communication_packet.opcode == RRQ_OPCODE ? SESSION_SENDING : SESSION_RECEIVING;
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = socket_transfer;
+    if (epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, socket_transfer, &event) < 0){
+        cout << "ERROR: epoll_ctl - registration of the transfer socket\n";
+        close(socket_transfer);
+        admission_session_end(client_address);
+        return;
+    }
+    engine->sessions[socket_transfer] = move(session_owner);
+    metrics_session_start(session->state == SESSION_SENDING, init_communication_packet.filename);
+
+    bool options_used = init_communication_packet.options.option_blocksize ||
+                        init_communication_packet.options.option_timeout_interval ||
+                        init_communication_packet.options.option_utimeout_interval ||
+                        init_communication_packet.options.option_transfer_size ||
+                        init_communication_packet.options.option_window_size ||
+                        init_communication_packet.options.option_rollover ||
+                        init_communication_packet.options.option_offset ||
+                        init_communication_packet.options.option_length ||
+                        init_communication_packet.options.option_resume;
+
+    if (options_used){
+        //offered block size is limited by the path MTU to the client
+        if (init_communication_packet.options.option_blocksize){
+            session->options.blocksize_limit = path_mtu_blocksize(client_address);
+        }
+        return_code = negotiate_option_server(&init_communication_packet.options, &session->options, &error_message);
+        if (return_code != PACKET_OK_CODE){
+            session_fail(engine, session, return_code, error_message);
+            return;
+        }
+    }
+    else{
+        session->options.blocksize = DEFAULT_BLOCK_SIZE;
+        session->options.timeout_interval = DEFAULT_TIMEOUT;
+        session->options.utimeout_interval = 0;
+        session->options.window_size = DEFAULT_WINDOW_SIZE;
+        session->options.rollover = DEFAULT_ROLLOVER;
+        session->options.offset = 0;
+        session->options.length = 0;
+        session->options.option_resume = false;
+    }
+    session->requested_options = init_communication_packet.options;
+    session->options_used = options_used;
+
+    //request is answered when the prefix of the resumed transfer is verified (the prefix is checksummed in the background)
+    if (options_used && session_submit_resume_check(engine, session)){
+        return;
+    }
+    session_respond(engine, session);
+}
+
+
+/**
+ * @brief Receives all pending initial packets on the listening socket
+ *
+ * @param engine engine structure
+ */
+static void engine_handle_listen_socket(engine_t *engine){
+    int datagrams_handled = 0;
+
+    while (datagrams_handled < ENGINE_MAX_DATAGRAMS_PER_EVENT){
+        //receiving requests of many clients by one system call
+        int received = receive_batch_fill(&engine->listen_batch, engine->listen_socket, MSG_DONTWAIT);
+        if (received <= 0){
+            if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+                cout << "ERROR: recvmmsg - server initialization communication (RRQ or WRQ)\n";
+            }
+            return;
+        }
+
+        int bytes_rx;
+        struct sockaddr_in client_address;
+        char *buffer;
+        while ((buffer = receive_batch_next(&engine->listen_batch, &bytes_rx, &client_address)) != NULL){
+            engine_handle_request(engine, &client_address, buffer, bytes_rx);
+            datagrams_handled++;
+        }
+
+        if (received < (int)engine->listen_batch.slots_number){
+            return;     //no more datagrams are waiting
+        }
+    }
+}
+
+
+/**
+ * @brief Receives all pending packets on the transfer socket of the session and processes them
+ *
+ * @param engine engine structure
+ * @param session_socket transfer socket of the session
+ */
+static void engine_handle_session_socket(engine_t *engine, int session_socket){
+    int datagrams_handled = 0;
+
+    while (datagrams_handled < ENGINE_MAX_DATAGRAMS_PER_EVENT){
+        //receiving all waiting Data or Acks of the session by one system call
+        int received = receive_batch_fill(&engine->session_batch, session_socket, MSG_DONTWAIT);
+        if (received <= 0){
+            if (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+                cout << "ERROR: recvmmsg - transfer socket\n";
+            }
+            return;
+        }
+
+        int bytes_rx;
+        struct sockaddr_in sender_address;
+        char *buffer;
+        while ((buffer = receive_batch_next(&engine->session_batch, &bytes_rx, &sender_address)) != NULL){
+            datagrams_handled++;
+
+            auto session_it = engine->sessions.find(session_socket);
+            if (session_it == engine->sessions.end()){
+                return;     //session was closed meanwhile
+            }
+            engine_session_t *session = session_it->second.get();
+
+            connection_info_t connection_information;
+            connection_information.socket = session->socket;
+            connection_information.address = (struct sockaddr *)&sender_address;
+            connection_information.address_size = sizeof(sender_address);
+
+            //bigger datagrams are truncated to the negotiated size (as recvfrom would do)
+            bytes_rx = min(bytes_rx, (int)(session->options.blocksize + DATA_PACKET_OFFSET));
+
+            //checking if the TID of host is valid
+            if (htons(sender_address.sin_port) != session->tid_client){
+                log_stranger_packet(&connection_information, buffer, bytes_rx);
+                string error_message = "Invalid TID - Transfer ID doesn't match established communication";
+                send_error_packet(&connection_information, ERR_CODE_UNKNOWN_TID, error_message, DEFAULT_TIMEOUT, false);
+                continue;
+            }
+
+            //packet of the client is handled with the connection of the session (addresses are formatted for the log once)
+            char opcode_char[2] = {buffer[0], buffer[1]};
+            if (chars_to_short(opcode_char) == ERROR_OPCODE){
+                receive_error(&session->connection_information, buffer, bytes_rx);
+                session_close(engine, session);
+                return;
+            }
+
+            if (session->resume_check != NULL){
+                continue;       //request isn't answered yet, the client has nothing to acknowledge
+            }
+            else if (session->state == SESSION_OACK_SENT || session->state == SESSION_SENDING || session->state == SESSION_MULTICAST){
+                session_handle_ack(engine, session, &session->connection_information, buffer);
+            }
+            else{
+                session_handle_data(engine, session, &session->connection_information, buffer, bytes_rx);
+            }
+        }
+
+        if (received < (int)engine->session_batch.slots_number){
+            return;     //no more datagrams are waiting
+        }
+    }
+}
+
+
+/**
+ * @brief Answers the requests of the sessions, whose prefix checks were completed
+ *
+ * @param engine engine structure
+ */
+static void engine_handle_resume_checks(engine_t *engine){
+    vector<shared_ptr<resume_check_t>> completed;
+    resume_checker_collect(&engine->resume_checker, &completed);
+
+    for (auto &check : completed){
+        auto session_it = engine->sessions.find(check->owner);
+        if (session_it == engine->sessions.end() || session_it->second->resume_check != check){
+            continue;       //session was closed meanwhile
+        }
+        session_respond(engine, session_it->second.get());
+    }
+}
+
+
+/**
+ * @brief Handles all expired retransmission timers
+ *
+ * @param engine engine structure
+ */
+static void engine_handle_timers(engine_t *engine){
+    engine_time_t now = chrono::steady_clock::now();
+
+    while (!engine->timers.empty() && engine->timers.begin()->first <= now){
+        int session_socket = engine->timers.begin()->second;
+        engine->timers.erase(engine->timers.begin());
+
+        auto session_it = engine->sessions.find(session_socket);
+        if (session_it != engine->sessions.end()){
+            session_handle_timeout(engine, session_it->second.get());
+        }
+    }
+}
+
+
+/**
+ * @brief Computes how long the engine can wait for events before the nearest retransmission timeout
+ *
+ * @param engine engine structure
+ * @return time to wait in milliseconds, -1 if there is no timer set
+ */
+static int engine_wait_time(engine_t *engine){
+    if (engine->timers.empty()){
+        return -1;
+    }
+
+    auto wait_time = chrono::duration_cast<chrono::milliseconds>(engine->timers.begin()->first - chrono::steady_clock::now());
+    return wait_time.count() > 0 ? wait_time.count() + 1 : 0;
+}
+
+
+int engine_init(engine_t *engine, int listen_socket, string root_dirpath, option_info_t *server_options){
+    //every session owns a socket and a file, allowing as many descriptors as possible
+    struct rlimit descriptors_limit;
+    if (getrlimit(RLIMIT_NOFILE, &descriptors_limit) == 0){
+        descriptors_limit.rlim_cur = descriptors_limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &descriptors_limit);
+    }
+
+    engine->listen_socket = listen_socket;
+    engine->root_dirpath = root_dirpath;
+    engine->server_options = *server_options;
+    receive_batch_prepare(&engine->listen_batch, DEFAULT_BLOCK_SIZE + DATA_PACKET_OFFSET);
+    receive_batch_prepare(&engine->session_batch, MAX_BLKSIZE_VALUE + DATA_PACKET_OFFSET);
+
+    engine->epoll_fd = epoll_create1(0);
+    if (engine->epoll_fd < 0){
+        cout << "ERROR: epoll_create - engine initialization\n";
+        return PROG_RET_CODE_ERR;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = listen_socket;
+    if (epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, listen_socket, &event) < 0){
+        cout << "ERROR: epoll_ctl - registration of the listening socket\n";
+        close(engine->epoll_fd);
+        return PROG_RET_CODE_ERR;
+    }
+
+    //resumed transfers are answered, when their prefixes are checksummed by the thread of the checker
+    if (server_options->option_resume){
+        if (!resume_checker_init(&engine->resume_checker)){
+            cout << "ERROR: eventfd - resume checker initialization\n";
+            close(engine->epoll_fd);
+            return PROG_RET_CODE_ERR;
+        }
+        event.data.fd = engine->resume_checker.event_fd;
+        if (epoll_ctl(engine->epoll_fd, EPOLL_CTL_ADD, engine->resume_checker.event_fd, &event) < 0){
+            cout << "ERROR: epoll_ctl - registration of the resume checker\n";
+            close(engine->epoll_fd);
+            return PROG_RET_CODE_ERR;
+        }
+    }
+
+    return PROG_RET_CODE_OK;
+}
+
+
+int engine_run(engine_t *engine){
+    struct epoll_event events[ENGINE_MAX_EVENTS];
+
+    while (true){
+        get_io_stats()->wait_syscalls++;
+        int events_number = epoll_wait(engine->epoll_fd, events, ENGINE_MAX_EVENTS, engine_wait_time(engine));
+        if (events_number < 0){
+            if (errno == EINTR){
+                continue;
+            }
+            cout << "ERROR: epoll_wait - error\n";
+            return PROG_RET_CODE_ERR;
+        }
+
+        for (int i = 0; i < events_number; i++){
+            if (events[i].data.fd == engine->listen_socket){
+                engine_handle_listen_socket(engine);
+            }
+            else if (events[i].data.fd == engine->resume_checker.event_fd){
+                engine_handle_resume_checks(engine);
+            }
+            else{
+                engine_handle_session_socket(engine, events[i].data.fd);
+            }
+        }
+
+        engine_handle_timers(engine);
+    }
+}
+
+
+/**
+ * @brief Creates a listening socket bound to the port, that can be shared with other workers (SO_REUSEPORT)
+ *
+ * @param port port, that server is listening on
+ * @return file descriptor of the socket, -1 if an error occurs
+ */
+static int create_reuseport_socket(int port){
+    int listen_socket = socket(AF_INET, SOCK_DGRAM, 0);
+    if (listen_socket < 0){
+        return -1;
+    }
+
+    int enable = 1;
+    if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0){
+        close(listen_socket);
+        return -1;
+    }
+
+    struct sockaddr_in server_address;
+    memset(&server_address, 0, sizeof(server_address));     //initialization of the memory
+    server_address.sin_family = AF_INET;
+    server_address.sin_port = htons(port);
+    server_address.sin_addr.s_addr = INADDR_ANY;
+
+    if (bind(listen_socket, (struct sockaddr *)&server_address, sizeof(server_address)) < 0){
+        close(listen_socket);
+        return -1;
+    }
+
+    return listen_socket;
+}
+
+
+/**
+ * @brief Body of the worker thread, pins the thread to the core and runs own engine
+ *
+ * @param listen_socket listening socket of the worker
+ * @param cpu core, that the worker is pinned to
+ * @param root_dirpath server root directory path
+ * @param server_options transfer options supported by the server
+ */
+static void engine_worker(int listen_socket, int cpu, string root_dirpath, option_info_t server_options){
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0){
+        cout << "ERROR: pthread_setaffinity_np - worker was not pinned to the core " << cpu << "\n";
+    }
+
+    unique_ptr<engine_t> engine(new engine_t());
+    if (engine_init(engine.get(), listen_socket, root_dirpath, &server_options) == PROG_RET_CODE_OK){
+        engine_run(engine.get());
+    }
+    close(listen_socket);
+}
+
+
+int engine_run_workers(int port, unsigned int workers_number, string root_dirpath, option_info_t *server_options){
+    if (workers_number > ENGINE_MAX_WORKERS){
+        cout << "ERR: too many workers (maximum is " << ENGINE_MAX_WORKERS << ")\n";
+        return PROG_RET_CODE_ERR;
+    }
+
+    //cores the process is allowed to run on
+    vector<int> cpus;
+    cpu_set_t allowed_cpus;
+    if (sched_getaffinity(0, sizeof(allowed_cpus), &allowed_cpus) == 0){
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++){
+            if (CPU_ISSET(cpu, &allowed_cpus)){
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()){
+        cpus.push_back(0);
+    }
+
+    //all listening sockets are bound before any worker starts, so binding errors are reported at once
+    vector<int> listen_sockets;
+    for (unsigned int i = 0; i < workers_number; i++){
+        int listen_socket = create_reuseport_socket(port);
+        if (listen_socket < 0){
+            cout << "ERR: bind has failed\n";
+            for (int opened_socket : listen_sockets){
+                close(opened_socket);
+            }
+            return PROG_RET_CODE_ERR;
+        }
+        listen_sockets.push_back(listen_socket);
+    }
+
+    vector<thread> workers;
+    for (unsigned int i = 0; i < workers_number; i++){
+        workers.emplace_back(engine_worker, listen_sockets[i], cpus[i % cpus.size()], root_dirpath, *server_options);
+    }
+    for (thread &worker : workers){
+        worker.join();
+    }
+
+    return PROG_RET_CODE_ERR;
+}
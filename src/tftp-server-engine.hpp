@@ -0,0 +1,155 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-server-engine.hpp
+ * @brief Event-driven server engine (all transfer sessions as non-blocking state machines in one process)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_SERVER_ENGINE_HPP
+#define TFTP_SERVER_ENGINE_HPP
+
+#include <chrono>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include "tftp-communication.hpp"
+#include "tftp-batch-io.hpp"
+#include "tftp-file-source.hpp"
+#include "tftp-shaper.hpp"
+
+#define ENGINE_MAX_EVENTS 256
+#define ENGINE_MAX_WORKERS 1024
+#define ENGINE_MAX_DATAGRAMS_PER_EVENT 64
+#define ENGINE_MULTICAST_MAX_GROUPS 256         //ports following the multicast port given to the server
+#define ENGINE_MULTICAST_MAX_BLOCKS 65535       //acks of the clients joining later are resolved only without the block number wrap
+
+
+typedef chrono::steady_clock::time_point engine_time_t;
+
+
+//States of the transfer session
+enum session_state{
+    SESSION_OACK_SENT,      //RRQ with options - waiting for the ACK of OACK (block 0)
+    SESSION_SENDING,        //RRQ - sending data, waiting for acks
+    SESSION_MULTICAST,      //RRQ - client of the multicast group (only the master client acks the Data of the group)
+    SESSION_RECEIVING,      //WRQ - receiving data, sending acks
+    SESSION_DALLYING        //WRQ - last ack sent, waiting for a possibly retransmitted last data
+};
+
+
+struct engine_multicast_group;
+
+
+//Structure containing state of a single transfer session
+typedef struct engine_session {
+    int socket;                                 //transfer socket (server TID)
+    struct sockaddr_in client_address;
+    connection_info_t connection_information;   //socket and client address of the session
+    int tid_client;
+    session_state state;
+
+    string file_path;
+    string mode;
+    option_info_t options;                      //negotiated transfer options
+    option_info_t requested_options;            //transfer options of the request
+    bool options_used = false;                  //request has options (answered by the Oack)
+    shared_ptr<resume_check_t> resume_check;    //prefix of the resumed transfer verified in the background (request isn't answered yet)
+    file_source_t file_source;
+    disk_file_t file_write;                     //WRQ: file written in the background
+
+    deque<string> packets_in_flight;            //RRQ: unacked Oack, WRQ: last sent Ack/Oack
+    data_window_t data_window;                  //RRQ: unacked Data blocks
+    session_buffers_t buffers;                  //RRQ: payloads of the window, WRQ: decoded NETASCII text
+    block_index_t current_block_index = 1;      //RRQ: the oldest unacknowledged block
+    block_index_t next_block_index = 1;         //RRQ: block to be read and sent next
+    bool last_block_sent = false;
+    bool window_resent = false;
+
+    struct engine_multicast_group *multicast_group = NULL;     //RRQ: group sending the file to the client (NULL for unicast)
+
+    block_index_t expected_block_index = 1;     //WRQ: block expected to be received next
+    unsigned int received_in_window = 0;
+    bool gap_acked = false;
+    netascii_state_t netascii_state;            //WRQ: CR straddling the blocks
+
+    int times_retransmitted = 0;
+    rto_estimator_t rto;                        //round-trip time estimate of the session
+    shaper_session_t shaper;                    //RRQ: bandwidth shaping of the sent Data
+    bool is_throttled = false;                  //RRQ: rest of the window waits for the tokens (deadline is the end of the wait)
+    engine_time_t deadline;                     //time of the retransmission timeout
+    engine_time_t started;                      //time of the request
+    bool is_complete = false;                   //whole file was transferred
+} engine_session_t;
+
+
+//Structure containing clients reading the same file over multicast (RFC 2090), every block is read once and
+//sent to all of them, the window is driven by the acks of the master client
+typedef struct engine_multicast_group {
+    string key;                                 //file and transfer options shared by the clients
+    connection_info_t connection_information;   //socket sending the Data and the group address
+    struct sockaddr_in group_address;
+    option_info_t options;                      //negotiated transfer options of the group
+    file_source_t file_source;                  //mapped file (blocks are addressed by their index)
+    data_window_t data_window;                  //Data blocks sent and not acknowledged by the master client
+    block_index_t current_block_index = 1;      //the oldest unacknowledged block
+    block_index_t next_block_index = 1;         //block to be sent next
+    block_index_t last_block_index = 1;         //the last block of the file
+    bool last_block_sent = false;
+    bool window_resent = false;
+    int master_socket = -1;                     //session of the master client (-1 if there is none)
+    deque<int> members;                         //sessions of the clients, that haven't received the whole file, by their requests
+} engine_multicast_group_t;
+
+
+//Structure containing state of the whole engine
+typedef struct engine {
+    int epoll_fd;
+    int listen_socket;
+    string root_dirpath;
+    option_info_t server_options;               //transfer options supported by the server
+    unordered_map<int, unique_ptr<engine_session_t>> sessions;     //sessions by their transfer socket
+    set<pair<engine_time_t, int>> timers;       //retransmission deadlines of the sessions
+    receive_batch_t listen_batch;               //requests received at once
+    receive_batch_t session_batch;              //Data or Acks of one session received at once
+    unordered_map<string, unique_ptr<engine_multicast_group_t>> multicast_groups;     //groups by their key
+    resume_checker_t resume_checker;            //prefixes of the resumed transfers are checksummed out of the event loop
+} engine_t;
+
+
+/**
+ * @brief Initializes the engine (epoll instance, registration of the listening socket)
+ *
+ * @param engine engine structure to be initialized
+ * @param listen_socket bound server socket, that initial RRQ and WRQ packets are received on
+ * @param root_dirpath server root directory path
+ * @param server_options transfer options supported by the server
+ * @return PROG_RET_CODE_OK if OK, else PROG_RET_CODE_ERR
+ */
+int engine_init(engine_t *engine, int listen_socket, string root_dirpath, option_info_t *server_options);
+
+
+/**
+ * @brief Runs the event loop of the engine, handles all sessions until an unrecoverable error occurs
+ *
+ * @param engine initialized engine structure
+ * @return PROG_RET_CODE_ERR when the loop ends on an error
+ */
+int engine_run(engine_t *engine);
+
+
+/**
+ * @brief Runs given number of engines in worker threads. Every worker is pinned to a core and owns
+ * its SO_REUSEPORT listening socket, so the kernel spreads requests between workers and all
+ * transfer sockets and files of a session stay on the worker that accepted it.
+ *
+ * @param port port, that server is listening on
+ * @param workers_number number of worker threads
+ * @param root_dirpath server root directory path
+ * @param server_options transfer options supported by the server
+ * @return PROG_RET_CODE_ERR when workers end on an error
+ */
+int engine_run_workers(int port, unsigned int workers_number, string root_dirpath, option_info_t *server_options);
+
+#endif
@@ -10,15 +10,26 @@
 #include <arpa/inet.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
+#include <climits>
 #include <fstream>
 #include <regex>
 #include <filesystem>
 #include <netdb.h>
 #include <signal.h>
+#include <sys/wait.h>
+#include <unordered_map>
 #include "tftp-communication.hpp"
+#include "tftp-server-engine.hpp"
+#include "tftp-batch-io.hpp"
+#include "tftp-file-cache.hpp"
+#include "tftp-metrics.hpp"
+#include "tftp-resume.hpp"
+#include "tftp-admission.hpp"
+#include "tftp-shaper.hpp"
 
 #define MIN_NUM_ARGS 2
-#define MAX_NUM_ARGS 4
+#define MAX_NUM_ARGS 34
 
 
 namespace fs = std::filesystem;
@@ -29,6 +40,32 @@ int socket_transfer;
 bool is_child_process = false;
 
 
+//Structure containing server settings given by the program arguments
+typedef struct server_settings {
+    string root_dirpath;
+    int port = DEFAULT_TFTP_PORT;
+    bool event_driven = false;          //all clients are served by one process
+    unsigned int workers = 0;           //number of worker threads with own listening socket (0 if not used)
+    size_t cache_budget = 0;            //Bytes of file contents cached in memory (0 if the cache is not used)
+    unsigned long long buffer_limit = 0;    //Bytes of the session buffers of all sessions (0 if not limited)
+    string metrics_address;             //port or Unix socket path of the Prometheus page (empty if not served)
+    unsigned int stats_interval = 0;    //seconds between statistics on standard error stream (0 if not written)
+    log_level_t log_level = LOG_LEVEL_PACKET;
+    log_format_t log_format = LOG_FORMAT_TEXT;
+    unsigned int log_sample_rate = 1;   //every n-th Data and Ack packet is logged
+    unsigned int multicast_address = 0;    //address of the multicast groups in network byte order (0 if multicast is not used)
+    unsigned int multicast_port = 0;    //port of the first multicast group
+    bool resume = false;                //interrupted transfers of clients requesting the resume option are resumed
+    unsigned int max_sessions = 0;      //sessions in progress at once (0 if not limited)
+    double rate_limit = 0;              //requests per second admitted from one client address (0 if not limited)
+    double rate_burst = 0;              //requests admitted from one client address at once
+    unsigned long long session_bandwidth = 0;   //Bytes per second sent by one session (0 if not limited)
+    unsigned long long subnet_bandwidth = 0;    //Bytes per second sent to one client subnet (0 if not limited)
+    unsigned int subnet_prefix = SHAPER_DEFAULT_SUBNET_PREFIX;
+    unsigned long long global_bandwidth = 0;    //Bytes per second sent by the whole server (0 if not limited)
+} server_settings_t;
+
+
 /**
  * @brief Prints help for the program
  */
@@ -37,11 +74,34 @@ void print_help(){
         << "  tftp-server - TFTP server\n"
         << "\n"
         << "USAGE:\n"
-        << "  Run server:\ttftp-server [-p port] root_dirpath\n"
+        << "  Run server:\ttftp-server [-p port] [-e] [-w workers] [-c cache_size] [--buffer-limit size] [--multicast address:port]\n"
+        << "\t\t[--resume] [--max-sessions count] [--rate-limit rate[:burst]] [--session-bandwidth rate] [--subnet-bandwidth rate[/prefix]]\n"
+        << "\t\t[--global-bandwidth rate] [--metrics address] [--stats-interval seconds] [--log-level level] [--log-format format] [--log-sample n]\n"
+        << "\t\troot_dirpath\n"
         << "  Show help:\ttftp-server --help\n"
         << "\n"
         << "OPTIONS:\n"
         << "  -p <MODE>\thost port number to connect to (if not set, then 69)\n"
+        << "  -e\t\tevent-driven mode, all clients are served by one process (if not set, then process per client)\n"
+        << "  -w <NUMBER>\tevent-driven mode with given number of worker threads pinned to cores, each with own listening socket\n"
+        << "  -c <SIZE>\tcache file contents in shared memory up to given size in Bytes (suffix K, M or G allowed)\n"
+        << "  --buffer-limit <SIZE>\tlimit memory of the buffers of all sessions (suffix K, M or G allowed), over it requests are refused\n"
+        << "  --multicast <ADDRESS:PORT>\tsend files to clients requesting the multicast option over the group (RFC 2090), groups of\n"
+        << "\t\tthe files use given port and the following ones (implies event-driven mode)\n"
+        << "  --resume\tresume interrupted transfers of clients requesting the resume option, partial uploaded files are kept\n"
+        << "\t\twith a sidecar (" << RESUME_SIDECAR_SUFFIX << ") recording their verified prefix\n"
+        << "  --max-sessions <COUNT>\tsessions in progress at once (if not set, then not limited), over it requests are answered 'server busy'\n"
+        << "  --rate-limit <RATE[:BURST]>\trequests per second admitted from one client address, at most BURST at once (if not set,\n"
+        << "\t\tthen not limited, BURST defaults to RATE), over it requests are answered 'server busy'\n"
+        << "  --session-bandwidth <RATE>\tlimit Data sent by one session to given Bytes per second (suffix K, M or G allowed)\n"
+        << "  --subnet-bandwidth <RATE[/PREFIX]>\tlimit Data sent to one client subnet (prefix length, if not set, then "
+        << SHAPER_DEFAULT_SUBNET_PREFIX << ") to given Bytes per second\n"
+        << "  --global-bandwidth <RATE>\tlimit Data sent by the whole server to given Bytes per second\n"
+        << "  --metrics <ADDRESS>\tserve Prometheus metrics on given local TCP port or Unix socket path (containing '/')\n"
+        << "  --stats-interval <SECONDS>\tprint transfer statistics to standard error stream every given number of seconds\n"
+        << "  --log-level <LEVEL>\tlogged packets: none, error, info (requests, Oack, Error) or packet (also Data and Ack, default)\n"
+        << "  --log-format <FORMAT>\tformat of the packet log: text (default) or json (object per line)\n"
+        << "  --log-sample <N>\tlog only Data and Ack packets with block number divisible by given number\n"
         << "  root_dirpath\tpath to the server directory to upload files to and download files from\n"
         << "\n"
         << "AUTHOR:\n"
@@ -64,20 +124,52 @@ void interrupt_signal_handler(int signum){
     }
     else{
         cout << "Main server process closed by the interrupt signal\n";
+        log_file_cache_stats();
         close(socket_server);
         exit(1);
     }
 }
 
+/**
+ * @brief Parses the size in Bytes (memory limits or rates in Bytes per second)
+ *
+ * @param value positive number with the optional suffix K, M or G (powers of 1024)
+ * @param size address where the size will be stored in
+ * @return true if OK, false if the format is invalid or the size doesn't fit in 64 bits
+ */
+bool parse_size(string value, unsigned long long *size){
+    if (!(regex_match(value, regex("^[1-9]\\d*[KMG]?$")))){
+        return false;
+    }
+
+    errno = 0;
+    unsigned long long number = strtoull(value.c_str(), NULL, 10);
+    if (errno == ERANGE){
+        return false;
+    }
+
+    unsigned int shift = 0;
+    switch (value.back()){
+        case 'G': shift = 30; break;
+        case 'M': shift = 20; break;
+        case 'K': shift = 10; break;
+    }
+    if (number > (ULLONG_MAX >> shift)){
+        return false;
+    }
+
+    *(size) = number << shift;
+    return true;
+}
+
 /**
  * @brief Validates and parses given program arguments
  *
  * @param argc number of arguments
  * @param argv array of given arguments
- * @param root_dirpath address where the root directory path will be stored in
- * @param port_host address where a host port will be stored in
+ * @param settings address where the server settings will be stored in
  */
-void check_program_args(int argc, char *argv[], string *root_dirpath, int *port_host){
+void check_program_args(int argc, char *argv[], server_settings_t *settings){
     if (argc == 2 && !strcmp(argv[1],"--help")){
         print_help();
     }
@@ -89,6 +181,21 @@ void check_program_args(int argc, char *argv[], string *root_dirpath, int *port_
 
     bool port_checked = false;
     bool root_dirpath_checked = false;
+    bool workers_checked = false;
+    bool cache_checked = false;
+    bool buffer_limit_checked = false;
+    bool multicast_checked = false;
+    bool resume_checked = false;
+    bool max_sessions_checked = false;
+    bool rate_limit_checked = false;
+    bool session_bandwidth_checked = false;
+    bool subnet_bandwidth_checked = false;
+    bool global_bandwidth_checked = false;
+    bool metrics_checked = false;
+    bool stats_interval_checked = false;
+    bool log_level_checked = false;
+    bool log_format_checked = false;
+    bool log_sample_checked = false;
 
     for (int i = 1; i < argc; i++){
         //check -p argument
@@ -101,7 +208,213 @@ void check_program_args(int argc, char *argv[], string *root_dirpath, int *port_
                 cout << "ERR: invalid format of port\n";
                 exit(PROG_RET_CODE_ERR);
             }
-            *(port_host) = atoi(argv[i]);
+            settings->port = atoi(argv[i]);
+        }
+        //check -e argument
+        else if ((strcmp(argv[i],"-e") == 0) && !settings->event_driven){
+            settings->event_driven = true;
+        }
+        //check -w argument
+        else if ((strcmp(argv[i],"-w") == 0) && !workers_checked && i + 1 < argc){
+            workers_checked = true;
+            i++;
+
+            //check number of workers format
+            if (!(regex_match(argv[i], regex("^[1-9]\\d*$")))){
+                cout << "ERR: invalid number of workers\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            settings->workers = atoi(argv[i]);
+            settings->event_driven = true;
+        }
+        //check -c argument
+        else if ((strcmp(argv[i],"-c") == 0) && !cache_checked && i + 1 < argc){
+            cache_checked = true;
+            i++;
+
+            //check cache size format
+            unsigned long long cache_budget;
+            if (!parse_size(argv[i], &cache_budget)){
+                cout << "ERR: invalid format of cache size\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            settings->cache_budget = cache_budget;
+        }
+        //check --buffer-limit argument
+        else if ((strcmp(argv[i],"--buffer-limit") == 0) && !buffer_limit_checked && i + 1 < argc){
+            buffer_limit_checked = true;
+            i++;
+
+            //check memory size format
+            if (!parse_size(argv[i], &settings->buffer_limit)){
+                cout << "ERR: invalid format of buffer limit\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+        }
+        //check --multicast argument
+        else if ((strcmp(argv[i],"--multicast") == 0) && !multicast_checked && i + 1 < argc){
+            multicast_checked = true;
+            i++;
+
+            //check multicast address and port format
+            struct in_addr group_address;
+            string group = argv[i];
+            size_t port_start = group.rfind(':');
+            if (port_start == string::npos || !(regex_match(group.substr(port_start + 1), regex("^[1-9]\\d{0,4}$"))) ||
+                stoi(group.substr(port_start + 1)) > 65535 || inet_pton(AF_INET, group.substr(0, port_start).c_str(), &group_address) != 1 ||
+                !IN_MULTICAST(ntohl(group_address.s_addr))){
+                cout << "ERR: invalid multicast address and port\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            settings->multicast_address = group_address.s_addr;
+            settings->multicast_port = stoi(group.substr(port_start + 1));
+            settings->event_driven = true;      //groups are shared by the sessions of one process
+        }
+        //check --resume argument
+        else if ((strcmp(argv[i],"--resume") == 0) && !resume_checked){
+            resume_checked = true;
+            settings->resume = true;
+        }
+        //check --max-sessions argument
+        else if ((strcmp(argv[i],"--max-sessions") == 0) && !max_sessions_checked && i + 1 < argc){
+            max_sessions_checked = true;
+            i++;
+
+            //check number of sessions format
+            if (!(regex_match(argv[i], regex("^[1-9]\\d{0,6}$")))){
+                cout << "ERR: invalid number of sessions (argument --max-sessions)\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            settings->max_sessions = atoi(argv[i]);
+        }
+        //check --rate-limit argument
+        else if ((strcmp(argv[i],"--rate-limit") == 0) && !rate_limit_checked && i + 1 < argc){
+            rate_limit_checked = true;
+            i++;
+
+            //check rate and burst format
+            cmatch rate_match;
+            if (!(regex_match(argv[i], rate_match, regex("^(\\d{1,6}(\\.\\d{1,3})?)(:([1-9]\\d{0,5}))?$"))) || stod(rate_match[1]) <= 0){
+                cout << "ERR: invalid format of request rate (argument --rate-limit)\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            settings->rate_limit = stod(rate_match[1]);
+            settings->rate_burst = rate_match[4].matched ? stod(rate_match[4]) : settings->rate_limit;
+        }
+        //check --session-bandwidth argument
+        else if ((strcmp(argv[i],"--session-bandwidth") == 0) && !session_bandwidth_checked && i + 1 < argc){
+            session_bandwidth_checked = true;
+            i++;
+
+            if (!parse_size(argv[i], &settings->session_bandwidth)){
+                cout << "ERR: invalid format of session bandwidth\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+        }
+        //check --subnet-bandwidth argument
+        else if ((strcmp(argv[i],"--subnet-bandwidth") == 0) && !subnet_bandwidth_checked && i + 1 < argc){
+            subnet_bandwidth_checked = true;
+            i++;
+
+            //check subnet prefix length format
+            string bandwidth = argv[i];
+            size_t prefix_start = bandwidth.find('/');
+            if (prefix_start != string::npos){
+                if (!(regex_match(bandwidth.substr(prefix_start + 1), regex("^\\d{1,2}$"))) || stoi(bandwidth.substr(prefix_start + 1)) > 32){
+                    cout << "ERR: invalid subnet prefix length of subnet bandwidth\n";
+                    exit(PROG_RET_CODE_ERR);
+                }
+                settings->subnet_prefix = stoi(bandwidth.substr(prefix_start + 1));
+                bandwidth = bandwidth.substr(0, prefix_start);
+            }
+            if (!parse_size(bandwidth, &settings->subnet_bandwidth)){
+                cout << "ERR: invalid format of subnet bandwidth\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+        }
+        //check --global-bandwidth argument
+        else if ((strcmp(argv[i],"--global-bandwidth") == 0) && !global_bandwidth_checked && i + 1 < argc){
+            global_bandwidth_checked = true;
+            i++;
+
+            if (!parse_size(argv[i], &settings->global_bandwidth)){
+                cout << "ERR: invalid format of global bandwidth\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+        }
+        //check --metrics argument
+        else if ((strcmp(argv[i],"--metrics") == 0) && !metrics_checked && i + 1 < argc){
+            metrics_checked = true;
+            i++;
+
+            //check port number or socket path format
+            if (!(regex_match(argv[i], regex("^\\d+$|^.*/.*$")))){
+                cout << "ERR: invalid format of metrics address\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            settings->metrics_address = argv[i];
+        }
+        //check --stats-interval argument
+        else if ((strcmp(argv[i],"--stats-interval") == 0) && !stats_interval_checked && i + 1 < argc){
+            stats_interval_checked = true;
+            i++;
+
+            //check interval format
+            if (!(regex_match(argv[i], regex("^[1-9]\\d*$")))){
+                cout << "ERR: invalid format of statistics interval\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            settings->stats_interval = atoi(argv[i]);
+        }
+        //check --log-level argument
+        else if ((strcmp(argv[i],"--log-level") == 0) && !log_level_checked && i + 1 < argc){
+            log_level_checked = true;
+            i++;
+
+            if (strcmp(argv[i],"none") == 0){
+                settings->log_level = LOG_LEVEL_NONE;
+            }
+            else if (strcmp(argv[i],"error") == 0){
+                settings->log_level = LOG_LEVEL_ERROR;
+            }
+            else if (strcmp(argv[i],"info") == 0){
+                settings->log_level = LOG_LEVEL_INFO;
+            }
+            else if (strcmp(argv[i],"packet") == 0){
+                settings->log_level = LOG_LEVEL_PACKET;
+            }
+            else{
+                cout << "ERR: invalid log level\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+        }
+        //check --log-format argument
+        else if ((strcmp(argv[i],"--log-format") == 0) && !log_format_checked && i + 1 < argc){
+            log_format_checked = true;
+            i++;
+
+            if (strcmp(argv[i],"text") == 0){
+                settings->log_format = LOG_FORMAT_TEXT;
+            }
+            else if (strcmp(argv[i],"json") == 0){
+                settings->log_format = LOG_FORMAT_JSON;
+            }
+            else{
+                cout << "ERR: invalid log format\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+        }
+        //check --log-sample argument
+        else if ((strcmp(argv[i],"--log-sample") == 0) && !log_sample_checked && i + 1 < argc){
+            log_sample_checked = true;
+            i++;
+
+            //check sampling rate format
+            if (!(regex_match(argv[i], regex("^[1-9]\\d*$")))){
+                cout << "ERR: invalid format of log sampling rate\n";
+                exit(PROG_RET_CODE_ERR);
+            }
+            settings->log_sample_rate = atoi(argv[i]);
         }
         else if (!root_dirpath_checked){
             //check root directory path format
@@ -110,18 +423,14 @@ void check_program_args(int argc, char *argv[], string *root_dirpath, int *port_
                 cout << "ERR: invalid format of root dirpath\n";
                 exit(PROG_RET_CODE_ERR);
             }
-            *(root_dirpath) = argv[i];
+            settings->root_dirpath = argv[i];
         }
         else{
-            cout << "ERR: invalid argument (the server is started using: 'tftp-server [-p port] root_dirpath')\n";
+            cout << "ERR: invalid argument (the server is started using: 'tftp-server [-p port] [-e] [-w workers] [-c cache_size] [--buffer-limit size] [--multicast address:port] [--resume] [--max-sessions count] [--rate-limit rate[:burst]] [--session-bandwidth rate] [--subnet-bandwidth rate[/prefix]] [--global-bandwidth rate] [--metrics address] [--stats-interval seconds] [--log-level level] [--log-format format] [--log-sample n] root_dirpath')\n";
             exit(PROG_RET_CODE_ERR);
         }
     }
 
-    if (!port_checked){
-        *(port_host) = DEFAULT_TFTP_PORT;
-    }
-
     if (!root_dirpath_checked){
         cout << "ERR: missing required argument (root_dirpath)\n";
         exit(PROG_RET_CODE_ERR);
@@ -164,7 +473,13 @@ struct sockaddr_in set_server_informations(int port)
 bool are_options_used(option_info_t *options){
     if (options->option_blocksize ||
         options->option_timeout_interval ||
-        options->option_transfer_size){
+        options->option_utimeout_interval ||
+        options->option_transfer_size ||
+        options->option_window_size ||
+        options->option_rollover ||
+        options->option_offset ||
+        options->option_length ||
+        options->option_resume){
         return true;
     }
     else{
@@ -173,7 +488,25 @@ bool are_options_used(option_info_t *options){
 }
 
 /**
- * @brief Handles TFTP communication with multiple clients
+ * @brief Reaps the ended child processes, their sessions are ended in the admission table
+ *
+ * @param children client addresses of the sessions by their child processes
+ */
+void reap_children(unordered_map<pid_t, struct sockaddr_in> *children){
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0){
+        auto child = children->find(pid);
+        if (child != children->end()){
+            admission_session_end(&child->second);
+            children->erase(child);
+        }
+    }
+}
+
+
+/**
+ * @brief Handles TFTP communication with multiple clients, child process is created only for a valid request
+ * admitted by the admission control
  *
  * @param connection_information connection information (socket, address)
  * @param root_dirpath server root directory path
@@ -189,9 +522,16 @@ void start_listen(connection_info_t *connection_information, string root_dirpath
     string error_message = "";
     string packet_to_be_send;
 
-    char buffer[option_information->blocksize + DATA_PACKET_OFFSET];
-    bzero(buffer, option_information->blocksize + DATA_PACKET_OFFSET);
+    char buffer[DEFAULT_BLOCK_SIZE + DATA_PACKET_OFFSET];      //initial request (packets of the transfer are received into the session buffers)
 
+    receive_batch_t receive_batch;
+    session_buffers_t session_buffers;
+    rto_estimator_t rto;
+    shaper_session_t shaper_session;
+    metrics_time_t session_start;
+    bool is_session_started = false;
+    bool is_session_completed = false;
+    unordered_map<pid_t, struct sockaddr_in> children;      //client address of the session of every child process
 
     while (true)
     {
@@ -203,23 +543,41 @@ void start_listen(connection_info_t *connection_information, string root_dirpath
             close(socket_server);
             exit(1);
         }
+        metrics_count_received(1, bytes_rx);
+
+        //sessions of the ended child processes are admitted again
+        reap_children(&children);
+
+        char opcode_char[2] = {buffer[0], buffer[1]};
+        if (chars_to_short(opcode_char) == ERROR_OPCODE){
+            receive_error(connection_information, buffer, bytes_rx);
+            continue;
+        }
+
+        tftp_rrq_wrq_packet_t init_communication_packet;
+        if (receive_wrq_rrq(connection_information, &init_communication_packet, buffer, bytes_rx) != PACKET_OK_CODE){
+            continue;
+        }
+
+        struct sockaddr_in client_address = *((struct sockaddr_in *)connection_information->address);
+        admission_result_t admission = admission_request(&client_address);
+        if (admission == ADMISSION_DUPLICATE){
+            continue;       //retransmitted request, the child process of the session answers the first one
+        }
+        else if (admission != ADMISSION_ACCEPTED){
+            send_error_packet(connection_information, ERR_CODE_NOT_DEF, admission_error_message(admission), DEFAULT_TIMEOUT, false);
+            continue;
+        }
 
         //creating child process that will handle communication with client
         pid_t pid = fork();
 
         if (pid == 0){
-            int tid_client = htons(((struct sockaddr_in*)connection_information->address)->sin_port);
-
-            char opcode_char[2] = {buffer[0], buffer[1]};
-            if (chars_to_short(opcode_char) == ERROR_OPCODE){
-                receive_error(connection_information, buffer);
-                break;
-            }
+            int tid_client = htons(client_address.sin_port);
 
-            tftp_rrq_wrq_packet_t init_communication_packet;
-            if (receive_wrq_rrq(connection_information, &init_communication_packet, buffer) != PACKET_OK_CODE){
-                break;
-            }
+            session_start = chrono::steady_clock::now();
+            is_session_started = true;
+            metrics_session_start(init_communication_packet.opcode == RRQ_OPCODE, init_communication_packet.filename);
 
             string full_path_file = root_dirpath + "/" + init_communication_packet.filename;
 
@@ -227,6 +585,17 @@ void start_listen(connection_info_t *connection_information, string root_dirpath
             is_child_process = true;
 
             connection_information->socket = socket_transfer;
+            connection_information->receive_batch = &receive_batch;     //datagrams waiting on the socket are received at once
+            connection_information->rto = &rto;                         //retransmission timeout adapts to the round-trip time
+            connection_information->buffers = &session_buffers;         //arenas reused by all blocks of the transfer
+            if (shaper_session_start(&shaper_session, &client_address)){
+                connection_information->shaper = &shaper_session;       //sent Data are limited by the bandwidth limits
+            }
+
+            //offered block size is limited by the path MTU to the client (fragmented blocks are lost by a lost fragment)
+            if (init_communication_packet.options.option_blocksize){
+                option_information->blocksize_limit = path_mtu_blocksize((struct sockaddr_in *)connection_information->address);
+            }
 
             if (init_communication_packet.opcode == RRQ_OPCODE){    //RRQ
                 //testing if the file we want to read from exists
@@ -245,38 +614,46 @@ void start_listen(connection_info_t *connection_information, string root_dirpath
                         send_error_packet(connection_information, return_code, error_message);
                         break;
                     }
+                    negotiate_range_server(option_information, full_path_file, init_communication_packet.mode);
+
+                    //Ack of the Oack may be as big as the negotiated datagram
+                    if (!acquire_session_buffers(connection_information, option_information->blocksize + DATA_PACKET_OFFSET, 0)){
+                        break;
+                    }
+                    char *transfer_buffer = session_buffers.receive;
+
                     packet_to_be_send = send_oack(connection_information, &init_communication_packet.options, option_information, full_path_file, true);
 
-                    int bytes_rx = recvfrom_retransmit(connection_information, option_information, buffer, packet_to_be_send, tid_client);
+                    int bytes_rx = recvfrom_retransmit(connection_information, option_information, transfer_buffer, packet_to_be_send, tid_client);
                     if (bytes_rx < 0){
                         break;
                     }
 
-                    char opcode_char[2] = {buffer[0], buffer[1]};
+                    char opcode_char[2] = {transfer_buffer[0], transfer_buffer[1]};
                     if (chars_to_short(opcode_char) == ERROR_OPCODE){
-                        receive_error(connection_information, buffer);
+                        receive_error(connection_information, transfer_buffer, bytes_rx);
                         break;
                     }
 
-                    if (receive_ack(connection_information, buffer, 0, option_information->timeout_interval) != PACKET_OK_CODE){
+                    if (receive_ack(connection_information, transfer_buffer, 0, option_information->timeout_interval) != PACKET_OK_CODE){
                         break;
                     }
 
                     //continue sending data
-                    read_from_file(connection_information, full_path_file, option_information, init_communication_packet.mode, tid_client);
+                    is_session_completed = read_from_file(connection_information, full_path_file, option_information, init_communication_packet.mode, tid_client) == PROG_RET_CODE_OK;
 
                 }
                 else{
                     //RRQ communication without options (Data response)
                     //continue sending data
-                    read_from_file(connection_information, full_path_file, &default_options, init_communication_packet.mode, tid_client);
+                    is_session_completed = read_from_file(connection_information, full_path_file, &default_options, init_communication_packet.mode, tid_client) == PROG_RET_CODE_OK;
                 }
 
             }
             else if (init_communication_packet.opcode == WRQ_OPCODE){   //WRQ
-                //testing if the file we want to write in doesn't exist
+                //testing if the file we want to write in doesn't exist (partial file of an interrupted upload may be replaced)
                 ifstream file_existence_test(full_path_file);
-                if (file_existence_test.is_open()){
+                if (file_existence_test.is_open() && !resume_is_partial(full_path_file)){
                     error_message = "File - file to write to already exists";
                     send_error_packet(connection_information, ERR_CODE_FILE_EXISTS, error_message);
                     file_existence_test.close();
@@ -292,20 +669,41 @@ void start_listen(connection_info_t *connection_information, string root_dirpath
                     }
                 }
 
-                ofstream file_write(full_path_file);
-                int write_to_file_ret_code;
+                option_info_t *transfer_options = &default_options;
                 if (are_options_used(&init_communication_packet.options)){
-                    //WRQ communication with options (OACK response)
                     int return_code = negotiate_option_server(&init_communication_packet.options, option_information, &error_message);
                     if (return_code != PACKET_OK_CODE){
                         send_error_packet(connection_information, return_code, error_message);
-                        close_remove_file(file_write, full_path_file.c_str());
                         break;
                     }
+                    negotiate_resume_upload_server(option_information, full_path_file, init_communication_packet.mode);
+                    transfer_options = option_information;
+                }
+
+                //upload continues behind the prefix of the partial file, the sidecar is kept until the upload is finished
+                disk_file_t file_write;
+                int error_number;
+                if (transfer_options->option_resume){
+                    error_number = resume_open(&file_write, full_path_file, transfer_options->resume_bytes, transfer_options->resume_checksum,
+                                               transfer_options->blocksize);
+                }
+                else{
+                    resume_discard(full_path_file);
+                    error_number = disk_file_open_write(&file_write, full_path_file);
+                }
+                if (error_number != 0){
+                    send_disk_error(connection_information, error_number);
+                    break;
+                }
+
+                int write_to_file_ret_code;
+                netascii_state_t netascii_state;
+                if (transfer_options != &default_options){
+                    //WRQ communication with options (OACK response)
                     packet_to_be_send = send_oack(connection_information, &init_communication_packet.options, option_information, full_path_file, false);
 
                     //continue receiving data
-                    write_to_file_ret_code = write_to_file(connection_information, option_information, file_write, packet_to_be_send, init_communication_packet.mode, tid_client, 1);
+                    write_to_file_ret_code = write_to_file(connection_information, option_information, &file_write, packet_to_be_send, init_communication_packet.mode, tid_client, 1, &netascii_state);
 
                 }
                 else{
@@ -313,46 +711,115 @@ void start_listen(connection_info_t *connection_information, string root_dirpath
                     packet_to_be_send = send_ack(connection_information, 0);
 
                     //continue receiving data
-                    write_to_file_ret_code = write_to_file(connection_information, &default_options, file_write, packet_to_be_send, init_communication_packet.mode, tid_client, 1);
+                    write_to_file_ret_code = write_to_file(connection_information, &default_options, &file_write, packet_to_be_send, init_communication_packet.mode, tid_client, 1, &netascii_state);
                 }
 
-                file_write.close();
-
-                //removing invalid file, when an error occurs
-                if (write_to_file_ret_code == PROG_RET_CODE_ERR){
-                    remove(full_path_file.c_str());
+                //removing invalid file, when an error occurs (partial file of the resumed upload is kept with its sidecar)
+                if (write_to_file_ret_code == PROG_RET_CODE_ERR && transfer_options->option_resume){
+                    if (!resume_keep(&file_write, full_path_file, transfer_options->blocksize)){
+                        remove(full_path_file.c_str());
+                    }
+                }
+                else{
+                    disk_file_close(&file_write);
+                    if (write_to_file_ret_code == PROG_RET_CODE_ERR){
+                        remove(full_path_file.c_str());
+                    }
+                    else{
+                        resume_discard(full_path_file);     //partial file of another transfer could be replaced meanwhile
+                    }
                 }
+                is_session_completed = write_to_file_ret_code == PROG_RET_CODE_OK;
             }
             break;
             close(socket_transfer);
         }
         else if (pid > 0){
             //Continue to listen for other clients
+            children[pid] = client_address;
             continue;
         }
         else{
-            cout << "Error: fork() - Error while creating a child process";
-            close(socket_server);
-            exit(1);
-            break;
+            //process table is full, the client should come back later
+            cout << "ERROR: fork() - Error while creating a child process\n";
+            admission_session_end(&client_address);
+            send_error_packet(connection_information, ERR_CODE_NOT_DEF, "Server busy - no more sessions can be handled", DEFAULT_TIMEOUT, false);
+            continue;
         }
     }
+
+    if (is_session_started){
+        metrics_session_end(is_session_completed, session_start);
+    }
+
+    //summary of the I/O system calls and the buffers of the finished transfer
+    if (is_child_process){
+        log_io_stats(get_io_stats());
+        log_buffer_usage(&session_buffers);
+        if (connection_information->shaper != NULL){
+            log_shaper_usage(&shaper_session);
+        }
+    }
+    buffer_pool_release(&session_buffers);
 }
 
 
 int main(int argc, char *argv[]) {
-    string root_dirpath;
-    int port_server;
+    server_settings_t settings;
 
-    cout << root_dirpath;
+    check_program_args(argc, argv, &settings);
+    log_configure(settings.log_level, settings.log_format, settings.log_sample_rate);
+    string root_dirpath = settings.root_dirpath;
 
-    check_program_args(argc, argv, &root_dirpath, &port_server);
+    signal(SIGINT, interrupt_signal_handler);
 
-    socket_server = create_socket();    //stored into the global variable due to interrupt signal
+    //defining transfer option information
+    option_info_t option_information;
+    option_information.option_blocksize = true;
+    option_information.option_transfer_size = true;
+    option_information.option_timeout_interval = true;
+    option_information.option_utimeout_interval = true;
+    option_information.option_window_size = true;
+    option_information.option_rollover = true;
+    option_information.option_offset = true;
+    option_information.option_length = true;
+    option_information.option_resume = settings.resume;
+    option_information.option_multicast = settings.multicast_address != 0;
+    option_information.multicast_address = settings.multicast_address;
+    option_information.multicast_port = settings.multicast_port;
+
+    //sessions of all worker threads are admitted by the same limits
+    admission_init(settings.max_sessions, settings.rate_limit, settings.rate_burst);
+
+    //buckets of the subnets and of the server are shared by all worker threads and child processes
+    if (shaper_init(settings.session_bandwidth, settings.subnet_bandwidth, settings.subnet_prefix, settings.global_bandwidth) != PROG_RET_CODE_OK){
+        return PROG_RET_CODE_ERR;
+    }
 
-    signal(SIGINT, interrupt_signal_handler);
+    //cache has to exist before creating worker threads or child processes, that share it
+    if (settings.cache_budget > 0 && file_cache_init(settings.cache_budget) != PROG_RET_CODE_OK){
+        return PROG_RET_CODE_ERR;
+    }
+
+    //memory of the session buffers is counted (and limited) over all worker threads and child processes
+    if (buffer_pool_init(settings.buffer_limit) != PROG_RET_CODE_OK){
+        return PROG_RET_CODE_ERR;
+    }
+
+    //metrics are updated by all worker threads and child processes, exporter thread runs in the main process
+    if (metrics_init() != PROG_RET_CODE_OK ||
+        metrics_start_exporter(settings.metrics_address, settings.stats_interval) != PROG_RET_CODE_OK){
+        return PROG_RET_CODE_ERR;
+    }
+
+    if (settings.workers > 0){
+        //every worker thread has own listening socket and sessions
+        return engine_run_workers(settings.port, settings.workers, root_dirpath, &option_information);
+    }
+
+    socket_server = create_socket();    //stored into the global variable due to interrupt signal
 
-    set_server_informations(port_server);
+    set_server_informations(settings.port);
 
     struct sockaddr_in client_addr;
 
@@ -362,16 +829,21 @@ int main(int argc, char *argv[]) {
     connection_information.address = (struct sockaddr *)&client_addr;
     connection_information.address_size = sizeof(client_addr);
 
-    //defining transfer option information
-    option_info_t option_information;
-    option_information.option_blocksize = true;
-    option_information.option_transfer_size = true;
-    option_information.option_timeout_interval = true;
-
+    if (settings.event_driven){
+        //all clients are served by the single process
+        engine_t engine;
+        if (engine_init(&engine, socket_server, root_dirpath, &option_information) != PROG_RET_CODE_OK){
+            close(socket_server);
+            return PROG_RET_CODE_ERR;
+        }
+        engine_run(&engine);
+        close(socket_server);
+        return PROG_RET_CODE_ERR;
+    }
 
     start_listen(&connection_information, root_dirpath, &option_information);
 
     cout << "End of the transfer\n";
 
     return 0;
-}
\ No newline at end of file
+}
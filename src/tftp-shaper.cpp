@@ -0,0 +1,272 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-shaper.cpp
+ * @brief Bandwidth shaping of the sent Data (token buckets of the session, of the client subnet and of the whole server,
+ * subnet and global buckets are kept in shared memory and shared by all sessions, worker threads and child processes)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#include <sys/mman.h>
+#include <time.h>
+#include <errno.h>
+#include <limits.h>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <new>
+#include "tftp-shaper.hpp"
+#include "tftp-metrics.hpp"
+#include "tftp-log.hpp"
+
+
+static shaper_t *shaper = NULL;
+static unsigned long long session_rate = 0;     //rate of the own bucket of every session (0 if not limited)
+
+
+/**
+ * @brief Gets the monotonic time shared by all processes
+ *
+ * @return time in nanoseconds
+ */
+static inline long long shaper_now_ns(){
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+
+/**
+ * @brief Sets the rate and the size of the bucket
+ *
+ * @param bucket token bucket
+ * @param rate Bytes per second (0 if not limited)
+ */
+static void shaper_bucket_init(shaper_bucket_t *bucket, unsigned long long rate){
+    bucket->rate = rate;
+    bucket->paid_off_ns = 0;
+    if (rate != 0){
+        double burst = max((double)rate * SHAPER_BURST_US / 1e6, (double)SHAPER_MIN_BURST);
+        bucket->burst_ns = burst * 1e9 / rate;
+    }
+}
+
+
+/**
+ * @brief Counts the Bytes, that can be sent through the bucket now
+ *
+ * @param bucket token bucket
+ * @param now current time in nanoseconds
+ * @return tokens in Bytes
+ */
+static double shaper_bucket_tokens(shaper_bucket_t *bucket, long long now){
+    long long debt_ns = max(0LL, __atomic_load_n(&bucket->paid_off_ns, __ATOMIC_RELAXED) - now);
+    return debt_ns >= bucket->burst_ns ? 0 : (double)(bucket->burst_ns - debt_ns) * bucket->rate / 1e9;
+}
+
+
+/**
+ * @brief Counts the time until the bucket has tokens for the data of the size
+ *
+ * @param bucket token bucket
+ * @param now current time in nanoseconds
+ * @param bytes size of the data
+ * @return time in nanoseconds (0 if the data can be sent now)
+ */
+static long long shaper_bucket_delay_ns(shaper_bucket_t *bucket, long long now, unsigned int bytes){
+    long long debt_ns = max(0LL, __atomic_load_n(&bucket->paid_off_ns, __ATOMIC_RELAXED) - now);
+    long long cost_ns = (double)bytes * 1e9 / bucket->rate;
+    return max(0LL, debt_ns + cost_ns - bucket->burst_ns);
+}
+
+
+/**
+ * @brief Takes the tokens of the sent data, the bucket may get into debt (data are sent by many sessions at once
+ * or the data were retransmitted), its time is paid off before the next data are sent
+ *
+ * @param bucket token bucket
+ * @param now current time in nanoseconds
+ * @param bytes size of the sent data
+ */
+static void shaper_bucket_charge(shaper_bucket_t *bucket, long long now, unsigned long long bytes){
+    long long cost_ns = (double)bytes * 1e9 / bucket->rate;
+    long long paid_off_ns = __atomic_load_n(&bucket->paid_off_ns, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&bucket->paid_off_ns, &paid_off_ns, max(paid_off_ns, now) + cost_ns,
+                                        true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+    }
+}
+
+
+/**
+ * @brief Finds the bucket of the client subnet, the subnet gets its slot in the table when its first session starts
+ *
+ * @param subnet address of the subnet in host byte order
+ * @return bucket of the subnet
+ */
+static shaper_bucket_t *shaper_subnet_bucket(unsigned int subnet){
+    unsigned long long key = (unsigned long long)subnet + 1;
+
+    for (unsigned int i = 0; i < SHAPER_MAX_SUBNETS; i++){
+        shaper_subnet_t *slot = &shaper->subnets[(subnet * 2654435761U + i) % SHAPER_MAX_SUBNETS];
+        unsigned long long slot_key = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE);
+        if (slot_key == 0){
+            if (__atomic_compare_exchange_n(&slot->key, &slot_key, key, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+                return &slot->bucket;
+            }
+        }
+        if (slot_key == key){
+            return &slot->bucket;
+        }
+    }
+
+    return &shaper->subnet_other;
+}
+
+
+int shaper_init(unsigned long long session_limit, unsigned long long subnet_rate, unsigned int subnet_prefix, unsigned long long global_rate){
+    session_rate = session_limit;
+    if (subnet_rate == 0 && global_rate == 0){
+        return PROG_RET_CODE_OK;        //only the own buckets of the sessions are used
+    }
+
+    void *memory = mmap(NULL, sizeof(shaper_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED){
+        cout << "ERROR: mmap - bandwidth shaping\n";
+        return PROG_RET_CODE_ERR;
+    }
+
+    shaper = new (memory) shaper_t();
+    shaper_bucket_init(&shaper->global, global_rate);
+    shaper->subnet_rate = subnet_rate;
+    shaper->subnet_mask = subnet_prefix == 0 ? 0 : 0xffffffffU << (32 - subnet_prefix);
+    for (unsigned int i = 0; i < SHAPER_MAX_SUBNETS; i++){
+        shaper_bucket_init(&shaper->subnets[i].bucket, subnet_rate);
+    }
+    shaper_bucket_init(&shaper->subnet_other, subnet_rate);
+
+    return PROG_RET_CODE_OK;
+}
+
+
+bool shaper_session_start(shaper_session_t *session, const struct sockaddr_in *client_address){
+    shaper_bucket_init(&session->bucket, session_rate);
+    session->subnet = NULL;
+    session->global = NULL;
+    session->throttle_started_ns = -1;
+    session->throttled_ns = 0;
+    session->throttles = 0;
+
+    if (shaper != NULL){
+        if (shaper->subnet_rate != 0){
+            session->subnet = shaper_subnet_bucket(ntohl(client_address->sin_addr.s_addr) & shaper->subnet_mask);
+        }
+        if (shaper->global.rate != 0){
+            session->global = &shaper->global;
+        }
+    }
+
+    return session->bucket.rate != 0 || session->subnet != NULL || session->global != NULL;
+}
+
+
+unsigned int shaper_allowed_datagrams(shaper_session_t *session, unsigned int datagram_size){
+    if (session == NULL){
+        return UINT_MAX;
+    }
+
+    long long now = shaper_now_ns();
+    double tokens = session->bucket.rate != 0 ? shaper_bucket_tokens(&session->bucket, now) : (double)UINT_MAX * datagram_size;
+    if (session->subnet != NULL){
+        tokens = min(tokens, shaper_bucket_tokens(session->subnet, now));
+    }
+    if (session->global != NULL){
+        tokens = min(tokens, shaper_bucket_tokens(session->global, now));
+    }
+
+    return (tokens + 1) / datagram_size;         //tokens are counted from the time, rounding may lose a Byte
+}
+
+
+long long shaper_delay_us(shaper_session_t *session, unsigned int datagram_size){
+    if (session == NULL){
+        return 0;
+    }
+
+    long long now = shaper_now_ns();
+    long long delay_ns = 0;
+    if (session->bucket.rate != 0){
+        delay_ns = shaper_bucket_delay_ns(&session->bucket, now, datagram_size);
+    }
+    if (session->subnet != NULL){
+        delay_ns = max(delay_ns, shaper_bucket_delay_ns(session->subnet, now, datagram_size));
+    }
+    if (session->global != NULL){
+        delay_ns = max(delay_ns, shaper_bucket_delay_ns(session->global, now, datagram_size));
+    }
+
+    return (delay_ns + 999) / 1000;
+}
+
+
+void shaper_charge(shaper_session_t *session, unsigned long long bytes){
+    if (session == NULL || bytes == 0){
+        return;
+    }
+
+    long long now = shaper_now_ns();
+    if (session->bucket.rate != 0){
+        shaper_bucket_charge(&session->bucket, now, bytes);
+    }
+    if (session->subnet != NULL){
+        shaper_bucket_charge(session->subnet, now, bytes);
+    }
+    if (session->global != NULL){
+        shaper_bucket_charge(session->global, now, bytes);
+    }
+}
+
+
+void shaper_throttle_begin(shaper_session_t *session){
+    if (session->throttle_started_ns < 0){
+        session->throttle_started_ns = shaper_now_ns();
+        session->throttles++;
+    }
+}
+
+
+void shaper_throttle_end(shaper_session_t *session){
+    if (session == NULL || session->throttle_started_ns < 0){
+        return;
+    }
+
+    long long throttled_ns = shaper_now_ns() - session->throttle_started_ns;
+    session->throttled_ns += throttled_ns;
+    session->throttle_started_ns = -1;
+    metrics_count_throttle(throttled_ns / 1000);
+}
+
+
+unsigned int shaper_wait(shaper_session_t *session, unsigned int datagram_size){
+    unsigned int allowed = shaper_allowed_datagrams(session, datagram_size);
+    if (allowed != 0){
+        return allowed;
+    }
+
+    shaper_throttle_begin(session);
+    while (allowed == 0){
+        long long delay_us = max(shaper_delay_us(session, datagram_size), 1LL);
+        struct timespec delay = {(time_t)(delay_us / 1000000), (long)(delay_us % 1000000) * 1000};
+        while (nanosleep(&delay, &delay) < 0 && errno == EINTR){
+        }
+        allowed = shaper_allowed_datagrams(session, datagram_size);
+    }
+    shaper_throttle_end(session);
+
+    return allowed;
+}
+
+
+void log_shaper_usage(shaper_session_t *session){
+    log_flush();        //summary follows the logged packets
+
+    cerr << "SHAPING throttled_s=" << fixed << setprecision(3) << session->throttled_ns / 1e9 << defaultfloat
+         << " throttles=" << session->throttles << "\n";
+}
@@ -0,0 +1,146 @@
+/**
+ * ISA - Projekt: TFTP Klient + Server
+ * @file tftp-shaper.hpp
+ * @brief Bandwidth shaping of the sent Data (token buckets of the session, of the client subnet and of the whole server,
+ * subnet and global buckets are kept in shared memory and shared by all sessions, worker threads and child processes)
+ * @author Dalibor Kříčka (xkrick01)
+ */
+
+
+#ifndef TFTP_SHAPER_HPP
+#define TFTP_SHAPER_HPP
+
+#include <arpa/inet.h>
+#include "tftp-packet-structures.hpp"
+
+#define SHAPER_MAX_SUBNETS 1024                 //subnets with own bucket, other subnets share one bucket
+#define SHAPER_BURST_US 50000                   //bucket holds the data sent at the full rate in this time
+#define SHAPER_MIN_BURST (2 * (MAX_BLKSIZE_VALUE + DATA_PACKET_OFFSET))    //bucket holds at least two Data packets of any size
+#define SHAPER_DEFAULT_SUBNET_PREFIX 24
+
+
+//Token bucket kept as the time, when all data sent through it are paid off by the rate (tokens are the time left
+//before that time exceeds the burst), the time is updated by atomic operations
+typedef struct shaper_bucket {
+    unsigned long long rate = 0;                //Bytes per second (0 if not limited)
+    long long burst_ns = 0;                     //data sent at once ahead of the rate (size of the bucket)
+    long long paid_off_ns = 0;                  //monotonic time, when the sent data are paid off
+} shaper_bucket_t;
+
+
+//Token bucket of the client subnet (slot of the hash table)
+typedef struct shaper_subnet {
+    unsigned long long key;                     //subnet address + 1 (0 if the slot is free)
+    shaper_bucket_t bucket;
+} shaper_subnet_t;
+
+
+//Structure placed in the shared memory
+typedef struct shaper {
+    shaper_bucket_t global;
+    unsigned long long subnet_rate;
+    unsigned int subnet_mask;                   //mask of the client subnet in host byte order
+    shaper_subnet_t subnets[SHAPER_MAX_SUBNETS];
+    shaper_bucket_t subnet_other;               //subnets, that did not fit into the table
+} shaper_t;
+
+
+//Shaping of one session
+typedef struct shaper_session {
+    shaper_bucket_t bucket;                     //own bucket of the session
+    shaper_bucket_t *subnet = NULL;             //bucket of the client subnet (NULL if not limited)
+    shaper_bucket_t *global = NULL;             //bucket of the server (NULL if not limited)
+    long long throttle_started_ns = -1;         //start of the current throttling (-1 if the session is not throttled)
+    long long throttled_ns = 0;                 //time the session waited for the tokens
+    unsigned long throttles = 0;                //number of the waits
+} shaper_session_t;
+
+
+/**
+ * @brief Creates the shared buckets, has to be called before creating child processes or threads.
+ * Without it no session is shaped.
+ *
+ * @param session_rate Bytes per second sent by one session (0 if not limited)
+ * @param subnet_rate Bytes per second sent to one client subnet (0 if not limited)
+ * @param subnet_prefix prefix length of the client subnet
+ * @param global_rate Bytes per second sent by the whole server (0 if not limited)
+ * @return PROG_RET_CODE_OK if OK, else PROG_RET_CODE_ERR
+ */
+int shaper_init(unsigned long long session_rate, unsigned long long subnet_rate, unsigned int subnet_prefix, unsigned long long global_rate);
+
+
+/**
+ * @brief Prepares shaping of the new session sending the Data to the client
+ *
+ * @param session shaping of the session
+ * @param client_address address of the client
+ * @return true if the session is shaped, false if no rate is limited
+ */
+bool shaper_session_start(shaper_session_t *session, const struct sockaddr_in *client_address);
+
+
+/**
+ * @brief Counts the Data packets of the size, that can be sent now by all buckets of the session
+ *
+ * @param session shaping of the session (NULL if not shaped)
+ * @param datagram_size size of one Data packet in Bytes
+ * @return number of the packets (UINT_MAX if the session is not shaped)
+ */
+unsigned int shaper_allowed_datagrams(shaper_session_t *session, unsigned int datagram_size);
+
+
+/**
+ * @brief Counts the time until all buckets of the session have tokens for the Data packet of the size
+ *
+ * @param session shaping of the session (NULL if not shaped)
+ * @param datagram_size size of the Data packet in Bytes
+ * @return time in microseconds (0 if the packet can be sent now)
+ */
+long long shaper_delay_us(shaper_session_t *session, unsigned int datagram_size);
+
+
+/**
+ * @brief Takes the tokens of the sent Data from all buckets of the session (also of the retransmitted Data,
+ * that is not waited for)
+ *
+ * @param session shaping of the session (NULL if not shaped)
+ * @param bytes sent Bytes
+ */
+void shaper_charge(shaper_session_t *session, unsigned long long bytes);
+
+
+/**
+ * @brief Marks the session waiting for the tokens, the waiting lasts until shaper_throttle_end
+ *
+ * @param session shaping of the session
+ */
+void shaper_throttle_begin(shaper_session_t *session);
+
+
+/**
+ * @brief Ends the waiting of the session for the tokens and counts its time (nothing if the session is not waiting)
+ *
+ * @param session shaping of the session (NULL if not shaped)
+ */
+void shaper_throttle_end(shaper_session_t *session);
+
+
+/**
+ * @brief Waits (sleeping, the process is descheduled) until the Data packet of the size can be sent
+ *
+ * @param session shaping of the session (NULL if not shaped)
+ * @param datagram_size size of one Data packet in Bytes
+ * @return number of the packets, that can be sent now (at least 1)
+ */
+unsigned int shaper_wait(shaper_session_t *session, unsigned int datagram_size);
+
+
+/**
+ * @brief Writes the time the session was throttled on standard error stream
+ * (SHAPING throttled_s=x throttles=n)
+ *
+ * @param session shaping of the session
+ */
+void log_shaper_usage(shaper_session_t *session);
+
+#endif